@@ -0,0 +1,421 @@
+/*
+ * trace-replay.c - Replay a recorded FUSE trace against a directory
+ *
+ * Re-issues the operations of a trace recorded with `agentfs mount --trace`
+ * or `agentfs run --trace` as system calls under <root>, as fast as possible,
+ * and reports the replay's throughput and latency along with the per-op
+ * latency the recording saw. <root> should hold the same tree the recorded
+ * session started from - a fresh AgentFS mount of it, or a native copy to
+ * compare against.
+ *
+ * By default the operations run one after another in trace order. With -c
+ * every thread of the recorded session gets a replay thread of its own, which
+ * issues that thread's operations in order, so the replay has the original
+ * concurrency; ordering across threads is not preserved.
+ *
+ * Each FUSE request becomes the system call that most directly produces it:
+ * lookup/getattr become fstatat(), open/create/opendir open a descriptor that
+ * later read/write/readdir/fsync/release requests of the same file handle
+ * use, and so on. Flushes are implied by close(). Requests whose path wasn't
+ * known to the recorder, or that have no syscall equivalent here, are skipped.
+ *
+ * Usage: ./trace-replay [-j] [-c] <trace> <root>
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+
+#include "../syscall/bench.h"
+#include "trace.h"
+
+/* Upper bound on replay threads with -c; further threads share them */
+#define MAX_THREADS 256
+#define FH_BUCKETS  4096
+
+struct op_stats {
+    uint64_t count;
+    uint64_t errors;
+    long long replay_ns;
+    long long recorded_ns;
+};
+
+struct stream {
+    struct trace_op **ops;
+    size_t len, cap;
+    struct bench_hist hist;
+    struct op_stats stats[FUSE_OPCODE_MAX];
+    uint64_t skipped;
+    pthread_t thread;
+};
+
+/* Recorded file handle -> replay descriptor */
+struct fh_entry {
+    uint64_t fh;
+    int fd;
+    struct fh_entry *next;
+};
+
+static struct fh_entry *fh_table[FH_BUCKETS];
+static pthread_mutex_t fh_lock = PTHREAD_MUTEX_INITIALIZER;
+static int root_fd;
+static size_t buffer_size;
+
+static void fh_insert(uint64_t fh, int fd)
+{
+    struct fh_entry *e = malloc(sizeof(*e));
+
+    e->fh = fh;
+    e->fd = fd;
+    pthread_mutex_lock(&fh_lock);
+    e->next = fh_table[fh % FH_BUCKETS];
+    fh_table[fh % FH_BUCKETS] = e;
+    pthread_mutex_unlock(&fh_lock);
+}
+
+static int fh_lookup(uint64_t fh)
+{
+    struct fh_entry *e;
+    int fd = -1;
+
+    pthread_mutex_lock(&fh_lock);
+    for (e = fh_table[fh % FH_BUCKETS]; e; e = e->next) {
+        if (e->fh == fh) {
+            fd = e->fd;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fh_lock);
+    return fd;
+}
+
+/* Remove `fh`, returning its descriptor, or -1 */
+static int fh_remove(uint64_t fh)
+{
+    struct fh_entry **p, *e;
+    int fd = -1;
+
+    pthread_mutex_lock(&fh_lock);
+    for (p = &fh_table[fh % FH_BUCKETS]; (e = *p); p = &e->next) {
+        if (e->fh == fh) {
+            *p = e->next;
+            fd = e->fd;
+            free(e);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&fh_lock);
+    return fd;
+}
+
+/* Path relative to the root descriptor; the root itself is "" */
+static inline const char *at_path(const char *path)
+{
+    return *path ? path : ".";
+}
+
+/*
+ * Replay `op`. Returns 0 on success, -1 if the system call failed, or 1 if
+ * the operation was skipped.
+ */
+static int replay_op(const struct trace_op *op, char *buf)
+{
+    const struct trace_record *r = &op->rec;
+    struct stat st;
+    struct statfs sfs;
+    int fd, ret = 0;
+
+    switch (r->opcode) {
+    case FUSE_LOOKUP:
+    case FUSE_GETATTR:
+        if (!op->path)
+            return 1;
+        return fstatat(root_fd, at_path(op->path), &st, AT_SYMLINK_NOFOLLOW);
+    case FUSE_SETATTR:
+        if (!op->path)
+            return 1;
+        if (r->flags & FATTR_SIZE) {
+            /* The new size is recorded in `offset` */
+            fd = r->fh ? fh_lookup(r->fh) : -1;
+            if (fd >= 0) {
+                ret = ftruncate(fd, (off_t)r->offset);
+            } else {
+                fd = openat(root_fd, op->path, O_WRONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return -1;
+                ret = ftruncate(fd, (off_t)r->offset);
+                close(fd);
+            }
+        }
+        if (ret == 0 && (r->flags & FATTR_MODE))
+            ret = fchmodat(root_fd, at_path(op->path), r->mode & 07777, 0);
+        if (ret == 0 && (r->flags & (FATTR_ATIME | FATTR_MTIME)))
+            ret = utimensat(root_fd, at_path(op->path), NULL, AT_SYMLINK_NOFOLLOW);
+        return ret;
+    case FUSE_READLINK:
+        if (!op->path)
+            return 1;
+        return readlinkat(root_fd, op->path, buf, buffer_size) < 0 ? -1 : 0;
+    case FUSE_SYMLINK:
+        if (!op->path || !op->path2)
+            return 1;
+        return symlinkat(op->path2, root_fd, op->path);
+    case FUSE_MKNOD:
+        if (!op->path)
+            return 1;
+        return mknodat(root_fd, op->path, r->mode, 0);
+    case FUSE_MKDIR:
+        if (!op->path)
+            return 1;
+        return mkdirat(root_fd, op->path, r->mode & 07777);
+    case FUSE_UNLINK:
+        if (!op->path)
+            return 1;
+        return unlinkat(root_fd, op->path, 0);
+    case FUSE_RMDIR:
+        if (!op->path)
+            return 1;
+        return unlinkat(root_fd, op->path, AT_REMOVEDIR);
+    case FUSE_RENAME:
+        if (!op->path || !op->path2)
+            return 1;
+        return renameat(root_fd, op->path, root_fd, op->path2);
+    case FUSE_LINK:
+        if (!op->path || !op->path2)
+            return 1;
+        return linkat(root_fd, op->path, root_fd, op->path2, 0);
+    case FUSE_OPEN:
+    case FUSE_OPENDIR:
+    case FUSE_CREATE:
+        if (!op->path)
+            return 1;
+        if (r->opcode == FUSE_CREATE)
+            fd = openat(root_fd, op->path,
+                        (r->flags & (O_ACCMODE | O_APPEND | O_EXCL | O_TRUNC)) | O_CREAT |
+                            O_CLOEXEC,
+                        r->mode & 07777);
+        else if (r->opcode == FUSE_OPENDIR)
+            fd = openat(root_fd, at_path(op->path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        else
+            fd = openat(root_fd, at_path(op->path),
+                        (r->flags & (O_ACCMODE | O_APPEND)) | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        fh_insert(r->fh, fd);
+        return 0;
+    case FUSE_READ:
+    case FUSE_WRITE:
+    case FUSE_READDIR:
+    case FUSE_FSYNC:
+    case FUSE_FSYNCDIR:
+        fd = fh_lookup(r->fh);
+        if (fd < 0)
+            return 1;
+        if (r->opcode == FUSE_READ)
+            return pread(fd, buf, r->size, (off_t)r->offset) < 0 ? -1 : 0;
+        if (r->opcode == FUSE_WRITE)
+            return pwrite(fd, buf, r->size, (off_t)r->offset) < 0 ? -1 : 0;
+        if (r->opcode == FUSE_READDIR) {
+            /* Directory offsets are opaque; only a rewind carries over */
+            if (r->offset == 0 && lseek(fd, 0, SEEK_SET) < 0)
+                return -1;
+            return syscall(SYS_getdents64, fd, buf, r->size) < 0 ? -1 : 0;
+        }
+        return r->flags & 1 ? fdatasync(fd) : fsync(fd);
+    case FUSE_RELEASE:
+    case FUSE_RELEASEDIR:
+        fd = fh_remove(r->fh);
+        if (fd < 0)
+            return 1;
+        return close(fd);
+    case FUSE_STATFS:
+        return fstatfs(root_fd, &sfs);
+    case FUSE_ACCESS:
+        if (!op->path)
+            return 1;
+        return faccessat(root_fd, at_path(op->path), r->flags, 0);
+    default:
+        return 1;
+    }
+}
+
+static void *stream_main(void *arg)
+{
+    struct stream *s = arg;
+    char *buf = calloc(1, buffer_size);
+    long long t, ns;
+    size_t i;
+    int ret;
+
+    for (i = 0; i < s->len; i++) {
+        const struct trace_op *op = s->ops[i];
+        struct op_stats *stats = &s->stats[op->rec.opcode % FUSE_OPCODE_MAX];
+
+        t = get_time_ns();
+        ret = replay_op(op, buf);
+        ns = get_time_ns() - t;
+        if (ret > 0) {
+            s->skipped++;
+            continue;
+        }
+        hist_record(&s->hist, ns);
+        stats->count++;
+        stats->replay_ns += ns;
+        stats->recorded_ns += (long long)op->rec.latency_ns;
+        if (ret < 0)
+            stats->errors++;
+    }
+    free(buf);
+    return NULL;
+}
+
+static void stream_push(struct stream *s, struct trace_op *op)
+{
+    if (s->len == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->ops = realloc(s->ops, s->cap * sizeof(*s->ops));
+    }
+    s->ops[s->len++] = op;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-j] [-c] <trace> <root>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts = { .json = 0 };
+    struct stream *streams;
+    struct bench_hist merged;
+    struct op_stats total[FUSE_OPCODE_MAX];
+    struct trace_op *ops;
+    uint32_t *pids;
+    const char *trace_file, *root;
+    size_t nops, i;
+    uint64_t skipped = 0, errors = 0;
+    int concurrent = 0, nstreams = 1, npids = 0, opt, fd, j, k;
+    long long start, elapsed;
+    struct stat st;
+    void *data;
+
+    while ((opt = getopt(argc, argv, "jc")) != -1) {
+        switch (opt) {
+        case 'j':
+            opts.json = 1;
+            break;
+        case 'c':
+            concurrent = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+    trace_file = argv[optind];
+    root = argv[optind + 1];
+
+    fd = open(trace_file, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(trace_file);
+        return 1;
+    }
+    data = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    ops = trace_parse(data, st.st_size, &nops);
+    if (!ops) {
+        fprintf(stderr, "%s: not an AgentFS trace\n", trace_file);
+        return 1;
+    }
+    munmap(data, st.st_size);
+    close(fd);
+
+    root_fd = open(root, O_RDONLY | O_DIRECTORY);
+    if (root_fd < 0) {
+        perror(root);
+        return 1;
+    }
+
+    /* Room for the largest read, write, listing or link target */
+    buffer_size = 64 * 1024;
+    for (i = 0; i < nops; i++) {
+        if (ops[i].rec.size > buffer_size)
+            buffer_size = ops[i].rec.size;
+    }
+
+    /* Split the trace into one stream per recorded thread */
+    pids = calloc(MAX_THREADS, sizeof(*pids));
+    streams = calloc(MAX_THREADS, sizeof(*streams));
+    for (i = 0; i < nops; i++) {
+        k = 0;
+        if (concurrent) {
+            for (j = 0; j < npids && pids[j] != ops[i].rec.pid; j++)
+                ;
+            if (j == npids && npids < MAX_THREADS)
+                pids[npids++] = ops[i].rec.pid;
+            k = j < npids ? j : (int)(ops[i].rec.pid % MAX_THREADS);
+        }
+        stream_push(&streams[k], &ops[i]);
+    }
+    if (concurrent)
+        nstreams = npids ? npids : 1;
+
+    start = get_time_ns();
+    if (nstreams == 1) {
+        stream_main(&streams[0]);
+    } else {
+        for (j = 0; j < nstreams; j++) {
+            if (pthread_create(&streams[j].thread, NULL, stream_main, &streams[j]) != 0) {
+                fprintf(stderr, "pthread_create failed\n");
+                return 1;
+            }
+        }
+        for (j = 0; j < nstreams; j++)
+            pthread_join(streams[j].thread, NULL);
+    }
+    elapsed = get_time_ns() - start;
+
+    memset(&merged, 0, sizeof(merged));
+    memset(total, 0, sizeof(total));
+    for (j = 0; j < nstreams; j++) {
+        hist_merge(&merged, &streams[j].hist);
+        skipped += streams[j].skipped;
+        for (k = 0; k < FUSE_OPCODE_MAX; k++) {
+            total[k].count += streams[j].stats[k].count;
+            total[k].errors += streams[j].stats[k].errors;
+            total[k].replay_ns += streams[j].stats[k].replay_ns;
+            total[k].recorded_ns += streams[j].stats[k].recorded_ns;
+        }
+    }
+    for (k = 0; k < FUSE_OPCODE_MAX; k++)
+        errors += total[k].errors;
+
+    bench_report(&opts, "trace replay", root, &merged, elapsed);
+    if (opts.json)
+        return 0;
+
+    printf("Threads:     %d\n", nstreams);
+    printf("Skipped:     %llu of %zu operations\n", (unsigned long long)skipped, nops);
+    printf("Failed:      %llu\n", (unsigned long long)errors);
+    printf("\n%-12s %10s %8s %14s %14s\n", "Operation", "Count", "Failed", "Replay avg ns",
+           "Recorded avg ns");
+    for (k = 0; k < FUSE_OPCODE_MAX; k++) {
+        if (!total[k].count)
+            continue;
+        printf("%-12s %10llu %8llu %14.1f %14.1f\n", trace_opcode_name(k),
+               (unsigned long long)total[k].count, (unsigned long long)total[k].errors,
+               (double)total[k].replay_ns / total[k].count,
+               (double)total[k].recorded_ns / total[k].count);
+    }
+    return 0;
+}
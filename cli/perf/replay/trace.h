@@ -0,0 +1,175 @@
+/*
+ * trace.h - Reader for FUSE operation traces
+ *
+ * `agentfs mount --trace FILE` and `agentfs run --trace FILE` record every
+ * FUSE request of the session: a header followed by fixed-size records, each
+ * followed by up to two paths relative to the mount root. The layout matches
+ * cli/src/fuser/trace.rs; integers are little-endian, which is also the byte
+ * order of every host this is expected to run on.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC        "AFSTRACE"
+#define TRACE_VERSION      1
+#define TRACE_PATH_UNKNOWN 0xffff
+
+/* FUSE opcodes, as in <linux/fuse.h> */
+enum {
+    FUSE_LOOKUP = 1,
+    FUSE_GETATTR = 3,
+    FUSE_SETATTR = 4,
+    FUSE_READLINK = 5,
+    FUSE_SYMLINK = 6,
+    FUSE_MKNOD = 8,
+    FUSE_MKDIR = 9,
+    FUSE_UNLINK = 10,
+    FUSE_RMDIR = 11,
+    FUSE_RENAME = 12,
+    FUSE_LINK = 13,
+    FUSE_OPEN = 14,
+    FUSE_READ = 15,
+    FUSE_WRITE = 16,
+    FUSE_STATFS = 17,
+    FUSE_RELEASE = 18,
+    FUSE_FSYNC = 20,
+    FUSE_FLUSH = 25,
+    FUSE_OPENDIR = 27,
+    FUSE_READDIR = 28,
+    FUSE_RELEASEDIR = 29,
+    FUSE_FSYNCDIR = 30,
+    FUSE_ACCESS = 34,
+    FUSE_CREATE = 35,
+    FUSE_OPCODE_MAX = 64,
+};
+
+/* Bits of the setattr `flags` */
+#define FATTR_MODE  (1 << 0)
+#define FATTR_SIZE  (1 << 3)
+#define FATTR_ATIME (1 << 4)
+#define FATTR_MTIME (1 << 5)
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct trace_record {
+    uint64_t time_ns;
+    uint64_t latency_ns;
+    uint64_t ino;
+    uint64_t fh;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t mode;
+    uint32_t pid;
+    uint32_t uid;
+    int32_t error;
+    uint16_t opcode;
+    uint16_t path_len;
+    uint16_t path2_len;
+    uint16_t reserved;
+};
+
+/* A record with its paths, NULL where the path is absent or unknown */
+struct trace_op {
+    struct trace_record rec;
+    char *path;
+    char *path2;
+};
+
+static const char *trace_opcode_name(unsigned opcode)
+{
+    static const char *names[FUSE_OPCODE_MAX] = {
+        [FUSE_LOOKUP] = "lookup",       [FUSE_GETATTR] = "getattr",
+        [FUSE_SETATTR] = "setattr",     [FUSE_READLINK] = "readlink",
+        [FUSE_SYMLINK] = "symlink",     [FUSE_MKNOD] = "mknod",
+        [FUSE_MKDIR] = "mkdir",         [FUSE_UNLINK] = "unlink",
+        [FUSE_RMDIR] = "rmdir",         [FUSE_RENAME] = "rename",
+        [FUSE_LINK] = "link",           [FUSE_OPEN] = "open",
+        [FUSE_READ] = "read",           [FUSE_WRITE] = "write",
+        [FUSE_STATFS] = "statfs",       [FUSE_RELEASE] = "release",
+        [FUSE_FSYNC] = "fsync",         [21] = "setxattr",
+        [22] = "getxattr",              [23] = "listxattr",
+        [24] = "removexattr",           [FUSE_FLUSH] = "flush",
+        [FUSE_OPENDIR] = "opendir",     [FUSE_READDIR] = "readdir",
+        [FUSE_RELEASEDIR] = "releasedir", [FUSE_FSYNCDIR] = "fsyncdir",
+        [31] = "getlk",                 [32] = "setlk",
+        [33] = "setlkw",                [FUSE_ACCESS] = "access",
+        [FUSE_CREATE] = "create",       [37] = "bmap",
+        [39] = "ioctl",                 [40] = "poll",
+        [43] = "fallocate",             [44] = "readdirplus",
+        [45] = "rename2",               [46] = "lseek",
+        [47] = "copy_file_range",
+    };
+
+    if (opcode < FUSE_OPCODE_MAX && names[opcode])
+        return names[opcode];
+    return "unknown";
+}
+
+static inline size_t trace_path_size(uint16_t len)
+{
+    return len == TRACE_PATH_UNKNOWN ? 0 : len;
+}
+
+static char *trace_path(const char **p, uint16_t len)
+{
+    char *path;
+
+    if (len == TRACE_PATH_UNKNOWN)
+        return NULL;
+    path = malloc(len + 1);
+    memcpy(path, *p, len);
+    path[len] = '\0';
+    *p += len;
+    return path;
+}
+
+/*
+ * Parse the trace in `data`, returning its operations and their number in
+ * `count`, or NULL if it isn't a trace. A truncated last record is dropped.
+ */
+static struct trace_op *trace_parse(const char *data, size_t len, size_t *count)
+{
+    const char *p = data, *end = data + len;
+    struct trace_header hdr;
+    struct trace_op *ops = NULL;
+    size_t n = 0, cap = 0;
+
+    if (len < sizeof(hdr))
+        return NULL;
+    memcpy(&hdr, p, sizeof(hdr));
+    if (memcmp(hdr.magic, TRACE_MAGIC, 8) != 0 || hdr.version != TRACE_VERSION ||
+        hdr.record_size < sizeof(struct trace_record))
+        return NULL;
+    p += sizeof(hdr);
+
+    while (p + hdr.record_size <= end) {
+        struct trace_op op;
+
+        memcpy(&op.rec, p, sizeof(op.rec));
+        if (p + hdr.record_size + trace_path_size(op.rec.path_len) +
+                trace_path_size(op.rec.path2_len) > end)
+            break;
+        p += hdr.record_size;
+        op.path = trace_path(&p, op.rec.path_len);
+        op.path2 = trace_path(&p, op.rec.path2_len);
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4096;
+            ops = realloc(ops, cap * sizeof(*ops));
+        }
+        ops[n++] = op;
+    }
+    *count = n;
+    return ops ? ops : calloc(1, sizeof(*ops));
+}
+
+#endif /* TRACE_H */
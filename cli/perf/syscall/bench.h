@@ -0,0 +1,225 @@
+/*
+ * bench.h - Shared timing, latency histogram and reporting for the
+ *           syscall micro-benchmarks
+ *
+ * Every benchmark times each iteration on its own and records it in a
+ * log-linear histogram (32 buckets per power of two, so percentiles are
+ * within ~3% of the true value), then reports the average together with
+ * p50/p90/p99/max. Averages alone hide the occasional stall - a SQLite
+ * checkpoint, a copy-up - that dominates what an agent actually waits for.
+ *
+ * Results are printed as text, or as a single JSON object with -j.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 100000
+#define WARMUP_ITERATIONS  1000
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  (64 * HIST_SUB)
+
+struct bench_hist {
+    uint64_t count;
+    long long total_ns;
+    long long max_ns;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+/* Command line options shared by all benchmarks */
+struct bench_opts {
+    int json;
+    int iterations;
+};
+
+static inline long long timespec_to_ns(struct timespec *ts)
+{
+    return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static inline long long get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+static inline int hist_index(long long ns)
+{
+    uint64_t v = ns < 0 ? 0 : (uint64_t)ns;
+    int shift;
+
+    if (v < 2 * HIST_SUB)
+        return (int)v;
+    shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return shift * HIST_SUB + (int)(v >> shift);
+}
+
+/* Largest value that falls into bucket `index` */
+static inline long long hist_bucket_max(int index)
+{
+    int shift;
+    uint64_t mantissa;
+
+    if (index < 2 * HIST_SUB)
+        return index;
+    shift = index / HIST_SUB - 1;
+    mantissa = (uint64_t)(index % HIST_SUB + HIST_SUB);
+    return (long long)(((mantissa + 1) << shift) - 1);
+}
+
+static inline void hist_record(struct bench_hist *h, long long ns)
+{
+    h->buckets[hist_index(ns)]++;
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+}
+
+/* Add the iterations recorded in `src` to `dst` */
+static inline void hist_merge(struct bench_hist *dst, const struct bench_hist *src)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    dst->total_ns += src->total_ns;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+}
+
+/* Latency below which `pct` percent of the iterations completed */
+static long long hist_percentile(const struct bench_hist *h, double pct)
+{
+    uint64_t rank, seen = 0;
+    long long value;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    rank = (uint64_t)(pct / 100.0 * h->count + 0.999999);
+    if (rank == 0)
+        rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            value = hist_bucket_max(i);
+            return value < h->max_ns ? value : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/*
+ * Parse "[-j] <positional>... [iterations]".
+ *
+ * Leaves the positional arguments in argv[0..npos), and picks up an
+ * optional iteration count after them. Exits with `usage` on bad input.
+ */
+static inline void bench_parse(int *argc, char ***argv, int npos, const char *usage,
+                               struct bench_opts *opts)
+{
+    const char *prog = (*argv)[0];
+    int ac = *argc - 1;
+    char **av = *argv + 1;
+
+    opts->json = 0;
+    opts->iterations = DEFAULT_ITERATIONS;
+
+    if (ac > 0 && strcmp(av[0], "-j") == 0) {
+        opts->json = 1;
+        ac--;
+        av++;
+    }
+    if (ac < npos || ac > npos + 1) {
+        fprintf(stderr, "Usage: %s [-j] %s [iterations]\n", prog, usage);
+        exit(1);
+    }
+    if (ac == npos + 1)
+        opts->iterations = atoi(av[npos]);
+    if (opts->iterations <= 0) {
+        fprintf(stderr, "Invalid iteration count\n");
+        exit(1);
+    }
+
+    *argc = npos;
+    *argv = av;
+}
+
+static inline int bench_warmup_iterations(const struct bench_opts *opts)
+{
+    return opts->iterations < WARMUP_ITERATIONS ? opts->iterations : WARMUP_ITERATIONS;
+}
+
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+/*
+ * Print the results of benchmark `name` run against `target`.
+ *
+ * `elapsed_ns` is the wall time of the timed loop, which throughput is
+ * computed from.
+ */
+static inline void bench_report(const struct bench_opts *opts, const char *name,
+                                const char *target, const struct bench_hist *h,
+                                long long elapsed_ns)
+{
+    double avg_ns = h->count ? (double)h->total_ns / h->count : 0.0;
+    double ops_per_sec = elapsed_ns > 0 ? h->count * 1000000000.0 / elapsed_ns : 0.0;
+    size_t i, len;
+
+    if (opts->json) {
+        printf("{\"benchmark\":");
+        json_string(name);
+        printf(",\"target\":");
+        json_string(target);
+        printf(",\"iterations\":%llu,\"total_ns\":%lld,\"avg_ns\":%.1f,"
+               "\"p50_ns\":%lld,\"p90_ns\":%lld,\"p99_ns\":%lld,\"max_ns\":%lld,"
+               "\"ops_per_sec\":%.0f}\n",
+               (unsigned long long)h->count, elapsed_ns, avg_ns,
+               hist_percentile(h, 50), hist_percentile(h, 90),
+               hist_percentile(h, 99), h->max_ns, ops_per_sec);
+        return;
+    }
+
+    len = printf("%s micro-benchmark\n", name) - 1;
+    for (i = 0; i < len; i++)
+        putchar('-');
+    putchar('\n');
+    printf("Target:      %s\n", target);
+    printf("Iterations:  %llu\n", (unsigned long long)h->count);
+    printf("Total time:  %.3f ms\n", elapsed_ns / 1000000.0);
+    printf("Avg latency: %.1f ns\n", avg_ns);
+    printf("p50 latency: %lld ns\n", hist_percentile(h, 50));
+    printf("p90 latency: %lld ns\n", hist_percentile(h, 90));
+    printf("p99 latency: %lld ns\n", hist_percentile(h, 99));
+    printf("Max latency: %lld ns\n", h->max_ns);
+    printf("Throughput:  %.0f ops/sec\n", ops_per_sec);
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,66 @@
+/*
+ * perf-create-unlink.c - Micro-benchmark for openat(O_CREAT), close() and
+ *                        unlink() of a new file
+ *
+ * Usage: ./perf-create-unlink [-j] <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+
+#include "bench.h"
+
+static void create_unlink(int dirfd, const char *name)
+{
+    int fd;
+
+    fd = openat(dirfd, name, O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror("openat");
+        exit(1);
+    }
+    close(fd);
+    if (unlinkat(dirfd, name, 0) < 0) {
+        perror("unlinkat");
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    const char *dir;
+    char name[NAME_MAX];
+    long long start, end, t;
+    int i, dirfd;
+
+    bench_parse(&argc, &argv, 1, "<dir>", &opts);
+    dir = argv[0];
+
+    dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) {
+        perror("open");
+        return 1;
+    }
+    snprintf(name, sizeof(name), "perf-create-unlink.%d", getpid());
+
+    /* Warmup */
+    for (i = 0; i < bench_warmup_iterations(&opts); i++) {
+        create_unlink(dirfd, name);
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        t = get_time_ns();
+        create_unlink(dirfd, name);
+        hist_record(&hist, get_time_ns() - t);
+    }
+    end = get_time_ns();
+
+    close(dirfd);
+    bench_report(&opts, "openat(O_CREAT)+unlink()", dir, &hist, end - start);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * perf-getdents.c - Micro-benchmark for listing a directory with getdents64()
+ *
+ * Every iteration opens the directory, reads it to the end and closes it,
+ * so the latency is that of listing the whole directory.
+ *
+ * Usage: ./perf-getdents [-j] <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+
+#define GETDENTS_BUFFER (64 * 1024)
+
+/* List `dir`, returning the number of entries */
+static long list_dir(const char *dir, char *buf)
+{
+    long entries = 0;
+    long n, pos;
+    int fd;
+
+    fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        perror("open");
+        exit(1);
+    }
+    while ((n = syscall(SYS_getdents64, fd, buf, GETDENTS_BUFFER)) > 0) {
+        for (pos = 0; pos < n; entries++) {
+            /* d_reclen follows the 8-byte d_ino and d_off */
+            pos += *(unsigned short *)(buf + pos + 16);
+        }
+    }
+    if (n < 0) {
+        perror("getdents64");
+        exit(1);
+    }
+    close(fd);
+    return entries;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    const char *dir;
+    char *buf;
+    char target[4096];
+    long long start, end, t;
+    long entries;
+    int i;
+
+    bench_parse(&argc, &argv, 1, "<dir>", &opts);
+    dir = argv[0];
+
+    buf = malloc(GETDENTS_BUFFER);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+
+    entries = list_dir(dir, buf);
+
+    /* Warmup */
+    for (i = 0; i < bench_warmup_iterations(&opts) / 10; i++) {
+        list_dir(dir, buf);
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        t = get_time_ns();
+        list_dir(dir, buf);
+        hist_record(&hist, get_time_ns() - t);
+    }
+    end = get_time_ns();
+
+    snprintf(target, sizeof(target), "%s (%ld entries)", dir, entries);
+    free(buf);
+    bench_report(&opts, "getdents64()", target, &hist, end - start);
+    return 0;
+}
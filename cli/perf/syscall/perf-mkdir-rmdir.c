@@ -0,0 +1,62 @@
+/*
+ * perf-mkdir-rmdir.c - Micro-benchmark for mkdir() and rmdir()
+ *
+ * Usage: ./perf-mkdir-rmdir [-j] <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+static void mkdir_rmdir(int dirfd, const char *name)
+{
+    if (mkdirat(dirfd, name, 0755) < 0) {
+        perror("mkdirat");
+        exit(1);
+    }
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) < 0) {
+        perror("unlinkat");
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    const char *dir;
+    char name[NAME_MAX];
+    long long start, end, t;
+    int i, dirfd;
+
+    bench_parse(&argc, &argv, 1, "<dir>", &opts);
+    dir = argv[0];
+
+    dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) {
+        perror("open");
+        return 1;
+    }
+    snprintf(name, sizeof(name), "perf-mkdir-rmdir.%d", getpid());
+
+    /* Warmup */
+    for (i = 0; i < bench_warmup_iterations(&opts); i++) {
+        mkdir_rmdir(dirfd, name);
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        t = get_time_ns();
+        mkdir_rmdir(dirfd, name);
+        hist_record(&hist, get_time_ns() - t);
+    }
+    end = get_time_ns();
+
+    close(dirfd);
+    bench_report(&opts, "mkdir()+rmdir()", dir, &hist, end - start);
+    return 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * perf-parallel.c - Scaling benchmark for concurrent filesystem operations
+ *
+ * Runs the operation with 1, 2, 4, ... up to <max-workers> workers at once,
+ * each doing [iterations] operations, as threads of one process or as
+ * separate processes. Workers either share one directory or each get their
+ * own. For every worker count it reports the aggregate throughput and the
+ * latency distribution of the individual operations across all workers.
+ *
+ * Operations:
+ *   stat    statx() of a file
+ *   open    open()+close() of a file
+ *   read    4 KiB pread() walking a 1 MiB file
+ *   create  openat(O_CREAT)+close()+unlink() of a new file
+ *
+ * Files the operations need are created under <dir> unless they already
+ * exist, so a run against a base directory prepared natively measures the
+ * base layer.
+ *
+ * Usage: ./perf-parallel [-j] <stat|open|read|create> <shared|private>
+ *                        <threads|processes> <max-workers> <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/stat.h>
+
+#include "bench.h"
+
+#define READ_SIZE 4096
+#define FILE_SIZE (1024 * 1024)
+#define FILE_NAME "file"
+
+enum op { OP_STAT, OP_OPEN, OP_READ, OP_CREATE };
+
+struct worker {
+    int id;
+    /* Directory the worker operates in, holding FILE_NAME */
+    int dirfd;
+    struct bench_hist *hist;
+};
+
+static enum op op;
+static int iterations;
+static int warmup_iterations;
+/* Read end of the pipe workers wait on until all of them are ready */
+static int start_fd;
+
+/* Create `name` with `size` bytes unless a file of that size exists */
+static void ensure_file(int dirfd, const char *name, off_t size)
+{
+    struct stat st;
+    int fd;
+
+    if (fstatat(dirfd, name, &st, 0) == 0 && st.st_size == size)
+        return;
+    fd = openat(dirfd, name, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        perror(name);
+        exit(1);
+    }
+    close(fd);
+}
+
+/* Open directory `name`, creating it if needed */
+static int ensure_dir(int dirfd, const char *name)
+{
+    int fd;
+
+    if (mkdirat(dirfd, name, 0755) < 0 && errno != EEXIST) {
+        perror(name);
+        exit(1);
+    }
+    fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        perror(name);
+        exit(1);
+    }
+    return fd;
+}
+
+static void run_op(struct worker *w, int fd, int i)
+{
+    struct statx stx;
+    char buf[READ_SIZE];
+    char name[NAME_MAX];
+    int tmp;
+
+    switch (op) {
+    case OP_STAT:
+        if (syscall(SYS_statx, w->dirfd, FILE_NAME, 0, STATX_BASIC_STATS, &stx) < 0) {
+            perror("statx");
+            exit(1);
+        }
+        break;
+    case OP_OPEN:
+        tmp = openat(w->dirfd, FILE_NAME, O_RDONLY);
+        if (tmp < 0) {
+            perror("open");
+            exit(1);
+        }
+        close(tmp);
+        break;
+    case OP_READ:
+        if (pread(fd, buf, READ_SIZE, (off_t)(i % (FILE_SIZE / READ_SIZE)) * READ_SIZE)
+            != READ_SIZE) {
+            perror("pread");
+            exit(1);
+        }
+        break;
+    case OP_CREATE:
+        snprintf(name, sizeof(name), "create.%d.%d", getpid(), w->id);
+        tmp = openat(w->dirfd, name, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (tmp < 0) {
+            perror("open");
+            exit(1);
+        }
+        close(tmp);
+        if (unlinkat(w->dirfd, name, 0) < 0) {
+            perror("unlink");
+            exit(1);
+        }
+        break;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    long long t;
+    char c;
+    int i, fd = -1;
+
+    if (op == OP_READ) {
+        fd = openat(w->dirfd, FILE_NAME, O_RDONLY);
+        if (fd < 0) {
+            perror("open");
+            exit(1);
+        }
+    }
+    for (i = 0; i < warmup_iterations; i++)
+        run_op(w, fd, i);
+
+    /* Wait until every worker is ready; the pipe is closed to start */
+    while (read(start_fd, &c, 1) > 0)
+        ;
+
+    for (i = 0; i < iterations; i++) {
+        t = get_time_ns();
+        run_op(w, fd, i);
+        hist_record(w->hist, get_time_ns() - t);
+    }
+    if (fd >= 0)
+        close(fd);
+    return NULL;
+}
+
+/* Run `n` workers at once, returning the wall time of the timed part */
+static long long run_workers(struct worker *workers, int n, int processes)
+{
+    pthread_t *threads = NULL;
+    pid_t *pids = NULL;
+    int pipefd[2];
+    long long start;
+    int i, status, failed = 0;
+
+    if (pipe(pipefd) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    start_fd = pipefd[0];
+
+    if (processes) {
+        pids = calloc(n, sizeof(*pids));
+        for (i = 0; i < n; i++) {
+            pids[i] = fork();
+            if (pids[i] < 0) {
+                perror("fork");
+                exit(1);
+            }
+            if (pids[i] == 0) {
+                close(pipefd[1]);
+                worker_main(&workers[i]);
+                _exit(0);
+            }
+        }
+    } else {
+        threads = calloc(n, sizeof(*threads));
+        for (i = 0; i < n; i++) {
+            if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+                fprintf(stderr, "pthread_create failed\n");
+                exit(1);
+            }
+        }
+    }
+
+    /*
+     * Workers finish their warmup before blocking on the pipe, so the first
+     * of them may start while others are still warming up; with short warmups
+     * this overlap is negligible next to the timed loop.
+     */
+    start = get_time_ns();
+    close(pipefd[1]);
+
+    for (i = 0; i < n; i++) {
+        if (processes) {
+            if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+                WEXITSTATUS(status) != 0)
+                failed = 1;
+        } else {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    start = get_time_ns() - start;
+
+    close(pipefd[0]);
+    free(pids);
+    free(threads);
+    if (failed) {
+        fprintf(stderr, "A worker failed\n");
+        exit(1);
+    }
+    return start;
+}
+
+static void report(const struct bench_opts *opts, const char *op_name, const char *layout,
+                   const char *mode, int n, const struct bench_hist *merged,
+                   long long elapsed_ns)
+{
+    double avg_ns = merged->count ? (double)merged->total_ns / merged->count : 0.0;
+    double ops_per_sec = elapsed_ns > 0 ? merged->count * 1000000000.0 / elapsed_ns : 0.0;
+
+    if (opts->json) {
+        printf("{\"benchmark\":\"parallel\",\"op\":");
+        json_string(op_name);
+        printf(",\"layout\":");
+        json_string(layout);
+        printf(",\"mode\":");
+        json_string(mode);
+        printf(",\"workers\":%d,\"iterations\":%llu,\"total_ns\":%lld,"
+               "\"ops_per_sec\":%.0f,\"ops_per_sec_per_worker\":%.0f,\"avg_ns\":%.1f,"
+               "\"p50_ns\":%lld,\"p90_ns\":%lld,\"p99_ns\":%lld,\"max_ns\":%lld}\n",
+               n, (unsigned long long)merged->count, elapsed_ns, ops_per_sec,
+               ops_per_sec / n, avg_ns, hist_percentile(merged, 50),
+               hist_percentile(merged, 90), hist_percentile(merged, 99),
+               merged->max_ns);
+        return;
+    }
+
+    printf("%7d %12.0f %12.0f %9.1f %9lld %9lld %9lld %10lld\n", n, ops_per_sec,
+           ops_per_sec / n, avg_ns, hist_percentile(merged, 50),
+           hist_percentile(merged, 90), hist_percentile(merged, 99), merged->max_ns);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist *hists, merged;
+    struct worker *workers;
+    const char *op_name, *layout, *mode, *dir;
+    char name[NAME_MAX];
+    int shared, processes, max_workers, n, i, basefd, shared_fd = -1;
+    long long elapsed;
+
+    bench_parse(&argc, &argv, 5,
+                "<stat|open|read|create> <shared|private> <threads|processes> <max-workers> <dir>",
+                &opts);
+    op_name = argv[0];
+    layout = argv[1];
+    mode = argv[2];
+    max_workers = atoi(argv[3]);
+    dir = argv[4];
+
+    if (strcmp(op_name, "stat") == 0)
+        op = OP_STAT;
+    else if (strcmp(op_name, "open") == 0)
+        op = OP_OPEN;
+    else if (strcmp(op_name, "read") == 0)
+        op = OP_READ;
+    else if (strcmp(op_name, "create") == 0)
+        op = OP_CREATE;
+    else {
+        fprintf(stderr, "Unknown operation: %s\n", op_name);
+        return 1;
+    }
+    if (strcmp(layout, "shared") != 0 && strcmp(layout, "private") != 0) {
+        fprintf(stderr, "Unknown layout: %s\n", layout);
+        return 1;
+    }
+    if (strcmp(mode, "threads") != 0 && strcmp(mode, "processes") != 0) {
+        fprintf(stderr, "Unknown mode: %s\n", mode);
+        return 1;
+    }
+    if (max_workers <= 0) {
+        fprintf(stderr, "Invalid worker count\n");
+        return 1;
+    }
+    shared = strcmp(layout, "shared") == 0;
+    processes = strcmp(mode, "processes") == 0;
+    iterations = opts.iterations;
+    warmup_iterations = bench_warmup_iterations(&opts) / 10;
+
+    /* Histograms live in shared memory so worker processes can fill them */
+    hists = mmap(NULL, sizeof(*hists) * max_workers, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (hists == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    workers = calloc(max_workers, sizeof(*workers));
+
+    basefd = ensure_dir(AT_FDCWD, dir);
+    basefd = ensure_dir(basefd, "parallel");
+    if (shared) {
+        shared_fd = ensure_dir(basefd, "shared");
+        if (op != OP_CREATE)
+            ensure_file(shared_fd, FILE_NAME, FILE_SIZE);
+    }
+    for (i = 0; i < max_workers; i++) {
+        workers[i].id = i;
+        workers[i].hist = &hists[i];
+        if (shared) {
+            workers[i].dirfd = shared_fd;
+            continue;
+        }
+        snprintf(name, sizeof(name), "worker-%d", i);
+        workers[i].dirfd = ensure_dir(basefd, name);
+        if (op != OP_CREATE)
+            ensure_file(workers[i].dirfd, FILE_NAME, FILE_SIZE);
+    }
+
+    if (!opts.json) {
+        printf("parallel %s (%s directories, %s) scaling benchmark\n", op_name, layout, mode);
+        printf("Target:      %s/parallel\n", dir);
+        printf("Iterations:  %d per worker\n", iterations);
+        printf("%7s %12s %12s %9s %9s %9s %9s %10s\n", "Workers", "ops/sec", "per worker",
+               "avg ns", "p50 ns", "p90 ns", "p99 ns", "max ns");
+    }
+
+    for (n = 1;; n = n * 2 < max_workers ? n * 2 : max_workers) {
+        memset(hists, 0, sizeof(*hists) * n);
+        elapsed = run_workers(workers, n, processes);
+
+        memset(&merged, 0, sizeof(merged));
+        for (i = 0; i < n; i++)
+            hist_merge(&merged, &hists[i]);
+        report(&opts, op_name, layout, mode, n, &merged, elapsed);
+        fflush(stdout);
+
+        if (n == max_workers)
+            break;
+    }
+
+    munmap(hists, sizeof(*hists) * max_workers);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * perf-rename.c - Micro-benchmark for rename() within a directory
+ *
+ * Moves one file back and forth between two names; every iteration is a
+ * single rename().
+ *
+ * Usage: ./perf-rename [-j] <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    const char *dir;
+    char names[2][NAME_MAX];
+    long long start, end, t;
+    int i, fd, dirfd, ret;
+
+    bench_parse(&argc, &argv, 1, "<dir>", &opts);
+    dir = argv[0];
+
+    dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) {
+        perror("open");
+        return 1;
+    }
+    snprintf(names[0], sizeof(names[0]), "perf-rename.%d.a", getpid());
+    snprintf(names[1], sizeof(names[1]), "perf-rename.%d.b", getpid());
+
+    fd = openat(dirfd, names[0], O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("openat");
+        return 1;
+    }
+    close(fd);
+
+    /* Warmup (an even count, so the file is back at names[0]) */
+    for (i = 0; i < bench_warmup_iterations(&opts) / 2 * 2; i++) {
+        renameat(dirfd, names[i % 2], dirfd, names[(i + 1) % 2]);
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        t = get_time_ns();
+        ret = renameat(dirfd, names[i % 2], dirfd, names[(i + 1) % 2]);
+        hist_record(&hist, get_time_ns() - t);
+        if (ret < 0) {
+            perror("renameat");
+            return 1;
+        }
+    }
+    end = get_time_ns();
+
+    unlinkat(dirfd, names[opts.iterations % 2], 0);
+    close(dirfd);
+    bench_report(&opts, "rename()", dir, &hist, end - start);
+    return 0;
+}
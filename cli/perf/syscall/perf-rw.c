@@ -0,0 +1,117 @@
+/*
+ * perf-rw.c - Micro-benchmark for pread() and pwrite() at a given block size
+ *
+ * Sequential runs walk the file block by block and wrap around at its end;
+ * random runs pick block-aligned offsets uniformly across the file. Writes
+ * rewrite existing blocks, so the file must already be at least one block
+ * long; its size stays the same.
+ *
+ * Usage: ./perf-rw [-j] <read|write> <seq|rand> <block-size> <file> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+/* xorshift64, so the random offsets are the same on every run */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    struct stat st;
+    const char *path;
+    char name[64];
+    char *buf;
+    int write_mode, random_mode;
+    long block_size;
+    uint64_t blocks, block = 0, seed = 0x9e3779b97f4a7c15ULL;
+    long long start, end, t;
+    ssize_t ret;
+    int i, fd;
+
+    bench_parse(&argc, &argv, 4, "<read|write> <seq|rand> <block-size> <file>", &opts);
+    if (strcmp(argv[0], "read") != 0 && strcmp(argv[0], "write") != 0) {
+        fprintf(stderr, "Unknown operation: %s\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "seq") != 0 && strcmp(argv[1], "rand") != 0) {
+        fprintf(stderr, "Unknown access pattern: %s\n", argv[1]);
+        return 1;
+    }
+    write_mode = strcmp(argv[0], "write") == 0;
+    random_mode = strcmp(argv[1], "rand") == 0;
+    block_size = atol(argv[2]);
+    path = argv[3];
+    if (block_size <= 0) {
+        fprintf(stderr, "Invalid block size\n");
+        return 1;
+    }
+
+    fd = open(path, write_mode ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        return 1;
+    }
+    blocks = (uint64_t)st.st_size / block_size;
+    if (blocks == 0) {
+        fprintf(stderr, "%s: smaller than one block\n", path);
+        return 1;
+    }
+
+    buf = malloc(block_size);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    memset(buf, 'x', block_size);
+
+    /* Warmup */
+    for (i = 0; i < bench_warmup_iterations(&opts); i++) {
+        block = random_mode ? next_random(&seed) % blocks : (block + 1) % blocks;
+        if (write_mode)
+            pwrite(fd, buf, block_size, (off_t)(block * block_size));
+        else
+            pread(fd, buf, block_size, (off_t)(block * block_size));
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        block = random_mode ? next_random(&seed) % blocks : (block + 1) % blocks;
+        t = get_time_ns();
+        if (write_mode)
+            ret = pwrite(fd, buf, block_size, (off_t)(block * block_size));
+        else
+            ret = pread(fd, buf, block_size, (off_t)(block * block_size));
+        hist_record(&hist, get_time_ns() - t);
+        if (ret != block_size) {
+            perror(write_mode ? "pwrite" : "pread");
+            return 1;
+        }
+    }
+    end = get_time_ns();
+
+    close(fd);
+    free(buf);
+    snprintf(name, sizeof(name), "%s %s() %ldB", random_mode ? "random" : "sequential",
+             write_mode ? "pwrite" : "pread", block_size);
+    bench_report(&opts, name, path, &hist, end - start);
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * perf-stat-noent.c - Micro-benchmark for statx() of a missing file
+ *
+ * Measures negative lookups (ENOENT), which build tools and module
+ * resolvers issue far more often than successful ones.
+ *
+ * Usage: ./perf-stat-noent [-j] <dir> [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/stat.h>
+
+#include "bench.h"
+
+int main(int argc, char *argv[])
+{
+    struct bench_opts opts;
+    struct bench_hist hist = { 0 };
+    struct statx stx;
+    char path[PATH_MAX];
+    long long start, end, t;
+    int i, ret;
+
+    bench_parse(&argc, &argv, 1, "<dir>", &opts);
+    snprintf(path, sizeof(path), "%s/perf-stat-noent.missing", argv[0]);
+
+    /* Verify the file is missing */
+    ret = syscall(SYS_statx, AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx);
+    if (ret == 0 || errno != ENOENT) {
+        fprintf(stderr, "%s: expected ENOENT\n", path);
+        return 1;
+    }
+
+    /* Warmup */
+    for (i = 0; i < bench_warmup_iterations(&opts); i++) {
+        syscall(SYS_statx, AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx);
+    }
+
+    /* Benchmark */
+    start = get_time_ns();
+    for (i = 0; i < opts.iterations; i++) {
+        t = get_time_ns();
+        syscall(SYS_statx, AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx);
+        hist_record(&hist, get_time_ns() - t);
+    }
+    end = get_time_ns();
+
+    bench_report(&opts, "statx() ENOENT", path, &hist, end - start);
+    return 0;
+}
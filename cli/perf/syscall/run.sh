@@ -2,8 +2,14 @@
 #
 # Benchmark syscall performance across different scenarios:
 #   1. Native filesystem
-#   2. AgentFS (file in base layer)
-#   3. AgentFS (file copied up to delta layer)
+#   2. AgentFS (file or directory in base layer)
+#   3. AgentFS (file copied up to, or directory created in, delta layer)
+#
+# Usage: ./run.sh [iterations]
+#
+# Every benchmark reports latency percentiles, and perf-parallel how
+# throughput scales with concurrent workers; the raw JSON results of all
+# runs are appended to $RESULTS (default: results.jsonl next to this script).
 #
 
 set -e
@@ -13,6 +19,25 @@ CLI_DIR="$(cd "$SCRIPT_DIR/../.." && pwd)"
 TEST_FILE="$SCRIPT_DIR/hello.txt"
 ITERATIONS="${1:-100000}"
 AGENTFS="$CLI_DIR/target/release/agentfs"
+RESULTS="${RESULTS:-$SCRIPT_DIR/results.jsonl}"
+
+# Block sizes of the pread()/pwrite() benchmarks
+BLOCK_SIZES="${BLOCK_SIZES:-4096 65536 1048576}"
+# Entries in the directory listed by the getdents64() benchmark
+LIST_ENTRIES="${LIST_ENTRIES:-10000}"
+# Largest worker count, operations, directory layouts and worker kinds of
+# the perf-parallel scaling benchmark
+PARALLEL_WORKERS="${PARALLEL_WORKERS:-$(nproc)}"
+PARALLEL_OPS="${PARALLEL_OPS:-stat open read create}"
+PARALLEL_LAYOUTS="${PARALLEL_LAYOUTS:-shared private}"
+PARALLEL_MODES="${PARALLEL_MODES:-threads processes}"
+
+DATA_DIR="$SCRIPT_DIR/data"
+DATA_FILE="$DATA_DIR/data.bin"
+LIST_DIR="$DATA_DIR/list"
+OPS_DIR="$DATA_DIR/ops"
+# Created inside the sandbox, so it only exists in the delta layer
+DELTA_DIR="$DATA_DIR/delta"
 
 # Build benchmarks if needed
 make -C "$SCRIPT_DIR" -s
@@ -24,64 +49,248 @@ if [ ! -x "$AGENTFS" ]; then
     exit 1
 fi
 
-# Extract metrics from benchmark output
-extract_latency() {
-    grep "Avg latency:" | awk '{print $3}'
+# Create the files and directories the benchmarks run against
+mkdir -p "$OPS_DIR"
+if [ ! -f "$DATA_FILE" ]; then
+    head -c $((16 * 1024 * 1024)) /dev/zero > "$DATA_FILE"
+fi
+if [ ! -d "$LIST_DIR" ]; then
+    mkdir -p "$LIST_DIR"
+    (cd "$LIST_DIR" && seq -f "entry-%06g" 1 "$LIST_ENTRIES" | xargs touch)
+fi
+
+# Extract a numeric field from a benchmark's JSON output
+json_field() {
+    sed -n "s/.*\"$1\":\([0-9.]*\).*/\1/p"
+}
+
+# Overhead of latency $2 over native latency $1, in percent
+overhead() {
+    if [ "$1" = "0" ] || [ -z "$1" ] || [ -z "$2" ]; then
+        echo "-"
+    else
+        awk -v native="$1" -v latency="$2" 'BEGIN { printf "%.1f", (latency / native - 1) * 100 }'
+    fi
+}
+
+# Keep the JSON line of a run's output, and append it to $RESULTS
+collect() {
+    local scenario="$1"
+    local json
+
+    json=$(grep '^{' | tail -n 1)
+    if [ -z "$json" ]; then
+        echo "Error: no result from $scenario run" >&2
+        return 1
+    fi
+    printf '{"scenario":"%s","result":%s}\n' "$scenario" "$json" >> "$RESULTS"
+    echo "$json"
 }
 
-extract_throughput() {
-    grep "Throughput:" | awk '{print $2}'
+# Like collect, but keep every JSON line of a run's output
+collect_all() {
+    local scenario="$1"
+    local json line
+
+    json=$(grep '^{')
+    if [ -z "$json" ]; then
+        echo "Error: no result from $scenario run" >&2
+        return 1
+    fi
+    while IFS= read -r line; do
+        printf '{"scenario":"%s","result":%s}\n' "$scenario" "$line" >> "$RESULTS"
+    done <<< "$json"
+    echo "$json"
 }
 
+SUMMARY=()
+
 # Run a benchmark for all three scenarios
+#
+# run_benchmark <name> <iterations> <target> <delta-setup> <delta-target> <benchmark> [args...]
+#
+# The benchmark is invoked as `<benchmark> -j [args...] <target> <iterations>`.
+# <delta-setup> runs in the sandbox first, to put <delta-target> in the delta
+# layer.
 run_benchmark() {
     local name="$1"
-    local benchmark="$2"
+    local iterations="$2"
+    local target="$3"
+    local delta_setup="$4"
+    local delta_target="$5"
+    local benchmark="$6"
+    shift 6
 
     echo "=============================================="
     echo "$name"
     echo "=============================================="
-    echo "Iterations: $ITERATIONS"
+    echo "Iterations: $iterations"
     echo ""
 
     # Test 1: Native filesystem
     echo "[1/3] Native filesystem..."
-    NATIVE_OUTPUT=$("$benchmark" "$TEST_FILE" "$ITERATIONS" 2>&1)
-    NATIVE_LATENCY=$(echo "$NATIVE_OUTPUT" | extract_latency)
-    NATIVE_THROUGHPUT=$(echo "$NATIVE_OUTPUT" | extract_throughput)
+    NATIVE=$("$benchmark" -j "$@" "$target" "$iterations" 2>&1 | collect native)
 
-    # Test 2: AgentFS (file in base layer)
+    # Test 2: AgentFS (base layer)
     echo "[2/3] AgentFS (base layer)..."
-    AGENTFS_BASE_OUTPUT=$("$AGENTFS" run "$benchmark" "$TEST_FILE" "$ITERATIONS" 2>&1)
-    AGENTFS_BASE_LATENCY=$(echo "$AGENTFS_BASE_OUTPUT" | extract_latency)
-    AGENTFS_BASE_THROUGHPUT=$(echo "$AGENTFS_BASE_OUTPUT" | extract_throughput)
+    AGENTFS_BASE=$("$AGENTFS" run "$benchmark" -j "$@" "$target" "$iterations" 2>&1 | collect base)
 
-    # Test 3: AgentFS (file copied up to delta)
+    # Test 3: AgentFS (delta layer)
     echo "[3/3] AgentFS (delta layer)..."
-    AGENTFS_DELTA_OUTPUT=$("$AGENTFS" run sh -c "
-        touch '$TEST_FILE'
-        '$benchmark' '$TEST_FILE' '$ITERATIONS'
-    " 2>&1)
-    AGENTFS_DELTA_LATENCY=$(echo "$AGENTFS_DELTA_OUTPUT" | extract_latency)
-    AGENTFS_DELTA_THROUGHPUT=$(echo "$AGENTFS_DELTA_OUTPUT" | extract_throughput)
-
-    # Calculate overhead percentages
-    AGENTFS_BASE_OVERHEAD=$(echo "scale=1; (($AGENTFS_BASE_LATENCY / $NATIVE_LATENCY) - 1) * 100" | bc)
-    AGENTFS_DELTA_OVERHEAD=$(echo "scale=1; (($AGENTFS_DELTA_LATENCY / $NATIVE_LATENCY) - 1) * 100" | bc)
+    AGENTFS_DELTA=$("$AGENTFS" run sh -c "$delta_setup && exec \"\$0\" \"\$@\"" \
+        "$benchmark" -j "$@" "$delta_target" "$iterations" 2>&1 | collect delta)
 
     # Results
     echo ""
     echo "Results:"
-    echo "----------------------------------------------"
-    printf "%-25s %10s %12s %10s\n" "Scenario" "Latency" "Throughput" "Overhead"
-    printf "%-25s %10s %12s %10s\n" "--------" "-------" "----------" "--------"
-    printf "%-25s %8s ns %10s/s %10s\n" "Native" "$NATIVE_LATENCY" "$NATIVE_THROUGHPUT" "-"
-    printf "%-25s %8s ns %10s/s %8s %%\n" "AgentFS (base)" "$AGENTFS_BASE_LATENCY" "$AGENTFS_BASE_THROUGHPUT" "$AGENTFS_BASE_OVERHEAD"
-    printf "%-25s %8s ns %10s/s %8s %%\n" "AgentFS (delta)" "$AGENTFS_DELTA_LATENCY" "$AGENTFS_DELTA_THROUGHPUT" "$AGENTFS_DELTA_OVERHEAD"
-    echo "----------------------------------------------"
+    echo "------------------------------------------------------------------------------"
+    printf "%-18s %10s %10s %10s %10s %12s %9s\n" \
+        "Scenario" "p50" "p90" "p99" "Max" "Throughput" "Overhead"
+    printf "%-18s %10s %10s %10s %10s %12s %9s\n" \
+        "--------" "---" "---" "---" "---" "----------" "--------"
+    local native_p50 scenario json p50 p99
+    native_p50=$(echo "$NATIVE" | json_field p50_ns)
+    for scenario in Native "AgentFS (base)" "AgentFS (delta)"; do
+        case "$scenario" in
+            Native) json="$NATIVE" ;;
+            "AgentFS (base)") json="$AGENTFS_BASE" ;;
+            *) json="$AGENTFS_DELTA" ;;
+        esac
+        p50=$(echo "$json" | json_field p50_ns)
+        printf "%-18s %7s ns %7s ns %7s ns %7s ns %10s/s %7s %%\n" "$scenario" \
+            "$p50" \
+            "$(echo "$json" | json_field p90_ns)" \
+            "$(echo "$json" | json_field p99_ns)" \
+            "$(echo "$json" | json_field max_ns)" \
+            "$(echo "$json" | json_field ops_per_sec)" \
+            "$(if [ "$scenario" = Native ]; then echo "-"; else overhead "$native_p50" "$p50"; fi)"
+    done
+    echo "------------------------------------------------------------------------------"
+    echo ""
+
+    p99=$(echo "$NATIVE" | json_field p99_ns)
+    SUMMARY+=("$(printf "%-42s %9s %9s %9s %10s %10s %10s" "$name" \
+        "$native_p50" \
+        "$(echo "$AGENTFS_BASE" | json_field p50_ns)" \
+        "$(echo "$AGENTFS_DELTA" | json_field p50_ns)" \
+        "$p99" \
+        "$(echo "$AGENTFS_BASE" | json_field p99_ns)" \
+        "$(echo "$AGENTFS_DELTA" | json_field p99_ns)")")
+}
+
+# $ITERATIONS scaled down by $1, but at least $2
+scaled() {
+    local n=$((ITERATIONS / $1))
+    if [ "$n" -lt "$2" ]; then
+        n="$2"
+    fi
+    echo "$n"
+}
+
+# Run the perf-parallel scaling benchmark for all three scenarios
+#
+# run_scaling <op> <layout> <mode> <iterations>
+#
+# Prints aggregate throughput and p99 latency for each worker count. The
+# native run creates the files under $DATA_DIR, which the base-layer run
+# then reuses; the delta-layer run creates its own under $DELTA_DIR.
+run_scaling() {
+    local op="$1"
+    local layout="$2"
+    local mode="$3"
+    local iterations="$4"
+    local benchmark="$SCRIPT_DIR/perf-parallel"
+    local native base delta
+
+    echo "=============================================="
+    echo "Parallel $op scaling ($layout directories, $mode)"
+    echo "=============================================="
+    echo "Iterations: $iterations per worker, up to $PARALLEL_WORKERS workers"
+    echo ""
+
+    echo "[1/3] Native filesystem..."
+    native=$("$benchmark" -j "$op" "$layout" "$mode" "$PARALLEL_WORKERS" \
+        "$DATA_DIR" "$iterations" 2>&1 | collect_all native)
+    echo "[2/3] AgentFS (base layer)..."
+    base=$("$AGENTFS" run "$benchmark" -j "$op" "$layout" "$mode" "$PARALLEL_WORKERS" \
+        "$DATA_DIR" "$iterations" 2>&1 | collect_all base)
+    echo "[3/3] AgentFS (delta layer)..."
+    delta=$("$AGENTFS" run sh -c "mkdir -p '$DELTA_DIR' && exec \"\$0\" \"\$@\"" \
+        "$benchmark" -j "$op" "$layout" "$mode" "$PARALLEL_WORKERS" \
+        "$DELTA_DIR" "$iterations" 2>&1 | collect_all delta)
+
+    local -a native_rows base_rows delta_rows
+    mapfile -t native_rows <<< "$native"
+    mapfile -t base_rows <<< "$base"
+    mapfile -t delta_rows <<< "$delta"
+
+    echo ""
+    echo "Results (ops/sec are aggregate over all workers):"
+    echo "------------------------------------------------------------------------------"
+    printf "%7s %11s %11s %11s %10s %10s %10s\n" \
+        "Workers" "ops/s nat" "ops/s base" "ops/s delta" "p99 nat" "p99 base" "p99 delta"
+    local i
+    for i in "${!native_rows[@]}"; do
+        printf "%7s %11s %11s %11s %7s ns %7s ns %7s ns\n" \
+            "$(echo "${native_rows[$i]}" | json_field workers)" \
+            "$(echo "${native_rows[$i]}" | json_field ops_per_sec)" \
+            "$(echo "${base_rows[$i]}" | json_field ops_per_sec)" \
+            "$(echo "${delta_rows[$i]}" | json_field ops_per_sec)" \
+            "$(echo "${native_rows[$i]}" | json_field p99_ns)" \
+            "$(echo "${base_rows[$i]}" | json_field p99_ns)" \
+            "$(echo "${delta_rows[$i]}" | json_field p99_ns)"
+    done
+    echo "------------------------------------------------------------------------------"
     echo ""
 }
 
 # Run all benchmarks
-run_benchmark "open()+close() Micro-Benchmark" "$SCRIPT_DIR/perf-open-close"
-run_benchmark "statx() Micro-Benchmark" "$SCRIPT_DIR/perf-statx"
+run_benchmark "open()+close() Micro-Benchmark" "$ITERATIONS" \
+    "$TEST_FILE" "touch '$TEST_FILE'" "$TEST_FILE" "$SCRIPT_DIR/perf-open-close"
+run_benchmark "statx() Micro-Benchmark" "$ITERATIONS" \
+    "$TEST_FILE" "touch '$TEST_FILE'" "$TEST_FILE" "$SCRIPT_DIR/perf-statx"
+run_benchmark "statx() ENOENT Micro-Benchmark" "$ITERATIONS" \
+    "$OPS_DIR" "mkdir -p '$DELTA_DIR'" "$DELTA_DIR" "$SCRIPT_DIR/perf-stat-noent"
+
+for bs in $BLOCK_SIZES; do
+    # Move about the same number of bytes at every block size
+    rw_iterations=$(scaled $((10 * bs / 4096)) 100)
+    for op in read write; do
+        for pattern in seq rand; do
+            run_benchmark "$pattern p$op() ${bs}B Micro-Benchmark" "$rw_iterations" \
+                "$DATA_FILE" "touch '$DATA_FILE'" "$DATA_FILE" \
+                "$SCRIPT_DIR/perf-rw" "$op" "$pattern" "$bs"
+        done
+    done
+done
+
+run_benchmark "getdents64() ${LIST_ENTRIES} entries" "$(scaled 1000 10)" \
+    "$LIST_DIR" \
+    "mkdir -p '$DELTA_DIR/list' && cd '$DELTA_DIR/list' && seq -f 'entry-%06g' 1 $LIST_ENTRIES | xargs touch" \
+    "$DELTA_DIR/list" "$SCRIPT_DIR/perf-getdents"
+run_benchmark "openat(O_CREAT)+unlink() Micro-Benchmark" "$(scaled 10 100)" \
+    "$OPS_DIR" "mkdir -p '$DELTA_DIR'" "$DELTA_DIR" "$SCRIPT_DIR/perf-create-unlink"
+run_benchmark "mkdir()+rmdir() Micro-Benchmark" "$(scaled 10 100)" \
+    "$OPS_DIR" "mkdir -p '$DELTA_DIR'" "$DELTA_DIR" "$SCRIPT_DIR/perf-mkdir-rmdir"
+run_benchmark "rename() Micro-Benchmark" "$(scaled 10 100)" \
+    "$OPS_DIR" "mkdir -p '$DELTA_DIR'" "$DELTA_DIR" "$SCRIPT_DIR/perf-rename"
+
+for op in $PARALLEL_OPS; do
+    for layout in $PARALLEL_LAYOUTS; do
+        for mode in $PARALLEL_MODES; do
+            run_scaling "$op" "$layout" "$mode" "$(scaled 10 100)"
+        done
+    done
+done
+
+# Summary of all benchmarks
+echo "=============================================="
+echo "Summary (latency in ns)"
+echo "=============================================="
+printf "%-42s %9s %9s %9s %10s %10s %10s\n" \
+    "Benchmark" "p50 nat" "p50 base" "p50 delta" "p99 nat" "p99 base" "p99 delta"
+for row in "${SUMMARY[@]}"; do
+    echo "$row"
+done
+echo ""
+echo "Raw results appended to $RESULTS"
@@ -162,6 +162,37 @@ pub async fn write_filesystem(
     Ok(())
 }
 
+#[cfg(unix)]
+pub async fn import_filesystem(
+    id_or_path: String,
+    host_dir: &std::path::Path,
+    path: &str,
+    encryption: Option<&(String, String)>,
+) -> AnyhowResult<()> {
+    let mut options = AgentFSOptions::resolve(&id_or_path)?;
+    if let Some((key, cipher)) = encryption {
+        options = options.with_encryption(EncryptionConfig {
+            hex_key: key.clone(),
+            cipher: cipher.clone(),
+        });
+    }
+    let agentfs = open_agentfs(options).await?;
+
+    let started = std::time::Instant::now();
+    let stats = agentfs
+        .fs
+        .import_tree(host_dir, path)
+        .await
+        .with_context(|| format!("Failed to import {}", host_dir.display()))?;
+    eprintln!(
+        "Imported {} entries ({} bytes) in {:.2}s",
+        stats.entries,
+        stats.bytes,
+        started.elapsed().as_secs_f64()
+    );
+    Ok(())
+}
+
 /// Represents a change type in the overlay filesystem
 #[derive(Debug, Clone, PartialEq, Eq)]
 enum ChangeType {
@@ -274,6 +305,8 @@ mod tests {
     use agentfs_sdk::{AgentFS, AgentFSOptions, EncryptionConfig};
     use tempfile::NamedTempFile;
 
+    #[cfg(unix)]
+    use crate::cmd::fs::import_filesystem;
     use crate::cmd::fs::{cat_filesystem, ls_filesystem, write_filesystem};
 
     const TEST_KEY: &str = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
@@ -402,6 +435,37 @@ f d/e/3.md
         );
     }
 
+    #[cfg(unix)]
+    #[tokio::test]
+    pub async fn import_and_ls() {
+        let (_agentfs, path, _file) = agentfs().await;
+        let host = tempfile::tempdir().unwrap();
+        std::fs::create_dir_all(host.path().join("a/b")).unwrap();
+        std::fs::write(host.path().join("a/b/1.md"), b"1").unwrap();
+        std::fs::write(host.path().join("2.md"), b"22").unwrap();
+        import_filesystem(path.clone(), host.path(), "/", None)
+            .await
+            .unwrap();
+
+        let mut buf = Vec::new();
+        ls_filesystem(&mut buf, path.clone(), "/", None)
+            .await
+            .unwrap();
+        assert_eq!(
+            buf,
+            b"f 2.md
+d a
+d a/b
+f a/b/1.md
+"
+        );
+        let mut buf = Vec::new();
+        cat_filesystem(&mut buf, path, "/a/b/1.md", None)
+            .await
+            .unwrap();
+        assert_eq!(buf, b"1");
+    }
+
     // Encryption tests
 
     #[tokio::test]
@@ -69,12 +69,18 @@ pub fn build_sync_options(sync_cmd_options: &SyncCommandOptions) -> SyncOptions
     sync
 }
 
+#[allow(clippy::too_many_arguments)]
 pub async fn init_database(
     id: Option<String>,
     sync_options: SyncCommandOptions,
     force: bool,
     base: Option<PathBuf>,
     encryption: Option<EncryptionOptions>,
+    chunk_size: Option<usize>,
+    dedup: bool,
+    compression: Option<String>,
+    deferred_reclaim: bool,
+    size_classes: bool,
     command: Option<String>,
     backend: MountBackend,
 ) -> AnyhowResult<()> {
@@ -131,6 +137,21 @@ pub async fn init_database(
     if let Some(base_path) = base.as_ref() {
         open_options = open_options.with_base(base_path);
     }
+    if let Some(chunk_size) = chunk_size {
+        open_options = open_options.with_chunk_size(chunk_size);
+    }
+    if dedup {
+        open_options = open_options.with_dedup();
+    }
+    if let Some(compression) = compression {
+        open_options = open_options.with_compression(compression.parse()?);
+    }
+    if deferred_reclaim {
+        open_options = open_options.with_deferred_reclaim();
+    }
+    if size_classes {
+        open_options = open_options.with_size_classes();
+    }
 
     let encrypted = if let Some(enc_opts) = encryption {
         if sync_options.sync_remote_url.is_some() {
@@ -210,17 +231,16 @@ async fn run_init_cmd(
     use agentfs_sdk::{FileSystem, HostFS};
     use std::process::Command;
     use std::sync::Arc;
-    use tokio::sync::Mutex;
 
-    let fs: Arc<Mutex<dyn FileSystem + Send>> = if let Some(ref base_path) = base {
+    let fs: Arc<dyn FileSystem> = if let Some(ref base_path) = base {
         let canonical = base_path
             .canonicalize()
             .context("Failed to canonicalize base path")?;
         let hostfs = HostFS::new(&canonical)?;
         let overlay = OverlayFS::new(Arc::new(hostfs), agent.fs);
-        Arc::new(Mutex::new(overlay)) as Arc<Mutex<dyn FileSystem + Send>>
+        Arc::new(overlay) as Arc<dyn FileSystem>
     } else {
-        Arc::new(Mutex::new(agent.fs)) as Arc<Mutex<dyn FileSystem + Send>>
+        Arc::new(agent.fs) as Arc<dyn FileSystem>
     };
 
     let exec_id = uuid::Uuid::new_v4().to_string();
@@ -238,6 +258,8 @@ async fn run_init_cmd(
         auto_unmount: false,
         lazy_unmount: true,
         timeout: std::time::Duration::from_secs(10),
+        concurrent: true,
+        trace: None,
     };
 
     let mount_handle = mount_fs(fs, mount_opts).await?;
@@ -1,11 +1,13 @@
-use agentfs_sdk::{error::Error as SdkError, AgentFSOptions, FileSystem, HostFS, OverlayFS};
+use agentfs_sdk::{
+    error::Error as SdkError, AgentFS, AgentFSOptions, AutoSync, AutoSyncOptions, FileSystem,
+    HostFS, OverlayFS,
+};
 use anyhow::{Context, Result};
 use std::{
     path::{Path, PathBuf},
     process::Command,
     sync::Arc,
 };
-use tokio::sync::Mutex;
 use turso::value::Value;
 
 use crate::mount::{mount_fs, MountOpts};
@@ -51,6 +53,18 @@ pub struct MountArgs {
     pub gid: Option<u32>,
     /// The mount backend to use (fuse or nfs).
     pub backend: MountBackend,
+    /// Dispatch FUSE requests concurrently on the runtime.
+    pub concurrent: bool,
+    /// Maximum number of directory entries to keep in the lookup cache.
+    pub dentry_cache_size: Option<usize>,
+    /// Use FUSE passthrough for read-only opens of host-backed files.
+    pub passthrough: bool,
+    /// Record every FUSE request to this trace file.
+    pub trace: Option<PathBuf>,
+    /// Write the operation metrics to this file once unmounted.
+    pub stats: Option<PathBuf>,
+    /// Push and checkpoint a synced database in the background.
+    pub auto_sync: bool,
 }
 
 /// Mount the agent filesystem (Linux).
@@ -130,9 +144,16 @@ fn mount_fuse(args: MountArgs) -> Result<()> {
         fsname,
         uid: args.uid,
         gid: args.gid,
+        concurrent: args.concurrent,
+        passthrough: args.passthrough,
+        // The daemon changes its working directory, so resolve the path first
+        trace: args.trace.as_deref().map(std::path::absolute).transpose()?,
     };
 
     let id_or_path = args.id_or_path.clone();
+    let dentry_cache_size = args.dentry_cache_size;
+    let stats = args.stats.as_deref().map(std::path::absolute).transpose()?;
+    let auto_sync = args.auto_sync;
     let mount = move || {
         let rt = crate::get_runtime();
         let agentfs = match rt.block_on(open_agentfs(opts)) {
@@ -142,6 +163,13 @@ fn mount_fuse(args: MountArgs) -> Result<()> {
             }
             Err(e) => return Err(e.into()),
         };
+        // The FUSE adapter flushes handles on close, so writes can be buffered
+        agentfs.fs.set_write_back(true);
+        if let Some(size) = dentry_cache_size {
+            agentfs.fs.set_dentry_cache_size(size);
+        }
+
+        let auto_sync = rt.block_on(async { start_auto_sync(&agentfs, auto_sync) });
 
         // Check for overlay configuration
         let fs: Arc<dyn FileSystem> = rt.block_on(async {
@@ -181,7 +209,15 @@ fn mount_fuse(args: MountArgs) -> Result<()> {
             }
         })?;
 
-        crate::fuse::mount(fs, fuse_opts, rt)
+        let result = crate::fuse::mount(fs, fuse_opts, rt);
+        if let Some(auto_sync) = auto_sync {
+            // The runtime went with the mount, push the rest on a new one
+            stop_auto_sync(&crate::get_runtime(), auto_sync);
+        }
+        if let Some(stats) = &stats {
+            crate::stats::dump(stats)?;
+        }
+        result
     };
 
     if args.foreground {
@@ -195,6 +231,29 @@ fn mount_fuse(args: MountArgs) -> Result<()> {
     }
 }
 
+/// Start pushing and checkpointing `agentfs` in the background on the current
+/// runtime, if `enabled`.
+fn start_auto_sync(agentfs: &AgentFS, enabled: bool) -> Option<AutoSync> {
+    if !enabled {
+        return None;
+    }
+    match agentfs.auto_sync(AutoSyncOptions::default()) {
+        Ok(auto_sync) => Some(auto_sync),
+        Err(_) => {
+            eprintln!("Warning: --auto-sync requires a synced database, ignoring");
+            None
+        }
+    }
+}
+
+/// Stop `auto_sync` on `rt`, pushing the changes still pending.
+#[cfg(target_os = "linux")]
+fn stop_auto_sync(rt: &tokio::runtime::Runtime, auto_sync: AutoSync) {
+    if let Err(e) = rt.block_on(auto_sync.stop()) {
+        eprintln!("Warning: failed to push the last changes: {}", e);
+    }
+}
+
 /// Mount the agent filesystem using NFS over localhost.
 async fn mount_nfs_backend(args: MountArgs) -> Result<()> {
     use crate::cmd::init::open_agentfs;
@@ -204,6 +263,12 @@ async fn mount_nfs_backend(args: MountArgs) -> Result<()> {
     if !args.mountpoint.exists() {
         anyhow::bail!("Mountpoint does not exist: {}", args.mountpoint.display());
     }
+    if args.trace.is_some() {
+        eprintln!("Warning: --trace is only supported with the FUSE backend, ignoring");
+    }
+    if args.stats.is_some() && !args.foreground {
+        eprintln!("Warning: --stats requires --foreground with the NFS backend, ignoring");
+    }
 
     let mountpoint = std::fs::canonicalize(args.mountpoint.clone())?;
 
@@ -222,6 +287,13 @@ async fn mount_nfs_backend(args: MountArgs) -> Result<()> {
         }
         Err(e) => return Err(e.into()),
     };
+    // The NFS adapter commits buffered writes on COMMIT and stable writes
+    agentfs.fs.set_write_back(true);
+    if let Some(size) = args.dentry_cache_size {
+        agentfs.fs.set_dentry_cache_size(size);
+    }
+
+    let auto_sync = start_auto_sync(&agentfs, args.auto_sync);
 
     // Check for overlay configuration
     // Query base_path in a separate scope so connection is released before load_whiteouts
@@ -246,16 +318,16 @@ async fn mount_nfs_backend(args: MountArgs) -> Result<()> {
         }
     }; // conn is dropped here
 
-    let fs: Arc<Mutex<dyn FileSystem + Send>> = if let Some(base_path) = base_path {
+    let fs: Arc<dyn FileSystem> = if let Some(base_path) = base_path {
         // Create OverlayFS with HostFS base, loading existing whiteouts
         eprintln!("Using overlay filesystem with base: {}", base_path);
         let hostfs = HostFS::new(&base_path)?;
         let overlay = OverlayFS::new(Arc::new(hostfs), agentfs.fs);
         overlay.load().await?; // Load persisted whiteouts and origin mappings
-        Arc::new(Mutex::new(overlay)) as Arc<Mutex<dyn FileSystem + Send>>
+        Arc::new(overlay) as Arc<dyn FileSystem>
     } else {
         // Plain AgentFS
-        Arc::new(Mutex::new(agentfs.fs)) as Arc<Mutex<dyn FileSystem + Send>>
+        Arc::new(agentfs.fs) as Arc<dyn FileSystem>
     };
 
     if args.foreground {
@@ -271,15 +343,25 @@ async fn mount_nfs_backend(args: MountArgs) -> Result<()> {
             auto_unmount: args.auto_unmount,
             lazy_unmount: true,
             timeout: std::time::Duration::from_secs(10),
+            concurrent: args.concurrent,
+            trace: None,
         };
 
-        let _mount_handle = mount_fs(fs, mount_opts).await?;
+        let mount_handle = mount_fs(fs, mount_opts).await?;
 
         eprintln!("Mounted at {}", mountpoint.display());
         eprintln!("Press Ctrl+C to unmount and exit.");
         tokio::signal::ctrl_c().await?;
 
-        // Handle drops automatically when we exit this scope
+        drop(mount_handle);
+        if let Some(auto_sync) = auto_sync {
+            if let Err(e) = auto_sync.stop().await {
+                eprintln!("Warning: failed to push the last changes: {}", e);
+            }
+        }
+        if let Some(stats) = &args.stats {
+            crate::stats::dump(stats)?;
+        }
     } else {
         // Daemon mode: use manual NFS server setup for persistent background operation
         let nfs = AgentNFS::new(fs);
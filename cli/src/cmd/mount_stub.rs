@@ -25,6 +25,18 @@ pub struct MountArgs {
     pub gid: Option<u32>,
     /// The mount backend to use (fuse or nfs).
     pub backend: MountBackend,
+    /// Dispatch FUSE requests concurrently on the runtime.
+    pub concurrent: bool,
+    /// Maximum number of directory entries to keep in the lookup cache.
+    pub dentry_cache_size: Option<usize>,
+    /// Use FUSE passthrough for read-only opens of host-backed files.
+    pub passthrough: bool,
+    /// Record every FUSE request to this trace file.
+    pub trace: Option<PathBuf>,
+    /// Write the operation metrics to this file once unmounted.
+    pub stats: Option<PathBuf>,
+    /// Push and checkpoint a synced database in the background.
+    pub auto_sync: bool,
 }
 
 /// List all currently mounted agentfs filesystems
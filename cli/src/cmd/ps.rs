@@ -31,6 +31,15 @@ pub fn procs_dir(session_id: &str) -> PathBuf {
         .join("procs")
 }
 
+/// Get the path to the stats socket of a session, served by its owner.
+pub fn stats_socket(session_id: &str) -> PathBuf {
+    let home = dirs::home_dir().expect("home directory");
+    home.join(".agentfs")
+        .join("run")
+        .join(session_id)
+        .join("stats.sock")
+}
+
 /// Get the path to a proc file.
 pub fn proc_file(session_id: &str, pid: u32) -> PathBuf {
     procs_dir(session_id).join(format!("{}.json", pid))
@@ -190,8 +199,9 @@ const COL_OWNER: usize = 5;
 const COL_COMMAND: usize = 15;
 const COL_STARTED: usize = 10;
 
-/// List active agentfs run sessions.
-pub fn list_ps<W: Write>(out: &mut W) -> Result<()> {
+/// List active agentfs run sessions, followed by the operation metrics of
+/// each if `stats` is set.
+pub fn list_ps<W: Write>(out: &mut W, stats: bool) -> Result<()> {
     let sessions = list_sessions();
 
     if sessions.is_empty() {
@@ -225,5 +235,29 @@ pub fn list_ps<W: Write>(out: &mut W) -> Result<()> {
         }
     }
 
+    if stats {
+        for session in &sessions {
+            writeln!(out)?;
+            writeln!(out, "Session {}:", session.session_id)?;
+            write_session_stats(out, &session.session_id)?;
+        }
+    }
+
+    Ok(())
+}
+
+/// Write the metrics served by the owner of a session.
+#[cfg(unix)]
+fn write_session_stats<W: Write>(out: &mut W, session_id: &str) -> Result<()> {
+    match crate::stats::fetch(&stats_socket(session_id)) {
+        Ok(snapshot) => crate::stats::write_table(out, &snapshot)?,
+        Err(e) => writeln!(out, "Stats unavailable: {:#}", e)?,
+    }
+    Ok(())
+}
+
+#[cfg(not(unix))]
+fn write_session_stats<W: Write>(out: &mut W, _session_id: &str) -> Result<()> {
+    writeln!(out, "Stats are only available on Unix.")?;
     Ok(())
 }
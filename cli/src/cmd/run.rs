@@ -6,6 +6,11 @@
 
 use anyhow::Result;
 use std::path::PathBuf;
+#[cfg(all(unix, feature = "sandbox"))]
+use std::sync::Arc;
+
+#[cfg(all(unix, feature = "sandbox"))]
+use agentfs_sdk::OverlayFS;
 
 #[cfg_attr(all(target_os = "linux", feature = "sandbox"), path = "run_linux.rs")]
 #[cfg_attr(all(target_os = "macos", feature = "sandbox"), path = "run_darwin.rs")]
@@ -26,6 +31,8 @@ pub async fn handle_run_command(
     session: Option<String>,
     system: bool,
     encryption: Option<(String, String)>,
+    trace: Option<PathBuf>,
+    warm_up: bool,
     command: PathBuf,
     args: Vec<String>,
 ) -> Result<()> {
@@ -37,8 +44,30 @@ pub async fn handle_run_command(
         session,
         system,
         encryption,
+        trace,
+        warm_up,
         command,
         args,
     )
     .await
 }
+
+/// Warm up `overlay` from the hot paths saved by previous runs of the
+/// session in the background, and record the ones of this run.
+///
+/// The warm-up runs concurrently with the command starting up, which only
+/// finds some of its lookups prefetched if it gets to them first.
+#[cfg(all(unix, feature = "sandbox"))]
+pub(crate) fn start_warm_up(overlay: &Arc<OverlayFS>) {
+    overlay.record_hot_paths();
+    let overlay = overlay.clone();
+    tokio::spawn(async move {
+        match overlay.load_hot_paths().await {
+            Ok(paths) => {
+                let warmed = overlay.warm_up(paths).await;
+                tracing::debug!("Warmed up {} hot directories", warmed);
+            }
+            Err(e) => tracing::warn!("Failed to load hot paths: {}", e),
+        }
+    });
+}
@@ -14,7 +14,6 @@ use anyhow::{Context, Result};
 use std::path::{Path, PathBuf};
 use std::process::Command;
 use std::sync::Arc;
-use tokio::sync::Mutex;
 
 use crate::nfs::AgentNFS;
 use crate::nfsserve::tcp::NFSTcp;
@@ -35,9 +34,14 @@ pub async fn run(
     session_id: Option<String>,
     _system: bool,
     encryption: Option<(String, String)>,
+    trace: Option<PathBuf>,
+    warm_up: bool,
     command: PathBuf,
     args: Vec<String>,
 ) -> Result<()> {
+    if trace.is_some() {
+        eprintln!("Warning: --trace is only supported with FUSE on Linux, ignoring");
+    }
     let cwd = std::env::current_dir().context("Failed to get current directory")?;
     let home = dirs::home_dir().context("Failed to get home directory")?;
 
@@ -75,11 +79,13 @@ pub async fn run(
     let agentfs = AgentFS::open(options)
         .await
         .context("Failed to create AgentFS")?;
+    // The NFS adapter commits buffered writes on COMMIT and stable writes
+    agentfs.fs.set_write_back(true);
 
     // Create overlay filesystem with CWD as base
     let base_str = cwd.to_string_lossy().to_string();
     let hostfs = HostFS::new(&base_str).context("Failed to create HostFS")?;
-    let overlay = OverlayFS::new(Arc::new(hostfs), agentfs.fs);
+    let overlay = Arc::new(OverlayFS::new(Arc::new(hostfs), agentfs.fs));
 
     // Initialize the overlay (copies directory structure)
     overlay
@@ -87,7 +93,11 @@ pub async fn run(
         .await
         .context("Failed to initialize overlay")?;
 
-    let fs: Arc<Mutex<dyn FileSystem>> = Arc::new(Mutex::new(overlay));
+    if warm_up {
+        crate::cmd::run::start_warm_up(&overlay);
+    }
+
+    let fs: Arc<dyn FileSystem> = overlay.clone();
 
     // Create NFS adapter
     let nfs = AgentNFS::new(fs);
@@ -122,6 +132,12 @@ pub async fn run(
     // Unmount
     unmount(&session.mountpoint)?;
 
+    if warm_up {
+        if let Err(e) = overlay.save_hot_paths().await {
+            eprintln!("Warning: Failed to save hot paths: {}", e);
+        }
+    }
+
     // Abort the server task (vendored nfsserve doesn't support graceful shutdown)
     server_handle.abort();
 
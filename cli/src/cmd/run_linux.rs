@@ -16,6 +16,8 @@ pub async fn run(
     session: Option<String>,
     system: bool,
     encryption: Option<(String, String)>,
+    trace: Option<PathBuf>,
+    warm_up: bool,
     command: PathBuf,
     args: Vec<String>,
 ) -> Result<()> {
@@ -29,6 +31,12 @@ pub async fn run(
         if encryption.is_some() {
             eprintln!("Warning: --key is not supported with --experimental-sandbox, ignoring");
         }
+        if trace.is_some() {
+            eprintln!("Warning: --trace is not supported with --experimental-sandbox, ignoring");
+        }
+        if warm_up {
+            eprintln!("Warning: --warm-up is not supported with --experimental-sandbox, ignoring");
+        }
         crate::sandbox::linux_ptrace::run_cmd(strace, command, args).await;
     } else {
         if strace {
@@ -40,6 +48,8 @@ pub async fn run(
             session,
             system,
             encryption,
+            trace,
+            warm_up,
             command,
             args,
         )
@@ -14,6 +14,8 @@ pub async fn run(
     _session: Option<String>,
     _system: bool,
     _encryption: Option<(String, String)>,
+    _trace: Option<PathBuf>,
+    _warm_up: bool,
     _command: PathBuf,
     _args: Vec<String>,
 ) -> Result<()> {
@@ -1,19 +1,25 @@
 use crate::fuser::{
     consts::{
-        FUSE_ASYNC_READ, FUSE_CACHE_SYMLINKS, FUSE_NO_OPENDIR_SUPPORT, FUSE_PARALLEL_DIROPS,
-        FUSE_WRITEBACK_CACHE,
+        FUSE_ASYNC_READ, FUSE_CACHE_SYMLINKS, FUSE_PARALLEL_DIROPS, FUSE_PASSTHROUGH,
+        FUSE_SPLICE_MOVE, FUSE_SPLICE_WRITE, FUSE_WRITEBACK_CACHE,
     },
-    fuse_forget_one, FileAttr, FileType, Filesystem, KernelConfig, MountOption, ReplyAttr,
-    ReplyCreate, ReplyData, ReplyDirectory, ReplyDirectoryPlus, ReplyEmpty, ReplyEntry, ReplyOpen,
-    ReplyStatfs, ReplyWrite, Request,
+    fuse_forget_one, BackingId, FileAttr, FileType, Filesystem, KernelConfig, MountOption,
+    ReplyAttr, ReplyCreate, ReplyData, ReplyDirectory, ReplyDirectoryPlus, ReplyEmpty, ReplyEntry,
+    ReplyOpen, ReplyStatfs, ReplyWrite, Request,
 };
 use agentfs_sdk::error::Error as SdkError;
 use agentfs_sdk::filesystem::{S_IFBLK, S_IFCHR, S_IFDIR, S_IFIFO, S_IFLNK, S_IFMT, S_IFSOCK};
-use agentfs_sdk::{BoxedFile, FileSystem, Stats, TimeChange};
+use agentfs_sdk::{
+    BoxedDirectory, BoxedFile, DirEntry, Directory, FileSystem, MeteredFileSystem, Stats,
+    TimeChange,
+};
+use anyhow::Context;
 use parking_lot::Mutex;
 use std::{
-    collections::HashMap,
+    collections::{HashMap, VecDeque},
     ffi::OsStr,
+    future::Future,
+    os::fd::BorrowedFd,
     path::PathBuf,
     sync::{
         atomic::{AtomicU64, Ordering},
@@ -73,6 +79,10 @@ fn maximize_fd_limit() {
 /// This is safe because we are the only writer to the filesystem.
 const TTL: Duration = Duration::MAX;
 
+/// Maximum number of outstanding background requests (async reads, writeback)
+/// the kernel may queue when requests are dispatched concurrently.
+const CONCURRENT_MAX_BACKGROUND: u16 = 64;
+
 /// Options for mounting an agent filesystem via FUSE.
 #[derive(Debug, Clone)]
 pub struct FuseMountOptions {
@@ -91,6 +101,18 @@ pub struct FuseMountOptions {
     pub uid: Option<u32>,
     /// Group ID to report for all files (defaults to current group).
     pub gid: Option<u32>,
+    /// Dispatch each request as an independent task on the Tokio runtime and
+    /// reply from that task, instead of handling requests one at a time on the
+    /// session thread. A slow write or copy-up then no longer stalls unrelated
+    /// lookups on the same mount.
+    pub concurrent: bool,
+    /// Let the kernel read host-backed files opened read-only directly from
+    /// the host file (FUSE passthrough, Linux 6.9+). This replaces writeback
+    /// caching, which the kernel doesn't combine with passthrough.
+    pub passthrough: bool,
+    /// Record every FUSE request (opcode, inode and path, offset, size,
+    /// latency) to this file, for replay with `perf/replay`.
+    pub trace: Option<PathBuf>,
 }
 
 /// Tracks an open file handle
@@ -99,13 +121,234 @@ struct OpenFile {
     file: BoxedFile,
 }
 
+/// Entries fetched from a directory stream per page.
+const READDIR_PAGE: usize = 256;
+
+/// Tracks an open directory handle
+struct OpenDir {
+    /// The directory stream from the filesystem layer.
+    dir: BoxedDirectory,
+    /// Position of the stream, shared by all readdir calls on the handle
+    cursor: tokio::sync::Mutex<DirCursor>,
+}
+
+/// Position of a directory stream in readdir offsets.
+///
+/// Offsets 0 and 1 are "." and "..", so entry `n` of the stream is at `n + 2`.
+#[derive(Default)]
+struct DirCursor {
+    /// Offset of the next entry to return
+    offset: i64,
+    /// Entries read from the stream but not returned yet
+    pending: VecDeque<DirEntry>,
+    /// Whether the stream has no entries left
+    done: bool,
+    /// Entries returned by the current reply, the first at `replied_from`
+    replied: Vec<DirEntry>,
+    /// Offset of the first entry in `replied`
+    replied_from: i64,
+}
+
+impl DirCursor {
+    /// Move to `offset` for a new reply, restarting the stream unless the
+    /// offset is at the cursor or within the previous reply.
+    ///
+    /// The kernel asks again from within a reply whenever the getdents(2)
+    /// buffer fills before the whole reply was copied to it, so both cases
+    /// are served without touching the stream. Only seekdir(3) or an offset
+    /// from an earlier listing costs a rewind and a skip.
+    async fn seek(&mut self, dir: &dyn Directory, offset: i64) -> Result<(), SdkError> {
+        if offset != self.offset && !self.reread(offset) {
+            dir.rewind().await?;
+            self.pending.clear();
+            self.done = false;
+            self.offset = offset.min(2);
+            while self.offset < offset {
+                if self.next(dir).await?.is_none() {
+                    break;
+                }
+                self.offset += 1;
+            }
+        }
+        self.replied.clear();
+        self.replied_from = self.offset.max(2);
+        Ok(())
+    }
+
+    /// Move back to `offset` if the previous reply returned the entries from
+    /// there on, putting them back in front of the pending ones.
+    fn reread(&mut self, offset: i64) -> bool {
+        let from = offset.max(2);
+        if offset > self.offset || from < self.replied_from {
+            return false;
+        }
+        let index = (from - self.replied_from) as usize;
+        for entry in self.replied.drain(index..).rev() {
+            self.pending.push_front(entry);
+        }
+        self.offset = offset;
+        true
+    }
+
+    /// Take the entry at the cursor, fetching the next page when needed.
+    ///
+    /// The caller advances past the entry once the reply has taken it.
+    async fn next(&mut self, dir: &dyn Directory) -> Result<Option<DirEntry>, SdkError> {
+        if self.pending.is_empty() && !self.done {
+            let page = dir.next_entries(READDIR_PAGE).await?;
+            self.done = page.len() < READDIR_PAGE;
+            self.pending.extend(page);
+        }
+        Ok(self.pending.pop_front())
+    }
+
+    /// Step past `entry`, which the current reply returned.
+    fn advance(&mut self, entry: DirEntry) {
+        self.replied.push(entry);
+        self.offset += 1;
+    }
+}
+
+/// Kernel I/O mode of an inode that has open files.
+enum InodeIo {
+    /// Opened through regular FUSE requests only
+    Regular { opens: usize },
+    /// Opened through passthrough to `backing` only
+    Passthrough {
+        backing: Arc<BackingId>,
+        opens: usize,
+    },
+}
+
+/// Tracks the I/O mode of open inodes when passthrough is enabled.
+///
+/// The kernel fails opens that mix passthrough and regular I/O on one inode,
+/// and expects all passthrough opens of an inode to share its backing file.
+#[derive(Default)]
+struct PassthroughInodes {
+    inodes: Mutex<HashMap<u64, InodeIo>>,
+}
+
+impl PassthroughInodes {
+    /// Account for an open of `ino` and pick the backing file to pass it
+    /// through to, if any.
+    ///
+    /// An inode only switches to passthrough when it isn't open otherwise and
+    /// the file is opened read-only with a host descriptor. While it is in
+    /// passthrough mode, writable opens fail with `ETXTBSY`, as writes can't
+    /// reach the file the kernel reads from.
+    fn open(
+        &self,
+        ino: u64,
+        file: &BoxedFile,
+        read_only: bool,
+        reply: &ReplyOpen,
+    ) -> Result<Option<Arc<BackingId>>, libc::c_int> {
+        let mut inodes = self.inodes.lock();
+        match inodes.get_mut(&ino) {
+            Some(InodeIo::Passthrough { .. }) if !read_only => Err(libc::ETXTBSY),
+            Some(InodeIo::Passthrough { backing, opens }) => {
+                *opens += 1;
+                Ok(Some(backing.clone()))
+            }
+            Some(InodeIo::Regular { opens }) => {
+                *opens += 1;
+                Ok(None)
+            }
+            None => {
+                let backing = file
+                    .raw_fd()
+                    .filter(|_| read_only)
+                    .and_then(|fd| {
+                        // SAFETY: `file` owns the descriptor for the whole call
+                        let fd = unsafe { BorrowedFd::borrow_raw(fd) };
+                        reply
+                            .open_backing(fd)
+                            .inspect_err(|e| {
+                                tracing::debug!("FUSE passthrough unavailable: ino={}: {}", ino, e)
+                            })
+                            .ok()
+                    })
+                    .map(Arc::new);
+                let io = match &backing {
+                    Some(backing) => InodeIo::Passthrough {
+                        backing: backing.clone(),
+                        opens: 1,
+                    },
+                    None => InodeIo::Regular { opens: 1 },
+                };
+                inodes.insert(ino, io);
+                Ok(backing)
+            }
+        }
+    }
+
+    /// Account for a regular open of a newly created inode.
+    fn create(&self, ino: u64) {
+        if let InodeIo::Regular { opens } = self
+            .inodes
+            .lock()
+            .entry(ino)
+            .or_insert(InodeIo::Regular { opens: 0 })
+        {
+            *opens += 1;
+        }
+    }
+
+    /// Account for a writable open of `ino` the adapter makes itself, such
+    /// as for a truncate without a file handle. Like writable opens from the
+    /// kernel, it fails with `ETXTBSY` while the inode is in passthrough mode.
+    fn open_writable(&self, ino: u64) -> Result<(), libc::c_int> {
+        match self
+            .inodes
+            .lock()
+            .entry(ino)
+            .or_insert(InodeIo::Regular { opens: 0 })
+        {
+            InodeIo::Passthrough { .. } => Err(libc::ETXTBSY),
+            InodeIo::Regular { opens } => {
+                *opens += 1;
+                Ok(())
+            }
+        }
+    }
+
+    /// Account for a release of `ino`, dropping its backing file with the
+    /// last passthrough open.
+    fn release(&self, ino: u64) {
+        let mut inodes = self.inodes.lock();
+        let remaining = match inodes.get_mut(&ino) {
+            Some(InodeIo::Regular { opens }) | Some(InodeIo::Passthrough { opens, .. }) => {
+                *opens -= 1;
+                *opens
+            }
+            None => return,
+        };
+        if remaining == 0 {
+            inodes.remove(&ino);
+        }
+    }
+}
+
 struct AgentFSFuse {
     fs: Arc<dyn FileSystem>,
     runtime: Runtime,
+    /// Whether requests are spawned onto the runtime or run inline.
+    concurrent: bool,
     /// Maps file handle -> open file state
     open_files: Arc<Mutex<HashMap<u64, OpenFile>>>,
+    /// Maps directory handle -> open directory stream
+    open_dirs: Arc<Mutex<HashMap<u64, Arc<OpenDir>>>>,
     /// Next file handle to allocate
     next_fh: AtomicU64,
+    /// Whether read replies may be spliced into the FUSE device.
+    splice_write: bool,
+    /// Whether spliced read replies may move page cache pages.
+    splice_move: bool,
+    /// Whether read-only opens of host-backed files use kernel passthrough.
+    passthrough: bool,
+    /// I/O mode of open inodes, maintained while passthrough is enabled
+    passthrough_inodes: Arc<PassthroughInodes>,
 }
 
 impl Filesystem for AgentFSFuse {
@@ -119,17 +362,31 @@ impl Filesystem for AgentFSFuse {
     ///   directory, improving performance for parallel file access patterns.
     /// - Cache symlinks: caches readlink responses, avoiding repeated round-trips
     ///   for symlink resolution.
-    /// - No opendir support: skips opendir/releasedir calls since we don't track
-    ///   directory handles, reducing round-trips for directory operations.
+    /// - Splice write/move: lets reads of host-backed files be spliced from the
+    ///   host file into the FUSE device instead of being copied through a buffer.
+    /// - Passthrough (when requested): lets the kernel serve reads of such files
+    ///   itself. It takes the place of writeback caching, which the kernel
+    ///   doesn't support together with passthrough.
+    ///
+    /// With concurrent dispatch the background queue is also enlarged so the
+    /// kernel keeps enough async requests in flight to occupy the runtime.
     fn init(&mut self, _req: &Request, config: &mut KernelConfig) -> Result<(), libc::c_int> {
         tracing::debug!("FUSE::init");
-        let _ = config.add_capabilities(
-            FUSE_ASYNC_READ
-                | FUSE_WRITEBACK_CACHE
-                | FUSE_PARALLEL_DIROPS
-                | FUSE_CACHE_SYMLINKS
-                | FUSE_NO_OPENDIR_SUPPORT,
-        );
+        self.passthrough = self.passthrough
+            && config.add_capabilities(FUSE_PASSTHROUGH).is_ok()
+            && config.set_max_stack_depth(1).is_ok();
+        let cache = if self.passthrough {
+            0
+        } else {
+            FUSE_WRITEBACK_CACHE
+        };
+        let _ = config
+            .add_capabilities(FUSE_ASYNC_READ | cache | FUSE_PARALLEL_DIROPS | FUSE_CACHE_SYMLINKS);
+        self.splice_write = config.add_capabilities(FUSE_SPLICE_WRITE).is_ok();
+        self.splice_move = self.splice_write && config.add_capabilities(FUSE_SPLICE_MOVE).is_ok();
+        if self.concurrent {
+            let _ = config.set_max_background(CONCURRENT_MAX_BACKGROUND);
+        }
         Ok(())
     }
 
@@ -150,18 +407,16 @@ impl Filesystem for AgentFSFuse {
 
         let fs = self.fs.clone();
         let name_owned = name_str.to_string();
-        let result = self
-            .runtime
-            .block_on(async move { fs.lookup(parent as i64, &name_owned).await });
-
-        match result {
-            Ok(Some(stats)) => {
-                let attr = fillattr(&stats);
-                reply.entry(&TTL, &attr, 0);
+        self.dispatch(async move {
+            match fs.lookup(parent as i64, &name_owned).await {
+                Ok(Some(stats)) => {
+                    let attr = fillattr(&stats);
+                    reply.entry(&TTL, &attr, 0);
+                }
+                Ok(None) => reply.error(libc::ENOENT),
+                Err(e) => reply.error(error_to_errno(&e)),
             }
-            Ok(None) => reply.error(libc::ENOENT),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        });
     }
 
     /// Retrieves file attributes for a given inode.
@@ -172,15 +427,13 @@ impl Filesystem for AgentFSFuse {
         tracing::debug!("FUSE::getattr: ino={}", ino);
 
         let fs = self.fs.clone();
-        let result = self
-            .runtime
-            .block_on(async move { fs.getattr(ino as i64).await });
-
-        match result {
-            Ok(Some(stats)) => reply.attr(&TTL, &fillattr(&stats)),
-            Ok(None) => reply.error(libc::ENOENT),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        self.dispatch(async move {
+            match fs.getattr(ino as i64).await {
+                Ok(Some(stats)) => reply.attr(&TTL, &fillattr(&stats)),
+                Ok(None) => reply.error(libc::ENOENT),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Reads the target of a symbolic link.
@@ -191,15 +444,13 @@ impl Filesystem for AgentFSFuse {
         tracing::debug!("FUSE::readlink: ino={}", ino);
 
         let fs = self.fs.clone();
-        let result = self
-            .runtime
-            .block_on(async move { fs.readlink(ino as i64).await });
-
-        match result {
-            Ok(Some(target)) => reply.data(target.as_bytes()),
-            Ok(None) => reply.error(libc::ENOENT),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        self.dispatch(async move {
+            match fs.readlink(ino as i64).await {
+                Ok(Some(target)) => reply.data(target.as_bytes()),
+                Ok(None) => reply.error(libc::ENOENT),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Sets file attributes, handling truncate and chmod operations.
@@ -233,278 +484,261 @@ impl Filesystem for AgentFSFuse {
             size
         );
 
-        // Handle chmod
-        if let Some(new_mode) = mode {
-            let fs = self.fs.clone();
-            let result = self
-                .runtime
-                .block_on(async move { fs.chmod(ino as i64, new_mode).await });
-
-            if let Err(e) = result {
-                reply.error(error_to_errno(&e));
-                return;
+        // Resolve the file handle up front (ftruncate) so a stale handle fails
+        // before any attribute has been changed.
+        let truncate_file = match (size, fh) {
+            (Some(_), Some(fh)) => {
+                let open_files = self.open_files.lock();
+                match open_files.get(&fh) {
+                    Some(open_file) => Some(open_file.file.clone()),
+                    None => {
+                        reply.error(libc::EBADF);
+                        return;
+                    }
+                }
             }
-        }
-
-        // Handle chown
-        if uid.is_some() || gid.is_some() {
-            let fs = self.fs.clone();
-            let result = self
-                .runtime
-                .block_on(async move { fs.chown(ino as i64, uid, gid).await });
-
-            if let Err(e) = result {
-                reply.error(error_to_errno(&e));
-                return;
+            _ => None,
+        };
+        // Truncating without a handle opens the file for writing, which keeps
+        // the inode out of passthrough mode until it is done
+        let passthrough = match (size, fh) {
+            (Some(_), None) if self.passthrough => {
+                if let Err(errno) = self.passthrough_inodes.open_writable(ino) {
+                    reply.error(errno);
+                    return;
+                }
+                Some(self.passthrough_inodes.clone())
             }
-        }
+            _ => None,
+        };
 
-        // Handle truncate
-        if let Some(new_size) = size {
-            let result = if let Some(fh) = fh {
-                // Use file handle if available (ftruncate)
-                let file = {
-                    let open_files = self.open_files.lock();
-                    open_files.get(&fh).map(|f| f.file.clone())
-                };
+        let new_atime = atime.map(time_or_now_to_change);
+        let new_mtime = mtime.map(time_or_now_to_change);
 
-                if let Some(file) = file {
-                    self.runtime
-                        .block_on(async move { file.truncate(new_size).await })
-                } else {
-                    reply.error(libc::EBADF);
-                    return;
+        let fs = self.fs.clone();
+        self.dispatch(async move {
+            let result: Result<Option<Stats>, SdkError> = async move {
+                // Handle chmod
+                if let Some(new_mode) = mode {
+                    fs.chmod(ino as i64, new_mode).await?;
                 }
-            } else {
-                // Open file and truncate via file handle
-                let fs = self.fs.clone();
-                self.runtime.block_on(async move {
-                    let file = fs.open(ino as i64, libc::O_RDWR).await?;
-                    file.truncate(new_size).await
-                })
-            };
 
-            if let Err(e) = result {
-                reply.error(error_to_errno(&e));
-                return;
-            }
-        }
+                // Handle chown
+                if uid.is_some() || gid.is_some() {
+                    fs.chown(ino as i64, uid, gid).await?;
+                }
 
-        // Handle atime/mtime changes (utimensat)
-        if atime.is_some() || mtime.is_some() {
-            let new_atime = match atime {
-                Some(crate::fuser::TimeOrNow::SpecificTime(t)) => {
-                    let dur = t.duration_since(UNIX_EPOCH).unwrap_or_default();
-                    TimeChange::Set(dur.as_secs() as i64, dur.subsec_nanos())
+                // Handle truncate
+                if let Some(new_size) = size {
+                    match truncate_file {
+                        Some(file) => file.truncate(new_size).await?,
+                        None => {
+                            // Open file and truncate via file handle
+                            let file = fs.open(ino as i64, libc::O_RDWR).await?;
+                            file.truncate(new_size).await?;
+                        }
+                    }
                 }
-                Some(crate::fuser::TimeOrNow::Now) => TimeChange::Now,
-                None => TimeChange::Omit,
-            };
-            let new_mtime = match mtime {
-                Some(crate::fuser::TimeOrNow::SpecificTime(t)) => {
-                    let dur = t.duration_since(UNIX_EPOCH).unwrap_or_default();
-                    TimeChange::Set(dur.as_secs() as i64, dur.subsec_nanos())
+
+                // Handle atime/mtime changes (utimensat)
+                if new_atime.is_some() || new_mtime.is_some() {
+                    fs.utimens(
+                        ino as i64,
+                        new_atime.unwrap_or(TimeChange::Omit),
+                        new_mtime.unwrap_or(TimeChange::Omit),
+                    )
+                    .await?;
                 }
-                Some(crate::fuser::TimeOrNow::Now) => TimeChange::Now,
-                None => TimeChange::Omit,
-            };
-            let fs = self.fs.clone();
-            let result = self
-                .runtime
-                .block_on(async move { fs.utimens(ino as i64, new_atime, new_mtime).await });
-            if let Err(e) = result {
-                reply.error(error_to_errno(&e));
-                return;
+
+                // Return updated attributes
+                fs.getattr(ino as i64).await
+            }
+            .await;
+            if let Some(inodes) = passthrough {
+                inodes.release(ino);
             }
-        }
 
-        // Return updated attributes
-        let fs = self.fs.clone();
-        let result = self
-            .runtime
-            .block_on(async move { fs.getattr(ino as i64).await });
-
-        match result {
-            Ok(Some(stats)) => reply.attr(&TTL, &fillattr(&stats)),
-            Ok(None) => reply.error(libc::ENOENT),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+            match result {
+                Ok(Some(stats)) => reply.attr(&TTL, &fillattr(&stats)),
+                Ok(None) => reply.error(libc::ENOENT),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     // ─────────────────────────────────────────────────────────────
     // Directory Operations
     // ─────────────────────────────────────────────────────────────
 
-    /// Reads directory entries for the given inode.
+    /// Opens a directory stream for the given inode.
     ///
-    /// Returns "." and ".." entries followed by the directory contents.
-    /// Each entry's inode is cached for subsequent lookups.
+    /// The stream's position is kept with the handle, so each readdir on it
+    /// picks up where the previous one stopped instead of listing the whole
+    /// directory again.
+    fn opendir(&mut self, _req: &Request, ino: u64, _flags: i32, reply: ReplyOpen) {
+        tracing::debug!("FUSE::opendir: ino={}", ino);
+
+        let fs = self.fs.clone();
+        let open_dirs = self.open_dirs.clone();
+        let fh = self.alloc_fh();
+        self.dispatch(async move {
+            match fs.opendir(ino as i64).await {
+                Ok(Some(dir)) => {
+                    let dir = OpenDir {
+                        dir,
+                        cursor: tokio::sync::Mutex::new(DirCursor::default()),
+                    };
+                    open_dirs.lock().insert(fh, Arc::new(dir));
+                    reply.opened(fh, 0);
+                }
+                Ok(None) => reply.error(libc::ENOENT),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
+    }
+
+    /// Reads directory entries for the given inode.
     ///
-    /// Uses readdir_plus to fetch entries with stats in a single query,
-    /// avoiding N+1 database queries.
+    /// Returns "." and ".." entries followed by the directory contents,
+    /// fetched from the handle's stream a page at a time.
     fn readdir(
         &mut self,
         _req: &Request,
         ino: u64,
-        _fh: u64,
+        fh: u64,
         offset: i64,
         mut reply: ReplyDirectory,
     ) {
         tracing::debug!("FUSE::readdir: ino={}, offset={}", ino, offset);
+        let Some(dir) = self.get_dir(fh) else {
+            reply.error(libc::EBADF);
+            return;
+        };
 
-        let fs = self.fs.clone();
-        let entries_result = self
-            .runtime
-            .block_on(async move { fs.readdir_plus(ino as i64).await });
-
-        let entries = match entries_result {
-            Ok(Some(entries)) => entries,
-            Ok(None) => {
-                reply.error(libc::ENOENT);
-                return;
-            }
-            Err(e) => {
+        self.dispatch(async move {
+            let mut cursor = dir.cursor.lock().await;
+            if let Err(e) = cursor.seek(dir.dir.as_ref(), offset).await {
                 reply.error(error_to_errno(&e));
                 return;
             }
-        };
-
-        // Determine parent inode for ".." entry
-        // In the inode-based API we don't track parent relationships directly.
-        // The kernel tracks this information and will resolve ".." correctly.
-        // We use 1 (root) as a fallback which is safe since the kernel
-        // won't actually use this value for path resolution.
-        let parent_ino = 1u64;
-
-        let mut all_entries = vec![
-            (ino, FileType::Directory, "."),
-            (parent_ino, FileType::Directory, ".."),
-        ];
-
-        // Process entries with stats already available (no N+1 queries!)
-        for entry in &entries {
-            let kind = if entry.stats.is_directory() {
-                FileType::Directory
-            } else if entry.stats.is_symlink() {
-                FileType::Symlink
-            } else {
-                FileType::RegularFile
-            };
 
-            all_entries.push((entry.stats.ino as u64, kind, entry.name.as_str()));
-        }
+            // In the inode-based API we don't track parent relationships directly.
+            // The kernel tracks this information and will resolve ".." correctly.
+            // We use 1 (root) as a fallback which is safe since the kernel
+            // won't actually use this value for path resolution.
+            while cursor.offset < 2 {
+                let (entry_ino, name) = if cursor.offset == 0 {
+                    (ino, ".")
+                } else {
+                    (1u64, "..")
+                };
+                if reply.add(entry_ino, cursor.offset + 1, FileType::Directory, name) {
+                    reply.ok();
+                    return;
+                }
+                cursor.offset += 1;
+            }
 
-        for (i, entry) in all_entries.iter().enumerate().skip(offset as usize) {
-            if reply.add(entry.0, (i + 1) as i64, entry.1, entry.2) {
-                break;
+            loop {
+                let entry = match cursor.next(dir.dir.as_ref()).await {
+                    Ok(Some(entry)) => entry,
+                    Ok(None) => break,
+                    Err(e) => {
+                        reply.error(error_to_errno(&e));
+                        return;
+                    }
+                };
+                let kind = if entry.stats.is_directory() {
+                    FileType::Directory
+                } else if entry.stats.is_symlink() {
+                    FileType::Symlink
+                } else {
+                    FileType::RegularFile
+                };
+                if reply.add(entry.stats.ino as u64, cursor.offset + 1, kind, &entry.name) {
+                    cursor.pending.push_front(entry);
+                    break;
+                }
+                cursor.advance(entry);
             }
-        }
-        reply.ok();
+            reply.ok();
+        });
     }
 
     /// Reads directory entries with full attributes for the given inode.
     ///
     /// This is an optimized version that returns both directory entries and
     /// their attributes in a single call, reducing kernel/userspace round trips.
-    /// Uses readdir_plus to fetch entries with stats in a single database query.
+    /// Entries come from the handle's stream with their stats already attached.
     fn readdirplus(
         &mut self,
         _req: &Request,
         ino: u64,
-        _fh: u64,
+        fh: u64,
         offset: i64,
         mut reply: ReplyDirectoryPlus,
     ) {
         tracing::debug!("FUSE::readdirplus: ino={}, offset={}", ino, offset);
+        let Some(dir) = self.get_dir(fh) else {
+            reply.error(libc::EBADF);
+            return;
+        };
 
         let fs = self.fs.clone();
-        let entries_result = self
-            .runtime
-            .block_on(async move { fs.readdir_plus(ino as i64).await });
-
-        let entries = match entries_result {
-            Ok(Some(entries)) => entries,
-            Ok(None) => {
-                reply.error(libc::ENOENT);
-                return;
-            }
-            Err(e) => {
+        self.dispatch(async move {
+            let mut cursor = dir.cursor.lock().await;
+            if let Err(e) = cursor.seek(dir.dir.as_ref(), offset).await {
                 reply.error(error_to_errno(&e));
                 return;
             }
-        };
-
-        // Get current directory stats for "."
-        let fs = self.fs.clone();
-        let dir_stats = self
-            .runtime
-            .block_on(async move { fs.getattr(ino as i64).await })
-            .ok()
-            .flatten();
-
-        // Determine parent inode and stats for ".." entry
-        // In the inode-based API we don't track parent relationships directly.
-        // Use root's stats for ".." as a fallback - the kernel handles proper ".." resolution.
-        let (parent_ino, parent_stats) = if ino == 1 {
-            (1u64, dir_stats.clone()) // Root's parent is itself
-        } else {
-            // Use root inode as fallback for parent
-            let fs = self.fs.clone();
-            let parent_stats = self
-                .runtime
-                .block_on(async move { fs.getattr(1).await })
-                .ok()
-                .flatten();
-            (1u64, parent_stats)
-        };
-
-        // Build the entries list with full attributes
-        let mut offset_counter = 0i64;
-
-        // Add "." entry
-        if offset <= offset_counter {
-            if let Some(ref stats) = dir_stats {
-                let attr = fillattr(stats);
-                if reply.add(ino, offset_counter + 1, ".", &TTL, &attr, 0) {
-                    reply.ok();
-                    return;
-                }
-            }
-        }
-        offset_counter += 1;
 
-        // Add ".." entry
-        if offset <= offset_counter {
-            if let Some(ref stats) = parent_stats {
-                let attr = fillattr(stats);
-                if reply.add(parent_ino, offset_counter + 1, "..", &TTL, &attr, 0) {
-                    reply.ok();
-                    return;
+            // Use the directory's stats for "." and root's stats for ".." as a
+            // fallback - the kernel handles proper ".." resolution. They are
+            // only looked up when this call returns them.
+            while cursor.offset < 2 {
+                let entry_ino = if cursor.offset == 0 { ino } else { 1u64 };
+                let name = if cursor.offset == 0 { "." } else { ".." };
+                if let Some(stats) = fs.getattr(entry_ino as i64).await.ok().flatten() {
+                    let attr = fillattr(&stats);
+                    if reply.add(entry_ino, cursor.offset + 1, name, &TTL, &attr, 0) {
+                        reply.ok();
+                        return;
+                    }
                 }
+                cursor.offset += 1;
             }
-        }
-        offset_counter += 1;
 
-        // Add directory entries with their attributes
-        for entry in &entries {
-            if offset <= offset_counter {
+            loop {
+                let entry = match cursor.next(dir.dir.as_ref()).await {
+                    Ok(Some(entry)) => entry,
+                    Ok(None) => break,
+                    Err(e) => {
+                        reply.error(error_to_errno(&e));
+                        return;
+                    }
+                };
                 let attr = fillattr(&entry.stats);
-
                 if reply.add(
                     entry.stats.ino as u64,
-                    offset_counter + 1,
+                    cursor.offset + 1,
                     &entry.name,
                     &TTL,
                     &attr,
                     0,
                 ) {
-                    reply.ok();
-                    return;
+                    cursor.pending.push_front(entry);
+                    break;
                 }
+                cursor.advance(entry);
             }
-            offset_counter += 1;
-        }
+            reply.ok();
+        });
+    }
 
+    /// Releases an open directory handle.
+    fn releasedir(&mut self, _req: &Request, _ino: u64, fh: u64, _flags: i32, reply: ReplyEmpty) {
+        tracing::debug!("FUSE::releasedir: fh={}", fh);
+        self.open_dirs.lock().remove(&fh);
         reply.ok();
     }
 
@@ -539,20 +773,20 @@ impl Filesystem for AgentFSFuse {
         let gid = req.gid();
         let fs = self.fs.clone();
         let name_owned = name_str.to_string();
-        let result = self.runtime.block_on(async move {
-            fs.mknod(parent as i64, &name_owned, mode, rdev as u64, uid, gid)
+        self.dispatch(async move {
+            match fs
+                .mknod(parent as i64, &name_owned, mode, rdev as u64, uid, gid)
                 .await
-        });
-
-        match result {
-            Ok(stats) => {
-                let attr = fillattr(&stats);
-                reply.entry(&TTL, &attr, 0);
-            }
-            Err(e) => {
-                reply.error(error_to_errno(&e));
+            {
+                Ok(stats) => {
+                    let attr = fillattr(&stats);
+                    reply.entry(&TTL, &attr, 0);
+                }
+                Err(e) => {
+                    reply.error(error_to_errno(&e));
+                }
             }
-        }
+        });
     }
 
     /// Creates a new directory.
@@ -584,19 +818,17 @@ impl Filesystem for AgentFSFuse {
         let gid = req.gid();
         let fs = self.fs.clone();
         let name_owned = name_str.to_string();
-        let result = self
-            .runtime
-            .block_on(async move { fs.mkdir(parent as i64, &name_owned, mode, uid, gid).await });
-
-        match result {
-            Ok(stats) => {
-                let attr = fillattr(&stats);
-                reply.entry(&TTL, &attr, 0);
-            }
-            Err(e) => {
-                reply.error(error_to_errno(&e));
+        self.dispatch(async move {
+            match fs.mkdir(parent as i64, &name_owned, mode, uid, gid).await {
+                Ok(stats) => {
+                    let attr = fillattr(&stats);
+                    reply.entry(&TTL, &attr, 0);
+                }
+                Err(e) => {
+                    reply.error(error_to_errno(&e));
+                }
             }
-        }
+        });
     }
 
     /// Removes an empty directory.
@@ -612,18 +844,17 @@ impl Filesystem for AgentFSFuse {
         };
 
         let fs = self.fs.clone();
+        let notifier = req.deferred_notifier().clone();
         let name_owned = name_str.to_string();
-        let result = self
-            .runtime
-            .block_on(async move { fs.rmdir(parent as i64, &name_owned).await });
-
-        match result {
-            Ok(()) => {
-                reply.ok();
-                req.deferred_notifier().inval_entry(parent, name);
+        self.dispatch(async move {
+            match fs.rmdir(parent as i64, &name_owned).await {
+                Ok(()) => {
+                    reply.ok();
+                    notifier.inval_entry(parent, OsStr::new(&name_owned));
+                }
+                Err(e) => reply.error(error_to_errno(&e)),
             }
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        });
     }
 
     // ─────────────────────────────────────────────────────────────
@@ -660,25 +891,28 @@ impl Filesystem for AgentFSFuse {
         let uid = req.uid();
         let gid = req.gid();
         let fs = self.fs.clone();
+        let open_files = self.open_files.clone();
+        let passthrough = self.passthrough.then(|| self.passthrough_inodes.clone());
+        let fh = self.alloc_fh();
         let name_owned = name_str.to_string();
-        let result = self.runtime.block_on(async move {
-            fs.create_file(parent as i64, &name_owned, mode, uid, gid)
+        self.dispatch(async move {
+            match fs
+                .create_file(parent as i64, &name_owned, mode, uid, gid)
                 .await
-        });
-
-        match result {
-            Ok((stats, file)) => {
-                let attr = fillattr(&stats);
-
-                let fh = self.alloc_fh();
-                self.open_files.lock().insert(fh, OpenFile { file });
-
-                reply.created(&TTL, &attr, 0, fh, 0);
-            }
-            Err(e) => {
-                reply.error(error_to_errno(&e));
+            {
+                Ok((stats, file)) => {
+                    let attr = fillattr(&stats);
+                    if let Some(inodes) = passthrough {
+                        inodes.create(attr.ino);
+                    }
+                    open_files.lock().insert(fh, OpenFile { file });
+                    reply.created(&TTL, &attr, 0, fh, 0);
+                }
+                Err(e) => {
+                    reply.error(error_to_errno(&e));
+                }
             }
-        }
+        });
     }
 
     /// Creates a symbolic link.
@@ -714,20 +948,20 @@ impl Filesystem for AgentFSFuse {
         let fs = self.fs.clone();
         let name_owned = name_str.to_string();
         let target_owned = target_str.to_string();
-        let result = self.runtime.block_on(async move {
-            fs.symlink(parent as i64, &name_owned, &target_owned, uid, gid)
+        self.dispatch(async move {
+            match fs
+                .symlink(parent as i64, &name_owned, &target_owned, uid, gid)
                 .await
-        });
-
-        match result {
-            Ok(stats) => {
-                let attr = fillattr(&stats);
-                reply.entry(&TTL, &attr, 0);
-            }
-            Err(e) => {
-                reply.error(error_to_errno(&e));
+            {
+                Ok(stats) => {
+                    let attr = fillattr(&stats);
+                    reply.entry(&TTL, &attr, 0);
+                }
+                Err(e) => {
+                    reply.error(error_to_errno(&e));
+                }
             }
-        }
+        });
     }
 
     /// Creates a hard link.
@@ -756,19 +990,17 @@ impl Filesystem for AgentFSFuse {
 
         let fs = self.fs.clone();
         let name_owned = name_str.to_string();
-        let result = self
-            .runtime
-            .block_on(async move { fs.link(ino as i64, newparent as i64, &name_owned).await });
-
-        match result {
-            Ok(stats) => {
-                let attr = fillattr(&stats);
-                reply.entry(&TTL, &attr, 0);
-            }
-            Err(e) => {
-                reply.error(error_to_errno(&e));
+        self.dispatch(async move {
+            match fs.link(ino as i64, newparent as i64, &name_owned).await {
+                Ok(stats) => {
+                    let attr = fillattr(&stats);
+                    reply.entry(&TTL, &attr, 0);
+                }
+                Err(e) => {
+                    reply.error(error_to_errno(&e));
+                }
             }
-        }
+        });
     }
 
     /// Removes a file (unlinks it from the directory).
@@ -783,18 +1015,17 @@ impl Filesystem for AgentFSFuse {
         };
 
         let fs = self.fs.clone();
+        let notifier = req.deferred_notifier().clone();
         let name_owned = name_str.to_string();
-        let result = self
-            .runtime
-            .block_on(async move { fs.unlink(parent as i64, &name_owned).await });
-
-        match result {
-            Ok(()) => {
-                reply.ok();
-                req.deferred_notifier().inval_entry(parent, name);
+        self.dispatch(async move {
+            match fs.unlink(parent as i64, &name_owned).await {
+                Ok(()) => {
+                    reply.ok();
+                    notifier.inval_entry(parent, OsStr::new(&name_owned));
+                }
+                Err(e) => reply.error(error_to_errno(&e)),
             }
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        });
     }
 
     /// Renames a file or directory.
@@ -829,27 +1060,28 @@ impl Filesystem for AgentFSFuse {
         };
 
         let fs = self.fs.clone();
+        let notifier = req.deferred_notifier().clone();
         let old_name_owned = old_name_str.to_string();
         let new_name_owned = new_name_str.to_string();
-        let result = self.runtime.block_on(async move {
-            fs.rename(
-                parent as i64,
-                &old_name_owned,
-                newparent as i64,
-                &new_name_owned,
-            )
-            .await
-        });
-
-        match result {
-            Ok(()) => {
-                reply.ok();
-                let dn = req.deferred_notifier();
-                dn.inval_entry(parent, name);
-                dn.inval_entry(newparent, newname);
+        self.dispatch(async move {
+            let result = fs
+                .rename(
+                    parent as i64,
+                    &old_name_owned,
+                    newparent as i64,
+                    &new_name_owned,
+                )
+                .await;
+
+            match result {
+                Ok(()) => {
+                    reply.ok();
+                    notifier.inval_entry(parent, OsStr::new(&old_name_owned));
+                    notifier.inval_entry(newparent, OsStr::new(&new_name_owned));
+                }
+                Err(e) => reply.error(error_to_errno(&e)),
             }
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        });
     }
 
     // ─────────────────────────────────────────────────────────────
@@ -859,25 +1091,47 @@ impl Filesystem for AgentFSFuse {
     /// Opens a file for reading or writing.
     ///
     /// Allocates a file handle and opens the file in the filesystem layer.
+    /// With passthrough enabled, read-only opens of host-backed files are
+    /// handed to the kernel, which then reads the host file directly.
     fn open(&mut self, _req: &Request, ino: u64, flags: i32, reply: ReplyOpen) {
         tracing::debug!("FUSE::open: ino={}, flags={}", ino, flags);
 
         let fs = self.fs.clone();
-        let result = self
-            .runtime
-            .block_on(async move { fs.open(ino as i64, flags).await });
-
-        match result {
-            Ok(file) => {
-                let fh = self.alloc_fh();
-                self.open_files.lock().insert(fh, OpenFile { file });
-                reply.opened(fh, 0);
+        let open_files = self.open_files.clone();
+        let passthrough = self.passthrough.then(|| self.passthrough_inodes.clone());
+        let fh = self.alloc_fh();
+        self.dispatch(async move {
+            match fs.open(ino as i64, flags).await {
+                Ok(file) => {
+                    let backing = match passthrough {
+                        Some(inodes) => {
+                            let read_only = flags & libc::O_ACCMODE == libc::O_RDONLY
+                                && flags & libc::O_TRUNC == 0;
+                            match inodes.open(ino, &file, read_only, &reply) {
+                                Ok(backing) => backing,
+                                Err(errno) => {
+                                    reply.error(errno);
+                                    return;
+                                }
+                            }
+                        }
+                        None => None,
+                    };
+                    open_files.lock().insert(fh, OpenFile { file });
+                    match backing {
+                        Some(backing) => reply.opened_passthrough(fh, 0, &backing),
+                        None => reply.opened(fh, 0),
+                    }
+                }
+                Err(e) => reply.error(error_to_errno(&e)),
             }
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        });
     }
 
     /// Reads data using the file handle.
+    ///
+    /// Handles backed by a host file are spliced straight into the reply when
+    /// the kernel supports it; everything else is read through `pread()`.
     fn read(
         &mut self,
         _req: &Request,
@@ -890,23 +1144,33 @@ impl Filesystem for AgentFSFuse {
         reply: ReplyData,
     ) {
         tracing::debug!("FUSE::read: fh={}, offset={}, size={}", fh, offset, size);
-        let file = {
-            let open_files = self.open_files.lock();
-            let Some(open_file) = open_files.get(&fh) else {
-                reply.error(libc::EBADF);
-                return;
-            };
-            open_file.file.clone()
+        let Some(file) = self.get_file(fh) else {
+            reply.error(libc::EBADF);
+            return;
         };
 
-        let result = self
-            .runtime
-            .block_on(async move { file.pread(offset as u64, size as u64).await });
-
-        match result {
-            Ok(data) => reply.data(&data),
-            Err(e) => reply.error(error_to_errno(&e)),
+        if self.splice_write {
+            if let Some(fd) = file.raw_fd() {
+                let move_pages = self.splice_move;
+                self.dispatch(async move {
+                    let _ = tokio::task::spawn_blocking(move || {
+                        // SAFETY: `file` owns the descriptor and outlives the borrow
+                        let borrowed = unsafe { BorrowedFd::borrow_raw(fd) };
+                        reply.data_from_fd(borrowed, offset, size as usize, move_pages);
+                        drop(file);
+                    })
+                    .await;
+                });
+                return;
+            }
         }
+
+        self.dispatch(async move {
+            match file.pread(offset as u64, size as u64).await {
+                Ok(data) => reply.data(&data),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Writes data using the file handle.
@@ -928,38 +1192,40 @@ impl Filesystem for AgentFSFuse {
             offset,
             data.len()
         );
-        let file = {
-            let open_files = self.open_files.lock();
-            let Some(open_file) = open_files.get(&fh) else {
-                reply.error(libc::EBADF);
-                return;
-            };
-            open_file.file.clone()
+        let Some(file) = self.get_file(fh) else {
+            reply.error(libc::EBADF);
+            return;
         };
 
+        // The request buffer is reused by the session loop, so the payload must
+        // be owned by the task.
         let data_len = data.len();
         let data_vec = data.to_vec();
-        let result = self
-            .runtime
-            .block_on(async move { file.pwrite(offset as u64, &data_vec).await });
-
-        match result {
-            Ok(()) => reply.written(data_len as u32),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        self.dispatch(async move {
+            match file.pwrite(offset as u64, &data_vec).await {
+                Ok(()) => reply.written(data_len as u32),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Flushes data to the backend storage.
     ///
-    /// Since writes go directly to the database, this is a no-op.
+    /// Called on every close(2) of a file descriptor, so this commits writes
+    /// buffered by the handle without forcing them to stable storage.
     fn flush(&mut self, _req: &Request, _ino: u64, fh: u64, _lock_owner: u64, reply: ReplyEmpty) {
         tracing::debug!("FUSE::flush: fh={}", fh);
-        let open_files = self.open_files.lock();
-        if open_files.contains_key(&fh) {
-            reply.ok();
-        } else {
+        let Some(file) = self.get_file(fh) else {
             reply.error(libc::EBADF);
-        }
+            return;
+        };
+
+        self.dispatch(async move {
+            match file.flush().await {
+                Ok(()) => reply.ok(),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Synchronizes file data to persistent storage using the file handle.
@@ -968,33 +1234,29 @@ impl Filesystem for AgentFSFuse {
     /// file exists in, avoiding errors when a file only exists in one layer.
     fn fsync(&mut self, _req: &Request, _ino: u64, fh: u64, _datasync: bool, reply: ReplyEmpty) {
         tracing::debug!("FUSE::fsync: fh={}", fh);
-        let file = {
-            let open_files = self.open_files.lock();
-            match open_files.get(&fh) {
-                Some(open_file) => open_file.file.clone(),
-                None => {
-                    reply.error(libc::EBADF);
-                    return;
-                }
-            }
+        let Some(file) = self.get_file(fh) else {
+            reply.error(libc::EBADF);
+            return;
         };
 
-        let result = self.runtime.block_on(async move { file.fsync().await });
-
-        match result {
-            Ok(()) => reply.ok(),
-            Err(e) => reply.error(error_to_errno(&e)),
-        }
+        self.dispatch(async move {
+            match file.fsync().await {
+                Ok(()) => reply.ok(),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Releases (closes) an open file handle.
     ///
-    /// Removes the file handle from the open files table.
-    /// Since writes go directly to the database, no flushing is needed.
+    /// Removes the file handle from the open files table and commits any
+    /// writes the handle still buffers.
+    /// In-flight requests on the handle hold their own reference to the file,
+    /// so removing it here never races with a concurrent read or write.
     fn release(
         &mut self,
         _req: &Request,
-        _ino: u64,
+        ino: u64,
         fh: u64,
         _flags: i32,
         _lock_owner: Option<u64>,
@@ -1002,8 +1264,20 @@ impl Filesystem for AgentFSFuse {
         reply: ReplyEmpty,
     ) {
         tracing::debug!("FUSE::release: fh={}", fh);
-        self.open_files.lock().remove(&fh);
-        reply.ok();
+        let Some(file) = self.open_files.lock().remove(&fh) else {
+            reply.ok();
+            return;
+        };
+        if self.passthrough {
+            self.passthrough_inodes.release(ino);
+        }
+
+        self.dispatch(async move {
+            match file.file.flush().await {
+                Ok(()) => reply.ok(),
+                Err(e) => reply.error(error_to_errno(&e)),
+            }
+        });
     }
 
     /// Returns filesystem statistics.
@@ -1016,31 +1290,31 @@ impl Filesystem for AgentFSFuse {
         const MAX_NAMELEN: u32 = 255;
 
         let fs = self.fs.clone();
-        let result = self.runtime.block_on(async move { fs.statfs().await });
-
-        let (used_blocks, used_inodes) = match result {
-            Ok(stats) => {
-                let used_blocks = stats.bytes_used.div_ceil(BLOCK_SIZE);
-                (used_blocks, stats.inodes)
-            }
-            Err(_) => (0, 1), // Fallback: just root inode
-        };
+        self.dispatch(async move {
+            let (used_blocks, used_inodes) = match fs.statfs().await {
+                Ok(stats) => {
+                    let used_blocks = stats.bytes_used.div_ceil(BLOCK_SIZE);
+                    (used_blocks, stats.inodes)
+                }
+                Err(_) => (0, 1), // Fallback: just root inode
+            };
 
-        // Report a large virtual capacity so tools don't think we're out of space
-        const TOTAL_BLOCKS: u64 = 1024 * 1024 * 1024; // ~4TB virtual size
-        let free_blocks = TOTAL_BLOCKS.saturating_sub(used_blocks);
-        let free_inodes = TOTAL_INODES.saturating_sub(used_inodes);
-
-        reply.statfs(
-            TOTAL_BLOCKS,
-            free_blocks,
-            free_blocks,
-            TOTAL_INODES,
-            free_inodes,
-            BLOCK_SIZE as u32,
-            MAX_NAMELEN,       // namelen: maximum filename length
-            BLOCK_SIZE as u32, // frsize: fragment size
-        );
+            // Report a large virtual capacity so tools don't think we're out of space
+            const TOTAL_BLOCKS: u64 = 1024 * 1024 * 1024; // ~4TB virtual size
+            let free_blocks = TOTAL_BLOCKS.saturating_sub(used_blocks);
+            let free_inodes = TOTAL_INODES.saturating_sub(used_inodes);
+
+            reply.statfs(
+                TOTAL_BLOCKS,
+                free_blocks,
+                free_blocks,
+                TOTAL_INODES,
+                free_inodes,
+                BLOCK_SIZE as u32,
+                MAX_NAMELEN,       // namelen: maximum filename length
+                BLOCK_SIZE as u32, // frsize: fragment size
+            );
+        });
     }
 
     // ─────────────────────────────────────────────────────────────
@@ -1052,10 +1326,14 @@ impl Filesystem for AgentFSFuse {
     /// Called when the kernel removes an inode from its cache. For passthrough
     /// filesystems (like HostFS), this allows releasing O_PATH file descriptors
     /// that were cached for the inode, preventing file descriptor exhaustion.
+    ///
+    /// The kernel only forgets lookups it has already received replies for, so
+    /// running this concurrently with other requests cannot drop a reference
+    /// that an in-flight lookup is about to hand out.
     fn forget(&mut self, _req: &Request, ino: u64, nlookup: u64) {
         tracing::debug!("FUSE::forget: ino={}, nlookup={}", ino, nlookup);
         let fs = self.fs.clone();
-        self.runtime.block_on(async move {
+        self.dispatch(async move {
             fs.forget(ino as i64, nlookup).await;
         });
     }
@@ -1068,7 +1346,7 @@ impl Filesystem for AgentFSFuse {
         let fs = self.fs.clone();
         let nodes_vec: Vec<(i64, u64)> =
             nodes.iter().map(|n| (n.nodeid as i64, n.nlookup)).collect();
-        self.runtime.block_on(async move {
+        self.dispatch(async move {
             for (ino, nlookup) in nodes_vec {
                 fs.forget(ino, nlookup).await;
             }
@@ -1080,13 +1358,38 @@ impl AgentFSFuse {
     /// Create a new FUSE filesystem adapter wrapping a FileSystem instance.
     ///
     /// The provided Tokio runtime is used to execute async FileSystem operations
-    /// from within synchronous FUSE callbacks via `block_on`.
-    fn new(fs: Arc<dyn FileSystem>, runtime: Runtime) -> Self {
+    /// from within synchronous FUSE callbacks. When `concurrent` is set, each
+    /// operation is spawned as a task that replies on completion; otherwise the
+    /// callback waits for it via `block_on`. `passthrough` asks for kernel
+    /// passthrough, which is only used if the kernel grants it at init.
+    fn new(fs: Arc<dyn FileSystem>, runtime: Runtime, concurrent: bool, passthrough: bool) -> Self {
         Self {
             fs,
             runtime,
+            concurrent,
             open_files: Arc::new(Mutex::new(HashMap::new())),
+            open_dirs: Arc::new(Mutex::new(HashMap::new())),
             next_fh: AtomicU64::new(1),
+            splice_write: false,
+            splice_move: false,
+            passthrough,
+            passthrough_inodes: Arc::default(),
+        }
+    }
+
+    /// Run a request handler that owns its reply.
+    ///
+    /// In concurrent mode the handler is spawned on the runtime and the session
+    /// loop immediately goes back to reading `/dev/fuse`; replies may then be
+    /// sent out of order, which FUSE allows since each carries its request id.
+    fn dispatch<F>(&self, handler: F)
+    where
+        F: Future<Output = ()> + Send + 'static,
+    {
+        if self.concurrent {
+            self.runtime.spawn(handler);
+        } else {
+            self.runtime.block_on(handler);
         }
     }
 
@@ -1097,6 +1400,27 @@ impl AgentFSFuse {
     fn alloc_fh(&self) -> u64 {
         self.next_fh.fetch_add(1, Ordering::SeqCst)
     }
+
+    /// Look up the file behind an open file handle.
+    fn get_file(&self, fh: u64) -> Option<BoxedFile> {
+        self.open_files.lock().get(&fh).map(|f| f.file.clone())
+    }
+
+    /// Look up the directory stream behind an open directory handle.
+    fn get_dir(&self, fh: u64) -> Option<Arc<OpenDir>> {
+        self.open_dirs.lock().get(&fh).cloned()
+    }
+}
+
+/// Convert a FUSE time specification into an SDK time change.
+fn time_or_now_to_change(time: crate::fuser::TimeOrNow) -> TimeChange {
+    match time {
+        crate::fuser::TimeOrNow::SpecificTime(t) => {
+            let dur = t.duration_since(UNIX_EPOCH).unwrap_or_default();
+            TimeChange::Set(dur.as_secs() as i64, dur.subsec_nanos())
+        }
+        crate::fuser::TimeOrNow::Now => TimeChange::Now,
+    }
 }
 
 // ─────────────────────────────────────────────────────────────
@@ -1183,7 +1507,8 @@ pub fn mount(
     // when passthrough filesystems cache O_PATH file descriptors
     maximize_fd_limit();
 
-    let fs = AgentFSFuse::new(fs, runtime);
+    let fs: Arc<dyn FileSystem> = Arc::new(MeteredFileSystem::new(fs));
+    let fs = AgentFSFuse::new(fs, runtime, opts.concurrent, opts.passthrough);
 
     let mut mount_opts = vec![
         MountOption::FSName(opts.fsname),
@@ -1211,7 +1536,328 @@ pub fn mount(
         mount_opts.push(MountOption::AllowRoot);
     }
 
-    crate::fuser::mount2(fs, &opts.mountpoint, &mount_opts)?;
+    match &opts.trace {
+        Some(path) => {
+            let tracer = crate::fuser::Tracer::create(path)
+                .with_context(|| format!("Failed to create trace file {}", path.display()))?;
+            crate::fuser::mount2_traced(fs, &opts.mountpoint, &mount_opts, tracer)?;
+        }
+        None => crate::fuser::mount2(fs, &opts.mountpoint, &mount_opts)?,
+    }
 
     Ok(())
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::fuser::{Reply, ReplySender};
+    use agentfs_sdk::{AgentFS, AgentFSOptions};
+    use std::io::IoSlice;
+    use std::sync::mpsc;
+
+    /// A reply as the kernel would receive it
+    struct Sent {
+        unique: u64,
+        error: i32,
+        data: Vec<u8>,
+    }
+
+    /// Hands the replies of the adapter to the test
+    struct Replies(mpsc::Sender<Sent>);
+
+    impl ReplySender for Replies {
+        fn send(&self, data: &[IoSlice<'_>]) -> std::io::Result<()> {
+            let bytes: Vec<u8> = data
+                .iter()
+                .flat_map(|slice| slice.iter().copied())
+                .collect();
+            let _ = self.0.send(Sent {
+                error: i32::from_ne_bytes(bytes[4..8].try_into().unwrap()),
+                unique: u64::from_ne_bytes(bytes[8..16].try_into().unwrap()),
+                data: bytes[16..].to_vec(),
+            });
+            Ok(())
+        }
+
+        fn open_backing(&self, _fd: BorrowedFd<'_>) -> std::io::Result<BackingId> {
+            unreachable!()
+        }
+    }
+
+    /// The adapter over an ephemeral AgentFS, called as the session would
+    struct Adapter {
+        fuse: AgentFSFuse,
+        tx: mpsc::Sender<Sent>,
+        rx: mpsc::Receiver<Sent>,
+        unique: u64,
+    }
+
+    impl Adapter {
+        fn new(concurrent: bool) -> Self {
+            let runtime = tokio::runtime::Builder::new_multi_thread()
+                .worker_threads(4)
+                .enable_all()
+                .build()
+                .unwrap();
+            let fs: Arc<dyn FileSystem> = runtime.block_on(async {
+                Arc::new(AgentFS::open(AgentFSOptions::ephemeral()).await.unwrap().fs)
+            });
+            let (tx, rx) = mpsc::channel();
+            Self {
+                fuse: AgentFSFuse::new(fs, runtime, concurrent, false),
+                tx,
+                rx,
+                unique: 0,
+            }
+        }
+
+        /// Run `f` against the filesystem under the adapter
+        fn with_fs<F, T>(&self, f: impl FnOnce(Arc<dyn FileSystem>) -> F) -> T
+        where
+            F: Future<Output = T>,
+        {
+            self.fuse.runtime.block_on(f(self.fuse.fs.clone()))
+        }
+
+        /// Id of the next request, and the sender for its reply
+        fn next(&mut self) -> (u64, Replies) {
+            self.unique += 1;
+            (self.unique, Replies(self.tx.clone()))
+        }
+
+        /// Replies to `count` requests, by request id
+        fn replies(&self, count: usize) -> HashMap<u64, Sent> {
+            (0..count)
+                .map(|_| {
+                    let sent = self.rx.recv_timeout(Duration::from_secs(10)).unwrap();
+                    (sent.unique, sent)
+                })
+                .collect()
+        }
+
+        fn reply(&self) -> Sent {
+            self.replies(1).into_values().next().unwrap()
+        }
+
+        fn lookup(&mut self, parent: u64, name: &str) -> u64 {
+            let (unique, sender) = self.next();
+            Request::with_test(|req| {
+                self.fuse
+                    .lookup(req, parent, OsStr::new(name), Reply::new(unique, sender))
+            });
+            unique
+        }
+
+        fn forget(&mut self, ino: u64, nlookup: u64) {
+            Request::with_test(|req| self.fuse.forget(req, ino, nlookup));
+        }
+
+        fn truncate(&mut self, ino: u64, size: u64) -> Sent {
+            let (unique, sender) = self.next();
+            Request::with_test(|req| {
+                self.fuse.setattr(
+                    req,
+                    ino,
+                    None,
+                    None,
+                    None,
+                    Some(size),
+                    None,
+                    None,
+                    None,
+                    None,
+                    None,
+                    None,
+                    None,
+                    None,
+                    Reply::new(unique, sender),
+                )
+            });
+            self.reply()
+        }
+
+        fn opendir(&mut self, ino: u64) -> u64 {
+            let (unique, sender) = self.next();
+            Request::with_test(|req| self.fuse.opendir(req, ino, 0, Reply::new(unique, sender)));
+            let sent = self.reply();
+            assert_eq!(sent.error, 0);
+            u64::from_ne_bytes(sent.data[0..8].try_into().unwrap())
+        }
+
+        fn readdir(&mut self, ino: u64, fh: u64, offset: i64, size: usize) -> u64 {
+            let (unique, sender) = self.next();
+            Request::with_test(|req| {
+                let reply = ReplyDirectory::new(unique, sender, size);
+                self.fuse.readdir(req, ino, fh, offset, reply)
+            });
+            unique
+        }
+    }
+
+    /// Offsets and names of the `fuse_dirent`s of a readdir reply
+    fn dirents(data: &[u8]) -> Vec<(i64, String)> {
+        let mut entries = Vec::new();
+        let mut at = 0;
+        while at < data.len() {
+            let off = i64::from_ne_bytes(data[at + 8..at + 16].try_into().unwrap());
+            let namelen = u32::from_ne_bytes(data[at + 16..at + 20].try_into().unwrap()) as usize;
+            let name = &data[at + 24..at + 24 + namelen];
+            entries.push((off, String::from_utf8(name.to_vec()).unwrap()));
+            at += (24 + namelen).next_multiple_of(8);
+        }
+        entries
+    }
+
+    /// Node id of a lookup reply
+    fn entry_ino(sent: &Sent) -> u64 {
+        assert_eq!(sent.error, 0);
+        u64::from_ne_bytes(sent.data[0..8].try_into().unwrap())
+    }
+
+    /// Create a directory of `count` files under the root, returning its inode
+    fn populate(adapter: &Adapter, count: usize) -> u64 {
+        adapter.with_fs(|fs| async move {
+            let dir = fs.mkdir(1, "dir", 0o755, 0, 0).await.unwrap();
+            for i in 0..count {
+                fs.create_file(dir.ino, &format!("f{i:03}"), 0o644, 0, 0)
+                    .await
+                    .unwrap();
+            }
+            dir.ino as u64
+        })
+    }
+
+    #[test]
+    fn test_readdir_rereads_within_reply() {
+        let mut adapter = Adapter::new(false);
+        let ino = populate(&adapter, 100);
+        let fh = adapter.opendir(ino);
+
+        // A small reply, of which the caller only takes the first half
+        adapter.readdir(ino, fh, 0, 512);
+        let first = dirents(&adapter.reply().data);
+        assert!(first.len() > 4);
+        let (offset, _) = first[first.len() / 2];
+        let mut names: Vec<String> = first[..=first.len() / 2]
+            .iter()
+            .map(|(_, name)| name.clone())
+            .collect();
+
+        // The next reply resumes right after the last entry taken
+        adapter.readdir(ino, fh, offset, 512);
+        let second = dirents(&adapter.reply().data);
+        assert_eq!(second[0].1, first[first.len() / 2 + 1].1);
+
+        let mut offset = offset;
+        let mut reply = second;
+        while !reply.is_empty() {
+            names.extend(reply.iter().map(|(_, name)| name.clone()));
+            offset = reply.last().unwrap().0;
+            adapter.readdir(ino, fh, offset, 512);
+            reply = dirents(&adapter.reply().data);
+        }
+        let mut expected = vec![".".to_string(), "..".to_string()];
+        expected.extend((0..100).map(|i| format!("f{i:03}")));
+        names[2..].sort();
+        assert_eq!(names, expected);
+    }
+
+    /// Lookups, forgets and listings of one directory issued back to back,
+    /// without waiting for replies in between; returns what each lookup
+    /// resolved to and what each listing held
+    fn overlapping(concurrent: bool) -> (Vec<(String, u64)>, Vec<Vec<String>>) {
+        let mut adapter = Adapter::new(concurrent);
+        let ino = populate(&adapter, 50);
+        let handles = [adapter.opendir(ino), adapter.opendir(ino)];
+        // References for the forgets below, which the kernel only sends for
+        // lookups it already has replies to
+        for _ in 0..5 {
+            adapter.lookup(1, "dir");
+            assert_eq!(entry_ino(&adapter.reply()), ino);
+        }
+
+        let mut lookups = HashMap::new();
+        let mut listings = Vec::new();
+        for round in 0..5 {
+            lookups.insert(adapter.lookup(1, "dir"), "dir".to_string());
+            for i in (round..50).step_by(5) {
+                let name = format!("f{i:03}");
+                lookups.insert(adapter.lookup(ino, &name), name);
+            }
+            adapter.forget(ino, 1);
+            if round < handles.len() {
+                listings.push(adapter.readdir(ino, handles[round], 0, 64 * 1024));
+            }
+        }
+
+        let mut replies = adapter.replies(lookups.len() + listings.len());
+        let mut resolved: Vec<(String, u64)> = lookups
+            .into_iter()
+            .map(|(unique, name)| (name, entry_ino(&replies[&unique])))
+            .collect();
+        resolved.sort();
+        let listed = listings
+            .iter()
+            .map(|unique| {
+                let sent = replies.remove(unique).unwrap();
+                assert_eq!(sent.error, 0);
+                dirents(&sent.data)
+                    .into_iter()
+                    .map(|(_, name)| name)
+                    .collect()
+            })
+            .collect();
+        (resolved, listed)
+    }
+
+    #[test]
+    fn test_overlapping_requests_match_serial() {
+        let (resolved, listed) = overlapping(true);
+        assert_eq!(resolved.len(), 55);
+        assert!(resolved.iter().all(|(_, ino)| *ino > 1));
+        for names in &listed {
+            assert_eq!(names.len(), 52);
+            let mut files = names[2..].to_vec();
+            files.sort();
+            assert_eq!(
+                files,
+                (0..50).map(|i| format!("f{i:03}")).collect::<Vec<_>>()
+            );
+        }
+
+        // --serial runs the same requests one at a time, with the same outcome
+        assert_eq!(overlapping(false), (resolved, listed));
+    }
+
+    #[test]
+    fn test_truncate_without_handle_respects_passthrough() {
+        let mut adapter = Adapter::new(false);
+        adapter.fuse.passthrough = true;
+        let ino = adapter.with_fs(|fs| async move {
+            let (stats, file) = fs.create_file(1, "a", 0o644, 0, 0).await.unwrap();
+            file.pwrite(0, b"hello").await.unwrap();
+            stats.ino as u64
+        });
+
+        // The kernel reads the inode from its backing file, which the
+        // truncate would not reach
+        adapter.fuse.passthrough_inodes.inodes.lock().insert(
+            ino,
+            InodeIo::Passthrough {
+                backing: Arc::new(BackingId::unregistered(1)),
+                opens: 1,
+            },
+        );
+        assert_eq!(adapter.truncate(ino, 0).error, -libc::ETXTBSY);
+        let size = adapter.with_fs(|fs| async move { fs.getattr(ino as i64).await });
+        assert_eq!(size.unwrap().unwrap().size, 5);
+
+        // Otherwise the truncate counts as a regular open while it runs
+        adapter.fuse.passthrough_inodes.release(ino);
+        assert_eq!(adapter.truncate(ino, 0).error, 0);
+        let size = adapter.with_fs(|fs| async move { fs.getattr(ino as i64).await });
+        assert_eq!(size.unwrap().unwrap().size, 0);
+        assert!(adapter.fuse.passthrough_inodes.inodes.lock().is_empty());
+    }
+}
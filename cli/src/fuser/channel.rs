@@ -7,10 +7,20 @@ use std::{
     },
     sync::Arc,
 };
+#[cfg(target_os = "linux")]
+use std::{
+    os::fd::{FromRawFd, OwnedFd},
+    sync::Mutex,
+};
 
 use libc::{c_int, c_void, size_t};
 
+#[cfg(target_os = "linux")]
+use super::ll::fuse_abi::fuse_out_header;
+use super::passthrough::BackingId;
 use super::reply::ReplySender;
+#[cfg(target_os = "linux")]
+use zerocopy::IntoBytes;
 
 /// A raw communication channel to the FUSE kernel driver
 #[derive(Debug)]
@@ -52,18 +62,27 @@ impl Channel {
     pub fn sender(&self) -> ChannelSender {
         // Since write/writev syscalls are threadsafe, we can simply create
         // a sender by using the same file and use it in other threads.
-        ChannelSender(self.0.clone())
+        ChannelSender {
+            device: self.0.clone(),
+            #[cfg(target_os = "linux")]
+            pipes: Arc::default(),
+        }
     }
 }
 
 #[derive(Clone, Debug)]
-pub struct ChannelSender(Arc<File>);
+pub struct ChannelSender {
+    device: Arc<File>,
+    /// Idle pipe pairs for spliced replies, shared by all senders of a channel
+    #[cfg(target_os = "linux")]
+    pipes: Arc<Mutex<Vec<SplicePipes>>>,
+}
 
 impl ReplySender for ChannelSender {
     fn send(&self, bufs: &[io::IoSlice<'_>]) -> io::Result<()> {
         let rc = unsafe {
             libc::writev(
-                self.0.as_raw_fd(),
+                self.device.as_raw_fd(),
                 bufs.as_ptr() as *const libc::iovec,
                 bufs.len() as c_int,
             )
@@ -75,4 +94,196 @@ impl ReplySender for ChannelSender {
             Ok(())
         }
     }
+
+    fn open_backing(&self, fd: BorrowedFd<'_>) -> io::Result<BackingId> {
+        BackingId::create(&self.device, fd)
+    }
+
+    #[cfg(target_os = "linux")]
+    fn send_spliced(
+        &self,
+        unique: u64,
+        fd: BorrowedFd<'_>,
+        offset: i64,
+        len: usize,
+        move_pages: bool,
+    ) -> io::Result<bool> {
+        let pooled = self.pipes.lock().unwrap().pop();
+        let Ok(mut pipes) = pooled.map_or_else(SplicePipes::new, Ok) else {
+            return Ok(false);
+        };
+        if pipes
+            .reserve(len + std::mem::size_of::<fuse_out_header>())
+            .is_err()
+        {
+            return Ok(false);
+        }
+        let sent = pipes.send(&self.device, unique, fd, offset, len, move_pages)?;
+        // Pipes that couldn't be drained still hold stale data
+        if sent {
+            let mut idle = self.pipes.lock().unwrap();
+            if idle.len() < MAX_IDLE_PIPES {
+                idle.push(pipes);
+            }
+        }
+        Ok(sent)
+    }
+}
+
+/// Maximum number of idle pipe pairs kept around for spliced replies.
+#[cfg(target_os = "linux")]
+const MAX_IDLE_PIPES: usize = 16;
+
+/// A pair of pipes used to splice a reply into the FUSE device.
+///
+/// File data is first spliced into `data`, so its final length is known before
+/// the reply header is written to `reply`. The data is then moved behind the
+/// header and the whole reply is spliced into the device in one go, as the
+/// kernel requires each reply to arrive in a single write.
+#[cfg(target_os = "linux")]
+#[derive(Debug)]
+struct SplicePipes {
+    data: (OwnedFd, OwnedFd),
+    reply: (OwnedFd, OwnedFd),
+    capacity: usize,
+}
+
+#[cfg(target_os = "linux")]
+impl SplicePipes {
+    fn new() -> io::Result<Self> {
+        let data = new_pipe()?;
+        let reply = new_pipe()?;
+        let capacity =
+            unsafe { libc::fcntl(data.1.as_raw_fd(), libc::F_GETPIPE_SZ) }.max(0) as usize;
+        Ok(Self {
+            data,
+            reply,
+            capacity,
+        })
+    }
+
+    /// Grow both pipes so that `len` bytes fit without blocking.
+    fn reserve(&mut self, len: usize) -> io::Result<()> {
+        if self.capacity >= len {
+            return Ok(());
+        }
+        for pipe in [&self.data.1, &self.reply.1] {
+            let rc = unsafe { libc::fcntl(pipe.as_raw_fd(), libc::F_SETPIPE_SZ, len as c_int) };
+            if rc < 0 {
+                return Err(io::Error::last_os_error());
+            }
+            self.capacity = rc as usize;
+        }
+        Ok(())
+    }
+
+    /// Send up to `len` bytes of `fd` at `offset` as the reply to `unique`.
+    ///
+    /// Returns `Ok(false)` without sending anything if the data can't be
+    /// spliced, in which case the pipes must be discarded.
+    fn send(
+        &self,
+        device: &File,
+        unique: u64,
+        fd: BorrowedFd<'_>,
+        offset: i64,
+        len: usize,
+        move_pages: bool,
+    ) -> io::Result<bool> {
+        let mut filled = 0;
+        let mut off = offset;
+        while filled < len {
+            let rc = unsafe {
+                libc::splice(
+                    fd.as_raw_fd(),
+                    &mut off,
+                    self.data.1.as_raw_fd(),
+                    std::ptr::null_mut(),
+                    len - filled,
+                    libc::SPLICE_F_NONBLOCK,
+                )
+            };
+            if rc < 0 {
+                let err = io::Error::last_os_error();
+                if err.raw_os_error() == Some(libc::EINTR) {
+                    continue;
+                }
+                // Not spliceable (e.g. EINVAL for this file type): let the
+                // caller fall back to copying
+                return Ok(false);
+            }
+            if rc == 0 {
+                break;
+            }
+            filled += rc as usize;
+        }
+
+        let header = fuse_out_header {
+            len: (std::mem::size_of::<fuse_out_header>() + filled) as u32,
+            error: 0,
+            unique,
+        };
+        let header = header.as_bytes();
+        let rc = unsafe {
+            libc::write(
+                self.reply.1.as_raw_fd(),
+                header.as_ptr() as *const c_void,
+                header.len(),
+            )
+        };
+        if rc != header.len() as isize {
+            return Ok(false);
+        }
+        if filled > 0 && !splice_all(&self.data.0, &self.reply.1, filled, 0)? {
+            return Ok(false);
+        }
+
+        // The reply is complete in the pipe now; failing past this point
+        // means the device rejected it, which the caller can't recover from
+        // by resending.
+        let flags = if move_pages { libc::SPLICE_F_MOVE } else { 0 };
+        if !splice_all(&self.reply.0, device, header.len() + filled, flags)? {
+            return Err(io::Error::from_raw_os_error(libc::EIO));
+        }
+        Ok(true)
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn new_pipe() -> io::Result<(OwnedFd, OwnedFd)> {
+    let mut fds = [0 as c_int; 2];
+    if unsafe { libc::pipe2(fds.as_mut_ptr(), libc::O_CLOEXEC) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(unsafe { (OwnedFd::from_raw_fd(fds[0]), OwnedFd::from_raw_fd(fds[1])) })
+}
+
+/// Splice exactly `len` bytes from the pipe `from` into `to`.
+#[cfg(target_os = "linux")]
+fn splice_all(from: &impl AsRawFd, to: &impl AsRawFd, len: usize, flags: u32) -> io::Result<bool> {
+    let mut moved = 0;
+    while moved < len {
+        let rc = unsafe {
+            libc::splice(
+                from.as_raw_fd(),
+                std::ptr::null_mut(),
+                to.as_raw_fd(),
+                std::ptr::null_mut(),
+                len - moved,
+                flags,
+            )
+        };
+        if rc < 0 {
+            let err = io::Error::last_os_error();
+            if err.raw_os_error() == Some(libc::EINTR) {
+                continue;
+            }
+            return Err(err);
+        }
+        if rc == 0 {
+            return Ok(false);
+        }
+        moved += rc as usize;
+    }
+    Ok(true)
 }
@@ -150,7 +150,8 @@ pub mod consts {
     pub const FOPEN_NONSEEKABLE: u32 = 1 << 2; // the file is not seekable
     pub const FOPEN_CACHE_DIR: u32 = 1 << 3; // allow caching this directory
     pub const FOPEN_STREAM: u32 = 1 << 4; // the file is stream-like (no file position at all)
-                                          // Init request/reply flags
+    pub const FOPEN_PASSTHROUGH: u32 = 1 << 7; // pass through I/O to the backing file
+                                               // Init request/reply flags
     pub const FUSE_ASYNC_READ: u64 = 1 << 0; // asynchronous read requests
     pub const FUSE_POSIX_LOCKS: u64 = 1 << 1; // remote locking for POSIX file locks
     pub const FUSE_FILE_OPS: u64 = 1 << 2; // kernel sends file handle for fstat, etc...
@@ -179,6 +180,7 @@ pub mod consts {
     pub const FUSE_EXPLICIT_INVAL_DATA: u64 = 1 << 25; // only invalidate cached pages on explicit request
     pub const FUSE_INIT_EXT: u64 = 1 << 30; // extended fuse_init_in request
     pub const FUSE_INIT_RESERVED: u64 = 1 << 31; // reserved, do not use
+    pub const FUSE_PASSTHROUGH: u64 = 1 << 37; // kernel supports passthrough of opened files (7.40)
 
     // CUSE init request/reply flags
     pub const CUSE_UNRESTRICTED_IOCTL: u32 = 1 << 0; // use unrestricted ioctl
@@ -588,9 +590,7 @@ pub struct fuse_create_out(pub fuse_entry_out, pub fuse_open_out);
 pub struct fuse_open_out {
     pub fh: u64,
     pub open_flags: u32,
-    #[cfg(not(feature = "abi-7-40"))]
-    pub padding: u32,
-    #[cfg(feature = "abi-7-40")]
+    // Padding before ABI 7.40, which the kernel only reads with FOPEN_PASSTHROUGH
     pub backing_id: u32,
 }
 
@@ -736,6 +736,18 @@ pub struct fuse_init_in {
     pub unused: [u32; 11],
 }
 
+/// Tail of `fuse_init_in` sent by kernels that set `FUSE_INIT_EXT` (Linux 5.17+).
+///
+/// Parsed separately with older ABIs, so that shorter requests from older kernels
+/// still parse.
+#[cfg(not(feature = "abi-7-36"))]
+#[repr(C)]
+#[derive(Debug, FromBytes, KnownLayout, Immutable)]
+pub struct fuse_init_in_ext {
+    pub flags2: u32,
+    pub unused: [u32; 11],
+}
+
 #[repr(C)]
 #[derive(Debug, IntoBytes, KnownLayout, Immutable)]
 pub struct fuse_init_out {
@@ -746,23 +758,14 @@ pub struct fuse_init_out {
     pub max_background: u16,
     pub congestion_threshold: u16,
     pub max_write: u32,
-    #[cfg(feature = "abi-7-23")]
+    // The remaining fields are reserved space in each older ABI (the kernel has
+    // accepted the full-size reply since 7.23), so the newest layout is always
+    // sent and fields the kernel doesn't know about are left zero.
     pub time_gran: u32,
-    #[cfg(all(feature = "abi-7-23", not(feature = "abi-7-28")))]
-    pub reserved: [u32; 9],
-    #[cfg(feature = "abi-7-28")]
     pub max_pages: u16,
-    #[cfg(feature = "abi-7-28")]
     pub unused2: u16,
-    #[cfg(all(feature = "abi-7-28", not(feature = "abi-7-36")))]
-    pub reserved: [u32; 8],
-    #[cfg(feature = "abi-7-36")]
     pub flags2: u32,
-    #[cfg(all(feature = "abi-7-36", not(feature = "abi-7-40")))]
-    pub reserved: [u32; 7],
-    #[cfg(feature = "abi-7-40")]
     pub max_stack_depth: u32,
-    #[cfg(feature = "abi-7-40")]
     pub reserved: [u32; 6],
 }
 
@@ -888,6 +891,19 @@ pub struct fuse_in_header {
     pub padding: u32,
 }
 
+/// Argument of the `FUSE_DEV_IOC_BACKING_OPEN` ioctl (7.40)
+#[repr(C)]
+#[derive(Debug, IntoBytes, KnownLayout, Immutable)]
+pub struct fuse_backing_map {
+    pub fd: i32,
+    pub flags: u32,
+    pub padding: u64,
+}
+
+// Device ioctls: _IOW(229, 1, struct fuse_backing_map) and _IOW(229, 2, uint32_t)
+pub const FUSE_DEV_IOC_BACKING_OPEN: u64 = 0x4010_e501;
+pub const FUSE_DEV_IOC_BACKING_CLOSE: u64 = 0x4004_e502;
+
 #[repr(C)]
 #[derive(Debug, IntoBytes, KnownLayout, Immutable)]
 pub struct fuse_out_header {
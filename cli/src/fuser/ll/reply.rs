@@ -120,15 +120,9 @@ impl<'a> Response<'a> {
 
     // TODO: Could flags be more strongly typed?
     pub(crate) fn new_open(fh: FileHandle, flags: u32, backing_id: u32) -> Self {
-        #[cfg(not(feature = "abi-7-40"))]
-        let _ = backing_id;
-
         let r = abi::fuse_open_out {
             fh: fh.into(),
             open_flags: flags,
-            #[cfg(not(feature = "abi-7-40"))]
-            padding: 0,
-            #[cfg(feature = "abi-7-40")]
             backing_id,
         };
         Self::from_struct(&r)
@@ -196,9 +190,6 @@ impl<'a> Response<'a> {
         flags: u32,
         backing_id: u32,
     ) -> Self {
-        #[cfg(not(feature = "abi-7-40"))]
-        let _ = backing_id;
-
         let r = abi::fuse_create_out(
             abi::fuse_entry_out {
                 nodeid: attr.attr.ino,
@@ -212,9 +203,6 @@ impl<'a> Response<'a> {
             abi::fuse_open_out {
                 fh: fh.into(),
                 open_flags: flags,
-                #[cfg(not(feature = "abi-7-40"))]
-                padding: 0,
-                #[cfg(feature = "abi-7-40")]
                 backing_id,
             },
         );
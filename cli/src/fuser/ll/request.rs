@@ -941,6 +941,8 @@ mod op {
     pub struct Init<'a> {
         header: &'a fuse_in_header,
         arg: &'a fuse_init_in,
+        #[cfg(not(feature = "abi-7-36"))]
+        ext: Option<&'a fuse_init_in_ext>,
     }
     impl_request!(Init<'a>);
     impl<'a> Init<'a> {
@@ -949,6 +951,12 @@ mod op {
             if self.arg.flags & (FUSE_INIT_EXT as u32) != 0 {
                 return u64::from(self.arg.flags) | (u64::from(self.arg.flags2) << 32);
             }
+            #[cfg(not(feature = "abi-7-36"))]
+            if let Some(ext) = self.ext {
+                if self.arg.flags & (FUSE_INIT_EXT as u32) != 0 {
+                    return u64::from(self.arg.flags) | (u64::from(ext.flags2) << 32);
+                }
+            }
             u64::from(self.arg.flags)
         }
         pub fn max_readahead(&self) -> u32 {
@@ -959,36 +967,33 @@ mod op {
         }
 
         pub fn reply(&self, config: &super::super::super::KernelConfig) -> Response<'a> {
-            let flags = self.capabilities() & config.requested; // use requested features and reported as capable
+            let mut flags = self.capabilities() & config.requested; // use requested features and reported as capable
+                                                                    // The kernel only reads flags2 when FUSE_INIT_EXT is set
+            if cfg!(feature = "abi-7-36") || flags >> 32 != 0 {
+                flags |= FUSE_INIT_EXT;
+            }
 
             let init = fuse_init_out {
                 major: FUSE_KERNEL_VERSION,
                 minor: FUSE_KERNEL_MINOR_VERSION,
                 max_readahead: config.max_readahead,
-                #[cfg(not(feature = "abi-7-36"))]
                 flags: flags as u32,
-                #[cfg(feature = "abi-7-36")]
-                flags: (flags | FUSE_INIT_EXT) as u32,
                 max_background: config.max_background,
                 congestion_threshold: config.congestion_threshold(),
                 max_write: config.max_write,
-                #[cfg(feature = "abi-7-23")]
-                time_gran: config.time_gran.as_nanos() as u32,
-                #[cfg(all(feature = "abi-7-23", not(feature = "abi-7-28")))]
-                reserved: [0; 9],
-                #[cfg(feature = "abi-7-28")]
-                max_pages: config.max_pages(),
-                #[cfg(feature = "abi-7-28")]
+                time_gran: if cfg!(feature = "abi-7-23") {
+                    config.time_gran.as_nanos() as u32
+                } else {
+                    0
+                },
+                max_pages: if cfg!(feature = "abi-7-28") {
+                    config.max_pages()
+                } else {
+                    0
+                },
                 unused2: 0,
-                #[cfg(all(feature = "abi-7-28", not(feature = "abi-7-36")))]
-                reserved: [0; 8],
-                #[cfg(feature = "abi-7-36")]
                 flags2: (flags >> 32) as u32,
-                #[cfg(all(feature = "abi-7-36", not(feature = "abi-7-40")))]
-                reserved: [0; 7],
-                #[cfg(feature = "abi-7-40")]
                 max_stack_depth: config.max_stack_depth,
-                #[cfg(feature = "abi-7-40")]
                 reserved: [0; 6],
             };
             Response::new_data(init.as_bytes())
@@ -1719,6 +1724,8 @@ mod op {
             fuse_opcode::FUSE_INIT => Operation::Init(Init {
                 header,
                 arg: data.fetch()?,
+                #[cfg(not(feature = "abi-7-36"))]
+                ext: data.fetch(),
             }),
             fuse_opcode::FUSE_OPENDIR => Operation::OpenDir(OpenDir {
                 header,
@@ -2112,6 +2119,11 @@ pub struct AnyRequest<'a> {
 impl_request!(AnyRequest<'_>);
 
 impl<'a> AnyRequest<'a> {
+    /// Raw opcode of the request, also for operations that aren't supported
+    pub fn opcode(&self) -> u32 {
+        self.header.opcode
+    }
+
     pub fn operation(&self) -> Result<Operation<'a>, RequestError> {
         // Parse/check opcode
         let opcode = fuse_opcode::try_from(self.header.opcode)
@@ -2290,6 +2302,25 @@ mod tests {
         }
     }
 
+    #[cfg(all(target_endian = "little", not(feature = "abi-7-36")))]
+    #[test]
+    fn init_extended_flags() {
+        use abi::consts::{FUSE_INIT_EXT, FUSE_PASSTHROUGH};
+
+        let mut data = AlignedData([0u8; 104]);
+        data[..56].copy_from_slice(&INIT_REQUEST[..]);
+        data[0] = 0x68; // len
+        data[52..56].copy_from_slice(&(FUSE_INIT_EXT as u32).to_le_bytes()); // flags
+        data[56..60].copy_from_slice(&((FUSE_PASSTHROUGH >> 32) as u32).to_le_bytes()); // flags2
+        let req = AnyRequest::try_from(&data[..]).unwrap();
+        match req.operation().unwrap() {
+            Operation::Init(x) => {
+                assert_eq!(x.capabilities(), FUSE_INIT_EXT | FUSE_PASSTHROUGH);
+            }
+            _ => panic!("Unexpected request operation"),
+        }
+    }
+
     #[test]
     fn mknod() {
         let req = AnyRequest::try_from(&MKNOD_REQUEST[..]).unwrap();
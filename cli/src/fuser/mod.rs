@@ -30,7 +30,10 @@ pub use ll::fuse_abi::FUSE_ROOT_ID;
 pub use ll::TimeOrNow;
 pub use mnt::mount_options::MountOption;
 pub use notify::{Notifier, PollHandle};
+pub use passthrough::BackingId;
 pub use reply::ReplyPoll;
+#[cfg(test)]
+pub(crate) use reply::ReplySender;
 pub use reply::ReplyXattr;
 pub use reply::{Reply, ReplyAttr, ReplyData, ReplyEmpty, ReplyEntry, ReplyOpen};
 pub use reply::{
@@ -39,6 +42,7 @@ pub use reply::{
 };
 pub use request::Request;
 pub use session::{BackgroundSession, Session, SessionACL, SessionUnmounter};
+pub use trace::Tracer;
 
 use ll::fuse_abi::consts::*;
 use mnt::mount_options::check_option_conflicts;
@@ -57,11 +61,13 @@ mod ll;
 mod mnt;
 #[allow(clippy::io_other_error)]
 mod notify;
+mod passthrough;
 #[allow(unexpected_cfgs)]
 mod reply;
 #[allow(unused_imports, unexpected_cfgs)]
 mod request;
 mod session;
+mod trace;
 
 /// We generally support async reads (Linux)
 const INIT_FLAGS: u64 = FUSE_ASYNC_READ | FUSE_BIG_WRITES;
@@ -135,6 +141,7 @@ pub struct KernelConfig {
     congestion_threshold: Option<u16>,
     max_write: u32,
     time_gran: std::time::Duration,
+    max_stack_depth: u32,
 }
 
 impl KernelConfig {
@@ -148,9 +155,25 @@ impl KernelConfig {
             congestion_threshold: None,
             max_write: MAX_WRITE_SIZE as u32,
             time_gran: std::time::Duration::new(0, 1),
+            max_stack_depth: 0,
         }
     }
 
+    /// Set the maximum stacking depth of the filesystem
+    ///
+    /// This has to be at least 1 to use passthrough, and backing files must live
+    /// on filesystems stacked less deeply than this.
+    pub fn set_max_stack_depth(&mut self, value: u32) -> Result<u32, u32> {
+        // The kernel's FILESYSTEM_MAX_STACK_DEPTH
+        const FILESYSTEM_MAX_STACK_DEPTH: u32 = 2;
+        if value > FILESYSTEM_MAX_STACK_DEPTH {
+            return Err(FILESYSTEM_MAX_STACK_DEPTH);
+        }
+        let previous = self.max_stack_depth;
+        self.max_stack_depth = value;
+        Ok(previous)
+    }
+
     /// Set the timestamp granularity
     pub fn set_time_granularity(
         &mut self,
@@ -789,6 +812,21 @@ pub fn mount2<FS: Filesystem, P: AsRef<Path>>(
     Session::new(filesystem, mountpoint.as_ref(), options).and_then(|mut se| se.run())
 }
 
+/// Mount the given filesystem to the given mountpoint like [`mount2`], and
+/// record every request of the session with `tracer`.
+pub fn mount2_traced<FS: Filesystem, P: AsRef<Path>>(
+    filesystem: FS,
+    mountpoint: P,
+    options: &[MountOption],
+    tracer: Tracer,
+) -> io::Result<()> {
+    check_option_conflicts(options)?;
+    Session::new(filesystem, mountpoint.as_ref(), options).and_then(|mut se| {
+        se.set_tracer(tracer);
+        se.run()
+    })
+}
+
 /// Mount the given filesystem to the given mountpoint. This function spawns
 /// a background thread to handle filesystem operations while being mounted
 /// and therefore returns immediately.
@@ -0,0 +1,73 @@
+//! Kernel passthrough of opened files (ABI 7.40, Linux 6.9+)
+//!
+//! A filesystem can register a file descriptor with the kernel and reply to an open
+//! with the resulting backing id. Reads and writes on that open file are then served
+//! by the kernel directly from the backing file, without FUSE requests.
+
+use std::fs::File;
+use std::io;
+use std::os::fd::{AsRawFd, BorrowedFd};
+use std::sync::{Arc, Weak};
+
+use super::ll::fuse_abi::{
+    fuse_backing_map, FUSE_DEV_IOC_BACKING_CLOSE, FUSE_DEV_IOC_BACKING_OPEN,
+};
+
+/// A file descriptor registered with the kernel for passthrough.
+///
+/// Pass it to `ReplyOpen::opened_passthrough()`. The registration is released when
+/// this is dropped; files already opened with it keep their own reference to the
+/// backing file.
+#[derive(Debug)]
+pub struct BackingId {
+    channel: Weak<File>,
+    pub(crate) backing_id: u32,
+}
+
+impl BackingId {
+    pub(crate) fn create(channel: &Arc<File>, fd: BorrowedFd<'_>) -> io::Result<Self> {
+        let map = fuse_backing_map {
+            fd: fd.as_raw_fd(),
+            flags: 0,
+            padding: 0,
+        };
+        let rc = unsafe {
+            libc::ioctl(
+                channel.as_raw_fd(),
+                FUSE_DEV_IOC_BACKING_OPEN as _,
+                &map as *const fuse_backing_map,
+            )
+        };
+        if rc < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self {
+            channel: Arc::downgrade(channel),
+            backing_id: rc as u32,
+        })
+    }
+
+    /// A backing id no session knows of, for tests
+    #[cfg(test)]
+    pub(crate) fn unregistered(backing_id: u32) -> Self {
+        Self {
+            channel: Weak::new(),
+            backing_id,
+        }
+    }
+}
+
+impl Drop for BackingId {
+    fn drop(&mut self) {
+        // Nothing to release if the session is gone
+        if let Some(channel) = self.channel.upgrade() {
+            let _ = unsafe {
+                libc::ioctl(
+                    channel.as_raw_fd(),
+                    FUSE_DEV_IOC_BACKING_CLOSE as _,
+                    &self.backing_id as *const u32,
+                )
+            };
+        }
+    }
+}
@@ -21,14 +21,33 @@ use std::convert::AsRef;
 use std::ffi::OsStr;
 use std::fmt;
 use std::io::IoSlice;
+use std::os::fd::{AsRawFd, BorrowedFd};
 use std::time::Duration;
 
-use super::{FileAttr, FileType};
+use super::ll::fuse_abi::consts::FOPEN_PASSTHROUGH;
+use super::{BackingId, FileAttr, FileType};
 
 /// Generic reply callback to send data
 pub trait ReplySender: Send + Sync + Unpin + 'static {
     /// Send data.
     fn send(&self, data: &[IoSlice<'_>]) -> std::io::Result<()>;
+
+    /// Register a file descriptor with the kernel for passthrough.
+    fn open_backing(&self, fd: BorrowedFd<'_>) -> std::io::Result<BackingId>;
+
+    /// Send up to `len` bytes of `fd` at `offset` as a data reply by splicing
+    /// them into the channel. Returns `Ok(false)` if nothing was sent because
+    /// splicing isn't possible, so the caller can fall back to `send()`.
+    fn send_spliced(
+        &self,
+        _unique: u64,
+        _fd: BorrowedFd<'_>,
+        _offset: i64,
+        _len: usize,
+        _move_pages: bool,
+    ) -> std::io::Result<bool> {
+        Ok(false)
+    }
 }
 
 impl fmt::Debug for Box<dyn ReplySender> {
@@ -148,6 +167,55 @@ impl ReplyData {
         self.reply.send_ll(&ll::Response::new_slice(data));
     }
 
+    /// Reply to a request with up to `size` bytes read from `fd` at `offset`.
+    ///
+    /// The data is spliced from `fd` into the kernel without passing through
+    /// user space when the channel supports it, and read with `pread(2)`
+    /// otherwise. `move_pages` asks the kernel to move rather than copy the
+    /// page cache pages, which requires `FUSE_SPLICE_MOVE`. This blocks on
+    /// the read, so it should not be called from an async executor thread.
+    pub fn data_from_fd(mut self, fd: BorrowedFd<'_>, offset: i64, size: usize, move_pages: bool) {
+        let sender = self.reply.sender.as_ref().unwrap();
+        match sender.send_spliced(self.reply.unique.0, fd, offset, size, move_pages) {
+            Ok(true) => {
+                self.reply.sender = None;
+                return;
+            }
+            Ok(false) => {}
+            Err(err) => {
+                self.reply.sender = None;
+                error!("Failed to send FUSE reply: {err}");
+                return;
+            }
+        }
+
+        let mut buf = vec![0u8; size];
+        let mut filled = 0;
+        while filled < size {
+            let rc = unsafe {
+                libc::pread(
+                    fd.as_raw_fd(),
+                    buf[filled..].as_mut_ptr() as *mut libc::c_void,
+                    size - filled,
+                    offset + filled as i64,
+                )
+            };
+            if rc < 0 {
+                let err = std::io::Error::last_os_error();
+                if err.raw_os_error() == Some(libc::EINTR) {
+                    continue;
+                }
+                self.error(err.raw_os_error().unwrap_or(libc::EIO));
+                return;
+            }
+            if rc == 0 {
+                break;
+            }
+            filled += rc as usize;
+        }
+        self.data(&buf[..filled]);
+    }
+
     /// Reply to a request with the given error code
     pub fn error(self, err: c_int) {
         self.reply.error(err);
@@ -270,7 +338,6 @@ impl ReplyOpen {
     /// # Panics
     /// When attempting to use kernel passthrough. Use `opened_passthrough()` instead.
     pub fn opened(self, fh: u64, flags: u32) {
-        #[cfg(feature = "abi-7-40")]
         assert_eq!(flags & FOPEN_PASSTHROUGH, 0);
         self.reply
             .send_ll(&ll::Response::new_open(ll::FileHandle(fh), flags, 0));
@@ -280,14 +347,12 @@ impl ReplyOpen {
     /// you can pass it as the 3rd parameter of `OpenReply::opened_passthrough()`.  This is done in
     /// two separate steps because it may make sense to reuse backing IDs (to avoid having to
     /// repeatedly reopen the underlying file or potentially keep thousands of fds open).
-    #[cfg(feature = "abi-7-40")]
     pub fn open_backing(&self, fd: impl std::os::fd::AsFd) -> std::io::Result<BackingId> {
         self.reply.sender.as_ref().unwrap().open_backing(fd.as_fd())
     }
 
     /// Reply to a request with an opened backing id.  Call `ReplyOpen::open_backing()` to get one of
     /// these.
-    #[cfg(feature = "abi-7-40")]
     pub fn opened_passthrough(self, fh: u64, flags: u32, backing_id: &BackingId) {
         self.reply.send_ll(&ll::Response::new_open(
             ll::FileHandle(fh),
@@ -392,7 +457,6 @@ impl ReplyCreate {
     /// # Panics
     /// When attempting to use kernel passthrough. Use `opened_passthrough()` instead.
     pub fn created(self, ttl: &Duration, attr: &FileAttr, generation: u64, fh: u64, flags: u32) {
-        #[cfg(feature = "abi-7-40")]
         assert_eq!(flags & FOPEN_PASSTHROUGH, 0);
         self.reply.send_ll(&ll::Response::new_create(
             ttl,
@@ -736,7 +800,6 @@ mod test {
             Ok(())
         }
 
-        #[cfg(feature = "abi-7-40")]
         fn open_backing(&self, _fd: BorrowedFd<'_>) -> std::io::Result<BackingId> {
             unreachable!()
         }
@@ -795,6 +858,23 @@ mod test {
         reply.data(&[0xde, 0xad, 0xbe, 0xef]);
     }
 
+    #[test]
+    fn reply_data_from_fd() {
+        use std::io::Write;
+        use std::os::fd::AsFd;
+
+        let sender = AssertSender {
+            expected: vec![
+                0x13, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xef, 0xbe, 0xad, 0xde, 0x00, 0x00,
+                0x00, 0x00, 0xad, 0xbe, 0xef,
+            ],
+        };
+        let mut file = tempfile::tempfile().unwrap();
+        file.write_all(&[0xde, 0xad, 0xbe, 0xef]).unwrap();
+        let reply: ReplyData = Reply::new(0xdeadbeef, sender);
+        reply.data_from_fd(file.as_fd(), 1, 8, false);
+    }
+
     #[test]
     fn reply_entry() {
         let mut expected = if cfg!(target_os = "macos") {
@@ -1102,7 +1182,6 @@ mod test {
             Ok(())
         }
 
-        #[cfg(feature = "abi-7-40")]
         fn open_backing(&self, _fd: BorrowedFd<'_>) -> std::io::Result<BackingId> {
             unreachable!()
         }
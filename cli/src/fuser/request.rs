@@ -6,10 +6,14 @@
 //! TODO: This module is meant to go away soon in favor of `ll::Request`.
 
 use super::ll::{fuse_abi as abi, Errno, Response};
+use agentfs_sdk::metrics::{OpMetrics, OpTimer};
+use agentfs_sdk::op_metrics;
 use log::{debug, error, warn};
 use std::convert::TryFrom;
 use std::convert::TryInto;
+use std::io::IoSlice;
 use std::path::Path;
+use std::sync::{Arc, Mutex};
 
 use super::channel::ChannelSender;
 use super::deferred_notify::DeferredNotifier;
@@ -17,6 +21,7 @@ use super::ll::Request as _;
 use super::reply::ReplyDirectoryPlus;
 use super::reply::{Reply, ReplyDirectory, ReplySender};
 use super::session::{Session, SessionACL};
+use super::trace::{TraceEvent, TracedSender, Tracer};
 use super::Filesystem;
 use super::PollHandle;
 use super::{ll, KernelConfig};
@@ -33,6 +38,10 @@ pub struct Request<'a> {
     data: &'a [u8],
     /// Parsed request
     request: ll::AnyRequest<'a>,
+    /// Trace event completed by the reply, if the session is traced
+    trace: Mutex<Option<TraceEvent>>,
+    /// Metrics timer completed by the reply
+    timer: Mutex<Option<RequestTimer>>,
 }
 
 impl<'a> Request<'a> {
@@ -41,6 +50,7 @@ impl<'a> Request<'a> {
         ch: ChannelSender,
         deferred: &'a DeferredNotifier,
         data: &'a [u8],
+        tracer: Option<&Arc<Tracer>>,
     ) -> Option<Request<'a>> {
         let request = match ll::AnyRequest::try_from(data) {
             Ok(request) => request,
@@ -50,11 +60,16 @@ impl<'a> Request<'a> {
             }
         };
 
+        let trace = tracer.and_then(|tracer| tracer.begin(&request));
+        let timer = RequestTimer::start(&request);
+
         Some(Self {
             ch,
             deferred,
             data,
             request,
+            trace: Mutex::new(trace),
+            timer: Mutex::new(timer),
         })
     }
 
@@ -74,7 +89,7 @@ impl<'a> Request<'a> {
             Ok(None) => return,
             Err(errno) => self.request.reply_err(errno),
         }
-        .with_iovec(unique, |iov| self.ch.send(iov));
+        .with_iovec(unique, |iov| self.sender().send(iov));
 
         if let Err(err) = res {
             warn!("Request {unique:?}: Failed to send reply: {err}");
@@ -368,7 +383,7 @@ impl<'a> Request<'a> {
                     x.offset(),
                     ReplyDirectory::new(
                         self.request.unique().into(),
-                        self.ch.clone(),
+                        self.sender(),
                         x.size() as usize,
                     ),
                 );
@@ -549,7 +564,7 @@ impl<'a> Request<'a> {
                     x.offset(),
                     ReplyDirectoryPlus::new(
                         self.request.unique().into(),
-                        self.ch.clone(),
+                        self.sender(),
                         x.size() as usize,
                     ),
                 );
@@ -626,7 +641,20 @@ impl<'a> Request<'a> {
     /// Create a reply object for this request that can be passed to the filesystem
     /// implementation and makes sure that a request is replied exactly once
     fn reply<T: Reply>(&self) -> T {
-        Reply::new(self.request.unique().into(), self.ch.clone())
+        Reply::new(self.request.unique().into(), self.sender())
+    }
+
+    /// Sender for the reply to this request, which records it in the
+    /// metrics, and in the trace when the session is traced
+    fn sender(&self) -> RequestSender {
+        let ch = match self.trace.lock().unwrap().take() {
+            Some(event) => ReplyChannel::Traced(TracedSender::new(self.ch.clone(), event)),
+            None => ReplyChannel::Plain(self.ch.clone()),
+        };
+        RequestSender {
+            ch,
+            timer: Mutex::new(self.timer.lock().unwrap().take()),
+        }
     }
 
     /// Returns the unique identifier of this request
@@ -653,3 +681,192 @@ impl<'a> Request<'a> {
         self.request.pid()
     }
 }
+
+#[cfg(test)]
+impl Request<'_> {
+    /// Call `f` with a request from root, for calling [`Filesystem`] methods
+    /// directly with replies of the test's own. Replies through the request
+    /// itself are discarded.
+    pub(crate) fn with_test<R>(f: impl FnOnce(&Request<'_>) -> R) -> R {
+        #[repr(C, align(8))]
+        struct Header([u8; std::mem::size_of::<abi::fuse_in_header>()]);
+
+        let mut header = Header([0; std::mem::size_of::<abi::fuse_in_header>()]);
+        let len = header.0.len() as u32;
+        header.0[0..4].copy_from_slice(&len.to_ne_bytes());
+        header.0[8..16].copy_from_slice(&1u64.to_ne_bytes()); // unique
+        header.0[16..24].copy_from_slice(&1u64.to_ne_bytes()); // nodeid
+        let device = std::fs::OpenOptions::new()
+            .write(true)
+            .open("/dev/null")
+            .unwrap();
+        let ch = super::channel::Channel::new(Arc::new(device)).sender();
+        let (tx, _rx) = std::sync::mpsc::channel();
+        let deferred = DeferredNotifier::new(tx);
+        let req = Request::new(ch, &deferred, &header.0, None).unwrap();
+        f(&req)
+    }
+}
+
+/// Reply sender of a request. Records the reply in the `fuse.*` metrics,
+/// and in the trace when the session is traced.
+#[derive(Debug)]
+struct RequestSender {
+    ch: ReplyChannel,
+    timer: Mutex<Option<RequestTimer>>,
+}
+
+#[derive(Debug)]
+enum ReplyChannel {
+    Plain(ChannelSender),
+    Traced(TracedSender),
+}
+
+impl RequestSender {
+    fn finish(&self, reply: Option<&[IoSlice<'_>]>, spliced: usize) {
+        if let Some(timer) = self.timer.lock().unwrap().take() {
+            timer.finish(reply, spliced);
+        }
+    }
+}
+
+impl ReplySender for RequestSender {
+    fn send(&self, data: &[IoSlice<'_>]) -> std::io::Result<()> {
+        let res = match &self.ch {
+            ReplyChannel::Plain(ch) => ch.send(data),
+            ReplyChannel::Traced(ch) => ch.send(data),
+        };
+        self.finish(Some(data), 0);
+        res
+    }
+
+    fn open_backing(
+        &self,
+        fd: std::os::fd::BorrowedFd<'_>,
+    ) -> std::io::Result<super::passthrough::BackingId> {
+        match &self.ch {
+            ReplyChannel::Plain(ch) => ch.open_backing(fd),
+            ReplyChannel::Traced(ch) => ch.open_backing(fd),
+        }
+    }
+
+    fn send_spliced(
+        &self,
+        unique: u64,
+        fd: std::os::fd::BorrowedFd<'_>,
+        offset: i64,
+        len: usize,
+        move_pages: bool,
+    ) -> std::io::Result<bool> {
+        let sent = match &self.ch {
+            ReplyChannel::Plain(ch) => ch.send_spliced(unique, fd, offset, len, move_pages),
+            ReplyChannel::Traced(ch) => ch.send_spliced(unique, fd, offset, len, move_pages),
+        }?;
+        if sent {
+            // A short read at EOF splices less than `len`, which the byte
+            // counts overlook
+            self.finish(None, len);
+        }
+        Ok(sent)
+    }
+}
+
+/// A request being timed in the `fuse.*` metrics until it is replied to.
+#[derive(Debug)]
+struct RequestTimer {
+    timer: OpTimer,
+    bytes: RequestBytes,
+}
+
+/// File data moved by a request.
+#[derive(Debug, Clone, Copy)]
+enum RequestBytes {
+    None,
+    /// The payload of a successful reply, for reads and directory listings
+    Reply,
+    /// Data of a write request, if it succeeds
+    Written(u64),
+}
+
+impl RequestTimer {
+    /// Start timing `request`, `None` for requests that aren't recorded.
+    fn start(request: &ll::AnyRequest<'_>) -> Option<Self> {
+        use ll::Operation as Op;
+
+        let op = request.operation().ok()?;
+        let mut bytes = RequestBytes::None;
+        let metrics: &'static OpMetrics = match op {
+            Op::Init(_)
+            | Op::Destroy(_)
+            | Op::Forget(_)
+            | Op::BatchForget(_)
+            | Op::Interrupt(_)
+            | Op::NotifyReply(_) => return None,
+            Op::Lookup(_) => op_metrics!("fuse.lookup"),
+            Op::GetAttr(_) => op_metrics!("fuse.getattr"),
+            Op::SetAttr(_) => op_metrics!("fuse.setattr"),
+            Op::ReadLink(_) => op_metrics!("fuse.readlink"),
+            Op::SymLink(_) => op_metrics!("fuse.symlink"),
+            Op::MkNod(_) => op_metrics!("fuse.mknod"),
+            Op::MkDir(_) => op_metrics!("fuse.mkdir"),
+            Op::Unlink(_) => op_metrics!("fuse.unlink"),
+            Op::RmDir(_) => op_metrics!("fuse.rmdir"),
+            Op::Rename(_) => op_metrics!("fuse.rename"),
+            Op::Link(_) => op_metrics!("fuse.link"),
+            Op::Open(_) => op_metrics!("fuse.open"),
+            Op::Read(_) => {
+                bytes = RequestBytes::Reply;
+                op_metrics!("fuse.read")
+            }
+            Op::Write(x) => {
+                bytes = RequestBytes::Written(x.data().len() as u64);
+                op_metrics!("fuse.write")
+            }
+            Op::StatFs(_) => op_metrics!("fuse.statfs"),
+            Op::Release(_) => op_metrics!("fuse.release"),
+            Op::FSync(_) => op_metrics!("fuse.fsync"),
+            Op::Flush(_) => op_metrics!("fuse.flush"),
+            Op::OpenDir(_) => op_metrics!("fuse.opendir"),
+            Op::ReadDir(_) => {
+                bytes = RequestBytes::Reply;
+                op_metrics!("fuse.readdir")
+            }
+            Op::ReleaseDir(_) => op_metrics!("fuse.releasedir"),
+            Op::FSyncDir(_) => op_metrics!("fuse.fsyncdir"),
+            Op::Access(_) => op_metrics!("fuse.access"),
+            Op::Create(_) => op_metrics!("fuse.create"),
+            _ => op_metrics!("fuse.other"),
+        };
+        Some(Self {
+            timer: metrics.start(),
+            bytes,
+        })
+    }
+
+    /// Record the request as replied to with `reply`, or with `len` bytes of
+    /// spliced data if `reply` is `None`.
+    fn finish(self, reply: Option<&[IoSlice<'_>]>, spliced: usize) {
+        const HEADER: usize = std::mem::size_of::<abi::fuse_out_header>();
+
+        // The header is always the first slice of a reply
+        let error = reply
+            .and_then(|data| data.first())
+            .and_then(|header| header.get(4..8))
+            .map_or(0, |error| i32::from_le_bytes(error.try_into().unwrap()));
+        let ok = error == 0;
+        let bytes = match self.bytes {
+            _ if !ok => 0,
+            RequestBytes::None => 0,
+            RequestBytes::Written(n) => n,
+            RequestBytes::Reply => match reply {
+                Some(data) => data
+                    .iter()
+                    .map(|slice| slice.len())
+                    .sum::<usize>()
+                    .saturating_sub(HEADER) as u64,
+                None => spliced as u64,
+            },
+        };
+        self.timer.finish(ok, bytes);
+    }
+}
@@ -19,6 +19,7 @@ use std::sync::mpsc;
 use super::deferred_notify::{DeferredNotifier, NotifyOp};
 use super::ll::fuse_abi as abi;
 use super::request::Request;
+use super::trace::Tracer;
 use super::Filesystem;
 use super::MountOption;
 use super::{channel::Channel, mnt::Mount};
@@ -71,6 +72,8 @@ pub struct Session<FS: Filesystem> {
     notify_tx: Option<mpsc::Sender<NotifyOp>>,
     /// Receiver half — moved to the notify thread in run()
     notify_rx: Option<mpsc::Receiver<NotifyOp>>,
+    /// Records every request to a trace file, if set
+    tracer: Option<Arc<Tracer>>,
 }
 
 impl<FS: Filesystem> AsFd for Session<FS> {
@@ -130,6 +133,7 @@ impl<FS: Filesystem> Session<FS> {
             destroyed: false,
             notify_tx: Some(notify_tx),
             notify_rx: Some(notify_rx),
+            tracer: None,
         })
     }
 
@@ -150,9 +154,15 @@ impl<FS: Filesystem> Session<FS> {
             destroyed: false,
             notify_tx: Some(notify_tx),
             notify_rx: Some(notify_rx),
+            tracer: None,
         }
     }
 
+    /// Record every request of the session with `tracer`.
+    pub fn set_tracer(&mut self, tracer: Tracer) {
+        self.tracer = Some(Arc::new(tracer));
+    }
+
     /// Run the session loop that receives kernel requests and dispatches them to method
     /// calls into the filesystem. This read-dispatch-loop is non-concurrent to prevent
     /// having multiple buffers (which take up much memory), but the filesystem methods
@@ -190,7 +200,12 @@ impl<FS: Filesystem> Session<FS> {
             // The kernel driver makes sure that we get exactly one request per read
             match self.ch.receive(buf) {
                 Ok(size) => {
-                    match Request::new(self.ch.sender(), &deferred, &buf[..size]) {
+                    match Request::new(
+                        self.ch.sender(),
+                        &deferred,
+                        &buf[..size],
+                        self.tracer.as_ref(),
+                    ) {
                         // Dispatch request
                         Some(req) => req.dispatch(self),
                         // Quit loop on illegal request
@@ -220,6 +235,11 @@ impl<FS: Filesystem> Session<FS> {
         if let Err(e) = notify_handle.join() {
             warn!("notify thread panicked: {e:?}");
         }
+        if let Some(tracer) = &self.tracer {
+            if let Err(e) = tracer.flush() {
+                warn!("Failed to flush FUSE trace: {e}");
+            }
+        }
 
         result
     }
@@ -0,0 +1,576 @@
+//! Operation trace recording
+//!
+//! A [`Tracer`] attached to a [`Session`](super::Session) appends a compact binary record for
+//! every request the kernel sends, written once the reply has gone out, so it carries the
+//! request's latency and result. Inode numbers are only meaningful to the mount that handed them
+//! out, so the tracer also follows the names the kernel looks up and creates, and records the
+//! path (relative to the mount root) of each request that names a file. A trace can then be
+//! replayed against any mounted directory.
+//!
+//! The file starts with a header:
+//!
+//! ```text
+//! magic        [u8; 8]   "AFSTRACE"
+//! version      u32       TRACE_VERSION
+//! record_size  u32       size of the fixed part of a record
+//! ```
+//!
+//! followed by records, all integers little-endian:
+//!
+//! ```text
+//! time_ns      u64   arrival of the request, since the trace started
+//! latency_ns   u64   arrival to reply
+//! ino          u64   inode of the request
+//! fh           u64   file handle used, or returned by open/opendir/create
+//! offset       u64   read/write/readdir offset, new size of a truncating setattr
+//! size         u32   read/write/readdir size
+//! flags        u32   open/create flags, FATTR_* mask of setattr, access mask
+//! mode         u32   mode of mknod/mkdir/create/setattr
+//! pid          u32   thread that issued the request
+//! uid          u32   user that issued the request
+//! error        i32   errno of the reply, 0 on success
+//! opcode       u16   FUSE opcode
+//! path_len     u16   length of the path following the record, PATH_UNKNOWN if unresolved
+//! path2_len    u16   length of the second path (rename/link destination, symlink target)
+//! reserved     u16
+//! ```
+//!
+//! Forgets, interrupts and the init/destroy handshake are not recorded; forgets drop the names of
+//! the inodes they release.
+
+use log::warn;
+use std::collections::HashMap;
+use std::ffi::{OsStr, OsString};
+use std::fs::File;
+use std::io::{self, BufWriter, IoSlice, Write};
+use std::mem::size_of;
+use std::os::fd::BorrowedFd;
+use std::os::unix::ffi::OsStrExt;
+use std::path::Path;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+use super::channel::ChannelSender;
+use super::ll::fuse_abi::consts::{
+    FATTR_ATIME, FATTR_GID, FATTR_MODE, FATTR_MTIME, FATTR_SIZE, FATTR_UID,
+};
+use super::ll::fuse_abi::{fuse_entry_out, fuse_out_header, FUSE_ROOT_ID};
+use super::ll::{self, Request as _};
+use super::passthrough::BackingId;
+use super::reply::ReplySender;
+
+/// Magic bytes at the start of a trace file.
+pub const TRACE_MAGIC: &[u8; 8] = b"AFSTRACE";
+/// Version of the trace format.
+pub const TRACE_VERSION: u32 = 1;
+/// Size of the fixed part of a record.
+pub const TRACE_RECORD_SIZE: usize = 72;
+/// `path_len` of a request whose inode had no known path.
+pub const PATH_UNKNOWN: u16 = u16::MAX;
+
+/// Buffered records are written out at least this often, so a trace of a
+/// session that is torn down without unmounting cleanly loses little.
+const FLUSH_INTERVAL: Duration = Duration::from_secs(1);
+
+/// Records the requests of a FUSE session to a trace file.
+#[derive(Debug)]
+pub struct Tracer {
+    start: Instant,
+    out: Mutex<TraceWriter>,
+    paths: Mutex<PathTable>,
+}
+
+#[derive(Debug)]
+struct TraceWriter {
+    file: BufWriter<File>,
+    last_flush: Instant,
+}
+
+impl Tracer {
+    /// Create (or truncate) the trace file at `path` and write its header.
+    pub fn create(path: &Path) -> io::Result<Tracer> {
+        let mut file = BufWriter::with_capacity(1 << 20, File::create(path)?);
+        file.write_all(TRACE_MAGIC)?;
+        file.write_all(&TRACE_VERSION.to_le_bytes())?;
+        file.write_all(&(TRACE_RECORD_SIZE as u32).to_le_bytes())?;
+        Ok(Tracer {
+            start: Instant::now(),
+            out: Mutex::new(TraceWriter {
+                file,
+                last_flush: Instant::now(),
+            }),
+            paths: Mutex::new(PathTable::default()),
+        })
+    }
+
+    /// Write out buffered records.
+    pub fn flush(&self) -> io::Result<()> {
+        let mut out = self.out.lock().unwrap();
+        out.last_flush = Instant::now();
+        out.file.flush()
+    }
+
+    /// Start tracing `req`, returning the event to complete when it is replied
+    /// to, or `None` for requests that aren't recorded.
+    pub(crate) fn begin(self: &Arc<Self>, req: &ll::AnyRequest<'_>) -> Option<TraceEvent> {
+        use ll::Operation as Op;
+
+        let op = req.operation().ok()?;
+        let ino: u64 = req.nodeid().into();
+        let mut ev = TraceEvent {
+            tracer: self.clone(),
+            start: Instant::now(),
+            opcode: req.opcode() as u16,
+            ino,
+            fh: 0,
+            offset: 0,
+            size: 0,
+            flags: 0,
+            mode: 0,
+            pid: req.pid(),
+            uid: req.uid(),
+            path: None,
+            path2: None,
+            update: PathUpdate::None,
+        };
+
+        let mut paths = self.paths.lock().unwrap();
+        match op {
+            // Forgotten inodes are out of the kernel's cache, so their names go
+            Op::Forget(_) => {
+                paths.forget(ino);
+                return None;
+            }
+            Op::BatchForget(x) => {
+                for node in x.nodes() {
+                    paths.forget(node.nodeid);
+                }
+                return None;
+            }
+            Op::Init(_) | Op::Destroy(_) | Op::Interrupt(_) | Op::NotifyReply(_) => return None,
+            Op::Lookup(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.update = PathUpdate::entry(ino, x.name().as_os_str());
+            }
+            Op::MkNod(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.mode = x.mode();
+                ev.update = PathUpdate::entry(ino, x.name().as_os_str());
+            }
+            Op::MkDir(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.mode = x.mode();
+                ev.update = PathUpdate::entry(ino, x.name().as_os_str());
+            }
+            Op::Create(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.mode = x.mode();
+                ev.flags = x.flags() as u32;
+                ev.update = PathUpdate::entry(ino, x.name().as_os_str());
+            }
+            Op::SymLink(x) => {
+                ev.path = paths.child_path(ino, x.link_name().as_os_str());
+                ev.path2 = Some(x.target().as_os_str().as_bytes().to_vec());
+                ev.update = PathUpdate::entry(ino, x.link_name().as_os_str());
+            }
+            Op::Link(x) => {
+                let dest = x.dest();
+                ev.path = paths.path(x.inode_no().into());
+                ev.path2 = paths.child_path(dest.dir.into(), dest.name.as_os_str());
+                ev.update = PathUpdate::entry(dest.dir.into(), dest.name.as_os_str());
+            }
+            Op::Unlink(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.update = PathUpdate::Remove(ino, x.name().as_os_str().to_owned());
+            }
+            Op::RmDir(x) => {
+                ev.path = paths.child_path(ino, x.name().as_os_str());
+                ev.update = PathUpdate::Remove(ino, x.name().as_os_str().to_owned());
+            }
+            Op::Rename(x) => {
+                let (src, dest) = (x.src(), x.dest());
+                ev.path = paths.child_path(src.dir.into(), src.name.as_os_str());
+                ev.path2 = paths.child_path(dest.dir.into(), dest.name.as_os_str());
+                ev.update = PathUpdate::Rename {
+                    from: (src.dir.into(), src.name.as_os_str().to_owned()),
+                    to: (dest.dir.into(), dest.name.as_os_str().to_owned()),
+                };
+            }
+            Op::SetAttr(x) => {
+                ev.path = paths.path(ino);
+                ev.fh = x.file_handle().map_or(0, u64::from);
+                let set = |present: bool, bit: u32| if present { bit } else { 0 };
+                ev.flags = set(x.mode().is_some(), FATTR_MODE)
+                    | set(x.uid().is_some(), FATTR_UID)
+                    | set(x.gid().is_some(), FATTR_GID)
+                    | set(x.size().is_some(), FATTR_SIZE)
+                    | set(x.atime().is_some(), FATTR_ATIME)
+                    | set(x.mtime().is_some(), FATTR_MTIME);
+                ev.mode = x.mode().unwrap_or(0);
+                ev.offset = x.size().unwrap_or(0);
+            }
+            Op::Open(x) => {
+                ev.path = paths.path(ino);
+                ev.flags = x.flags() as u32;
+                ev.update = PathUpdate::Handle;
+            }
+            Op::OpenDir(x) => {
+                ev.path = paths.path(ino);
+                ev.flags = x.flags() as u32;
+                ev.update = PathUpdate::Handle;
+            }
+            Op::Access(x) => {
+                ev.path = paths.path(ino);
+                ev.flags = x.mask() as u32;
+            }
+            Op::Read(x) => {
+                ev.fh = x.file_handle().into();
+                ev.offset = x.offset() as u64;
+                ev.size = x.size();
+            }
+            Op::Write(x) => {
+                ev.fh = x.file_handle().into();
+                ev.offset = x.offset() as u64;
+                ev.size = x.data().len() as u32;
+            }
+            Op::ReadDir(x) => {
+                ev.fh = x.file_handle().into();
+                ev.offset = x.offset() as u64;
+                ev.size = x.size();
+            }
+            Op::Flush(x) => ev.fh = x.file_handle().into(),
+            Op::Release(x) => ev.fh = x.file_handle().into(),
+            Op::FSync(x) => {
+                ev.fh = x.file_handle().into();
+                ev.flags = x.fdatasync() as u32;
+            }
+            Op::ReleaseDir(x) => ev.fh = x.file_handle().into(),
+            Op::FSyncDir(x) => {
+                ev.fh = x.file_handle().into();
+                ev.flags = x.fdatasync() as u32;
+            }
+            // Everything else is recorded by inode and path only
+            _ => ev.path = paths.path(ino),
+        }
+        Some(ev)
+    }
+
+    /// Append a finished event to the trace.
+    fn record(&self, ev: &TraceEvent, latency: Duration, error: i32) {
+        let time = ev.start.saturating_duration_since(self.start);
+        let path_len = |path: &Option<Vec<u8>>| match path {
+            Some(p) if p.len() < PATH_UNKNOWN as usize => p.len() as u16,
+            _ => PATH_UNKNOWN,
+        };
+        let (path_len, path2_len) = (path_len(&ev.path), path_len(&ev.path2));
+
+        let mut rec = [0u8; TRACE_RECORD_SIZE];
+        let mut at = 0;
+        let mut put = |bytes: &[u8]| {
+            rec[at..at + bytes.len()].copy_from_slice(bytes);
+            at += bytes.len();
+        };
+        put(&(time.as_nanos() as u64).to_le_bytes());
+        put(&(latency.as_nanos() as u64).to_le_bytes());
+        put(&ev.ino.to_le_bytes());
+        put(&ev.fh.to_le_bytes());
+        put(&ev.offset.to_le_bytes());
+        put(&ev.size.to_le_bytes());
+        put(&ev.flags.to_le_bytes());
+        put(&ev.mode.to_le_bytes());
+        put(&ev.pid.to_le_bytes());
+        put(&ev.uid.to_le_bytes());
+        put(&error.to_le_bytes());
+        put(&ev.opcode.to_le_bytes());
+        put(&path_len.to_le_bytes());
+        put(&path2_len.to_le_bytes());
+
+        let mut out = self.out.lock().unwrap();
+        let mut res = out.file.write_all(&rec);
+        for (path, len) in [(&ev.path, path_len), (&ev.path2, path2_len)] {
+            if let (Some(p), true) = (path, len != PATH_UNKNOWN) {
+                res = res.and_then(|_| out.file.write_all(p));
+            }
+        }
+        if res.is_ok() && out.last_flush.elapsed() >= FLUSH_INTERVAL {
+            out.last_flush = Instant::now();
+            res = out.file.flush();
+        }
+        if let Err(err) = res {
+            warn!("Failed to write FUSE trace record: {err}");
+        }
+    }
+}
+
+impl Drop for Tracer {
+    fn drop(&mut self) {
+        if let Err(err) = self.flush() {
+            warn!("Failed to flush FUSE trace: {err}");
+        }
+    }
+}
+
+/// Last known name of each inode the kernel has looked up or created.
+#[derive(Debug, Default)]
+struct PathTable {
+    /// Inode -> (parent inode, name)
+    names: HashMap<u64, (u64, OsString)>,
+    /// (parent inode, name) -> inode
+    children: HashMap<(u64, OsString), u64>,
+}
+
+impl PathTable {
+    /// Longest parent chain followed, in case of a cycle left by a stale entry.
+    const MAX_DEPTH: usize = 4096;
+
+    fn path(&self, mut ino: u64) -> Option<Vec<u8>> {
+        let mut names = Vec::new();
+        while ino != FUSE_ROOT_ID {
+            let (parent, name) = self.names.get(&ino)?;
+            if names.len() == Self::MAX_DEPTH {
+                return None;
+            }
+            names.push(name.as_bytes());
+            ino = *parent;
+        }
+        let mut path = Vec::new();
+        for name in names.iter().rev() {
+            if !path.is_empty() {
+                path.push(b'/');
+            }
+            path.extend_from_slice(name);
+        }
+        Some(path)
+    }
+
+    fn child_path(&self, parent: u64, name: &OsStr) -> Option<Vec<u8>> {
+        let mut path = self.path(parent)?;
+        if !path.is_empty() {
+            path.push(b'/');
+        }
+        path.extend_from_slice(name.as_bytes());
+        Some(path)
+    }
+
+    fn insert(&mut self, ino: u64, parent: u64, name: OsString) {
+        let key = (parent, name);
+        // Keep a single name per inode, so forgetting it drops every entry
+        if let Some(old) = self.names.insert(ino, key.clone()) {
+            if old != key && self.children.get(&old) == Some(&ino) {
+                self.children.remove(&old);
+            }
+        }
+        self.children.insert(key, ino);
+    }
+
+    fn remove(&mut self, parent: u64, name: OsString) -> Option<u64> {
+        let key = (parent, name);
+        let ino = self.children.remove(&key)?;
+        if self.names.get(&ino) == Some(&key) {
+            self.names.remove(&ino);
+        }
+        Some(ino)
+    }
+
+    /// Drop `ino`, which the kernel no longer knows by any name.
+    fn forget(&mut self, ino: u64) {
+        if let Some(key) = self.names.remove(&ino) {
+            if self.children.get(&key) == Some(&ino) {
+                self.children.remove(&key);
+            }
+        }
+    }
+}
+
+/// How a successful reply changes the path table, or which handle it returns.
+#[derive(Debug)]
+enum PathUpdate {
+    None,
+    /// The reply carries the inode of `name` in `parent`
+    Entry(u64, OsString),
+    /// The reply carries a file handle
+    Handle,
+    Remove(u64, OsString),
+    Rename {
+        from: (u64, OsString),
+        to: (u64, OsString),
+    },
+}
+
+impl PathUpdate {
+    fn entry(parent: u64, name: &OsStr) -> Self {
+        PathUpdate::Entry(parent, name.to_owned())
+    }
+}
+
+/// A request being traced, recorded once it is replied to.
+#[derive(Debug)]
+pub(crate) struct TraceEvent {
+    tracer: Arc<Tracer>,
+    start: Instant,
+    opcode: u16,
+    ino: u64,
+    fh: u64,
+    offset: u64,
+    size: u32,
+    flags: u32,
+    mode: u32,
+    pid: u32,
+    uid: u32,
+    path: Option<Vec<u8>>,
+    path2: Option<Vec<u8>>,
+    update: PathUpdate,
+}
+
+impl TraceEvent {
+    /// Complete the event with the reply in `data`.
+    fn finish(mut self, data: &[IoSlice<'_>]) {
+        let latency = self.start.elapsed();
+
+        // Only the header and the fixed part of entry/open replies are needed
+        const HEADER: usize = size_of::<fuse_out_header>();
+        const ENTRY: usize = size_of::<fuse_entry_out>();
+        let mut head = [0u8; HEADER + ENTRY + 8];
+        let mut len = 0;
+        for slice in data {
+            let n = slice.len().min(head.len() - len);
+            head[len..len + n].copy_from_slice(&slice[..n]);
+            len += n;
+            if len == head.len() {
+                break;
+            }
+        }
+        let u64_at = |at: usize| {
+            (len >= at + 8).then(|| u64::from_le_bytes(head[at..at + 8].try_into().unwrap()))
+        };
+        let error = if len >= 8 {
+            -i32::from_le_bytes(head[4..8].try_into().unwrap())
+        } else {
+            0
+        };
+
+        if error == 0 {
+            let opcode = self.opcode as u32;
+            match std::mem::replace(&mut self.update, PathUpdate::None) {
+                PathUpdate::None => {}
+                PathUpdate::Entry(parent, name) => {
+                    if opcode == ll::fuse_abi::fuse_opcode::FUSE_CREATE as u32 {
+                        self.fh = u64_at(HEADER + ENTRY).unwrap_or(0);
+                    }
+                    // A zero node id is a cached negative lookup
+                    if let Some(ino) = u64_at(HEADER).filter(|&ino| ino != 0) {
+                        self.tracer.paths.lock().unwrap().insert(ino, parent, name);
+                    }
+                }
+                PathUpdate::Handle => self.fh = u64_at(HEADER).unwrap_or(0),
+                PathUpdate::Remove(parent, name) => {
+                    self.tracer.paths.lock().unwrap().remove(parent, name);
+                }
+                PathUpdate::Rename { from, to } => {
+                    let mut paths = self.tracer.paths.lock().unwrap();
+                    paths.remove(to.0, to.1.clone());
+                    if let Some(ino) = paths.remove(from.0, from.1) {
+                        paths.insert(ino, to.0, to.1);
+                    }
+                }
+            }
+        }
+
+        self.tracer.record(&self, latency, error);
+    }
+}
+
+/// Reply sender of a traced request, which records the request once the
+/// reply has been sent.
+#[derive(Debug)]
+pub(crate) struct TracedSender {
+    ch: ChannelSender,
+    event: Mutex<Option<TraceEvent>>,
+}
+
+impl TracedSender {
+    pub(crate) fn new(ch: ChannelSender, event: TraceEvent) -> Self {
+        TracedSender {
+            ch,
+            event: Mutex::new(Some(event)),
+        }
+    }
+
+    fn finish(&self, data: &[IoSlice<'_>]) {
+        if let Some(event) = self.event.lock().unwrap().take() {
+            event.finish(data);
+        }
+    }
+}
+
+impl ReplySender for TracedSender {
+    fn send(&self, data: &[IoSlice<'_>]) -> io::Result<()> {
+        let res = self.ch.send(data);
+        self.finish(data);
+        res
+    }
+
+    fn open_backing(&self, fd: BorrowedFd<'_>) -> io::Result<BackingId> {
+        self.ch.open_backing(fd)
+    }
+
+    fn send_spliced(
+        &self,
+        unique: u64,
+        fd: BorrowedFd<'_>,
+        offset: i64,
+        len: usize,
+        move_pages: bool,
+    ) -> io::Result<bool> {
+        let sent = self.ch.send_spliced(unique, fd, offset, len, move_pages)?;
+        if sent {
+            self.finish(&[]);
+        }
+        Ok(sent)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn path_table_follows_renames_and_unlinks() {
+        let mut paths = PathTable::default();
+        paths.insert(2, FUSE_ROOT_ID, "dir".into());
+        paths.insert(3, 2, "file".into());
+
+        assert_eq!(paths.path(FUSE_ROOT_ID), Some(Vec::new()));
+        assert_eq!(paths.path(3), Some(b"dir/file".to_vec()));
+        assert_eq!(
+            paths.child_path(2, OsStr::new("new")),
+            Some(b"dir/new".to_vec())
+        );
+
+        let ino = paths.remove(2, "file".into()).unwrap();
+        paths.insert(ino, FUSE_ROOT_ID, "moved".into());
+        assert_eq!(paths.path(3), Some(b"moved".to_vec()));
+
+        paths.remove(FUSE_ROOT_ID, "moved".into());
+        assert_eq!(paths.path(3), None);
+        assert_eq!(paths.child_path(4, OsStr::new("x")), None);
+    }
+
+    #[test]
+    fn path_table_drops_forgotten_inodes() {
+        let mut paths = PathTable::default();
+        paths.insert(2, FUSE_ROOT_ID, "dir".into());
+        paths.insert(3, 2, "file".into());
+        // A second name of the same inode replaces the first
+        paths.insert(3, FUSE_ROOT_ID, "link".into());
+        assert_eq!(paths.path(3), Some(b"link".to_vec()));
+        assert_eq!(paths.children.len(), 2);
+
+        paths.forget(3);
+        paths.forget(2);
+        assert!(paths.names.is_empty());
+        assert!(paths.children.is_empty());
+        assert_eq!(paths.path(3), None);
+        paths.forget(4);
+    }
+}
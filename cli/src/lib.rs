@@ -20,6 +20,9 @@ pub mod nfs;
 #[cfg(unix)]
 pub mod mount;
 
+#[cfg(unix)]
+pub mod stats;
+
 pub fn get_runtime() -> tokio::runtime::Runtime {
     tokio::runtime::Runtime::new().expect("Internal error: failed to initialize runtime")
 }
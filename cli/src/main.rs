@@ -45,6 +45,11 @@ fn main() {
             base,
             key,
             cipher,
+            chunk_size,
+            dedup,
+            compression,
+            deferred_reclaim,
+            size_classes,
             command,
             backend,
             sync,
@@ -58,6 +63,11 @@ fn main() {
                 force,
                 base,
                 encryption_opts,
+                chunk_size,
+                dedup,
+                compression,
+                deferred_reclaim,
+                size_classes,
                 command,
                 backend,
             )) {
@@ -110,6 +120,8 @@ fn main() {
             system,
             key,
             cipher,
+            trace,
+            warm_up,
             command,
             args,
         } => {
@@ -124,6 +136,8 @@ fn main() {
                 session,
                 system,
                 encryption,
+                trace,
+                warm_up,
                 command,
                 args,
             )) {
@@ -159,6 +173,12 @@ fn main() {
             uid,
             gid,
             backend,
+            serial,
+            dentry_cache_size,
+            passthrough,
+            trace,
+            stats,
+            auto_sync,
         } => match (id_or_path, mountpoint) {
             (Some(id_or_path), Some(mountpoint)) => {
                 if let Err(e) = cmd::mount(cmd::MountArgs {
@@ -171,6 +191,12 @@ fn main() {
                     uid,
                     gid,
                     backend,
+                    concurrent: !serial,
+                    dentry_cache_size,
+                    passthrough,
+                    trace,
+                    stats,
+                    auto_sync,
                 }) {
                     eprintln!("Error: {}", e);
                     std::process::exit(1);
@@ -256,6 +282,18 @@ fn main() {
                         std::process::exit(1);
                     }
                 }
+                #[cfg(unix)]
+                FsCommand::Import { host_dir, fs_path } => {
+                    if let Err(e) = rt.block_on(cmd::fs::import_filesystem(
+                        id_or_path,
+                        &host_dir,
+                        &fs_path,
+                        encryption.as_ref(),
+                    )) {
+                        eprintln!("Error: {}", e);
+                        std::process::exit(1);
+                    }
+                }
             }
         }
         Command::Completions { command } => handle_completions(command),
@@ -307,8 +345,8 @@ fn main() {
                 }
             }
         },
-        Command::Ps => {
-            if let Err(e) = cmd::ps::list_ps(&mut std::io::stdout()) {
+        Command::Ps { stats } => {
+            if let Err(e) = cmd::ps::list_ps(&mut std::io::stdout(), stats) {
                 eprintln!("Error: {}", e);
                 std::process::exit(1);
             }
@@ -9,7 +9,7 @@
 //! use agentfs_cli::mount::{mount_fs, MountOpts, MountBackend};
 //!
 //! let opts = MountOpts::new(PathBuf::from("/mnt/agent"), MountBackend::Fuse);
-//! let handle = mount_fs(Arc::new(Mutex::new(my_fs)), opts).await?;
+//! let handle = mount_fs(Arc::new(my_fs), opts).await?;
 //! // ... use the mounted filesystem ...
 //! drop(handle); // auto-unmounts
 //! ```
@@ -22,7 +22,6 @@ use anyhow::Result;
 use std::path::{Path, PathBuf};
 use std::sync::Arc;
 use std::time::Duration;
-use tokio::sync::Mutex;
 use tokio_util::sync::CancellationToken;
 
 pub use crate::opts::MountBackend;
@@ -56,6 +55,10 @@ pub struct MountOpts {
     pub lazy_unmount: bool,
     /// Timeout for mount to become ready.
     pub timeout: Duration,
+    /// Dispatch requests concurrently instead of one at a time (FUSE only).
+    pub concurrent: bool,
+    /// Record every request to this trace file (FUSE only).
+    pub trace: Option<PathBuf>,
 }
 
 impl MountOpts {
@@ -72,6 +75,8 @@ impl MountOpts {
             auto_unmount: false,
             lazy_unmount: false,
             timeout: DEFAULT_MOUNT_TIMEOUT,
+            concurrent: true,
+            trace: None,
         }
     }
 }
@@ -161,10 +166,11 @@ pub fn unmount(mountpoint: &Path, backend: MountBackend, lazy: bool) -> Result<(
 /// Mount a filesystem with the given options.
 ///
 /// Returns a handle that automatically unmounts when dropped.
-/// The filesystem must be wrapped in `Arc<Mutex<dyn FileSystem + Send>>`.
+/// The filesystem is shared with the backend as `Arc<dyn FileSystem>`; FUSE may
+/// call into it concurrently, so implementations must synchronize internally.
 #[cfg(target_os = "linux")]
 pub async fn mount_fs(
-    fs: Arc<Mutex<dyn agentfs_sdk::FileSystem + Send>>,
+    fs: Arc<dyn agentfs_sdk::FileSystem>,
     opts: MountOpts,
 ) -> Result<MountHandle> {
     match opts.backend {
@@ -176,7 +182,7 @@ pub async fn mount_fs(
 /// Mount a filesystem with the given options (macOS version).
 #[cfg(target_os = "macos")]
 pub async fn mount_fs(
-    fs: Arc<Mutex<dyn agentfs_sdk::FileSystem + Send>>,
+    fs: Arc<dyn agentfs_sdk::FileSystem>,
     opts: MountOpts,
 ) -> Result<MountHandle> {
     match opts.backend {
@@ -4,7 +4,10 @@
 //! FileSystem trait, enabling systems to mount AgentFS via NFS without requiring
 //! FUSE or other system extensions.
 
-use std::sync::Arc;
+use std::collections::{HashMap, VecDeque};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex as StdMutex};
+use std::time::Duration;
 
 use libc::{O_RDONLY, O_RDWR};
 
@@ -16,8 +19,8 @@ use crate::nfsserve::vfs::{auth_unix, DirEntry, NFSFileSystem, ReadDirResult, VF
 use agentfs_sdk::error::Error as SdkError;
 use agentfs_sdk::filesystem::FsError;
 use agentfs_sdk::{
-    FileSystem, Stats, TimeChange, S_IFBLK, S_IFCHR, S_IFDIR, S_IFIFO, S_IFLNK, S_IFMT, S_IFREG,
-    S_IFSOCK,
+    BoxedDirectory, BoxedFile, FileSystem, MeteredFileSystem, Stats, TimeChange, S_IFBLK, S_IFCHR,
+    S_IFDIR, S_IFIFO, S_IFLNK, S_IFMT, S_IFREG, S_IFSOCK,
 };
 use async_trait::async_trait;
 use tokio::sync::Mutex;
@@ -25,6 +28,15 @@ use tokio::sync::Mutex;
 /// Root directory inode number
 const ROOT_INO: fileid3 = 1;
 
+/// How often files with unstable writes are committed without a COMMIT
+const UNSTABLE_FLUSH_INTERVAL: Duration = Duration::from_secs(5);
+
+/// Entries fetched from a directory stream per page
+const READDIR_PAGE: usize = 256;
+
+/// Directory listings kept open between READDIR calls
+const MAX_DIR_CURSORS: usize = 64;
+
 /// Convert a fileid3 to a filesystem inode number.
 fn id_to_fs_ino(id: fileid3) -> i64 {
     id as i64
@@ -53,14 +65,181 @@ fn error_to_nfsstat(e: SdkError) -> nfsstat3 {
 
 /// NFS adapter that wraps an AgentFS FileSystem.
 pub struct AgentNFS {
-    /// The underlying filesystem (wrapped in Mutex to serialize operations)
-    fs: Arc<Mutex<dyn FileSystem>>,
+    /// The underlying filesystem
+    fs: Arc<dyn FileSystem>,
+    /// Listings in progress, by directory, resumed by the next READDIR
+    dir_cursors: Mutex<HashMap<fileid3, DirCursor>>,
+    /// Directories whose entries are being created or removed
+    dir_locks: DirLocks,
+    /// Handles of files with unstable writes that may not be committed yet
+    unstable: Arc<Mutex<HashMap<fileid3, BoxedFile>>>,
+    /// Whether the task committing unstable writes periodically is running
+    flusher_started: AtomicBool,
+    /// How often the flusher commits unstable writes
+    flush_interval: Duration,
+}
+
+/// Locks of directories, held by the RPCs changing their entries and going
+/// away with the last of them.
+///
+/// CREATE with EXCLUSIVE looks the name up before creating it, and REMOVE
+/// looks at the type of the entry before unlinking or removing it; each
+/// holds the lock of its directory so no other RPC changes the entry in
+/// between. Other RPCs run concurrently.
+#[derive(Default)]
+struct DirLocks(StdMutex<HashMap<fileid3, Arc<Mutex<()>>>>);
+
+impl DirLocks {
+    /// Wait for the lock of directory `dirid`
+    async fn lock(&self, dirid: fileid3) -> DirGuard<'_> {
+        let lock = self.0.lock().unwrap().entry(dirid).or_default().clone();
+        let guard = lock.clone().lock_owned().await;
+        DirGuard {
+            locks: self,
+            dirid,
+            lock,
+            guard: Some(guard),
+        }
+    }
+
+    /// Wait for the locks of directories `a` and `b`, in inode order so two
+    /// RPCs locking the same two can't deadlock
+    async fn lock_both(&self, a: fileid3, b: fileid3) -> (DirGuard<'_>, Option<DirGuard<'_>>) {
+        if a == b {
+            return (self.lock(a).await, None);
+        }
+        let first = self.lock(a.min(b)).await;
+        let second = self.lock(a.max(b)).await;
+        (first, Some(second))
+    }
+}
+
+/// Lock of a directory, from [`DirLocks::lock()`]
+struct DirGuard<'a> {
+    locks: &'a DirLocks,
+    dirid: fileid3,
+    lock: Arc<Mutex<()>>,
+    guard: Option<tokio::sync::OwnedMutexGuard<()>>,
+}
+
+impl Drop for DirGuard<'_> {
+    fn drop(&mut self) {
+        self.guard.take();
+        // Waiters clone the lock under the map's lock, so none is left if
+        // only the map and this guard hold it
+        let mut locks = self.locks.0.lock().unwrap();
+        if Arc::strong_count(&self.lock) == 2 {
+            locks.remove(&self.dirid);
+        }
+    }
+}
+
+/// An open directory stream positioned after the entry `last`.
+///
+/// NFS clients continue a listing with the fileid of the last entry they got
+/// as cookie, so the stream is resumed when the cookie matches `last`.
+struct DirCursor {
+    dir: BoxedDirectory,
+    /// Fileid of the last entry returned, 0 before the first one
+    last: fileid3,
+    /// Entries read from the stream but not returned yet
+    pending: VecDeque<agentfs_sdk::DirEntry>,
+    /// Whether the stream has no entries left
+    done: bool,
+}
+
+impl DirCursor {
+    fn new(dir: BoxedDirectory) -> Self {
+        Self {
+            dir,
+            last: 0,
+            pending: VecDeque::new(),
+            done: false,
+        }
+    }
+
+    /// Fetch the next page if all read entries have been returned.
+    async fn fill(&mut self) -> Result<(), SdkError> {
+        if self.pending.is_empty() && !self.done {
+            let page = self.dir.next_entries(READDIR_PAGE).await?;
+            self.done = page.len() < READDIR_PAGE;
+            self.pending.extend(page);
+        }
+        Ok(())
+    }
+
+    /// Take the next entry of the stream.
+    async fn next(&mut self) -> Result<Option<agentfs_sdk::DirEntry>, SdkError> {
+        self.fill().await?;
+        let entry = self.pending.pop_front();
+        if let Some(ref entry) = entry {
+            self.last = entry.stats.ino as fileid3;
+        }
+        Ok(entry)
+    }
+
+    /// Whether the stream is exhausted.
+    async fn at_end(&mut self) -> Result<bool, SdkError> {
+        self.fill().await?;
+        Ok(self.pending.is_empty())
+    }
 }
 
 impl AgentNFS {
-    /// Create a new NFS adapter wrapping the given filesystem.
-    pub fn new(fs: Arc<Mutex<dyn FileSystem>>) -> Self {
-        AgentNFS { fs }
+    /// Create a new NFS adapter wrapping the given filesystem, whose calls
+    /// are recorded in the `fs.*` metrics.
+    pub fn new(fs: Arc<dyn FileSystem>) -> Self {
+        AgentNFS {
+            fs: Arc::new(MeteredFileSystem::new(fs)),
+            dir_cursors: Mutex::new(HashMap::new()),
+            dir_locks: DirLocks::default(),
+            unstable: Arc::new(Mutex::new(HashMap::new())),
+            flusher_started: AtomicBool::new(false),
+            flush_interval: UNSTABLE_FLUSH_INTERVAL,
+        }
+    }
+
+    /// Handle to write unstable data of `id` through, the one already held
+    /// for it if any.
+    ///
+    /// With write-back enabled on the filesystem, writes through the handle
+    /// are buffered and committed together by its next flush.
+    async fn unstable_file(&self, id: fileid3) -> Result<BoxedFile, nfsstat3> {
+        if let Some(file) = self.unstable.lock().await.get(&id) {
+            return Ok(file.clone());
+        }
+        self.fs
+            .open(id_to_fs_ino(id), O_RDWR)
+            .await
+            .map_err(error_to_nfsstat)
+    }
+
+    /// Start committing unstable writes in the background, for clients
+    /// that are slow to send COMMIT.
+    fn start_flusher(&self) {
+        if self.flusher_started.swap(true, Ordering::Relaxed) {
+            return;
+        }
+        let unstable = Arc::downgrade(&self.unstable);
+        let period = self.flush_interval;
+        tokio::spawn(async move {
+            let start = tokio::time::Instant::now() + period;
+            let mut interval = tokio::time::interval_at(start, period);
+            loop {
+                interval.tick().await;
+                let Some(unstable) = unstable.upgrade() else {
+                    break;
+                };
+                let files: Vec<_> = unstable.lock().await.drain().collect();
+                for (id, file) in files {
+                    if let Err(e) = file.flush().await {
+                        // Keep the handle, so COMMIT tries again and reports the error
+                        tracing::warn!("NFS: failed to commit writes of {}: {}", id, e);
+                        unstable.lock().await.entry(id).or_insert(file);
+                    }
+                }
+            }
+        });
     }
 
     /// Convert AgentFS Stats to NFS fattr3.
@@ -127,7 +306,7 @@ impl NFSFileSystem for AgentNFS {
             return Ok(dirid);
         }
 
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
 
         // Handle .. via filesystem lookup
         if name == ".." {
@@ -161,7 +340,7 @@ impl NFSFileSystem for AgentNFS {
     }
 
     async fn getattr(&self, id: fileid3) -> Result<fattr3, nfsstat3> {
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
         let stats = fs
             .getattr(id_to_fs_ino(id))
             .await
@@ -173,7 +352,7 @@ impl NFSFileSystem for AgentNFS {
 
     async fn setattr(&self, id: fileid3, setattr: sattr3) -> Result<fattr3, nfsstat3> {
         let fs_ino = id_to_fs_ino(id);
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
 
         // Handle chmod (mode change)
         if let set_mode3::mode(mode) = setattr.mode {
@@ -236,7 +415,7 @@ impl NFSFileSystem for AgentNFS {
         offset: u64,
         count: u32,
     ) -> Result<(Vec<u8>, bool), nfsstat3> {
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
 
         let file = fs
             .open(id_to_fs_ino(id), O_RDONLY)
@@ -255,13 +434,15 @@ impl NFSFileSystem for AgentNFS {
     }
 
     async fn write(&self, id: fileid3, offset: u64, data: &[u8]) -> Result<fattr3, nfsstat3> {
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
 
         let file = fs
             .open(id_to_fs_ino(id), O_RDWR)
             .await
             .map_err(error_to_nfsstat)?;
         file.pwrite(offset, data).await.map_err(error_to_nfsstat)?;
+        // A stable write must be committed before we reply
+        file.flush().await.map_err(error_to_nfsstat)?;
 
         let stats = fs
             .getattr(id_to_fs_ino(id))
@@ -272,6 +453,54 @@ impl NFSFileSystem for AgentNFS {
         Ok(self.stats_to_fattr(&stats))
     }
 
+    async fn write_unstable(
+        &self,
+        id: fileid3,
+        offset: u64,
+        data: &[u8],
+    ) -> Result<fattr3, nfsstat3> {
+        let file = self.unstable_file(id).await?;
+        file.pwrite(offset, data).await.map_err(error_to_nfsstat)?;
+        // Hold the handle only once written through: the flusher may have
+        // committed and let go of it while the write was in progress
+        self.unstable.lock().await.entry(id).or_insert(file);
+        self.start_flusher();
+
+        let stats = self
+            .fs
+            .getattr(id_to_fs_ino(id))
+            .await
+            .map_err(error_to_nfsstat)?
+            .ok_or(nfsstat3::NFS3ERR_NOENT)?;
+        Ok(self.stats_to_fattr(&stats))
+    }
+
+    async fn commit(&self, id: fileid3) -> Result<fattr3, nfsstat3> {
+        // Buffers belong to the inode, so a new handle also commits writes
+        // made through one the background flusher has already let go of
+        let held = self.unstable.lock().await.remove(&id);
+        let file = match held {
+            Some(file) => file,
+            None => self
+                .fs
+                .open(id_to_fs_ino(id), O_RDWR)
+                .await
+                .map_err(error_to_nfsstat)?,
+        };
+        if let Err(e) = file.flush().await {
+            self.unstable.lock().await.entry(id).or_insert(file);
+            return Err(error_to_nfsstat(e));
+        }
+
+        let stats = self
+            .fs
+            .getattr(id_to_fs_ino(id))
+            .await
+            .map_err(error_to_nfsstat)?
+            .ok_or(nfsstat3::NFS3ERR_NOENT)?;
+        Ok(self.stats_to_fattr(&stats))
+    }
+
     async fn create(
         &self,
         dirid: fileid3,
@@ -288,7 +517,8 @@ impl NFSFileSystem for AgentNFS {
             set_mode3::Void => 0o644,
         };
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
         let (stats, _file) = fs
             .create_file(dir_fs_ino, name, S_IFREG | mode, auth.uid, auth.gid)
             .await
@@ -308,7 +538,8 @@ impl NFSFileSystem for AgentNFS {
         let dir_fs_ino = id_to_fs_ino(dirid);
         let name = std::str::from_utf8(filename).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
 
         // Check if file already exists
         if fs
@@ -345,7 +576,8 @@ impl NFSFileSystem for AgentNFS {
             set_mode3::Void => 0o755,
         };
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
 
         let stats = fs
             .mkdir(dir_fs_ino, name, mode, auth.uid, auth.gid)
@@ -387,7 +619,8 @@ impl NFSFileSystem for AgentNFS {
         // Convert rdev from specdata3 (major/minor) to u64
         let rdev_val = libc::makedev(rdev.specdata1 as _, rdev.specdata2 as _) as u64;
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
 
         let stats = fs
             .mknod(
@@ -410,7 +643,8 @@ impl NFSFileSystem for AgentNFS {
         let dir_fs_ino = id_to_fs_ino(dirid);
         let name = std::str::from_utf8(filename).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
 
         // Check if it's a file or directory and use appropriate method
         let stats = fs
@@ -442,7 +676,8 @@ impl NFSFileSystem for AgentNFS {
         let from_name = std::str::from_utf8(from_filename).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
         let to_name = std::str::from_utf8(to_filename).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
 
-        let fs = self.fs.lock().await;
+        let _locks = self.dir_locks.lock_both(from_dirid, to_dirid).await;
+        let fs = &self.fs;
 
         fs.rename(from_dir_fs_ino, from_name, to_dir_fs_ino, to_name)
             .await
@@ -461,7 +696,8 @@ impl NFSFileSystem for AgentNFS {
         let dir_fs_ino = id_to_fs_ino(dirid);
         let name = std::str::from_utf8(filename).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
         let stats = fs
             .link(fs_ino, dir_fs_ino, name)
             .await
@@ -478,49 +714,62 @@ impl NFSFileSystem for AgentNFS {
     ) -> Result<ReadDirResult, nfsstat3> {
         let dir_fs_ino = id_to_fs_ino(dirid);
 
-        let fs = self.fs.lock().await;
-
-        let entries = fs
-            .readdir_plus(dir_fs_ino)
+        // Resume the listing this call continues, if it is still open
+        let cursor = self
+            .dir_cursors
+            .lock()
             .await
-            .map_err(error_to_nfsstat)?
-            .ok_or(nfsstat3::NFS3ERR_NOENT)?;
-
-        drop(fs);
+            .remove(&dirid)
+            .filter(|cursor| start_after != 0 && cursor.last == start_after);
+
+        let mut cursor = match cursor {
+            Some(cursor) => cursor,
+            None => {
+                let dir = self
+                    .fs
+                    .opendir(dir_fs_ino)
+                    .await
+                    .map_err(error_to_nfsstat)?
+                    .ok_or(nfsstat3::NFS3ERR_NOENT)?;
+                let mut cursor = DirCursor::new(dir);
+                // Otherwise find the start position in a new listing
+                if start_after > 0 {
+                    while let Some(entry) = cursor.next().await.map_err(error_to_nfsstat)? {
+                        if entry.stats.ino as fileid3 == start_after {
+                            break;
+                        }
+                    }
+                }
+                cursor
+            }
+        };
 
         let mut result = ReadDirResult {
             entries: Vec::new(),
             end: false,
         };
 
-        // Find start position if start_after is specified
-        let mut skip = start_after > 0;
-        let mut skipped_count = 0;
-
-        for entry in entries.iter() {
-            let ino = entry.stats.ino as fileid3;
-
-            if skip {
-                if ino == start_after {
-                    skip = false;
-                }
-                skipped_count += 1;
-                continue;
-            }
-
-            if result.entries.len() >= max_entries {
+        while result.entries.len() < max_entries {
+            let Some(entry) = cursor.next().await.map_err(error_to_nfsstat)? else {
                 break;
-            }
-
+            };
             result.entries.push(DirEntry {
-                fileid: ino,
+                fileid: entry.stats.ino as fileid3,
                 name: entry.name.as_bytes().into(),
                 attr: self.stats_to_fattr(&entry.stats),
             });
         }
 
         // Mark as end if we've returned all remaining entries
-        result.end = result.entries.len() + skipped_count >= entries.len();
+        result.end = cursor.at_end().await.map_err(error_to_nfsstat)?;
+
+        if !result.end {
+            let mut cursors = self.dir_cursors.lock().await;
+            if cursors.len() >= MAX_DIR_CURSORS {
+                cursors.clear();
+            }
+            cursors.insert(dirid, cursor);
+        }
 
         Ok(result)
     }
@@ -537,7 +786,8 @@ impl NFSFileSystem for AgentNFS {
         let name = std::str::from_utf8(linkname).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
         let target = std::str::from_utf8(symlink).map_err(|_| nfsstat3::NFS3ERR_INVAL)?;
 
-        let fs = self.fs.lock().await;
+        let _lock = self.dir_locks.lock(dirid).await;
+        let fs = &self.fs;
 
         let stats = fs
             .symlink(dir_fs_ino, name, target, auth.uid, auth.gid)
@@ -550,7 +800,7 @@ impl NFSFileSystem for AgentNFS {
     }
 
     async fn readlink(&self, id: fileid3) -> Result<nfspath3, nfsstat3> {
-        let fs = self.fs.lock().await;
+        let fs = &self.fs;
 
         let target = fs
             .readlink(id_to_fs_ino(id))
@@ -561,3 +811,134 @@ impl NFSFileSystem for AgentNFS {
         Ok(target.into_bytes().into())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use agentfs_sdk::{AgentFS, AgentFSOptions};
+
+    /// Adapter over a write-back filesystem holding one empty file, and the
+    /// filesystem itself to look at what is committed
+    async fn setup() -> (AgentNFS, Arc<agentfs_sdk::filesystem::AgentFS>, fileid3) {
+        let fs = Arc::new(AgentFS::open(AgentFSOptions::ephemeral()).await.unwrap().fs);
+        fs.set_write_back(true);
+        let (stats, _) = fs
+            .create_file("/a.txt", S_IFREG | 0o644, 0, 0)
+            .await
+            .unwrap();
+        let mut nfs = AgentNFS::new(fs.clone());
+        nfs.flush_interval = Duration::from_millis(50);
+        (nfs, fs, stats.ino as fileid3)
+    }
+
+    /// Number of chunks of `id` committed to the database
+    async fn committed_chunks(fs: &agentfs_sdk::filesystem::AgentFS, id: fileid3) -> i64 {
+        let conn = fs.get_read_connection().await.unwrap();
+        let mut rows = conn
+            .query(
+                "SELECT COUNT(*) FROM fs_data WHERE ino = ?",
+                (id_to_fs_ino(id),),
+            )
+            .await
+            .unwrap();
+        let row = rows.next().await.unwrap().unwrap();
+        row.get_value(0).unwrap().as_integer().copied().unwrap()
+    }
+
+    #[tokio::test]
+    async fn test_unstable_write_is_committed_by_commit() {
+        let (mut nfs, fs, id) = setup().await;
+        nfs.flush_interval = Duration::from_secs(3600);
+
+        let attr = nfs.write_unstable(id, 0, b"hello").await.unwrap();
+        assert_eq!(attr.size, 5);
+        assert_eq!(committed_chunks(&fs, id).await, 0);
+
+        let attr = nfs.commit(id).await.unwrap();
+        assert_eq!(attr.size, 5);
+        assert_eq!(committed_chunks(&fs, id).await, 1);
+        assert!(nfs.unstable.lock().await.is_empty());
+        assert_eq!(fs.read_file("/a.txt").await.unwrap().unwrap(), b"hello");
+    }
+
+    #[tokio::test]
+    async fn test_unstable_write_is_committed_by_flusher() {
+        let (nfs, fs, id) = setup().await;
+
+        nfs.write_unstable(id, 0, b"hello").await.unwrap();
+        assert_eq!(committed_chunks(&fs, id).await, 0);
+
+        // The flusher commits the write and lets go of the handle
+        let deadline = tokio::time::Instant::now() + Duration::from_secs(10);
+        while !nfs.unstable.lock().await.is_empty() {
+            assert!(tokio::time::Instant::now() < deadline);
+            tokio::time::sleep(Duration::from_millis(10)).await;
+        }
+        assert_eq!(committed_chunks(&fs, id).await, 1);
+        assert_eq!(fs.read_file("/a.txt").await.unwrap().unwrap(), b"hello");
+    }
+
+    #[tokio::test(flavor = "multi_thread", worker_threads = 4)]
+    async fn test_concurrent_exclusive_creates_and_removes() {
+        let (nfs, _fs, _) = setup().await;
+        let nfs = Arc::new(nfs);
+        let auth = auth_unix::default();
+
+        // One exclusive create of a name wins, the others see it
+        let mut tasks = tokio::task::JoinSet::new();
+        for _ in 0..16 {
+            let (nfs, auth) = (nfs.clone(), auth.clone());
+            tasks.spawn(async move {
+                nfs.create_exclusive(ROOT_INO, &b"x.txt".to_vec().into(), &auth)
+                    .await
+            });
+        }
+        let mut created = 0;
+        while let Some(result) = tasks.join_next().await {
+            match result.unwrap() {
+                Ok(_) => created += 1,
+                Err(e) => assert!(matches!(e, nfsstat3::NFS3ERR_EXIST)),
+            }
+        }
+        assert_eq!(created, 1);
+        assert!(nfs.dir_locks.0.lock().unwrap().is_empty());
+
+        // And one remove of it
+        let mut tasks = tokio::task::JoinSet::new();
+        for _ in 0..16 {
+            let nfs = nfs.clone();
+            tasks.spawn(async move { nfs.remove(ROOT_INO, &b"x.txt".to_vec().into()).await });
+        }
+        let mut removed = 0;
+        while let Some(result) = tasks.join_next().await {
+            match result.unwrap() {
+                Ok(()) => removed += 1,
+                Err(e) => assert!(matches!(e, nfsstat3::NFS3ERR_NOENT)),
+            }
+        }
+        assert_eq!(removed, 1);
+    }
+
+    #[tokio::test]
+    async fn test_commit_after_flusher_dropped_handle() {
+        let (nfs, fs, id) = setup().await;
+
+        nfs.write_unstable(id, 0, b"hello").await.unwrap();
+        let deadline = tokio::time::Instant::now() + Duration::from_secs(10);
+        while !nfs.unstable.lock().await.is_empty() {
+            assert!(tokio::time::Instant::now() < deadline);
+            tokio::time::sleep(Duration::from_millis(10)).await;
+        }
+
+        // A later write is tracked again, and COMMIT succeeds either way
+        nfs.write_unstable(id, 5, b" world").await.unwrap();
+        let attr = nfs.commit(id).await.unwrap();
+        assert_eq!(attr.size, 11);
+        let attr = nfs.commit(id).await.unwrap();
+        assert_eq!(attr.size, 11);
+        assert_eq!(
+            fs.read_file("/a.txt").await.unwrap().unwrap(),
+            b"hello world"
+        );
+    }
+}
@@ -4,8 +4,11 @@ use super::context::RPCContext;
 use super::nfs;
 use super::permissions;
 use super::rpc::*;
+use super::rpcwire::ReplyBuffer;
 use super::vfs::VFSCapabilities;
 use super::xdr::*;
+use agentfs_sdk::metrics::OpMetrics;
+use agentfs_sdk::op_metrics;
 use byteorder::{ReadBytesExt, WriteBytesExt};
 use num_derive::{FromPrimitive, ToPrimitive};
 use num_traits::cast::FromPrimitive;
@@ -118,7 +121,7 @@ pub async fn handle_nfs(
     xid: u32,
     call: call_body,
     input: &mut impl Read,
-    output: &mut impl Write,
+    output: &mut ReplyBuffer,
     context: &RPCContext,
 ) -> Result<(), anyhow::Error> {
     if call.vers != nfs::VERSION {
@@ -132,6 +135,50 @@ pub async fn handle_nfs(
     }
     let prog = NFSProgram::from_u32(call.proc).unwrap_or(NFSProgram::INVALID);
 
+    let timer = nfs_metrics(prog).start();
+    let result = dispatch_nfs(prog, xid, input, output, context).await;
+    // Failures are mostly reported in the reply status rather than as errors
+    let ok = result.is_ok() && matches!(output.nfs_status(), None | Some(0));
+    timer.finish(ok, if ok { output.appended_len() as u64 } else { 0 });
+    result
+}
+
+/// Metrics of the calls to procedure `prog`.
+fn nfs_metrics(prog: NFSProgram) -> &'static OpMetrics {
+    match prog {
+        NFSProgram::NFSPROC3_NULL => op_metrics!("nfs.null"),
+        NFSProgram::NFSPROC3_GETATTR => op_metrics!("nfs.getattr"),
+        NFSProgram::NFSPROC3_LOOKUP => op_metrics!("nfs.lookup"),
+        NFSProgram::NFSPROC3_READ => op_metrics!("nfs.read"),
+        NFSProgram::NFSPROC3_FSINFO => op_metrics!("nfs.fsinfo"),
+        NFSProgram::NFSPROC3_ACCESS => op_metrics!("nfs.access"),
+        NFSProgram::NFSPROC3_PATHCONF => op_metrics!("nfs.pathconf"),
+        NFSProgram::NFSPROC3_FSSTAT => op_metrics!("nfs.fsstat"),
+        NFSProgram::NFSPROC3_READDIR => op_metrics!("nfs.readdir"),
+        NFSProgram::NFSPROC3_READDIRPLUS => op_metrics!("nfs.readdirplus"),
+        NFSProgram::NFSPROC3_WRITE => op_metrics!("nfs.write"),
+        NFSProgram::NFSPROC3_CREATE => op_metrics!("nfs.create"),
+        NFSProgram::NFSPROC3_SETATTR => op_metrics!("nfs.setattr"),
+        NFSProgram::NFSPROC3_REMOVE => op_metrics!("nfs.remove"),
+        NFSProgram::NFSPROC3_RMDIR => op_metrics!("nfs.rmdir"),
+        NFSProgram::NFSPROC3_RENAME => op_metrics!("nfs.rename"),
+        NFSProgram::NFSPROC3_MKDIR => op_metrics!("nfs.mkdir"),
+        NFSProgram::NFSPROC3_SYMLINK => op_metrics!("nfs.symlink"),
+        NFSProgram::NFSPROC3_READLINK => op_metrics!("nfs.readlink"),
+        NFSProgram::NFSPROC3_MKNOD => op_metrics!("nfs.mknod"),
+        NFSProgram::NFSPROC3_LINK => op_metrics!("nfs.link"),
+        NFSProgram::NFSPROC3_COMMIT => op_metrics!("nfs.commit"),
+        _ => op_metrics!("nfs.other"),
+    }
+}
+
+async fn dispatch_nfs(
+    prog: NFSProgram,
+    xid: u32,
+    input: &mut impl Read,
+    output: &mut ReplyBuffer,
+    context: &RPCContext,
+) -> Result<(), anyhow::Error> {
     match prog {
         NFSProgram::NFSPROC3_NULL => nfsproc3_null(xid, input, output)?,
         NFSProgram::NFSPROC3_GETATTR => nfsproc3_getattr(xid, input, output, context).await?,
@@ -156,11 +203,11 @@ pub async fn handle_nfs(
         NFSProgram::NFSPROC3_READLINK => nfsproc3_readlink(xid, input, output, context).await?,
         NFSProgram::NFSPROC3_MKNOD => nfsproc3_mknod(xid, input, output, context).await?,
         NFSProgram::NFSPROC3_LINK => nfsproc3_link(xid, input, output, context).await?,
+        NFSProgram::NFSPROC3_COMMIT => nfsproc3_commit(xid, input, output, context).await?,
         _ => {
             warn!("Unimplemented message {:?}", prog);
             proc_unavail_reply_message(xid).serialize(output)?;
         } /*
-          NFSPROC3_COMMIT,
           INVALID*/
     }
     Ok(())
@@ -368,7 +415,7 @@ default:
 pub async fn nfsproc3_read(
     xid: u32,
     input: &mut impl Read,
-    output: &mut impl Write,
+    output: &mut ReplyBuffer,
     context: &RPCContext,
 ) -> Result<(), anyhow::Error> {
     let mut args = READ3args::default();
@@ -406,15 +453,19 @@ pub async fn nfsproc3_read(
     let obj_attr = nfs::post_op_attr::attributes(attr);
     match context.vfs.read(id, args.offset, args.count).await {
         Ok((bytes, eof)) => {
-            let res = READ3resok {
-                file_attributes: obj_attr,
-                count: bytes.len() as u32,
-                eof,
-                data: bytes,
-            };
+            // Serialize READ3resok by hand so the data goes out from the
+            // buffer it was read into
+            let count = bytes.len() as u32;
             make_success_reply(xid).serialize(output)?;
             nfs::nfsstat3::NFS3_OK.serialize(output)?;
-            res.serialize(output)?;
+            obj_attr.serialize(output)?;
+            count.serialize(output)?;
+            eof.serialize(output)?;
+            count.serialize(output)?;
+            output.append(bytes);
+            // write padding
+            let pad = ((4 - count % 4) % 4) as usize;
+            output.write_all(&[0; 4][..pad])?;
         }
         Err(stat) => {
             error!("read error {:?} --> {:?}", xid, stat);
@@ -1337,7 +1388,18 @@ pub async fn nfsproc3_write(
         ctime: attr.ctime,
     });
 
-    match context.vfs.write(id, args.offset, &args.data).await {
+    // UNSTABLE writes may stay buffered until the client sends COMMIT
+    let (result, committed) = if args.stable == stable_how::UNSTABLE as u32 {
+        let result = context
+            .vfs
+            .write_unstable(id, args.offset, &args.data)
+            .await;
+        (result, stable_how::UNSTABLE)
+    } else {
+        let result = context.vfs.write(id, args.offset, &args.data).await;
+        (result, stable_how::FILE_SYNC)
+    };
+    match result {
         Ok(mut fattr) => {
             // POSIX: Clear SUID/SGID bits when a non-root user writes to a file
             if context.auth.uid != 0 && fattr.mode & 0o6000 != 0 {
@@ -1357,7 +1419,7 @@ pub async fn nfsproc3_write(
                     after: nfs::post_op_attr::attributes(fattr),
                 },
                 count: args.count,
-                committed: stable_how::FILE_SYNC,
+                committed,
                 verf: context.vfs.serverid(),
             };
             make_success_reply(xid).serialize(output)?;
@@ -1374,6 +1436,91 @@ pub async fn nfsproc3_write(
     Ok(())
 }
 
+#[allow(non_camel_case_types)]
+#[derive(Debug, Default)]
+struct COMMIT3args {
+    file: nfs::nfs_fh3,
+    offset: nfs::offset3,
+    count: nfs::count3,
+}
+XDRStruct!(COMMIT3args, file, offset, count);
+
+#[allow(non_camel_case_types)]
+#[derive(Debug, Default)]
+struct COMMIT3resok {
+    file_wcc: nfs::wcc_data,
+    verf: nfs::writeverf3,
+}
+XDRStruct!(COMMIT3resok, file_wcc, verf);
+/*
+COMMIT3res NFSPROC3_COMMIT(COMMIT3args) = 21;
+
+struct COMMIT3args {
+    nfs_fh3    file;
+    offset3    offset;
+    count3     count;
+};
+
+struct COMMIT3resok {
+    wcc_data   file_wcc;
+    writeverf3 verf;
+};
+
+struct COMMIT3resfail {
+    wcc_data   file_wcc;
+};
+
+union COMMIT3res switch (nfsstat3 status) {
+    case NFS3_OK:
+        COMMIT3resok   resok;
+    default:
+        COMMIT3resfail resfail;
+};
+ */
+pub async fn nfsproc3_commit(
+    xid: u32,
+    input: &mut impl Read,
+    output: &mut impl Write,
+    context: &RPCContext,
+) -> Result<(), anyhow::Error> {
+    let mut args = COMMIT3args::default();
+    args.deserialize(input)?;
+    debug!("nfsproc3_commit({:?},{:?}) ", xid, args);
+
+    let id = context.vfs.fh_to_id(&args.file);
+    if let Err(stat) = id {
+        make_success_reply(xid).serialize(output)?;
+        stat.serialize(output)?;
+        nfs::wcc_data::default().serialize(output)?;
+        return Ok(());
+    }
+    let id = id.unwrap();
+
+    // The whole file is committed, whatever range the client asks for
+    match context.vfs.commit(id).await {
+        Ok(fattr) => {
+            debug!("commit success {:?} --> {:?}", xid, fattr);
+            let res = COMMIT3resok {
+                file_wcc: nfs::wcc_data {
+                    before: nfs::pre_op_attr::Void,
+                    after: nfs::post_op_attr::attributes(fattr),
+                },
+                verf: context.vfs.serverid(),
+            };
+            make_success_reply(xid).serialize(output)?;
+            nfs::nfsstat3::NFS3_OK.serialize(output)?;
+            res.serialize(output)?;
+        }
+        Err(stat) => {
+            error!("commit error {:?} --> {:?}", xid, stat);
+            make_success_reply(xid).serialize(output)?;
+            stat.serialize(output)?;
+            nfs::wcc_data::default().serialize(output)?;
+        }
+    }
+    Ok(())
+}
+
 #[allow(non_camel_case_types)]
 #[derive(Copy, Clone, Debug, Default, FromPrimitive, ToPrimitive)]
 #[repr(u32)]
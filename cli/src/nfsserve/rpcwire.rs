@@ -1,5 +1,6 @@
 use anyhow::anyhow;
 use std::io::Cursor;
+use std::io::IoSlice;
 use std::io::{Read, Write};
 use tracing::{debug, error, trace, warn};
 
@@ -15,10 +16,12 @@ use super::nfs_handlers;
 
 use super::portmap;
 use super::portmap_handlers;
+use std::sync::Arc;
 use tokio::io::AsyncReadExt;
 use tokio::io::AsyncWriteExt;
-use tokio::io::DuplexStream;
-use tokio::sync::mpsc;
+use tokio::io::{AsyncRead, AsyncWrite, BufReader};
+use tokio::net::tcp::OwnedReadHalf;
+use tokio::sync::{mpsc, Semaphore};
 
 // Information from RFC 5531
 // https://datatracker.ietf.org/doc/html/rfc5531
@@ -27,9 +30,21 @@ const NFS_ACL_PROGRAM: u32 = 100227;
 const NFS_ID_MAP_PROGRAM: u32 = 100270;
 const NFS_METADATA_PROGRAM: u32 = 200024;
 
+/// Maximum number of RPCs of one connection being handled at a time.
+///
+/// Clients keep many READ/WRITE/LOOKUP calls outstanding on one connection;
+/// past this limit we stop reading the socket until a call completes.
+pub(super) const MAX_IN_FLIGHT_RPCS: usize = 128;
+
+/// Size of the buffer records are read from the socket through.
+const SOCKET_READ_BUFFER: usize = 256 * 1024;
+
+/// Length of the record marking header in front of every fragment.
+const FRAGMENT_HEADER_LEN: usize = 4;
+
 async fn handle_rpc(
     input: &mut impl Read,
-    output: &mut impl Write,
+    output: &mut ReplyBuffer,
     mut context: RPCContext,
 ) -> Result<bool, anyhow::Error> {
     let mut recv = rpc_msg::default();
@@ -114,7 +129,7 @@ async fn handle_rpc(
 /// highest-order bit of the header; the length is the 31 low-order bits.
 /// (Note that this record specification is NOT in XDR standard form!)
 async fn read_fragment(
-    socket: &mut DuplexStream,
+    socket: &mut (impl AsyncRead + Unpin),
     append_to: &mut Vec<u8>,
 ) -> Result<bool, anyhow::Error> {
     let mut header_buf = [0_u8; 4];
@@ -134,53 +149,152 @@ async fn read_fragment(
     Ok(is_last)
 }
 
-pub async fn write_fragment(
-    socket: &mut tokio::net::TcpStream,
-    buf: &[u8],
+/// An RPC reply being serialized, as the list of buffers it is sent from.
+///
+/// Serialized fields are appended to a small buffer, while bulk data (like
+/// the data of a READ reply) is moved in as a buffer of its own and written
+/// to the socket from there, without copying it into the reply.
+#[derive(Debug)]
+pub struct ReplyBuffer {
+    segments: Vec<Vec<u8>>,
+    current: Vec<u8>,
+    /// Bytes moved in by `append()`
+    appended: usize,
+}
+
+impl ReplyBuffer {
+    fn new() -> Self {
+        // Room for the record marking header
+        Self {
+            segments: Vec::new(),
+            current: vec![0; FRAGMENT_HEADER_LEN],
+            appended: 0,
+        }
+    }
+
+    /// Bytes of bulk data moved into the reply.
+    pub fn appended_len(&self) -> usize {
+        self.appended
+    }
+
+    /// Status of an accepted NFS reply: the first word after the RPC reply
+    /// header, `None` if the call wasn't accepted.
+    pub fn nfs_status(&self) -> Option<u32> {
+        let head = self.segments.first().unwrap_or(&self.current);
+        let word = |at: usize| {
+            let at = FRAGMENT_HEADER_LEN + at;
+            head.get(at..at + 4)
+                .map(|w| u32::from_be_bytes(w.try_into().unwrap()))
+        };
+        // xid, msg_type, reply_stat, verifier (flavor, empty body), accept_stat
+        if word(8)? != 0 || word(20)? != 0 {
+            return None;
+        }
+        word(24)
+    }
+
+    /// Append `data` to the reply without copying it.
+    pub fn append(&mut self, data: Vec<u8>) {
+        if data.is_empty() {
+            return;
+        }
+        self.appended += data.len();
+        self.segments.push(std::mem::take(&mut self.current));
+        self.segments.push(data);
+    }
+
+    /// Fill in the record marking header, making the reply a single, last
+    /// fragment, and return its buffers.
+    fn into_record(mut self) -> Vec<Vec<u8>> {
+        self.segments.push(self.current);
+        let length: usize = self.segments.iter().map(Vec::len).sum::<usize>() - FRAGMENT_HEADER_LEN;
+        // TODO: split into many fragments
+        assert!(length < (1 << 31));
+        // set the last flag
+        let fragment_header = length as u32 + (1 << 31);
+        self.segments[0][..FRAGMENT_HEADER_LEN].copy_from_slice(&u32::to_be_bytes(fragment_header));
+        self.segments
+    }
+}
+
+impl Write for ReplyBuffer {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        self.current.extend_from_slice(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+    }
+}
+
+/// Most buffers handed to the socket in one vectored write
+const MAX_WRITE_SLICES: usize = 256;
+
+/// Write records built by the message handler, headers included.
+///
+/// The buffers of all records go out together in vectored writes, so large
+/// READ payloads reach the socket without being copied into a staging buffer.
+pub async fn write_records(
+    socket: &mut (impl AsyncWrite + Unpin),
+    records: &[Vec<Vec<u8>>],
 ) -> Result<(), anyhow::Error> {
-    // TODO: split into many fragments
-    assert!(buf.len() < (1 << 31));
-    // set the last flag
-    let fragment_header = buf.len() as u32 + (1 << 31);
-    let header_buf = u32::to_be_bytes(fragment_header);
-    socket.write_all(&header_buf).await?;
-    trace!("Writing fragment length:{}", buf.len());
-    socket.write_all(buf).await?;
+    for record in records {
+        trace!(
+            "Writing fragment length:{}",
+            record.iter().map(Vec::len).sum::<usize>() - FRAGMENT_HEADER_LEN
+        );
+    }
+    let mut slices: Vec<IoSlice<'_>> = records
+        .iter()
+        .flatten()
+        .filter(|segment| !segment.is_empty())
+        .map(|segment| IoSlice::new(segment))
+        .collect();
+    let mut remaining = &mut slices[..];
+    while !remaining.is_empty() {
+        let batch = remaining.len().min(MAX_WRITE_SLICES);
+        let written = socket.write_vectored(&remaining[..batch]).await?;
+        if written == 0 {
+            return Err(std::io::Error::from(std::io::ErrorKind::WriteZero).into());
+        }
+        IoSlice::advance_slices(&mut remaining, written);
+    }
     Ok(())
 }
 
-pub type SocketMessageType = Result<Vec<u8>, anyhow::Error>;
+pub type SocketMessageType = Result<Vec<Vec<u8>>, anyhow::Error>;
 
 /// The Socket Message Handler reads from a TcpStream and spawns off
 /// subtasks to handle each message. replies are queued into the
-/// reply_send_channel.
+/// reply_send_channel as they complete, in any order; each carries its xid.
+///
+/// At most `MAX_IN_FLIGHT_RPCS` subtasks run at a time.
 #[derive(Debug)]
 pub struct SocketMessageHandler {
     cur_fragment: Vec<u8>,
-    socket_receive_channel: DuplexStream,
+    socket_receive_channel: BufReader<OwnedReadHalf>,
     reply_send_channel: mpsc::UnboundedSender<SocketMessageType>,
+    in_flight: Arc<Semaphore>,
     context: RPCContext,
 }
 
 impl SocketMessageHandler {
-    /// Creates a new SocketMessageHandler with the receiver for queued message replies
+    /// Creates a new SocketMessageHandler reading from `socket`, with the
+    /// receiver for queued message replies
     pub fn new(
         context: &RPCContext,
-    ) -> (
-        Self,
-        DuplexStream,
-        mpsc::UnboundedReceiver<SocketMessageType>,
-    ) {
-        let (socksend, sockrecv) = tokio::io::duplex(256000);
+        socket: OwnedReadHalf,
+    ) -> (Self, mpsc::UnboundedReceiver<SocketMessageType>) {
         let (msgsend, msgrecv) = mpsc::unbounded_channel();
         (
             Self {
                 cur_fragment: Vec::new(),
-                socket_receive_channel: sockrecv,
+                socket_receive_channel: BufReader::with_capacity(SOCKET_READ_BUFFER, socket),
                 reply_send_channel: msgsend,
+                in_flight: Arc::new(Semaphore::new(MAX_IN_FLIGHT_RPCS)),
                 context: context.clone(),
             },
-            socksend,
             msgrecv,
         )
     }
@@ -191,21 +305,20 @@ impl SocketMessageHandler {
             read_fragment(&mut self.socket_receive_channel, &mut self.cur_fragment).await?;
         if is_last {
             let fragment = std::mem::take(&mut self.cur_fragment);
+            let permit = self.in_flight.clone().acquire_owned().await?;
             let context = self.context.clone();
             let send = self.reply_send_channel.clone();
             tokio::spawn(async move {
-                let mut write_buf: Vec<u8> = Vec::new();
-                let mut write_cursor = Cursor::new(&mut write_buf);
-                let maybe_reply =
-                    handle_rpc(&mut Cursor::new(fragment), &mut write_cursor, context).await;
+                let _permit = permit;
+                let mut reply = ReplyBuffer::new();
+                let maybe_reply = handle_rpc(&mut Cursor::new(fragment), &mut reply, context).await;
                 match maybe_reply {
                     Err(e) => {
                         error!("RPC Error: {:?}", e);
                         let _ = send.send(Err(e));
                     }
                     Ok(true) => {
-                        let _ = std::io::Write::flush(&mut write_cursor);
-                        let _ = send.send(Ok(write_buf));
+                        let _ = send.send(Ok(reply.into_record()));
                     }
                     Ok(false) => {
                         // do not reply
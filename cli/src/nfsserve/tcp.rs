@@ -8,7 +8,6 @@ use std::net::SocketAddr;
 use std::sync::Arc;
 use std::time::Duration;
 use std::{io, net::IpAddr};
-use tokio::io::AsyncWriteExt;
 use tokio::net::TcpListener;
 use tokio::sync::mpsc;
 use tracing::{debug, error};
@@ -32,14 +31,19 @@ pub fn generate_host_ip(hostnum: u16) -> String {
 }
 
 /// processes an established socket
+///
+/// Records are decoded straight from the socket and handled concurrently;
+/// replies are written as they complete, and replies that complete together
+/// go out in one vectored write.
 async fn process_socket(
-    mut socket: tokio::net::TcpStream,
+    socket: tokio::net::TcpStream,
     context: RPCContext,
 ) -> Result<(), anyhow::Error> {
-    let (mut message_handler, mut socksend, mut msgrecvchan) = SocketMessageHandler::new(&context);
     let _ = socket.set_nodelay(true);
+    let (sockrecv, mut socksend) = socket.into_split();
+    let (mut message_handler, mut msgrecvchan) = SocketMessageHandler::new(&context, sockrecv);
 
-    tokio::spawn(async move {
+    let reader = tokio::spawn(async move {
         loop {
             if let Err(e) = message_handler.read().await {
                 debug!("Message loop broken due to {:?}", e);
@@ -47,46 +51,32 @@ async fn process_socket(
             }
         }
     });
-    loop {
-        tokio::select! {
-            _ = socket.readable() => {
-                let mut buf = [0; 128000];
-
-                match socket.try_read(&mut buf) {
-                    Ok(0) => {
-                        return Ok(());
-                    }
-                    Ok(n) => {
-                        let _ = socksend.write_all(&buf[..n]).await;
-                    }
-                    Err(ref e) if e.kind() == io::ErrorKind::WouldBlock => {
-                        continue;
-                    }
+    let result = async {
+        // The channel closes once the reader has stopped and every call it
+        // started has replied
+        while let Some(reply) = msgrecvchan.recv().await {
+            let mut ready = Vec::new();
+            let mut reply = Some(reply);
+            while let Some(msg) = reply.take() {
+                match msg {
                     Err(e) => {
-                        debug!("Message handling closed : {:?}", e);
-                        return Err(e.into());
-                    }
-                }
-
-            },
-            reply = msgrecvchan.recv() => {
-                match reply {
-                    Some(Err(e)) => {
                         debug!("Message handling closed : {:?}", e);
                         return Err(e);
                     }
-                    Some(Ok(msg)) => {
-                        if let Err(e) = write_fragment(&mut socket, &msg).await {
-                            error!("Write error {:?}", e);
-                        }
-                    }
-                    None => {
-                        return Err(anyhow::anyhow!("Unexpected socket context termination"));
-                    }
+                    Ok(msg) => ready.push(msg),
                 }
+                reply = msgrecvchan.try_recv().ok();
+            }
+            if let Err(e) = write_records(&mut socksend, &ready).await {
+                error!("Write error {:?}", e);
+                return Err(e);
             }
         }
+        Ok(())
     }
+    .await;
+    reader.abort();
+    result
 }
 
 #[async_trait]
@@ -230,3 +220,225 @@ impl<T: NFSFileSystem + Send + Sync + 'static> NFSTcp for NFSTcpListener<T> {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::nfsserve::nfs::{
+        self, fattr3, fileid3, filename3, ftype3, nfspath3, nfsstat3, sattr3, specdata3,
+    };
+    use crate::nfsserve::rpc::{auth_unix, call_body, opaque_auth, rpc_body, rpc_msg};
+    use crate::nfsserve::vfs::{ReadDirResult, VFSCapabilities};
+    use crate::nfsserve::xdr::XDR;
+    use std::collections::HashSet;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use tokio::io::{AsyncRead, AsyncReadExt, AsyncWriteExt};
+    use tokio::net::TcpStream;
+    use tokio::sync::Semaphore;
+
+    /// A filesystem whose GETATTR calls wait until the gate opens
+    struct Gated {
+        gate: Semaphore,
+        /// GETATTR calls waiting at the gate
+        waiting: AtomicUsize,
+        /// Most calls that ever waited at the gate together
+        most_waiting: AtomicUsize,
+    }
+
+    #[async_trait]
+    impl NFSFileSystem for Gated {
+        fn capabilities(&self) -> VFSCapabilities {
+            VFSCapabilities::ReadOnly
+        }
+        fn root_dir(&self) -> fileid3 {
+            1
+        }
+        async fn lookup(&self, _: fileid3, _: &filename3) -> Result<fileid3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn getattr(&self, id: fileid3) -> Result<fattr3, nfsstat3> {
+            let waiting = self.waiting.fetch_add(1, Ordering::SeqCst) + 1;
+            self.most_waiting.fetch_max(waiting, Ordering::SeqCst);
+            drop(self.gate.acquire().await.unwrap());
+            self.waiting.fetch_sub(1, Ordering::SeqCst);
+            Ok(fattr3 {
+                fileid: id,
+                ..Default::default()
+            })
+        }
+        async fn setattr(&self, _: fileid3, _: sattr3) -> Result<fattr3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn read(&self, _: fileid3, _: u64, _: u32) -> Result<(Vec<u8>, bool), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn write(&self, _: fileid3, _: u64, _: &[u8]) -> Result<fattr3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn create(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: sattr3,
+            _: &auth_unix,
+        ) -> Result<(fileid3, fattr3), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn create_exclusive(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: &auth_unix,
+        ) -> Result<fileid3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn mkdir(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: sattr3,
+            _: &auth_unix,
+        ) -> Result<(fileid3, fattr3), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn mknod(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: ftype3,
+            _: sattr3,
+            _: specdata3,
+            _: &auth_unix,
+        ) -> Result<(fileid3, fattr3), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn remove(&self, _: fileid3, _: &filename3) -> Result<(), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn rename(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: fileid3,
+            _: &filename3,
+        ) -> Result<(), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn link(&self, _: fileid3, _: fileid3, _: &filename3) -> Result<fattr3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn readdir(
+            &self,
+            _: fileid3,
+            _: fileid3,
+            _: usize,
+        ) -> Result<ReadDirResult, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn symlink(
+            &self,
+            _: fileid3,
+            _: &filename3,
+            _: &nfspath3,
+            _: &sattr3,
+            _: &auth_unix,
+        ) -> Result<(fileid3, fattr3), nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+        async fn readlink(&self, _: fileid3) -> Result<nfspath3, nfsstat3> {
+            Err(nfsstat3::NFS3ERR_NOTSUPP)
+        }
+    }
+
+    /// A GETATTR call for `handle` as a single-fragment record
+    fn getattr_call(xid: u32, handle: &nfs::nfs_fh3) -> Vec<u8> {
+        let call = call_body {
+            rpcvers: 2,
+            prog: nfs::PROGRAM,
+            vers: nfs::VERSION,
+            proc: 1,
+            cred: opaque_auth::default(),
+            verf: opaque_auth::default(),
+        };
+        let mut body = Vec::new();
+        rpc_msg {
+            xid,
+            body: rpc_body::CALL(call),
+        }
+        .serialize(&mut body)
+        .unwrap();
+        handle.serialize(&mut body).unwrap();
+        let mut record = (body.len() as u32 | (1 << 31)).to_be_bytes().to_vec();
+        record.extend(body);
+        record
+    }
+
+    /// Read one reply record, returning its xid, status and the fileid of
+    /// the attributes in it
+    async fn read_reply(socket: &mut (impl AsyncRead + Unpin)) -> (u32, u32, u64) {
+        let header = socket.read_u32().await.unwrap();
+        assert_ne!(header & (1 << 31), 0);
+        let mut body = vec![0; (header & !(1 << 31)) as usize];
+        socket.read_exact(&mut body).await.unwrap();
+        let word = |at: usize| u32::from_be_bytes(body[at..at + 4].try_into().unwrap());
+        // xid, msg_type, reply_stat, verifier, accept_stat, then GETATTR3res
+        assert_eq!((word(4), word(8), word(20)), (1, 0, 0));
+        let fileid = u64::from_be_bytes(body[80..88].try_into().unwrap());
+        (word(0), word(24), fileid)
+    }
+
+    #[tokio::test(flavor = "multi_thread", worker_threads = 4)]
+    async fn test_pipelined_calls_past_window_all_get_replies() {
+        let vfs = Arc::new(Gated {
+            gate: Semaphore::new(0),
+            waiting: AtomicUsize::new(0),
+            most_waiting: AtomicUsize::new(0),
+        });
+        let listener = TcpListener::bind("127.0.0.1:0").await.unwrap();
+        let addr = listener.local_addr().unwrap();
+        let context = RPCContext {
+            local_port: addr.port(),
+            client_addr: String::new(),
+            auth: auth_unix::default(),
+            vfs: vfs.clone(),
+            mount_signal: None,
+            export_name: Arc::new("/".to_string()),
+            transaction_tracker: Arc::new(TransactionTracker::new(Duration::from_secs(60))),
+        };
+        let server = tokio::spawn(async move {
+            let (socket, _) = listener.accept().await.unwrap();
+            process_socket(socket, context).await
+        });
+
+        // Send three windows' worth of calls without reading any reply
+        let calls = 3 * MAX_IN_FLIGHT_RPCS as u32;
+        let (mut recv, mut send) = TcpStream::connect(addr).await.unwrap().into_split();
+        let records: Vec<u8> = (1..=calls)
+            .flat_map(|xid| getattr_call(xid, &vfs.id_to_fh(xid as fileid3)))
+            .collect();
+        send.write_all(&records).await.unwrap();
+
+        // The window fills up, and no more calls are started than it holds
+        let deadline = tokio::time::Instant::now() + Duration::from_secs(10);
+        while vfs.waiting.load(Ordering::SeqCst) < MAX_IN_FLIGHT_RPCS {
+            assert!(tokio::time::Instant::now() < deadline);
+            tokio::time::sleep(Duration::from_millis(1)).await;
+        }
+        tokio::time::sleep(Duration::from_millis(50)).await;
+        assert_eq!(vfs.most_waiting.load(Ordering::SeqCst), MAX_IN_FLIGHT_RPCS);
+
+        // Once the calls go through, each gets exactly one reply, for its file
+        vfs.gate.add_permits(1);
+        let mut replied = HashSet::new();
+        for _ in 0..calls {
+            let (xid, status, fileid) = read_reply(&mut recv).await;
+            assert_eq!(status, 0);
+            assert_eq!(fileid, xid as u64);
+            assert!(replied.insert(xid), "xid {xid} replied twice");
+        }
+        assert_eq!(replied, (1..=calls).collect::<HashSet<_>>());
+
+        drop(send);
+        server.await.unwrap().unwrap();
+    }
+}
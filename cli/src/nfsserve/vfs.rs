@@ -131,6 +131,27 @@ pub trait NFSFileSystem: Sync {
     /// this should return Err(nfsstat3::NFS3ERR_ROFS)
     async fn write(&self, id: fileid3, offset: u64, data: &[u8]) -> Result<fattr3, nfsstat3>;
 
+    /// Writes like write(), but the data may be kept in memory until the
+    /// next commit() of the file (an UNSTABLE write).
+    /// The server verifier returned by serverid() must change if such
+    /// data can be lost, so clients know to send it again.
+    /// The default implementation writes synchronously.
+    async fn write_unstable(
+        &self,
+        id: fileid3,
+        offset: u64,
+        data: &[u8],
+    ) -> Result<fattr3, nfsstat3> {
+        self.write(id, offset, data).await
+    }
+
+    /// Makes the data of earlier unstable writes to a file durable,
+    /// returning the attributes of the file.
+    /// The default implementation has nothing to commit.
+    async fn commit(&self, id: fileid3) -> Result<fattr3, nfsstat3> {
+        self.getattr(id).await
+    }
+
     /// Creates a file with the following attributes.
     /// If not supported due to readonly file system
     /// this should return Err(nfsstat3::NFS3ERR_ROFS)
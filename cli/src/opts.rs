@@ -92,6 +92,31 @@ pub enum Command {
         #[arg(long, env = "AGENTFS_CIPHER")]
         cipher: Option<String>,
 
+        /// Size in bytes of the chunks file data is stored in (512 to 1048576, default: 4096).
+        /// Larger chunks suit filesystems holding mostly large files.
+        #[arg(long)]
+        chunk_size: Option<usize>,
+
+        /// Store identical chunks of file data once, shared by all files holding
+        /// them. Suits filesystems holding many copies of the same content.
+        #[arg(long)]
+        dedup: bool,
+
+        /// Compress file data with this codec where that makes it smaller (none, lz4).
+        /// Suits source trees, JSON and logs.
+        #[arg(long, value_parser = ["none", "lz4"])]
+        compression: Option<String>,
+
+        /// Free the data of large removed and truncated files in the background
+        /// instead of before the operation returns
+        #[arg(long)]
+        deferred_reclaim: bool,
+
+        /// Give each file chunks that grow with its size, up to 1 MiB for files of
+        /// 64 MiB or more. Suits filesystems holding large files among small ones.
+        #[arg(long)]
+        size_classes: bool,
+
         /// Command to execute after initialization (mounts the filesystem, runs command, unmounts)
         #[arg(short = 'c', long = "command")]
         command: Option<String>,
@@ -174,6 +199,16 @@ pub enum Command {
         #[arg(long, env = "AGENTFS_CIPHER")]
         cipher: Option<String>,
 
+        /// Record every FUSE request of the sandbox to this file, for replay
+        /// with the perf/replay tool
+        #[arg(long, value_name = "FILE")]
+        trace: Option<PathBuf>,
+
+        /// Prefetch the directories used by previous runs of the session
+        /// while the command starts, and record the ones this run uses
+        #[arg(long = "warm-up")]
+        warm_up: bool,
+
         /// Command to execute (defaults to bash on Linux, zsh on macOS)
         command: Option<PathBuf>,
 
@@ -251,6 +286,35 @@ pub enum Command {
         /// Backend to use for mounting
         #[arg(long, default_value_t = MountBackend::default())]
         backend: MountBackend,
+
+        /// Handle FUSE requests one at a time instead of dispatching them
+        /// concurrently
+        #[arg(long)]
+        serial: bool,
+
+        /// Maximum number of directory entries to keep in the lookup cache
+        #[arg(long, value_name = "N")]
+        dentry_cache_size: Option<usize>,
+
+        /// Let the kernel read unmodified host files directly (FUSE
+        /// passthrough, Linux 6.9+, requires root). Disables writeback caching
+        #[arg(long)]
+        passthrough: bool,
+
+        /// Record every FUSE request to this file, for replay with the
+        /// perf/replay tool
+        #[arg(long, value_name = "FILE")]
+        trace: Option<PathBuf>,
+
+        /// Write the operation metrics of the mount to this file as JSON
+        /// once it is unmounted
+        #[arg(long, value_name = "FILE")]
+        stats: Option<PathBuf>,
+
+        /// Push changes of a synced database and checkpoint it in the
+        /// background while mounted
+        #[arg(long)]
+        auto_sync: bool,
     },
     /// Show differences between base filesystem and delta (overlay mode only)
     Diff {
@@ -317,7 +381,11 @@ pub enum Command {
         command: ServeCommand,
     },
     /// List active agentfs run sessions
-    Ps,
+    Ps {
+        /// Show the operation metrics of each session
+        #[arg(long)]
+        stats: bool,
+    },
     /// Prune unused resources
     Prune {
         #[command(subcommand)]
@@ -356,6 +424,16 @@ pub enum FsCommand {
         /// Content of the file
         content: String,
     },
+    /// Copy a host directory tree into the filesystem, in bulk
+    #[cfg(unix)]
+    Import {
+        /// Host directory to copy
+        host_dir: PathBuf,
+
+        /// Directory to copy it into (default: /)
+        #[arg(default_value = "/")]
+        fs_path: String,
+    },
 }
 
 #[derive(Subcommand, Debug)]
@@ -32,7 +32,6 @@ use std::{
         Arc,
     },
 };
-use tokio::sync::Mutex;
 
 /// Global child PID for signal forwarding.
 /// Set by the parent before installing signal handlers.
@@ -144,6 +143,8 @@ pub async fn run_cmd(
     session_id: Option<String>,
     system: bool,
     encryption: Option<(String, String)>,
+    trace: Option<PathBuf>,
+    warm_up: bool,
     command: PathBuf,
     args: Vec<String>,
 ) -> Result<()> {
@@ -162,6 +163,12 @@ pub async fn run_cmd(
             .context("Failed to read session base path")?;
         let overlay_base = PathBuf::from(overlay_base.trim());
 
+        if trace.is_some() {
+            eprintln!("Warning: --trace only applies when a session is started, ignoring");
+        }
+        if warm_up {
+            eprintln!("Warning: --warm-up only applies when a session is started, ignoring");
+        }
         eprintln!("Joining existing session: {}", session.run_id);
         eprintln!();
         return run_in_existing_session(
@@ -207,8 +214,11 @@ pub async fn run_cmd(
         hostfs.with_fuse_mountpoint(mountpoint_inode)
     };
 
+    // The FUSE adapter flushes handles on close, so writes can be buffered
+    agentfs.fs.set_write_back(true);
+
     let base = Arc::new(hostfs);
-    let overlay = OverlayFS::new(base, agentfs.fs);
+    let overlay = Arc::new(OverlayFS::new(base, agentfs.fs));
 
     let cwd_str = cwd
         .to_str()
@@ -237,10 +247,18 @@ pub async fn run_cmd(
         auto_unmount: false,
         lazy_unmount: true,
         timeout: FUSE_MOUNT_TIMEOUT,
+        concurrent: true,
+        trace,
     };
 
     // Mount the overlay filesystem
-    let mount_handle = mount_fs(Arc::new(Mutex::new(overlay)), mount_opts).await?;
+    let mount_handle = mount_fs(overlay.clone(), mount_opts).await?;
+
+    // Prefetch the session's hot paths while the command starts up
+    let warm_up = warm_up.then(|| {
+        crate::cmd::run::start_warm_up(&overlay);
+        overlay
+    });
 
     // Create pipes for parent-child coordination.
     // The parent needs to write uid_map/gid_map for the child after unshare.
@@ -305,8 +323,25 @@ pub async fn run_cmd(
             eprintln!("Warning: Failed to write proc file: {}", e);
         }
 
+        // Serve the mount's metrics for `agentfs ps --stats`
+        let stats_server = match crate::stats::serve(&crate::cmd::ps::stats_socket(&session.run_id))
+        {
+            Ok(server) => Some(server),
+            Err(e) => {
+                eprintln!("Warning: Failed to serve stats socket: {}", e);
+                None
+            }
+        };
+
         // Keep cwd_fd alive - it's needed by HostFS in the FUSE thread
-        run_parent(child_pid, cwd_fd, mount_handle, &session.run_id);
+        run_parent(
+            child_pid,
+            cwd_fd,
+            mount_handle,
+            stats_server,
+            warm_up,
+            &session.run_id,
+        );
     }
 }
 
@@ -888,6 +923,8 @@ fn run_parent(
     child_pid: i32,
     cwd_fd: std::fs::File,
     mount_handle: MountHandle,
+    stats_server: Option<crate::stats::StatsServer>,
+    warm_up: Option<Arc<OverlayFS>>,
     session_id: &str,
 ) -> ! {
     // Store child PID and install signal handlers before waiting
@@ -909,6 +946,23 @@ fn run_parent(
     // Drop the mount handle to unmount (this also moves away from mountpoint)
     drop(mount_handle);
 
+    // Save the directories this run used, for warming up the next one
+    if let Some(overlay) = warm_up {
+        let saved = tokio::task::block_in_place(|| {
+            tokio::runtime::Handle::current().block_on(overlay.save_hot_paths())
+        });
+        if let Err(e) = saved {
+            eprintln!("Warning: Failed to save hot paths: {}", e);
+        }
+    }
+
+    // Keep the final metrics of the session, now that it is unmounted
+    drop(stats_server);
+    let stats_file = crate::cmd::ps::procs_dir(session_id).with_file_name("stats.json");
+    if let Err(e) = crate::stats::dump(&stats_file) {
+        eprintln!("Warning: {:#}", e);
+    }
+
     // Clean up the FUSE mountpoint directory (but keep the delta database)
     if let Err(e) = std::fs::remove_dir_all(&fuse_mountpoint) {
         eprintln!(
@@ -931,6 +985,8 @@ fn run_parent(
     eprintln!();
     eprintln!("To see what changed:");
     eprintln!("  agentfs diff {}", session_id);
+    eprintln!();
+    eprintln!("Operation metrics: {}", stats_file.display());
 
     std::process::exit(exit_code);
 }
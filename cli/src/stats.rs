@@ -0,0 +1,171 @@
+//! Operation metrics of a running mount.
+//!
+//! The process serving a mount records its FUSE, NFS, filesystem and SQL
+//! metrics in [`agentfs_sdk::metrics`]. [`serve()`] makes them available to
+//! other processes on a Unix socket, which answers every connection with a
+//! JSON [`MetricsSnapshot`], and [`dump()`] writes one to a file, for the
+//! final numbers once the mount is gone.
+
+use std::io::{self, Read, Write};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+
+use agentfs_sdk::metrics::{self, MetricsSnapshot};
+use anyhow::{Context, Result};
+
+/// A stats socket being served, removed when dropped.
+pub struct StatsServer {
+    path: PathBuf,
+}
+
+impl Drop for StatsServer {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_file(&self.path);
+    }
+}
+
+/// Serve the metrics of this process on a Unix socket at `path`, replacing a
+/// stale socket left there.
+pub fn serve(path: &Path) -> io::Result<StatsServer> {
+    let _ = std::fs::remove_file(path);
+    let listener = UnixListener::bind(path)?;
+    std::thread::Builder::new()
+        .name("agentfs-stats".to_string())
+        .spawn(move || {
+            for stream in listener.incoming() {
+                let Ok(mut stream) = stream else { continue };
+                if let Ok(json) = serde_json::to_vec(&metrics::snapshot()) {
+                    let _ = stream.write_all(&json);
+                }
+            }
+        })?;
+    Ok(StatsServer {
+        path: path.to_path_buf(),
+    })
+}
+
+/// Fetch the metrics served on the socket at `path`.
+pub fn fetch(path: &Path) -> Result<MetricsSnapshot> {
+    let mut stream = UnixStream::connect(path)
+        .with_context(|| format!("Failed to connect to {}", path.display()))?;
+    let mut json = Vec::new();
+    stream.read_to_end(&mut json)?;
+    Ok(serde_json::from_slice(&json)?)
+}
+
+/// Write the metrics of this process to `path` as JSON.
+pub fn dump(path: &Path) -> Result<()> {
+    let json = serde_json::to_string_pretty(&metrics::snapshot())?;
+    std::fs::write(path, json)
+        .with_context(|| format!("Failed to write stats to {}", path.display()))
+}
+
+/// Format nanoseconds with a unit fitting their magnitude.
+fn format_ns(ns: u64) -> String {
+    if ns < 1_000 {
+        format!("{}ns", ns)
+    } else if ns < 1_000_000 {
+        format!("{:.1}us", ns as f64 / 1e3)
+    } else if ns < 1_000_000_000 {
+        format!("{:.1}ms", ns as f64 / 1e6)
+    } else {
+        format!("{:.2}s", ns as f64 / 1e9)
+    }
+}
+
+// Column widths for table output
+const COL_NAME: usize = 24;
+const COL_COUNT: usize = 10;
+const COL_BYTES: usize = 12;
+const COL_TIME: usize = 9;
+
+/// Write `snapshot` as tables of operations and counters, with the hit rates
+/// of the caches.
+pub fn write_table<W: Write>(out: &mut W, snapshot: &MetricsSnapshot) -> io::Result<()> {
+    writeln!(
+        out,
+        "{:<COL_NAME$} {:>COL_COUNT$} {:>COL_COUNT$} {:>COL_BYTES$} {:>COL_TIME$} {:>COL_TIME$} {:>COL_TIME$} {:>COL_TIME$}",
+        "OPERATION", "CALLS", "ERRORS", "BYTES", "AVG", "P50", "P99", "MAX",
+    )?;
+    for op in &snapshot.ops {
+        writeln!(
+            out,
+            "{:<COL_NAME$} {:>COL_COUNT$} {:>COL_COUNT$} {:>COL_BYTES$} {:>COL_TIME$} {:>COL_TIME$} {:>COL_TIME$} {:>COL_TIME$}",
+            op.name,
+            op.calls,
+            op.errors,
+            op.bytes,
+            format_ns(op.avg_ns()),
+            format_ns(op.p50_ns),
+            format_ns(op.p99_ns),
+            format_ns(op.max_ns),
+        )?;
+    }
+
+    if !snapshot.counters.is_empty() {
+        writeln!(out)?;
+        writeln!(out, "{:<COL_NAME$} {:>COL_COUNT$}", "COUNTER", "VALUE")?;
+        for counter in &snapshot.counters {
+            writeln!(
+                out,
+                "{:<COL_NAME$} {:>COL_COUNT$}",
+                counter.name, counter.value
+            )?;
+        }
+    }
+
+    for cache in ["dentry_cache", "attr_cache", "kv_cache", "readahead"] {
+        let hits = snapshot.counter(&format!("{cache}.hits"));
+        let misses = snapshot.counter(&format!("{cache}.misses"));
+        if hits + misses > 0 {
+            writeln!(
+                out,
+                "{:<COL_NAME$} {:>COL_COUNT$.1}%",
+                format!("{cache}.hit_rate"),
+                hits as f64 * 100.0 / (hits + misses) as f64,
+            )?;
+        }
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_serve_and_fetch() {
+        static COUNTER: metrics::Counter = metrics::Counter::new("test.stats_socket");
+        COUNTER.add(7);
+
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("stats.sock");
+        let server = serve(&path).unwrap();
+        let snapshot = fetch(&path).unwrap();
+        assert_eq!(snapshot.counter("test.stats_socket"), 7);
+
+        drop(server);
+        assert!(!path.exists());
+    }
+
+    #[test]
+    fn test_write_table() {
+        let snapshot: MetricsSnapshot = serde_json::from_str(
+            r#"{
+                "ops": [{"name": "fuse.read", "calls": 2, "errors": 0, "bytes": 8192,
+                         "total_ns": 3000, "p50_ns": 1000, "p90_ns": 2000,
+                         "p99_ns": 2000, "max_ns": 2000}],
+                "counters": [{"name": "dentry_cache.hits", "value": 3},
+                             {"name": "dentry_cache.misses", "value": 1}]
+            }"#,
+        )
+        .unwrap();
+        let mut out = Vec::new();
+        write_table(&mut out, &snapshot).unwrap();
+        let out = String::from_utf8(out).unwrap();
+        assert!(out.contains("fuse.read"));
+        assert!(out.contains("1.5us"));
+        assert!(out.contains("75.0%"));
+    }
+}
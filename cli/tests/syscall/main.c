@@ -20,6 +20,7 @@ int main(int argc, char *argv[]) {
     test_case_t tests[] = {
         {"openat", test_openat},
         {"read", test_read},
+        {"readv", test_readv},
         {"write", test_write},
         {"close", test_close},
         {"dup", test_dup},
@@ -37,6 +37,7 @@ typedef struct {
 /* Test function declarations */
 int test_openat(const char *base_path);
 int test_read(const char *base_path);
+int test_readv(const char *base_path);
 int test_write(const char *base_path);
 int test_close(const char *base_path);
 int test_dup(const char *base_path);
@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/stat.h>
 
 /* Linux dirent64 structure */
 struct linux_dirent64 {
@@ -62,5 +63,59 @@ int test_getdents64(const char *base_path) {
 
     close(fd);
 
+    /* Test 6: list a large directory in small batches */
+#define MANY_ENTRIES 500
+    char dir_path[512];
+    char entry_path[1024];
+    snprintf(dir_path, sizeof(dir_path), "%s/getdents_many", base_path);
+    TEST_ASSERT_ERRNO(mkdir(dir_path, 0755) == 0, "mkdir for many entries should succeed");
+    for (int i = 0; i < MANY_ENTRIES; i++) {
+        snprintf(entry_path, sizeof(entry_path), "%s/entry-%03d", dir_path, i);
+        int file_fd = open(entry_path, O_CREAT | O_WRONLY, 0644);
+        TEST_ASSERT_ERRNO(file_fd >= 0, "create entry should succeed");
+        close(file_fd);
+    }
+
+    fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    TEST_ASSERT_ERRNO(fd >= 0, "open large directory should succeed");
+
+    for (int pass = 0; pass < 2; pass++) {
+        char seen[MANY_ENTRIES] = {0};
+        char small[1024];
+        int listed = 0;
+
+        while ((nread = syscall(SYS_getdents64, fd, small, sizeof(small))) > 0) {
+            for (int pos = 0; pos < nread;) {
+                d = (struct linux_dirent64 *) (small + pos);
+                int n;
+                if (sscanf(d->d_name, "entry-%d", &n) == 1) {
+                    TEST_ASSERT(n >= 0 && n < MANY_ENTRIES, "entry name should be in range");
+                    TEST_ASSERT(!seen[n], "entry should be listed once");
+                    seen[n] = 1;
+                }
+                listed++;
+                pos += d->d_reclen;
+            }
+        }
+        TEST_ASSERT_ERRNO(nread == 0, "getdents64 should return 0 at end of large directory");
+        TEST_ASSERT(listed == MANY_ENTRIES + 2, "every entry plus . and .. should be listed");
+
+        /* Rewind and list again */
+        TEST_ASSERT_ERRNO(lseek(fd, 0, SEEK_SET) == 0, "rewinding directory should succeed");
+    }
+
+    /* Test 7: a buffer too small for any entry should fail */
+    nread = syscall(SYS_getdents64, fd, buf, 8);
+    TEST_ASSERT(nread < 0 && errno == EINVAL, "getdents64 with tiny buffer should fail with EINVAL");
+
+    close(fd);
+
+    for (int i = 0; i < MANY_ENTRIES; i++) {
+        snprintf(entry_path, sizeof(entry_path), "%s/entry-%03d", dir_path, i);
+        unlink(entry_path);
+    }
+    rmdir(dir_path);
+#undef MANY_ENTRIES
+
     return 0;
 }
@@ -0,0 +1,54 @@
+#define _GNU_SOURCE
+#include "test-common.h"
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int test_readv(const char *base_path) {
+    char path[512];
+    char a[4], b[1], c[16];
+    struct iovec iov[3];
+    int fd;
+    ssize_t n;
+
+    snprintf(path, sizeof(path), "%s/readv.txt", base_path);
+
+    /* Test 1: writev gathers all buffers in order */
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_ERRNO(fd >= 0, "open for writing should succeed");
+
+    iov[0].iov_base = "vect";
+    iov[0].iov_len = 4;
+    iov[1].iov_base = "";
+    iov[1].iov_len = 0;
+    iov[2].iov_base = "ored io";
+    iov[2].iov_len = 7;
+    n = writev(fd, iov, 3);
+    TEST_ASSERT_ERRNO(n == 11, "writev should write all 11 bytes");
+    close(fd);
+
+    /* Test 2: readv scatters the data over the buffers */
+    fd = open(path, O_RDONLY);
+    TEST_ASSERT_ERRNO(fd >= 0, "open for reading should succeed");
+
+    memset(c, 0, sizeof(c));
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = b;
+    iov[1].iov_len = sizeof(b);
+    iov[2].iov_base = c;
+    iov[2].iov_len = sizeof(c);
+    n = readv(fd, iov, 3);
+    TEST_ASSERT_ERRNO(n == 11, "readv should read all 11 bytes");
+    TEST_ASSERT(memcmp(a, "vect", 4) == 0, "first buffer should be filled first");
+    TEST_ASSERT(b[0] == 'o', "second buffer should hold the next byte");
+    TEST_ASSERT(memcmp(c, "red io", 6) == 0, "last buffer should hold the rest");
+
+    /* Test 3: readv at EOF returns 0 */
+    n = readv(fd, iov, 3);
+    TEST_ASSERT_ERRNO(n == 0, "readv at EOF should return 0");
+    close(fd);
+
+    unlink(path);
+    return 0;
+}
@@ -2,7 +2,10 @@ use crate::{
     syscall,
     vfs::{fdtable::FdTable, mount::MountTable},
 };
-use reverie::{syscalls::Syscall, Error, Guest, Tool};
+use reverie::{
+    syscalls::{Syscall, Sysno},
+    Error, GlobalTool, Guest, Subscription, Tool,
+};
 use std::collections::HashMap;
 use std::sync::{
     atomic::{AtomicBool, Ordering},
@@ -80,6 +83,61 @@ fn format_result(value: i64) -> String {
     format!("{}", value)
 }
 
+/// Syscalls the sandbox lets through unchanged.
+///
+/// They touch no paths or file descriptors, so the seccomp filter installed
+/// from [`Sandbox::subscriptions()`] allows them without stopping the
+/// tracee. Several (`futex`, `clock_gettime`, `mprotect`) are among
+/// the most frequent syscalls of any program.
+const PASSTHROUGH_SYSCALLS: &[Sysno] = &[
+    Sysno::rt_sigaction,
+    Sysno::rt_sigprocmask,
+    Sysno::rt_sigreturn,
+    Sysno::sigaltstack,
+    Sysno::getpid,
+    Sysno::getppid,
+    Sysno::gettid,
+    Sysno::getuid,
+    Sysno::geteuid,
+    Sysno::getgid,
+    Sysno::getegid,
+    Sysno::wait4,
+    Sysno::waitid,
+    Sysno::brk,
+    #[cfg(not(target_arch = "aarch64"))]
+    Sysno::arch_prctl,
+    Sysno::munmap,
+    Sysno::mprotect,
+    Sysno::mremap,
+    Sysno::madvise,
+    Sysno::set_tid_address,
+    Sysno::set_robust_list,
+    Sysno::futex,
+    #[cfg(not(target_arch = "aarch64"))]
+    Sysno::time,
+    Sysno::clock_gettime,
+    Sysno::clock_getres,
+    Sysno::gettimeofday,
+    Sysno::getrandom,
+    Sysno::prlimit64,
+    Sysno::getrlimit,
+    Sysno::setrlimit,
+    Sysno::tgkill,
+    Sysno::tkill,
+    Sysno::kill,
+    Sysno::uname,
+    #[cfg(not(target_arch = "aarch64"))]
+    Sysno::getpgrp,
+    Sysno::getpgid,
+    Sysno::setpgid,
+    Sysno::setsid,
+    Sysno::setfsuid,
+    Sysno::setfsgid,
+    Sysno::umask,
+    Sysno::prctl,
+    Sysno::rseq,
+];
+
 /// The Sandbox tool
 ///
 /// This implements the Reverie Tool trait and intercepts syscalls
@@ -92,6 +150,19 @@ impl Tool for Sandbox {
     type GlobalState = ();
     type ThreadState = ();
 
+    /// Intercept every syscall except the passthrough ones, which then run
+    /// at native speed. Everything is intercepted with strace enabled, so
+    /// that it is logged.
+    fn subscriptions(_cfg: &<Self::GlobalState as GlobalTool>::Config) -> Subscription {
+        let mut subscription = Subscription::all();
+        if !is_strace_enabled() {
+            for &sysno in PASSTHROUGH_SYSCALLS {
+                subscription.disable_syscall(sysno);
+            }
+        }
+        subscription
+    }
+
     async fn handle_syscall_event<T: Guest<Self>>(
         &self,
         guest: &mut T,
@@ -1,8 +1,13 @@
 use crate::{
     sandbox::Sandbox,
-    syscall::translate_path,
+    syscall::{
+        translate_path,
+        vm::{self, GuestBuf},
+        SyscallResult,
+    },
     vfs::{
         fdtable::{FdEntry, FdTable},
+        file::BoxedFileOps,
         mount::MountTable,
     },
 };
@@ -12,6 +17,16 @@ use reverie::{
 };
 use std::mem::MaybeUninit;
 
+/// Result of a virtual file operation that failed with `e`.
+fn vfs_error_result(e: crate::vfs::VfsError) -> SyscallResult {
+    let errno = match e {
+        crate::vfs::VfsError::NotFound => libc::ENOENT,
+        crate::vfs::VfsError::PermissionDenied => libc::EACCES,
+        _ => libc::EIO,
+    };
+    SyscallResult::Value(-errno as i64)
+}
+
 /// The `openat` system call.
 ///
 /// This intercepts `openat` system calls and translates paths according to the mount table,
@@ -167,27 +182,11 @@ pub async fn handle_read<T: Guest<Sandbox>>(
                     None => return Ok(crate::syscall::SyscallResult::Value(-libc::EFAULT as i64)),
                 };
 
-                let buf_len = args.len();
-                let mut buf = vec![0u8; buf_len];
-
-                match file_ops.read(&mut buf).await {
-                    Ok(n) => {
-                        // Write the data back to guest memory
-                        if n > 0 {
-                            guest.memory().write_exact(buf_addr, &buf[..n])?;
-                        }
-                        return Ok(crate::syscall::SyscallResult::Value(n as i64));
-                    }
-                    Err(e) => {
-                        // Map VFS errors to errno
-                        let errno = match e {
-                            crate::vfs::VfsError::NotFound => -libc::ENOENT as i64,
-                            crate::vfs::VfsError::PermissionDenied => -libc::EACCES as i64,
-                            _ => -libc::EIO as i64,
-                        };
-                        return Ok(crate::syscall::SyscallResult::Value(errno));
-                    }
-                }
+                let remote = [GuestBuf {
+                    addr: buf_addr.as_raw(),
+                    len: args.len().min(vm::MAX_RW_COUNT),
+                }];
+                return Ok(read_virtual(guest, &file_ops, &remote).await);
             }
         }
     }
@@ -226,26 +225,11 @@ pub async fn handle_write<T: Guest<Sandbox>>(
                     None => return Ok(crate::syscall::SyscallResult::Value(-libc::EFAULT as i64)),
                 };
 
-                let buf_len = args.len();
-                let mut buf = vec![0u8; buf_len];
-
-                // Read data from guest memory
-                guest.memory().read_exact(buf_addr, &mut buf)?;
-
-                match file_ops.write(&buf).await {
-                    Ok(n) => {
-                        return Ok(crate::syscall::SyscallResult::Value(n as i64));
-                    }
-                    Err(e) => {
-                        // Map VFS errors to errno
-                        let errno = match e {
-                            crate::vfs::VfsError::NotFound => -libc::ENOENT as i64,
-                            crate::vfs::VfsError::PermissionDenied => -libc::EACCES as i64,
-                            _ => -libc::EIO as i64,
-                        };
-                        return Ok(crate::syscall::SyscallResult::Value(errno));
-                    }
-                }
+                let remote = [GuestBuf {
+                    addr: buf_addr.as_raw(),
+                    len: args.len().min(vm::MAX_RW_COUNT),
+                }];
+                return Ok(write_virtual(guest, &file_ops, &remote).await);
             }
         }
     }
@@ -970,60 +954,64 @@ pub async fn handle_getdents64<T: Guest<Sandbox>>(
                 )));
             }
             FdEntry::Virtual { file_ops, .. } => {
-                // Virtual file - use FileOps::getdents()
-                match file_ops.getdents().await {
-                    Ok(entries) => {
-                        // Format as linux_dirent64 structures
-                        let dirent_addr = match args.dirent() {
-                            Some(addr) => addr,
-                            None => {
-                                return Ok(crate::syscall::SyscallResult::Value(
-                                    -libc::EFAULT as i64,
-                                ))
-                            }
-                        };
-                        let count = args.count() as usize;
-
-                        let mut buf = Vec::new();
-                        let mut offset = 1i64;
-
-                        for (ino, name, d_type) in entries {
-                            // Calculate record length (aligned to 8 bytes)
-                            let name_len = name.len() + 1; // +1 for null terminator
-                            let reclen = (19 + name_len).div_ceil(8) * 8; // 19 = sizeof(ino + off + reclen + type)
-
-                            if buf.len() + reclen > count {
-                                break; // Not enough space
-                            }
-
-                            // Write linux_dirent64 structure
-                            buf.extend_from_slice(&ino.to_ne_bytes()); // d_ino (u64)
-                            buf.extend_from_slice(&offset.to_ne_bytes()); // d_off (i64)
-                            buf.extend_from_slice(&(reclen as u16).to_ne_bytes()); // d_reclen (u16)
-                            buf.push(d_type); // d_type (u8)
-                            buf.extend_from_slice(name.as_bytes()); // d_name
-                            buf.push(0); // null terminator
-
-                            // Pad to 8-byte alignment
-                            while buf.len() % 8 != 0 {
-                                buf.push(0);
-                            }
-
-                            offset += 1;
+                // Virtual file - format entries from the stream position as
+                // linux_dirent64 structures until the guest buffer is full
+                let dirent_addr = match args.dirent() {
+                    Some(addr) => addr,
+                    None => return Ok(crate::syscall::SyscallResult::Value(-libc::EFAULT as i64)),
+                };
+                let count = args.count() as usize;
+
+                let mut buf = Vec::new();
+                let mut too_small = false;
+                let result = {
+                    let mut fill = |ino: u64, off: i64, name: &str, d_type: u8| {
+                        // Calculate record length (aligned to 8 bytes)
+                        let name_len = name.len() + 1; // +1 for null terminator
+                        let reclen = (19 + name_len).div_ceil(8) * 8; // 19 = sizeof(ino + off + reclen + type)
+
+                        if buf.len() + reclen > count {
+                            // Not enough space, the entry is returned by the next call
+                            too_small = buf.is_empty();
+                            return false;
                         }
 
-                        // Write to guest memory
-                        if !buf.is_empty() {
-                            guest.memory().write_exact(dirent_addr.cast::<u8>(), &buf)?;
+                        // Write linux_dirent64 structure
+                        buf.extend_from_slice(&ino.to_ne_bytes()); // d_ino (u64)
+                        buf.extend_from_slice(&off.to_ne_bytes()); // d_off (i64)
+                        buf.extend_from_slice(&(reclen as u16).to_ne_bytes()); // d_reclen (u16)
+                        buf.push(d_type); // d_type (u8)
+                        buf.extend_from_slice(name.as_bytes()); // d_name
+                        buf.push(0); // null terminator
+
+                        // Pad to 8-byte alignment
+                        while buf.len() % 8 != 0 {
+                            buf.push(0);
                         }
+                        true
+                    };
+                    file_ops.getdents(&mut fill).await
+                };
 
-                        return Ok(crate::syscall::SyscallResult::Value(buf.len() as i64));
-                    }
-                    Err(_) => {
-                        // Not a directory or error
-                        return Ok(crate::syscall::SyscallResult::Value(-libc::ENOTDIR as i64));
-                    }
+                if result.is_err() && buf.is_empty() {
+                    // Not a directory or error
+                    return Ok(crate::syscall::SyscallResult::Value(-libc::ENOTDIR as i64));
+                }
+                if too_small {
+                    // Result buffer is too small for the next entry
+                    return Ok(crate::syscall::SyscallResult::Value(-libc::EINVAL as i64));
                 }
+
+                // Write to guest memory
+                let remote = [GuestBuf {
+                    addr: dirent_addr.as_raw(),
+                    len: buf.len(),
+                }];
+                if let Err(errno) = vm::write_guest(guest.pid().as_raw(), &buf, &remote) {
+                    return Ok(crate::syscall::SyscallResult::Value(-errno as i64));
+                }
+
+                return Ok(crate::syscall::SyscallResult::Value(buf.len() as i64));
             }
         }
     }
@@ -1188,52 +1176,40 @@ pub async fn handle_fstatat<T: Guest<Sandbox>>(
 ///
 /// This intercepts `pread64` system calls and translates virtual FDs to kernel FDs.
 pub async fn handle_pread64<T: Guest<Sandbox>>(
-    guest: &mut T,
+    _guest: &mut T,
+    syscall: Syscall,
     args: &reverie::syscalls::Pread64,
     fd_table: &FdTable,
-) -> Result<Option<i64>, Error> {
-    let virtual_fd = args.fd();
-
+) -> Result<SyscallResult, Error> {
     // Translate virtual FD to kernel FD
-    if let Some(kernel_fd) = fd_table.translate(virtual_fd) {
-        let new_syscall = reverie::syscalls::Pread64::new()
-            .with_fd(kernel_fd)
-            .with_buf(args.buf())
-            .with_len(args.len())
-            .with_offset(args.offset());
-
-        let result = guest.inject(Syscall::Pread64(new_syscall)).await?;
-        return Ok(Some(result));
+    if let Some(kernel_fd) = fd_table.translate(args.fd()) {
+        return Ok(SyscallResult::Syscall(Syscall::Pread64(
+            args.with_fd(kernel_fd),
+        )));
     }
 
     // FD not in table, let the original syscall through (will likely fail with EBADF)
-    Ok(None)
+    Ok(SyscallResult::Syscall(syscall))
 }
 
 /// The `pwrite64` system call.
 ///
 /// This intercepts `pwrite64` system calls and translates virtual FDs to kernel FDs.
 pub async fn handle_pwrite64<T: Guest<Sandbox>>(
-    guest: &mut T,
+    _guest: &mut T,
+    syscall: Syscall,
     args: &reverie::syscalls::Pwrite64,
     fd_table: &FdTable,
-) -> Result<Option<i64>, Error> {
-    let virtual_fd = args.fd();
-
+) -> Result<SyscallResult, Error> {
     // Translate virtual FD to kernel FD
-    if let Some(kernel_fd) = fd_table.translate(virtual_fd) {
-        let new_syscall = reverie::syscalls::Pwrite64::new()
-            .with_fd(kernel_fd)
-            .with_buf(args.buf())
-            .with_len(args.len())
-            .with_offset(args.offset());
-
-        let result = guest.inject(Syscall::Pwrite64(new_syscall)).await?;
-        return Ok(Some(result));
+    if let Some(kernel_fd) = fd_table.translate(args.fd()) {
+        return Ok(SyscallResult::Syscall(Syscall::Pwrite64(
+            args.with_fd(kernel_fd),
+        )));
     }
 
     // FD not in table, let the original syscall through (will likely fail with EBADF)
-    Ok(None)
+    Ok(SyscallResult::Syscall(syscall))
 }
 
 /// The `lseek` system call.
@@ -1518,50 +1494,86 @@ pub async fn handle_unlink<T: Guest<Sandbox>>(
 
 /// The `readv` system call.
 ///
-/// This intercepts `readv` system calls and translates virtual FDs to kernel FDs.
+/// This intercepts `readv` system calls and translates virtual FDs to kernel FDs,
+/// or reads virtual files into the guest buffers with one batched copy.
 pub async fn handle_readv<T: Guest<Sandbox>>(
     guest: &mut T,
+    syscall: Syscall,
     args: &reverie::syscalls::Readv,
     fd_table: &FdTable,
-) -> Result<Option<i64>, Error> {
-    let virtual_fd = args.fd();
-
-    // Translate virtual FD to kernel FD
-    if let Some(kernel_fd) = fd_table.translate(virtual_fd) {
-        let new_syscall = reverie::syscalls::Readv::new()
-            .with_fd(kernel_fd)
-            .with_iov(args.iov());
-
-        let result = guest.inject(Syscall::Readv(new_syscall)).await?;
-        return Ok(Some(result));
+) -> Result<SyscallResult, Error> {
+    match fd_table.get(args.fd()) {
+        Some(FdEntry::Passthrough { kernel_fd, .. }) => Ok(SyscallResult::Syscall(Syscall::Readv(
+            args.with_fd(kernel_fd),
+        ))),
+        Some(FdEntry::Virtual { file_ops, .. }) => {
+            let iov = args.iov().map_or(0, |addr| addr.as_raw());
+            match vm::read_iovecs(guest.pid().as_raw(), iov, args.len()) {
+                Ok(remote) => Ok(read_virtual(guest, &file_ops, &remote).await),
+                Err(errno) => Ok(SyscallResult::Value(-errno as i64)),
+            }
+        }
+        // FD not in table, let the original syscall through (will likely fail with EBADF)
+        None => Ok(SyscallResult::Syscall(syscall)),
     }
-
-    // FD not in table, let the original syscall through (will likely fail with EBADF)
-    Ok(None)
 }
 
 /// The `writev` system call.
 ///
-/// This intercepts `writev` system calls and translates virtual FDs to kernel FDs.
+/// This intercepts `writev` system calls and translates virtual FDs to kernel FDs,
+/// or writes the guest buffers to virtual files with one batched copy.
 pub async fn handle_writev<T: Guest<Sandbox>>(
     guest: &mut T,
+    syscall: Syscall,
     args: &reverie::syscalls::Writev,
     fd_table: &FdTable,
-) -> Result<Option<i64>, Error> {
-    let virtual_fd = args.fd();
-
-    // Translate virtual FD to kernel FD
-    if let Some(kernel_fd) = fd_table.translate(virtual_fd) {
-        let new_syscall = reverie::syscalls::Writev::new()
-            .with_fd(kernel_fd)
-            .with_iov(args.iov());
+) -> Result<SyscallResult, Error> {
+    match fd_table.get(args.fd()) {
+        Some(FdEntry::Passthrough { kernel_fd, .. }) => Ok(SyscallResult::Syscall(
+            Syscall::Writev(args.with_fd(kernel_fd)),
+        )),
+        Some(FdEntry::Virtual { file_ops, .. }) => {
+            let iov = args.iov().map_or(0, |addr| addr.as_raw());
+            match vm::read_iovecs(guest.pid().as_raw(), iov, args.len()) {
+                Ok(remote) => Ok(write_virtual(guest, &file_ops, &remote).await),
+                Err(errno) => Ok(SyscallResult::Value(-errno as i64)),
+            }
+        }
+        // FD not in table, let the original syscall through (will likely fail with EBADF)
+        None => Ok(SyscallResult::Syscall(syscall)),
+    }
+}
 
-        let result = guest.inject(Syscall::Writev(new_syscall)).await?;
-        return Ok(Some(result));
+/// Read from a virtual file into the guest buffers `remote`, in order.
+async fn read_virtual<T: Guest<Sandbox>>(
+    guest: &mut T,
+    file_ops: &BoxedFileOps,
+    remote: &[GuestBuf],
+) -> SyscallResult {
+    let mut buf = vec![0u8; vm::total_len(remote)];
+    match file_ops.read(&mut buf).await {
+        Ok(n) => match vm::write_guest(guest.pid().as_raw(), &buf[..n], remote) {
+            Ok(()) => SyscallResult::Value(n as i64),
+            Err(errno) => SyscallResult::Value(-errno as i64),
+        },
+        Err(e) => vfs_error_result(e),
     }
+}
 
-    // FD not in table, let the original syscall through (will likely fail with EBADF)
-    Ok(None)
+/// Write the guest buffers `remote` to a virtual file.
+async fn write_virtual<T: Guest<Sandbox>>(
+    guest: &mut T,
+    file_ops: &BoxedFileOps,
+    remote: &[GuestBuf],
+) -> SyscallResult {
+    let mut buf = vec![0u8; vm::total_len(remote)];
+    if let Err(errno) = vm::read_guest(guest.pid().as_raw(), remote, &mut buf) {
+        return SyscallResult::Value(-errno as i64);
+    }
+    match file_ops.write(&buf).await {
+        Ok(n) => SyscallResult::Value(n as i64),
+        Err(e) => vfs_error_result(e),
+    }
 }
 
 /// The `pipe2` system call.
@@ -1,6 +1,7 @@
 pub mod file;
 pub mod process;
 pub mod stat;
+pub mod vm;
 pub mod xattr;
 
 use crate::{
@@ -292,36 +293,12 @@ pub async fn dispatch_syscall<T: Guest<Sandbox>>(
         Syscall::Fstatat(args) => {
             file::handle_fstatat(guest, syscall, args, fd_table, mount_table).await
         }
-        Syscall::Pread64(args) => {
-            if let Some(result) = file::handle_pread64(guest, args, fd_table).await? {
-                Ok(SyscallResult::Value(result))
-            } else {
-                Ok(SyscallResult::Syscall(syscall))
-            }
-        }
-        Syscall::Pwrite64(args) => {
-            if let Some(result) = file::handle_pwrite64(guest, args, fd_table).await? {
-                Ok(SyscallResult::Value(result))
-            } else {
-                Ok(SyscallResult::Syscall(syscall))
-            }
-        }
+        Syscall::Pread64(args) => file::handle_pread64(guest, syscall, args, fd_table).await,
+        Syscall::Pwrite64(args) => file::handle_pwrite64(guest, syscall, args, fd_table).await,
         #[cfg(not(target_arch = "aarch64"))]
         Syscall::Lseek(args) => file::handle_lseek(guest, syscall, args, fd_table).await,
-        Syscall::Readv(args) => {
-            if let Some(result) = file::handle_readv(guest, args, fd_table).await? {
-                Ok(SyscallResult::Value(result))
-            } else {
-                Ok(SyscallResult::Syscall(syscall))
-            }
-        }
-        Syscall::Writev(args) => {
-            if let Some(result) = file::handle_writev(guest, args, fd_table).await? {
-                Ok(SyscallResult::Value(result))
-            } else {
-                Ok(SyscallResult::Syscall(syscall))
-            }
-        }
+        Syscall::Readv(args) => file::handle_readv(guest, syscall, args, fd_table).await,
+        Syscall::Writev(args) => file::handle_writev(guest, syscall, args, fd_table).await,
         Syscall::Pipe2(args) => {
             if let Some(result) = file::handle_pipe2(guest, args, fd_table).await? {
                 Ok(SyscallResult::Value(result))
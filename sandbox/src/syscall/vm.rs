@@ -0,0 +1,219 @@
+//! Bulk data transfer to and from guest memory.
+//!
+//! Data of virtual file reads and writes is moved with `process_vm_readv(2)`
+//! and `process_vm_writev(2)`, one call per batch of up to [`IOV_MAX`] guest
+//! buffers, instead of a memory access per buffer.
+//!
+//! Failures are reported as `errno` values, for the handlers to return to
+//! the guest.
+
+/// Most iovecs a vectored syscall accepts.
+pub const IOV_MAX: usize = 1024;
+
+/// Most bytes a single read or write transfers (the kernel's `MAX_RW_COUNT`).
+pub const MAX_RW_COUNT: usize = 0x7fff_f000;
+
+/// A buffer in guest memory.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct GuestBuf {
+    pub addr: usize,
+    pub len: usize,
+}
+
+impl GuestBuf {
+    fn iovec(&self) -> libc::iovec {
+        libc::iovec {
+            iov_base: self.addr as *mut libc::c_void,
+            iov_len: self.len,
+        }
+    }
+}
+
+/// Total length of `bufs`, capped at [`MAX_RW_COUNT`].
+pub fn total_len(bufs: &[GuestBuf]) -> usize {
+    bufs.iter()
+        .fold(0usize, |n, buf| n.saturating_add(buf.len))
+        .min(MAX_RW_COUNT)
+}
+
+/// Read the `count` iovecs at `addr` in the memory of `pid`.
+///
+/// Fails with `EINVAL` if `count` exceeds [`IOV_MAX`], like `readv(2)`.
+pub fn read_iovecs(pid: i32, addr: usize, count: usize) -> Result<Vec<GuestBuf>, i32> {
+    if count > IOV_MAX {
+        return Err(libc::EINVAL);
+    }
+    let mut iovecs = vec![
+        libc::iovec {
+            iov_base: std::ptr::null_mut(),
+            iov_len: 0,
+        };
+        count
+    ];
+    // SAFETY: iovec is plain data, any bytes are a valid value
+    let bytes = unsafe {
+        std::slice::from_raw_parts_mut(
+            iovecs.as_mut_ptr() as *mut u8,
+            count * std::mem::size_of::<libc::iovec>(),
+        )
+    };
+    read_guest(
+        pid,
+        &[GuestBuf {
+            addr,
+            len: bytes.len(),
+        }],
+        bytes,
+    )?;
+    Ok(iovecs
+        .iter()
+        .map(|iov| GuestBuf {
+            addr: iov.iov_base as usize,
+            len: iov.iov_len,
+        })
+        .collect())
+}
+
+/// Fill `local` from the guest buffers `remote`, in order.
+///
+/// Fails with `EFAULT` unless all of `local` could be filled.
+pub fn read_guest(pid: i32, remote: &[GuestBuf], local: &mut [u8]) -> Result<(), i32> {
+    let local_iov = libc::iovec {
+        iov_base: local.as_mut_ptr() as *mut libc::c_void,
+        iov_len: local.len(),
+    };
+    transfer(local_iov, remote, |local, remote, count| {
+        // SAFETY: `local` is a buffer we own, `remote` has `count` entries
+        unsafe { libc::process_vm_readv(pid, local, 1, remote, count, 0) }
+    })
+}
+
+/// Copy `local` to the guest buffers `remote`, filling them in order.
+///
+/// Fails with `EFAULT` unless all of `local` could be copied.
+pub fn write_guest(pid: i32, local: &[u8], remote: &[GuestBuf]) -> Result<(), i32> {
+    let local_iov = libc::iovec {
+        iov_base: local.as_ptr() as *mut libc::c_void,
+        iov_len: local.len(),
+    };
+    transfer(local_iov, remote, |local, remote, count| {
+        // SAFETY: `local` is a buffer we own and is only read, `remote` has
+        // `count` entries
+        unsafe { libc::process_vm_writev(pid, local, 1, remote, count, 0) }
+    })
+}
+
+/// Move the bytes of `local` to or from the start of `remote` with `op`,
+/// batching up to [`IOV_MAX`] guest buffers per call.
+fn transfer(
+    local: libc::iovec,
+    remote: &[GuestBuf],
+    op: impl Fn(*const libc::iovec, *const libc::iovec, libc::c_ulong) -> isize,
+) -> Result<(), i32> {
+    let mut done = 0;
+    let mut batch = Vec::with_capacity(remote.len().min(IOV_MAX));
+    let mut bufs = remote.iter().filter(|buf| buf.len > 0);
+
+    while done < local.iov_len {
+        // Guest buffers covering the next part of `local`
+        batch.clear();
+        let mut len = 0;
+        for buf in bufs.by_ref() {
+            let take = buf.len.min(local.iov_len - done - len);
+            batch.push(
+                GuestBuf {
+                    addr: buf.addr,
+                    len: take,
+                }
+                .iovec(),
+            );
+            len += take;
+            if batch.len() == IOV_MAX || done + len == local.iov_len {
+                break;
+            }
+        }
+        if batch.is_empty() {
+            return Err(libc::EFAULT);
+        }
+
+        let local_part = libc::iovec {
+            // SAFETY: `done + len` is within `local`
+            iov_base: unsafe { (local.iov_base as *mut u8).add(done) } as *mut libc::c_void,
+            iov_len: len,
+        };
+        let n = op(&local_part, batch.as_ptr(), batch.len() as libc::c_ulong);
+        if n < 0 || n as usize != len {
+            return Err(libc::EFAULT);
+        }
+        done += len;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn buf_of(data: &[u8]) -> GuestBuf {
+        GuestBuf {
+            addr: data.as_ptr() as usize,
+            len: data.len(),
+        }
+    }
+
+    fn pid() -> i32 {
+        std::process::id() as i32
+    }
+
+    fn buf_of_mut(data: &mut [u8]) -> GuestBuf {
+        GuestBuf {
+            addr: data.as_mut_ptr() as usize,
+            len: data.len(),
+        }
+    }
+
+    #[test]
+    fn test_scatter_and_gather() {
+        let mut a = vec![0u8; 3];
+        let mut b = vec![0u8; 0];
+        let mut c = vec![0u8; 5];
+        let remote = [buf_of_mut(&mut a), buf_of_mut(&mut b), buf_of_mut(&mut c)];
+
+        write_guest(pid(), b"hello wo", &remote).unwrap();
+        assert_eq!(&a, b"hel");
+        assert_eq!(&c, b"lo wo");
+
+        let mut local = [0u8; 6];
+        read_guest(pid(), &remote, &mut local).unwrap();
+        assert_eq!(&local, b"hello ");
+        assert_eq!(total_len(&remote), 8);
+    }
+
+    #[test]
+    fn test_more_buffers_than_one_batch() {
+        let data: Vec<u8> = (0..IOV_MAX * 2 + 7).map(|i| i as u8).collect();
+        let remote: Vec<GuestBuf> = data.chunks(1).map(buf_of).collect();
+
+        let mut local = vec![0u8; data.len()];
+        read_guest(pid(), &remote, &mut local).unwrap();
+        assert_eq!(local, data);
+    }
+
+    #[test]
+    fn test_short_guest_buffers_fault() {
+        let mut a = vec![0u8; 2];
+        assert_eq!(
+            write_guest(pid(), b"abc", &[buf_of_mut(&mut a)]),
+            Err(libc::EFAULT)
+        );
+    }
+
+    #[test]
+    fn test_read_iovecs() {
+        let a = vec![0u8; 4];
+        let iovecs = [buf_of(&a).iovec(), buf_of(&a[1..]).iovec()];
+        let bufs = read_iovecs(pid(), iovecs.as_ptr() as usize, 2).unwrap();
+        assert_eq!(bufs, vec![buf_of(&a), buf_of(&a[1..])]);
+        assert_eq!(read_iovecs(pid(), 0, IOV_MAX + 1), Err(libc::EINVAL));
+    }
+}
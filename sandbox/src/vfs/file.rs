@@ -49,11 +49,17 @@ pub trait FileOps: Send + Sync {
     /// Set flags associated with this file descriptor
     fn set_flags(&self, flags: i32) -> VfsResult<()>;
 
-    /// Read directory entries (for directories only)
+    /// Read directory entries from the stream position (for directories only)
     ///
-    /// This is used to implement getdents64. Returns a vector of (inode, name, type) tuples.
-    /// Returns an error if this is not a directory.
-    async fn getdents(&self) -> VfsResult<Vec<(u64, String, u8)>> {
+    /// This is used to implement getdents64. Calls `fill` with the inode, the
+    /// offset after the entry, the name and the type of each entry in turn,
+    /// until it returns false or the directory ends. The entries `fill`
+    /// accepted are consumed, so the next call continues with the one it
+    /// declined. Returns an error if this is not a directory.
+    async fn getdents(
+        &self,
+        _fill: &mut (dyn FnMut(u64, i64, &str, u8) -> bool + Send),
+    ) -> VfsResult<()> {
         Err(super::VfsError::Other("Not a directory".to_string()))
     }
 }
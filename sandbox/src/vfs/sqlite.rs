@@ -1,6 +1,7 @@
 use super::file::{BoxedFileOps, FileOps};
 use super::{Vfs, VfsError, VfsResult};
-use agentfs_sdk::{filesystem::AgentFS, FileSystem};
+use agentfs_sdk::{filesystem::AgentFS, BoxedDirectory, FileSystem};
+use std::collections::VecDeque;
 use std::os::unix::io::RawFd;
 use std::path::{Path, PathBuf};
 use std::sync::{Arc, Mutex};
@@ -151,8 +152,7 @@ impl Vfs for SqliteVfs {
                         ino: stats.ino,
                         path: relative_path,
                         flags: Mutex::new(flags),
-                        entries: Arc::new(Mutex::new(None)),
-                        position: Arc::new(Mutex::new(0)),
+                        stream: tokio::sync::Mutex::new(DirStream::default()),
                     }))
                 } else {
                     // If O_TRUNC is set, skip reading the file and use empty data
@@ -545,8 +545,24 @@ impl FileOps for SqliteFileOps {
     }
 }
 
-/// Type alias for directory entry list: (inode, name, type)
-type DirEntryList = Vec<(u64, String, u8)>;
+/// Directory entries read from the filesystem per batch
+const DIR_BATCH_SIZE: usize = 256;
+
+/// Position of a directory stream
+///
+/// Entries are read from the filesystem's directory stream one batch at a
+/// time, after "." and "..", and handed out from `pending`.
+#[derive(Default)]
+struct DirStream {
+    /// Directory stream of the filesystem, opened by the first read
+    dir: Option<BoxedDirectory>,
+    /// Entries read but not returned yet: (inode, name, type)
+    pending: VecDeque<(u64, String, u8)>,
+    /// Number of entries returned so far
+    position: usize,
+    /// Whether `dir` is exhausted
+    eof: bool,
+}
 
 /// Directory operations for SQLite VFS directories
 struct SqliteDirectoryOps {
@@ -554,10 +570,106 @@ struct SqliteDirectoryOps {
     ino: i64,
     path: String,
     flags: Mutex<i32>,
-    /// Cached directory entries
-    entries: Arc<Mutex<Option<DirEntryList>>>,
-    /// Current position in the directory listing
-    position: Arc<Mutex<usize>>,
+    /// Directory stream, shared by duplicated FDs like a kernel file offset
+    stream: tokio::sync::Mutex<DirStream>,
+}
+
+impl SqliteDirectoryOps {
+    /// The "." and ".." entries of the directory
+    async fn dot_entries(&self) -> VfsResult<[(u64, String, u8); 2]> {
+        // Get current directory stats for "."
+        let current_stats = self
+            .fs
+            .getattr(self.ino)
+            .await
+            .map_err(|e| VfsError::Other(format!("Failed to getattr current dir: {}", e)))?
+            .ok_or(VfsError::NotFound)?;
+
+        // Get parent directory inode for ".."
+        // Walk the path to find the parent
+        let parent_ino = if self.path == "/" {
+            ROOT_INO // Root's parent is itself
+        } else {
+            let parent_path = std::path::Path::new(&self.path)
+                .parent()
+                .map(|p| p.to_str().unwrap_or("/").to_string())
+                .unwrap_or("/".to_string());
+            let parent_path = if parent_path.is_empty() { "/" } else { &parent_path };
+
+            // Walk to find parent inode
+            let mut ino = ROOT_INO;
+            for component in parent_path.split('/').filter(|s| !s.is_empty()) {
+                if let Some(stats) = self.fs.lookup(ino, component).await
+                    .map_err(|e| VfsError::Other(format!("Failed to lookup: {}", e)))? {
+                    ino = stats.ino;
+                }
+            }
+            ino
+        };
+
+        Ok([
+            (current_stats.ino as u64, ".".to_string(), libc::DT_DIR),
+            (parent_ino as u64, "..".to_string(), libc::DT_DIR),
+        ])
+    }
+
+    /// Read the next batch of entries into `stream.pending`
+    async fn fill(&self, stream: &mut DirStream) -> VfsResult<()> {
+        if stream.dir.is_none() {
+            stream.pending.extend(self.dot_entries().await?);
+            let dir = self
+                .fs
+                .opendir(self.ino)
+                .await
+                .map_err(|e| VfsError::Other(format!("Failed to read directory: {}", e)))?
+                .ok_or(VfsError::NotFound)?;
+            stream.dir = Some(dir);
+            return Ok(());
+        }
+
+        let entries = stream
+            .dir
+            .as_ref()
+            .unwrap()
+            .next_entries(DIR_BATCH_SIZE)
+            .await
+            .map_err(|e| VfsError::Other(format!("Failed to read directory: {}", e)))?;
+        stream.eof = entries.is_empty();
+        for entry in entries {
+            let d_type = if entry.stats.is_directory() {
+                libc::DT_DIR
+            } else if entry.stats.is_symlink() {
+                libc::DT_LNK
+            } else {
+                libc::DT_REG
+            };
+            stream.pending.push_back((entry.stats.ino as u64, entry.name, d_type));
+        }
+        Ok(())
+    }
+
+    /// Hand entries from the stream position to `fill` until it declines one
+    async fn read_entries(
+        &self,
+        stream: &mut DirStream,
+        fill: &mut (dyn FnMut(u64, i64, &str, u8) -> bool + Send),
+    ) -> VfsResult<()> {
+        loop {
+            if stream.pending.is_empty() {
+                if stream.eof {
+                    return Ok(());
+                }
+                self.fill(stream).await?;
+                continue;
+            }
+            let (ino, name, d_type) = &stream.pending[0];
+            if !fill(*ino, stream.position as i64 + 1, name, *d_type) {
+                return Ok(());
+            }
+            stream.pending.pop_front();
+            stream.position += 1;
+        }
+    }
 }
 
 #[async_trait::async_trait]
@@ -572,9 +684,28 @@ impl FileOps for SqliteDirectoryOps {
         Err(VfsError::Other("Is a directory".to_string()))
     }
 
-    async fn seek(&self, _offset: i64, _whence: i32) -> VfsResult<i64> {
-        // Cannot seek in a directory
-        Err(VfsError::Other("Is a directory".to_string()))
+    async fn seek(&self, offset: i64, whence: i32) -> VfsResult<i64> {
+        // Directory offsets count entries, as in the d_off of getdents64
+        let mut stream = self.stream.lock().await;
+        let target = match whence {
+            libc::SEEK_SET => offset,
+            libc::SEEK_CUR => stream.position as i64 + offset,
+            _ => return Err(VfsError::InvalidInput("Invalid whence".to_string())),
+        };
+        if target < 0 {
+            return Err(VfsError::InvalidInput("Invalid offset".to_string()));
+        }
+
+        // Seeking backwards (rewinddir in particular) restarts the stream,
+        // which also picks up entries created since it was opened
+        if (target as usize) < stream.position {
+            *stream = DirStream::default();
+        }
+        self.read_entries(&mut stream, &mut |_: u64, next: i64, _: &str, _: u8| {
+            next <= target
+        })
+        .await?;
+        Ok(stream.position as i64)
     }
 
     async fn fstat(&self) -> VfsResult<libc::stat> {
@@ -658,87 +789,11 @@ impl FileOps for SqliteDirectoryOps {
         Ok(())
     }
 
-    async fn getdents(&self) -> VfsResult<DirEntryList> {
-        // Check if we need to populate the entries cache
-        let needs_populate = {
-            let entries_lock = self.entries.lock().unwrap();
-            entries_lock.is_none()
-        };
-
-        if needs_populate {
-            // Read directory entries from the filesystem using readdir_plus
-            let dir_entries = self
-                .fs
-                .readdir_plus(self.ino)
-                .await
-                .map_err(|e| VfsError::Other(format!("Failed to read directory: {}", e)))?
-                .ok_or(VfsError::NotFound)?;
-
-            // Convert to the format expected by getdents64
-            let mut result = Vec::new();
-
-            // Get current directory stats for "."
-            let current_stats = self
-                .fs
-                .getattr(self.ino)
-                .await
-                .map_err(|e| VfsError::Other(format!("Failed to getattr current dir: {}", e)))?
-                .ok_or(VfsError::NotFound)?;
-
-            // Get parent directory inode for ".."
-            // Walk the path to find the parent
-            let parent_ino = if self.path == "/" {
-                ROOT_INO // Root's parent is itself
-            } else {
-                let parent_path = std::path::Path::new(&self.path)
-                    .parent()
-                    .map(|p| p.to_str().unwrap_or("/").to_string())
-                    .unwrap_or("/".to_string());
-                let parent_path = if parent_path.is_empty() { "/" } else { &parent_path };
-
-                // Walk to find parent inode
-                let mut ino = ROOT_INO;
-                for component in parent_path.split('/').filter(|s| !s.is_empty()) {
-                    if let Some(stats) = self.fs.lookup(ino, component).await
-                        .map_err(|e| VfsError::Other(format!("Failed to lookup: {}", e)))? {
-                        ino = stats.ino;
-                    }
-                }
-                ino
-            };
-
-            result.push((current_stats.ino as u64, ".".to_string(), libc::DT_DIR));
-            result.push((parent_ino as u64, "..".to_string(), libc::DT_DIR));
-
-            for entry in dir_entries {
-                let d_type = if entry.stats.is_directory() {
-                    libc::DT_DIR
-                } else if entry.stats.is_symlink() {
-                    libc::DT_LNK
-                } else {
-                    libc::DT_REG
-                };
-                result.push((entry.stats.ino as u64, entry.name, d_type));
-            }
-
-            // Store the results
-            let mut entries_lock = self.entries.lock().unwrap();
-            *entries_lock = Some(result);
-        }
-
-        // Get the current position and return entries
-        let mut position = self.position.lock().unwrap();
-        let entries_lock = self.entries.lock().unwrap();
-        let all_entries = entries_lock.as_ref().unwrap();
-
-        if *position >= all_entries.len() {
-            // No more entries - return empty to signal EOF
-            Ok(Vec::new())
-        } else {
-            // Return remaining entries and update position
-            let remaining = all_entries[*position..].to_vec();
-            *position = all_entries.len();
-            Ok(remaining)
-        }
+    async fn getdents(
+        &self,
+        fill: &mut (dyn FnMut(u64, i64, &str, u8) -> bool + Send),
+    ) -> VfsResult<()> {
+        let mut stream = self.stream.lock().await;
+        self.read_entries(&mut stream, fill).await
     }
 }
@@ -0,0 +1,231 @@
+//! Background pushes and checkpoints of a synced database.
+//!
+//! The sync engine records every row a write changes, and a push ships only
+//! the rows changed since the previous one. Since file data is stored in
+//! chunks, a push after a small write to a large file carries the chunks
+//! that write touched, not the file. What is left to decide is when to push
+//! and when to checkpoint, and [`AutoSync`] does that from a task of its own,
+//! so a mount keeps serving requests meanwhile:
+//!
+//! - changes are pushed once enough of them are pending, or once the oldest
+//!   has waited long enough;
+//! - the WAL is checkpointed once it grows past a size, keeping reads fast;
+//! - a failed push is retried after the push interval, not on every poll.
+
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use tokio::sync::Notify;
+use tokio::task::JoinHandle;
+
+use crate::error::Result;
+use crate::metrics::Counter;
+
+static PUSHES: Counter = Counter::new("autosync.pushes");
+static CHECKPOINTS: Counter = Counter::new("autosync.checkpoints");
+static ERRORS: Counter = Counter::new("autosync.errors");
+
+/// When [`AutoSync`] pushes and checkpoints.
+#[derive(Debug, Clone, Copy)]
+pub struct AutoSyncOptions {
+    /// Push once this many changes are pending
+    pub push_after_changes: u64,
+    /// Push pending changes once the oldest has waited this long
+    pub push_interval: Duration,
+    /// Checkpoint once the WAL is larger than this many bytes
+    pub checkpoint_wal_bytes: u64,
+    /// How often to look at the pending changes and the WAL
+    pub poll_interval: Duration,
+}
+
+impl Default for AutoSyncOptions {
+    fn default() -> Self {
+        Self {
+            push_after_changes: 1000,
+            push_interval: Duration::from_secs(30),
+            checkpoint_wal_bytes: 64 * 1024 * 1024,
+            poll_interval: Duration::from_secs(1),
+        }
+    }
+}
+
+/// A task pushing and checkpointing a synced database in the background.
+///
+/// Dropping it aborts the task; [`AutoSync::stop()`] pushes what is still
+/// pending first.
+pub struct AutoSync {
+    db: turso::sync::Database,
+    options: AutoSyncOptions,
+    stop: Arc<Notify>,
+    task: Option<JoinHandle<Result<()>>>,
+}
+
+impl AutoSync {
+    /// Start pushing and checkpointing `db` on the current tokio runtime.
+    pub fn spawn(db: turso::sync::Database, options: AutoSyncOptions) -> Self {
+        let stop = Arc::new(Notify::new());
+        let task = tokio::spawn(run(db.clone(), options, stop.clone()));
+        Self {
+            db,
+            options,
+            stop,
+            task: Some(task),
+        }
+    }
+
+    /// Stop the task, pushing the changes still pending, and return the
+    /// error of that last push if it failed.
+    ///
+    /// This also works on another runtime than the one the task was spawned
+    /// on, after that one is gone.
+    pub async fn stop(mut self) -> Result<()> {
+        self.stop.notify_one();
+        if let Some(task) = self.task.take() {
+            if let Ok(result) = task.await {
+                return result;
+            }
+        }
+        // The task was cancelled with its runtime, push from here
+        let mut state = State::default();
+        tick(&self.db, &self.options, &mut state, true).await
+    }
+}
+
+impl Drop for AutoSync {
+    fn drop(&mut self) {
+        if let Some(task) = self.task.take() {
+            task.abort();
+        }
+    }
+}
+
+/// What the task knows about the changes between polls.
+#[derive(Debug, Default)]
+struct State {
+    /// Change count of the database right after the last push
+    pushed: u64,
+    /// When changes were first seen pending since the last push
+    dirty_since: Option<Instant>,
+    /// No push before this, after a failed one
+    retry_at: Option<Instant>,
+}
+
+impl State {
+    /// Changes made since the last push, given the current change count.
+    fn pending(&self, changes: u64) -> u64 {
+        if changes >= self.pushed {
+            changes - self.pushed
+        } else {
+            // The count was reset since, everything counted is new
+            changes
+        }
+    }
+
+    /// Whether `pending` changes are due for a push at `now`.
+    fn push_due(&mut self, pending: u64, options: &AutoSyncOptions, now: Instant) -> bool {
+        if pending == 0 {
+            self.dirty_since = None;
+            return false;
+        }
+        if let Some(at) = self.retry_at {
+            if now < at {
+                return false;
+            }
+        }
+        let since = *self.dirty_since.get_or_insert(now);
+        pending >= options.push_after_changes || now.duration_since(since) >= options.push_interval
+    }
+}
+
+/// Push and checkpoint until stopped, then push what is pending and return
+/// the result of that last push.
+async fn run(db: turso::sync::Database, options: AutoSyncOptions, stop: Arc<Notify>) -> Result<()> {
+    let mut state = State::default();
+    loop {
+        let stopping = tokio::select! {
+            _ = tokio::time::sleep(options.poll_interval) => false,
+            _ = stop.notified() => true,
+        };
+        let result = tick(&db, &options, &mut state, stopping).await;
+        if result.is_err() {
+            ERRORS.increment();
+        }
+        if stopping {
+            // Reported by stop()
+            return result;
+        }
+        if let Err(e) = result {
+            state.retry_at = Some(Instant::now() + options.push_interval);
+            tracing::warn!("Background sync failed: {}", e);
+        }
+    }
+}
+
+/// Push and checkpoint `db` if due, or push anything pending if `flush`.
+async fn tick(
+    db: &turso::sync::Database,
+    options: &AutoSyncOptions,
+    state: &mut State,
+    flush: bool,
+) -> Result<()> {
+    let stats = db.stats().await?;
+    let pending = state.pending(stats.cdc_operations as u64);
+    let due = state.push_due(pending, options, Instant::now());
+    if pending > 0 && (due || flush) {
+        db.push().await?;
+        PUSHES.increment();
+        state.pushed = db.stats().await?.cdc_operations as u64;
+        state.dirty_since = None;
+        state.retry_at = None;
+    }
+
+    if stats.main_wal_size as u64 >= options.checkpoint_wal_bytes {
+        db.checkpoint().await?;
+        CHECKPOINTS.increment();
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_push_due() {
+        let options = AutoSyncOptions {
+            push_after_changes: 10,
+            push_interval: Duration::from_secs(30),
+            ..Default::default()
+        };
+        let start = Instant::now();
+        let mut state = State::default();
+
+        // Nothing pending, nothing to push
+        assert!(!state.push_due(0, &options, start));
+
+        // A few changes wait for the interval
+        assert!(!state.push_due(3, &options, start));
+        assert!(!state.push_due(5, &options, start + Duration::from_secs(10)));
+        assert!(state.push_due(5, &options, start + Duration::from_secs(30)));
+
+        // Enough changes are pushed right away
+        let mut state = State::default();
+        assert!(state.push_due(10, &options, start));
+
+        // A failed push waits before retrying
+        state.retry_at = Some(start + Duration::from_secs(30));
+        assert!(!state.push_due(20, &options, start + Duration::from_secs(1)));
+        assert!(state.push_due(20, &options, start + Duration::from_secs(30)));
+    }
+
+    #[test]
+    fn test_pending_changes() {
+        let state = State {
+            pushed: 100,
+            ..Default::default()
+        };
+        assert_eq!(state.pending(100), 0);
+        assert_eq!(state.pending(142), 42);
+        assert_eq!(state.pending(7), 7);
+    }
+}
@@ -3,19 +3,44 @@
 //! This module provides a thread-safe connection pool that manages database
 //! connections with a maximum limit. When the pool is exhausted, callers block
 //! until a connection becomes available or timeout occurs.
+//!
+//! The pool has two sides: a single writer connection, and a set of read-only
+//! connections that run in parallel with it and with each other. Readers rely
+//! on WAL snapshot isolation, so each read statement sees the state as of the
+//! last committed write and never blocks the writer.
+//!
+//! The time callers wait for a connection is recorded in the `pool.*`
+//! metrics, and statements run through a [`PooledConnection`] are counted.
 
-use std::{sync::Arc, time::Duration};
-use tokio::sync::{Mutex, OwnedSemaphorePermit, Semaphore};
-use turso::{Connection, Database};
+use std::{
+    sync::{Arc, Mutex, Weak},
+    time::Duration,
+};
+use tokio::sync::{OwnedSemaphorePermit, Semaphore};
+use turso::{Connection, Database, Rows, Statement};
 
 use crate::error::{Error, Result};
+use crate::metrics::{Counter, OpMetrics};
 
-/// Maximum number of connections in the pool.
+/// Maximum number of writer connections in the pool.
 const MAX_CONNECTIONS: usize = 1;
 
+/// Upper bound on the number of concurrent read-only connections.
+const MAX_READ_CONNECTIONS: usize = 16;
+
+/// Busy timeout applied to read-only connections, matching the writer's.
+const READ_BUSY_TIMEOUT_MS: u32 = 5000;
+
 /// Default timeout for acquiring a connection from the pool.
 const DEFAULT_TIMEOUT: Duration = Duration::from_secs(30);
 
+/// Time spent waiting for the writer connection.
+static WRITER_WAIT: OpMetrics = OpMetrics::new("pool.writer_wait");
+/// Time spent waiting for a read-only connection.
+static READER_WAIT: OpMetrics = OpMetrics::new("pool.reader_wait");
+/// Statements prepared or executed through pooled connections.
+static SQL_STATEMENTS: Counter = Counter::new("sql.statements");
+
 /// Database wrapper that supports both regular and sync databases.
 enum DatabaseType {
     Local(Database),
@@ -27,19 +52,55 @@ enum DatabaseType {
 /// The pool enforces a maximum number of concurrent connections. When all
 /// connections are in use, `get_connection()` blocks until one becomes
 /// available or the timeout expires (returning `ConnectionPoolTimeout`).
+///
+/// `get_connection()` hands out the writer; `get_read_connection()` hands out
+/// one of up to `available_parallelism()` readers (capped at
+/// `MAX_READ_CONNECTIONS`). Sync databases have no reader side and serve
+/// reads from the writer.
 #[derive(Clone)]
 pub struct ConnectionPool {
     inner: Arc<ConnectionPoolInner>,
 }
 
+/// A reference to a [`ConnectionPool`] that doesn't keep its database open,
+/// for background tasks that should stop with it
+#[derive(Clone)]
+pub(crate) struct WeakConnectionPool {
+    inner: Weak<ConnectionPoolInner>,
+}
+
+impl WeakConnectionPool {
+    /// The pool, unless every other reference to it was dropped
+    pub(crate) fn upgrade(&self) -> Option<ConnectionPool> {
+        self.inner.upgrade().map(|inner| ConnectionPool { inner })
+    }
+}
+
 struct ConnectionPoolInner {
     db: DatabaseType,
+    /// Writer side of the pool
+    writer: Slots,
+    /// Read-only side of the pool (None for sync databases)
+    readers: Option<Slots>,
+    /// Timeout for acquiring a connection
+    timeout: Duration,
+}
+
+/// Idle connections plus the semaphore bounding how many may be checked out.
+struct Slots {
     /// Available connections ready to be reused
     pool: Mutex<Vec<Connection>>,
     /// Semaphore to limit concurrent connections
     semaphore: Arc<Semaphore>,
-    /// Timeout for acquiring a connection
-    timeout: Duration,
+}
+
+impl Slots {
+    fn new(max: usize) -> Self {
+        Self {
+            pool: Mutex::new(Vec::with_capacity(max)),
+            semaphore: Arc::new(Semaphore::new(max)),
+        }
+    }
 }
 
 impl ConnectionPool {
@@ -55,16 +116,35 @@ impl ConnectionPool {
 
     /// Create a connection pool with a custom timeout.
     fn with_timeout(db: DatabaseType, timeout: Duration) -> Self {
+        let readers = match db {
+            DatabaseType::Local(_) => Some(Slots::new(Self::max_read_connections())),
+            DatabaseType::Sync(_) => None,
+        };
         Self {
             inner: Arc::new(ConnectionPoolInner {
                 db,
-                pool: Mutex::new(Vec::new()),
-                semaphore: Arc::new(Semaphore::new(MAX_CONNECTIONS)),
+                writer: Slots::new(MAX_CONNECTIONS),
+                readers,
                 timeout,
             }),
         }
     }
 
+    /// A reference to the pool that doesn't keep it open
+    pub(crate) fn downgrade(&self) -> WeakConnectionPool {
+        WeakConnectionPool {
+            inner: Arc::downgrade(&self.inner),
+        }
+    }
+
+    /// Number of read-only connections: one per core, capped.
+    fn max_read_connections() -> usize {
+        std::thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1)
+            .clamp(1, MAX_READ_CONNECTIONS)
+    }
+
     /// Get a connection from the pool.
     ///
     /// If a pooled connection is available, it is returned immediately.
@@ -72,26 +152,18 @@ impl ConnectionPool {
     /// is created. If at max capacity, this blocks until a connection is
     /// returned to the pool or timeout expires.
     ///
+    /// This is the writer connection; use it for anything that modifies the
+    /// database or must observe its own uncommitted changes.
+    ///
     /// # Errors
     ///
     /// Returns `Error::ConnectionPoolTimeout` if no connection becomes
     /// available within the timeout period.
     pub async fn get_connection(&self) -> Result<PooledConnection> {
-        // Try to acquire a permit with timeout
-        let permit = tokio::time::timeout(
-            self.inner.timeout,
-            Arc::clone(&self.inner.semaphore).acquire_owned(),
-        )
-        .await
-        .map_err(|_| Error::ConnectionPoolTimeout)?
-        .map_err(|_| Error::Internal("semaphore closed".to_string()))?;
+        let permit = self.acquire(&self.inner.writer, &WRITER_WAIT).await?;
 
         // We have a permit - try to get an existing connection or create new one
-        let conn = {
-            let mut pool = self.inner.pool.lock().await;
-            pool.pop()
-        };
-
+        let conn = self.inner.writer.pool.lock().unwrap().pop();
         let conn = match conn {
             Some(c) => c,
             None => match &self.inner.db {
@@ -103,10 +175,67 @@ impl ConnectionPool {
         Ok(PooledConnection {
             conn: Some(conn),
             pool: self.inner.clone(),
+            reader: false,
             _permit: permit,
         })
     }
 
+    /// Get a read-only connection from the pool.
+    ///
+    /// Readers run concurrently with each other and with the writer. Each
+    /// statement reads a consistent snapshot of the last committed state, so
+    /// callers must not use a reader for statements that modify the database.
+    /// Falls back to the writer when the database has no reader side.
+    ///
+    /// # Errors
+    ///
+    /// Returns `Error::ConnectionPoolTimeout` if no connection becomes
+    /// available within the timeout period.
+    pub async fn get_read_connection(&self) -> Result<PooledConnection> {
+        let (Some(readers), DatabaseType::Local(db)) = (&self.inner.readers, &self.inner.db) else {
+            return self.get_connection().await;
+        };
+
+        let permit = self.acquire(readers, &READER_WAIT).await?;
+
+        let conn = readers.pool.lock().unwrap().pop();
+        let conn = match conn {
+            Some(c) => c,
+            None => {
+                let conn = db.connect()?;
+                conn.execute(&format!("PRAGMA busy_timeout = {READ_BUSY_TIMEOUT_MS}"), ())
+                    .await?;
+                conn
+            }
+        };
+
+        Ok(PooledConnection {
+            conn: Some(conn),
+            pool: self.inner.clone(),
+            reader: true,
+            _permit: permit,
+        })
+    }
+
+    /// Acquire a permit for one side of the pool, honouring the pool timeout,
+    /// and record the wait in `wait`.
+    async fn acquire(
+        &self,
+        slots: &Slots,
+        wait: &'static OpMetrics,
+    ) -> Result<OwnedSemaphorePermit> {
+        let timer = wait.start();
+        let permit = tokio::time::timeout(
+            self.inner.timeout,
+            Arc::clone(&slots.semaphore).acquire_owned(),
+        )
+        .await;
+        timer.finish(permit.is_ok(), 0);
+        permit
+            .map_err(|_| Error::ConnectionPoolTimeout)?
+            .map_err(|_| Error::Internal("semaphore closed".to_string()))
+    }
+
     /// Get the underlying database reference (for creating additional connections).
     /// Returns None if this is a sync database.
     pub fn database(&self) -> Option<&Database> {
@@ -132,6 +261,8 @@ impl ConnectionPool {
 pub struct PooledConnection {
     conn: Option<Connection>,
     pool: Arc<ConnectionPoolInner>,
+    /// Whether this connection belongs to the read-only side
+    reader: bool,
     /// Held permit - released when this is dropped
     _permit: OwnedSemaphorePermit,
 }
@@ -141,6 +272,33 @@ impl PooledConnection {
     pub fn connection(&self) -> &Connection {
         self.conn.as_ref().expect("connection already taken")
     }
+
+    // The statement methods below shadow the connection's own, so that the
+    // statements callers run are counted.
+
+    /// Execute a statement, returning the number of rows changed.
+    pub async fn execute(&self, sql: &str, params: impl turso::params::IntoParams) -> Result<u64> {
+        SQL_STATEMENTS.increment();
+        Ok(self.connection().execute(sql, params).await?)
+    }
+
+    /// Run a query, returning its rows.
+    pub async fn query(&self, sql: &str, params: impl turso::params::IntoParams) -> Result<Rows> {
+        SQL_STATEMENTS.increment();
+        Ok(self.connection().query(sql, params).await?)
+    }
+
+    /// Prepare a statement, reusing the connection's cached one for `sql`.
+    pub async fn prepare_cached(&self, sql: &str) -> Result<Statement> {
+        SQL_STATEMENTS.increment();
+        Ok(self.connection().prepare_cached(sql).await?)
+    }
+
+    /// Prepare a statement.
+    pub async fn prepare(&self, sql: &str) -> Result<Statement> {
+        SQL_STATEMENTS.increment();
+        Ok(self.connection().prepare(sql).await?)
+    }
 }
 
 impl std::ops::Deref for PooledConnection {
@@ -154,9 +312,14 @@ impl std::ops::Deref for PooledConnection {
 impl Drop for PooledConnection {
     fn drop(&mut self) {
         if let Some(conn) = self.conn.take() {
-            // Return connection to pool - use try_lock to avoid blocking in drop
-            // If we can't get the lock, just drop the connection (it will be recreated)
-            if let Ok(mut pool) = self.pool.pool.try_lock() {
+            let slots = match (self.reader, &self.pool.readers) {
+                (true, Some(readers)) => readers,
+                _ => &self.pool.writer,
+            };
+            // The idle list is only held for a push or pop, so this never waits
+            // on an in-flight query. A poisoned lock just drops the connection
+            // (it will be recreated).
+            if let Ok(mut pool) = slots.pool.lock() {
                 pool.push(conn);
             }
             // Permit is automatically released when _permit is dropped
@@ -251,4 +414,58 @@ mod tests {
         // All 5 should have completed (serially, since max=1)
         assert_eq!(counter.load(Ordering::SeqCst), 5);
     }
+
+    #[tokio::test]
+    async fn test_read_connection_alongside_writer() {
+        let db = Builder::new_local(":memory:").build().await.unwrap();
+        let pool = ConnectionPool::with_timeout(DatabaseType::Local(db), Duration::from_millis(50));
+
+        // Holding the writer must not block readers
+        let _writer = pool.get_connection().await.unwrap();
+        let reader = pool.get_read_connection().await.unwrap();
+        assert!(reader.reader);
+    }
+
+    #[tokio::test]
+    async fn test_read_connections_limit() {
+        let db = Builder::new_local(":memory:").build().await.unwrap();
+        let pool = ConnectionPool::with_timeout(DatabaseType::Local(db), Duration::from_millis(50));
+
+        // All readers can be held at once
+        let max = ConnectionPool::max_read_connections();
+        let mut readers = Vec::new();
+        for _ in 0..max {
+            readers.push(pool.get_read_connection().await.unwrap());
+        }
+
+        // One more exceeds the limit
+        let result = pool.get_read_connection().await;
+        assert!(matches!(result, Err(Error::ConnectionPoolTimeout)));
+
+        // Returning one makes room again
+        readers.pop();
+        assert!(pool.get_read_connection().await.is_ok());
+    }
+
+    #[tokio::test]
+    async fn test_read_connection_sees_committed_writes() {
+        let db = Builder::new_local(":memory:").build().await.unwrap();
+        let pool = ConnectionPool::new(db);
+
+        let writer = pool.get_connection().await.unwrap();
+        writer
+            .execute("CREATE TABLE t (x INTEGER)", ())
+            .await
+            .unwrap();
+        writer
+            .execute("INSERT INTO t VALUES (1), (2)", ())
+            .await
+            .unwrap();
+
+        let reader = pool.get_read_connection().await.unwrap();
+        let mut rows = reader.query("SELECT COUNT(*) FROM t", ()).await.unwrap();
+        let row = rows.next().await.unwrap().unwrap();
+        let count = row.get_value(0).ok().and_then(|v| v.as_integer().copied());
+        assert_eq!(count, Some(2));
+    }
 }
@@ -65,6 +65,14 @@ pub enum Error {
     #[error("invalid encryption key: {0}")]
     InvalidEncryptionKey(String),
 
+    /// Chunk size outside the supported range
+    #[error("invalid chunk size {0}: must be between 512 bytes and 1 MiB")]
+    InvalidChunkSize(usize),
+
+    /// Compression codec this version doesn't know
+    #[error("unsupported compression: {0}")]
+    UnsupportedCompression(String),
+
     /// Internal error (for unexpected conditions)
     #[error("{0}")]
     Internal(String),
@@ -1,66 +1,674 @@
 use crate::error::{Error, Result};
 use async_trait::async_trait;
 use lru::LruCache;
+use std::borrow::Borrow;
+use std::collections::hash_map::RandomState;
+use std::collections::{BTreeMap, HashMap};
+use std::hash::{BuildHasher, Hash, Hasher};
 use std::num::NonZeroUsize;
 use std::path::Path;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
 use std::sync::{Arc, Mutex};
-use std::time::{SystemTime, UNIX_EPOCH};
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
 use turso::transaction::{Transaction, TransactionBehavior};
 use turso::{Builder, Connection, Value};
 
+use super::chunks::{ChunkStore, Compression};
 use super::{
-    BoxedFile, DirEntry, File, FileSystem, FilesystemStats, FsError, Stats, TimeChange,
-    DEFAULT_DIR_MODE, DEFAULT_FILE_MODE, MAX_NAME_LEN, S_IFLNK, S_IFMT, S_IFREG,
+    BoxedDirectory, BoxedFile, DirEntry, Directory, File, FileSystem, FilesystemStats, FsError,
+    Stats, TimeChange, DEFAULT_DIR_MODE, DEFAULT_FILE_MODE, MAX_NAME_LEN, S_IFLNK, S_IFMT, S_IFREG,
 };
-use crate::connection_pool::ConnectionPool;
+use crate::connection_pool::{ConnectionPool, PooledConnection};
+use crate::metrics::Counter;
 use crate::schema::AGENTFS_SCHEMA_VERSION;
 
+mod flusher;
+#[cfg(unix)]
+mod import;
+mod readahead;
+mod reaper;
+#[cfg(unix)]
+pub use import::ImportStats;
+
 const ROOT_INO: i64 = 1;
 const DEFAULT_CHUNK_SIZE: usize = 4096;
-const DENTRY_CACHE_MAX_SIZE: usize = 10000;
+const MIN_CHUNK_SIZE: usize = 512;
+const MAX_CHUNK_SIZE: usize = 1024 * 1024;
+/// Default number of entries kept by the dentry cache
+pub const DENTRY_CACHE_MAX_SIZE: usize = 10000;
+const DENTRY_CACHE_SHARDS: usize = 16;
+const ATTR_CACHE_MAX_SIZE: usize = 10000;
+/// Directory entries read per query by `prefetch_dir()`
+const PREFETCH_PAGE_SIZE: usize = 1024;
+/// Buffered bytes after which a write-back buffer is flushed by the next write
+const WRITE_BUFFER_MAX_BYTES: usize = 1024 * 1024;
+/// Chunks a write-back buffer holds before a flush at least, so large chunks
+/// are still coalesced
+const WRITE_BUFFER_MIN_CHUNKS: usize = 4;
+/// Age of the oldest buffered write after which the next write flushes, and
+/// interval of the flusher, which commits buffers that have reached it
+const WRITE_BUFFER_MAX_AGE: Duration = Duration::from_secs(1);
+
+static DENTRY_CACHE_HITS: Counter = Counter::new("dentry_cache.hits");
+static DENTRY_CACHE_MISSES: Counter = Counter::new("dentry_cache.misses");
+static ATTR_CACHE_HITS: Counter = Counter::new("attr_cache.hits");
+static ATTR_CACHE_MISSES: Counter = Counter::new("attr_cache.misses");
+
+/// Cached outcome of a directory entry lookup
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum CachedDentry {
+    /// The entry exists and refers to this inode
+    Found(i64),
+    /// The entry is known not to exist
+    Missing,
+}
+
+/// Owned dentry cache key.
+///
+/// Hashes exactly like the borrowed `(i64, &str)` view, so lookups can go
+/// through `dyn DentryKeyView` without allocating a `String`.
+#[derive(PartialEq, Eq)]
+struct DentryKey {
+    parent_ino: i64,
+    name: Box<str>,
+}
+
+trait DentryKeyView {
+    fn key(&self) -> (i64, &str);
+}
+
+impl DentryKeyView for DentryKey {
+    fn key(&self) -> (i64, &str) {
+        (self.parent_ino, &self.name)
+    }
+}
+
+impl DentryKeyView for (i64, &str) {
+    fn key(&self) -> (i64, &str) {
+        (self.0, self.1)
+    }
+}
+
+impl<'a> Borrow<dyn DentryKeyView + 'a> for DentryKey {
+    fn borrow(&self) -> &(dyn DentryKeyView + 'a) {
+        self
+    }
+}
+
+impl Hash for DentryKey {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.key().hash(state)
+    }
+}
+
+impl Hash for dyn DentryKeyView + '_ {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.key().hash(state)
+    }
+}
+
+impl PartialEq for dyn DentryKeyView + '_ {
+    fn eq(&self, other: &Self) -> bool {
+        self.key() == other.key()
+    }
+}
+
+impl Eq for dyn DentryKeyView + '_ {}
+
+/// One independently locked slice of the dentry cache
+struct DentryShard {
+    // Mutex required because LruCache::get() mutates internal order
+    entries: Mutex<LruCache<DentryKey, CachedDentry>>,
+    /// Incremented on every change made by a writer
+    generation: AtomicU64,
+}
 
-/// LRU cache for directory entry lookups.
+/// Sharded LRU cache for directory entry lookups.
 ///
 /// Maps (parent_ino, name) -> child_ino to avoid repeated database queries
 /// during path resolution. For a path like `/a/b/c/d`, this reduces queries
-/// from 4 to potentially 0 on cache hits.
+/// from 4 to potentially 0 on cache hits. Misses are cached too, so repeated
+/// lookups of names that don't exist (module resolution, `PATH` searches)
+/// don't reach the database either.
+///
+/// Entries are spread over `DENTRY_CACHE_SHARDS` shards by key hash, so
+/// concurrent lookups rarely contend on the same lock.
+///
+/// Lookups run on reader connections concurrently with the writer, so a
+/// reader may finish its query after a writer has changed the same entry.
+/// Writers bump the shard's generation counter, and readers populate the
+/// cache with `insert_if_current()` to avoid caching a result they read
+/// from an older snapshot.
 struct DentryCache {
-    // Mutex required because LruCache::get() mutates internal order
-    entries: Mutex<LruCache<(i64, String), i64>>,
+    shards: Box<[DentryShard]>,
+    hasher: RandomState,
 }
 
 impl DentryCache {
     fn new(max_size: usize) -> Self {
+        let shards = (0..DENTRY_CACHE_SHARDS)
+            .map(|_| DentryShard {
+                entries: Mutex::new(LruCache::new(Self::shard_capacity(max_size))),
+                generation: AtomicU64::new(0),
+            })
+            .collect();
         Self {
-            entries: Mutex::new(LruCache::new(
-                NonZeroUsize::new(max_size).expect("cache size must be > 0"),
-            )),
+            shards,
+            hasher: RandomState::new(),
+        }
+    }
+
+    fn shard_capacity(max_size: usize) -> NonZeroUsize {
+        NonZeroUsize::new(max_size.div_ceil(DENTRY_CACHE_SHARDS)).expect("cache size must be > 0")
+    }
+
+    /// Change the total number of cached entries, evicting LRU entries if
+    /// the cache shrinks
+    fn resize(&self, max_size: usize) {
+        for shard in self.shards.iter() {
+            shard
+                .entries
+                .lock()
+                .unwrap()
+                .resize(Self::shard_capacity(max_size));
         }
     }
 
+    fn shard_index(&self, parent_ino: i64, name: &str) -> usize {
+        let hash = self.hasher.hash_one((parent_ino, name));
+        hash as usize % self.shards.len()
+    }
+
+    fn shard(&self, parent_ino: i64, name: &str) -> &DentryShard {
+        &self.shards[self.shard_index(parent_ino, name)]
+    }
+
+    /// Current change generation of an entry's shard, sampled before a
+    /// read-side query
+    fn generation(&self, parent_ino: i64, name: &str) -> u64 {
+        self.shard(parent_ino, name)
+            .generation
+            .load(Ordering::Acquire)
+    }
+
+    /// Current change generations of all shards, sampled before a read-side
+    /// query returning many entries
+    fn generations(&self) -> Vec<u64> {
+        self.shards
+            .iter()
+            .map(|shard| shard.generation.load(Ordering::Acquire))
+            .collect()
+    }
+
     /// Look up a cached entry (updates LRU order)
-    fn get(&self, parent_ino: i64, name: &str) -> Option<i64> {
-        self.entries
+    fn get(&self, parent_ino: i64, name: &str) -> Option<CachedDentry> {
+        let key: &dyn DentryKeyView = &(parent_ino, name);
+        let entry = self
+            .shard(parent_ino, name)
+            .entries
             .lock()
             .unwrap()
-            .get(&(parent_ino, name.to_string()))
-            .copied()
+            .get(key)
+            .copied();
+        match entry {
+            Some(_) => DENTRY_CACHE_HITS.increment(),
+            None => DENTRY_CACHE_MISSES.increment(),
+        }
+        entry
     }
 
-    /// Insert an entry into the cache (evicts LRU entry if full)
+    /// Record an entry created by a writer (evicts LRU entry if full)
     fn insert(&self, parent_ino: i64, name: &str, child_ino: i64) {
-        self.entries
-            .lock()
-            .unwrap()
-            .put((parent_ino, name.to_string()), child_ino);
+        let shard = self.shard(parent_ino, name);
+        let mut entries = shard.entries.lock().unwrap();
+        shard.generation.fetch_add(1, Ordering::AcqRel);
+        entries.put(
+            DentryKey {
+                parent_ino,
+                name: name.into(),
+            },
+            CachedDentry::Found(child_ino),
+        );
+    }
+
+    /// Cache a lookup result read at `generation`, unless a writer changed
+    /// the shard since
+    fn insert_if_current(&self, generation: u64, parent_ino: i64, name: &str, entry: CachedDentry) {
+        let shard = self.shard(parent_ino, name);
+        let mut entries = shard.entries.lock().unwrap();
+        if shard.generation.load(Ordering::Acquire) == generation {
+            entries.put(
+                DentryKey {
+                    parent_ino,
+                    name: name.into(),
+                },
+                entry,
+            );
+        }
+    }
+
+    /// Cache a lookup result read when the shards were at `generations`,
+    /// unless a writer changed the entry's shard since
+    fn insert_if_current_in(
+        &self,
+        generations: &[u64],
+        parent_ino: i64,
+        name: &str,
+        entry: CachedDentry,
+    ) {
+        let generation = generations[self.shard_index(parent_ino, name)];
+        self.insert_if_current(generation, parent_ino, name, entry);
     }
 
     /// Remove an entry from the cache
     fn remove(&self, parent_ino: i64, name: &str) {
-        self.entries
+        let shard = self.shard(parent_ino, name);
+        let mut entries = shard.entries.lock().unwrap();
+        shard.generation.fetch_add(1, Ordering::AcqRel);
+        let key: &dyn DentryKeyView = &(parent_ino, name);
+        entries.pop(key);
+    }
+}
+
+/// LRU cache of committed inode attributes.
+///
+/// Serves `getattr`, `lstat`, `stat`, `fstat` and the stats returned by
+/// `lookup` without a `SELECT` on `fs_inode`. After committing a change to an
+/// inode, writers either update the cached entry in place (`update()`, for
+/// chmod/chown/utimens and data writes) or drop it (`remove()`, for changes to
+/// link counts and directory timestamps).
+///
+/// As with the dentry cache, readers can race with writers, so both kinds of
+/// change bump a generation counter and readers populate the cache with
+/// `insert_if_current()`. Entries describe committed state only; callers
+/// overlay write-back buffered sizes and mtimes themselves.
+struct AttrCache {
+    // Mutex required because LruCache::get() mutates internal order
+    entries: Mutex<LruCache<i64, Stats>>,
+    /// Incremented on every change made by a writer
+    generation: AtomicU64,
+}
+
+impl AttrCache {
+    fn new(max_size: usize) -> Self {
+        Self {
+            entries: Mutex::new(LruCache::new(
+                NonZeroUsize::new(max_size).expect("cache size must be > 0"),
+            )),
+            generation: AtomicU64::new(0),
+        }
+    }
+
+    fn get(&self, ino: i64) -> Option<Stats> {
+        let stats = self.entries.lock().unwrap().get(&ino).cloned();
+        match stats {
+            Some(_) => ATTR_CACHE_HITS.increment(),
+            None => ATTR_CACHE_MISSES.increment(),
+        }
+        stats
+    }
+
+    /// Get the attributes of `ino`, reading them with `conn` on a miss.
+    ///
+    /// `conn` must not have uncommitted changes to the inode.
+    async fn load(&self, conn: &PooledConnection, ino: i64) -> Result<Option<Stats>> {
+        if let Some(stats) = self.get(ino) {
+            return Ok(Some(stats));
+        }
+        let generation = self.generation.load(Ordering::Acquire);
+        let mut stmt = conn
+            .prepare_cached("SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?")
+            .await?;
+        let mut rows = stmt.query((ino,)).await?;
+        match rows.next().await? {
+            Some(row) => {
+                let stats = AgentFS::build_stats_from_row(&row)?;
+                self.insert_if_current(generation, &stats);
+                Ok(Some(stats))
+            }
+            None => Ok(None),
+        }
+    }
+
+    /// Cache attributes read at `generation`, unless a writer changed any
+    /// inode since
+    fn insert_if_current(&self, generation: u64, stats: &Stats) {
+        let mut entries = self.entries.lock().unwrap();
+        if self.generation.load(Ordering::Acquire) == generation {
+            entries.put(stats.ino, stats.clone());
+        }
+    }
+
+    /// Apply a committed change to the cached attributes of `ino`, if any
+    fn update(&self, ino: i64, change: impl FnOnce(&mut Stats)) {
+        let mut entries = self.entries.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::AcqRel);
+        if let Some(stats) = entries.get_mut(&ino) {
+            change(stats);
+        }
+    }
+
+    /// Drop the cached attributes of `ino`
+    fn remove(&self, ino: i64) {
+        let mut entries = self.entries.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::AcqRel);
+        entries.pop(&ino);
+    }
+}
+
+/// Writes buffered for one inode that have not been committed yet.
+#[derive(Default)]
+struct PendingWrites {
+    /// Whole-chunk images keyed by chunk index
+    chunks: BTreeMap<i64, Vec<u8>>,
+    /// Chunk size `chunks` are cut in, set while any are buffered
+    chunk_size: Option<usize>,
+    /// End of the furthest buffered write since the last truncate
+    end: u64,
+    /// Modification time of the latest buffered write
+    mtime: Option<(i64, u32)>,
+    /// When the oldest uncommitted chunk was dirtied
+    dirty_since: Option<Instant>,
+}
+
+/// Write-back buffer shared by every open handle of an inode.
+struct InodeWriteBuffer {
+    /// Serializes buffered writes, flushes and truncates of the inode
+    io: tokio::sync::Mutex<()>,
+    pending: Mutex<PendingWrites>,
+}
+
+impl InodeWriteBuffer {
+    fn new() -> Self {
+        Self {
+            io: tokio::sync::Mutex::new(()),
+            pending: Mutex::new(PendingWrites::default()),
+        }
+    }
+
+    fn is_dirty(&self) -> bool {
+        !self.pending.lock().unwrap().chunks.is_empty()
+    }
+
+    /// Whether the oldest uncommitted chunk was dirtied `age` ago or more
+    fn is_dirty_for(&self, age: Duration) -> bool {
+        let pending = self.pending.lock().unwrap();
+        !pending.chunks.is_empty()
+            && pending
+                .dirty_since
+                .is_some_and(|dirty_since| dirty_since.elapsed() >= age)
+    }
+
+    /// Overlay the buffered size and mtime onto committed stats
+    fn apply(&self, stats: &mut Stats) {
+        let pending = self.pending.lock().unwrap();
+        stats.size = std::cmp::max(stats.size, pending.end as i64);
+        if let Some((secs, nsec)) = pending.mtime {
+            stats.mtime = secs;
+            stats.mtime_nsec = nsec;
+        }
+    }
+
+    /// Copy out the buffered chunks holding `size` bytes at `offset`, the
+    /// buffered end and the chunk size of the buffered chunks, if any
+    fn snapshot(&self, offset: u64, size: u64) -> (Vec<(i64, Vec<u8>)>, u64, Option<usize>) {
+        let pending = self.pending.lock().unwrap();
+        let Some(chunk_size) = pending.chunk_size else {
+            return (Vec::new(), pending.end, None);
+        };
+        let first = (offset / chunk_size as u64) as i64;
+        let last = ((offset + size).saturating_sub(1) / chunk_size as u64) as i64;
+        let chunks = pending
+            .chunks
+            .range(first..=last)
+            .map(|(index, data)| (*index, data.clone()))
+            .collect();
+        (chunks, pending.end, Some(chunk_size))
+    }
+
+    /// Commit all buffered chunks, the new size and mtime in one transaction.
+    ///
+    /// The caller must hold `io`, so no write can change the chunk set
+    /// between the copy taken here and clearing it after commit.
+    async fn flush_locked(
+        &self,
+        pool: &ConnectionPool,
+        chunk_store: &ChunkStore,
+        attrs: &AttrCache,
+        ino: i64,
+    ) -> Result<()> {
+        let (chunks, end, mtime, chunk_size) = {
+            let pending = self.pending.lock().unwrap();
+            if pending.chunks.is_empty() {
+                return Ok(());
+            }
+            let chunks: Vec<(i64, Vec<u8>)> = pending
+                .chunks
+                .iter()
+                .map(|(index, data)| (*index, data.clone()))
+                .collect();
+            (chunks, pending.end, pending.mtime, pending.chunk_size)
+        };
+
+        let conn = pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+        let (mtime_secs, mtime_nsec) = mtime.unwrap_or_default();
+        let result: Result<Option<u64>> = async {
+            let mut stmt = conn
+                .prepare_cached("SELECT size FROM fs_inode WHERE ino = ?")
+                .await?;
+            let mut rows = stmt.query((ino,)).await?;
+            let current_size = match rows.next().await? {
+                Some(row) => row
+                    .get_value(0)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u64,
+                // The inode was removed while buffered; nothing to persist
+                None => return Ok(None),
+            };
+            drop(rows);
+            stmt.reset()?;
+
+            // The chunks of an empty file were cut in the size class chosen
+            // by its first buffered write
+            if current_size == 0 {
+                if let Some(chunk_size) = chunk_size {
+                    chunk_store.set_chunk_size(&conn, ino, chunk_size).await?;
+                }
+            }
+            for (chunk_index, data) in chunks {
+                chunk_store.write(&conn, ino, chunk_index, &data).await?;
+            }
+
+            let new_size = std::cmp::max(current_size, end);
+            let mut stmt = conn
+                .prepare_cached(
+                    "UPDATE fs_inode SET size = ?, mtime = ?, mtime_nsec = ? WHERE ino = ?",
+                )
+                .await?;
+            stmt.execute((new_size as i64, mtime_secs, mtime_nsec as i64, ino))
+                .await?;
+            Ok(Some(new_size))
+        }
+        .await;
+
+        let new_size = match result {
+            Ok(new_size) => new_size,
+            Err(e) => {
+                let _ = txn.rollback().await;
+                return Err(e);
+            }
+        };
+        txn.commit().await?;
+        if let Some(new_size) = new_size {
+            attrs.update(ino, |stats| {
+                stats.size = new_size as i64;
+                stats.mtime = mtime_secs;
+                stats.mtime_nsec = mtime_nsec;
+            });
+        }
+
+        let mut pending = self.pending.lock().unwrap();
+        pending.chunks.clear();
+        pending.chunk_size = None;
+        pending.mtime = None;
+        pending.dirty_since = None;
+        Ok(())
+    }
+
+    async fn flush(
+        &self,
+        pool: &ConnectionPool,
+        chunk_store: &ChunkStore,
+        attrs: &AttrCache,
+        ino: i64,
+    ) -> Result<()> {
+        let _io = self.io.lock().await;
+        self.flush_locked(pool, chunk_store, attrs, ino).await
+    }
+}
+
+/// Buffered bytes after which a write-back buffer of `chunk_size` byte chunks
+/// is flushed by the next write
+fn write_buffer_max_bytes(chunk_size: usize) -> usize {
+    WRITE_BUFFER_MAX_BYTES.max(chunk_size * WRITE_BUFFER_MIN_CHUNKS)
+}
+
+/// Per-inode write-back buffers (shared across clones of AgentFS).
+///
+/// When enabled, handles coalesce `pwrite()` calls into whole-chunk images
+/// in memory instead of doing a read-modify-write of each `fs_data` row and
+/// an `fs_inode` update per call. Buffered chunks are committed in a single
+/// transaction by `File::flush()`, `File::fsync()` and truncation, by the
+/// next write once more than `WRITE_BUFFER_MAX_BYTES` (or
+/// `WRITE_BUFFER_MIN_CHUNKS` chunks, if more) are buffered or the oldest
+/// buffered write is older than `WRITE_BUFFER_MAX_AGE`, and by the flusher
+/// within about twice `WRITE_BUFFER_MAX_AGE` of the oldest buffered write if
+/// no write comes.
+///
+/// Buffers are keyed by inode rather than by handle, so every handle of a
+/// file and the inode-level `getattr`/`lookup`/`readdir_plus` see buffered
+/// data and sizes. A buffer whose last handle is dropped without a flush is
+/// committed in the background, and the buffer of a file whose last link is
+/// removed is dropped with its data.
+struct WriteBuffers {
+    enabled: AtomicBool,
+    inodes: Mutex<HashMap<i64, Arc<InodeWriteBuffer>>>,
+    /// Whether the flusher is running
+    flusher: AtomicBool,
+}
+
+impl WriteBuffers {
+    fn new() -> Self {
+        Self {
+            enabled: AtomicBool::new(false),
+            inodes: Mutex::new(HashMap::new()),
+            flusher: AtomicBool::new(false),
+        }
+    }
+
+    fn is_empty(&self) -> bool {
+        self.inodes.lock().unwrap().is_empty()
+    }
+
+    /// Buffer for a newly opened handle, or `None` when write-back is disabled
+    fn acquire(&self, ino: i64) -> Option<Arc<InodeWriteBuffer>> {
+        if !self.enabled.load(Ordering::Relaxed) {
+            return None;
+        }
+        let mut inodes = self.inodes.lock().unwrap();
+        Some(
+            inodes
+                .entry(ino)
+                .or_insert_with(|| Arc::new(InodeWriteBuffer::new()))
+                .clone(),
+        )
+    }
+
+    fn get(&self, ino: i64) -> Option<Arc<InodeWriteBuffer>> {
+        let inodes = self.inodes.lock().unwrap();
+        if inodes.is_empty() {
+            return None;
+        }
+        inodes.get(&ino).cloned()
+    }
+
+    /// Drop the registry entry once the caller holds the last other reference
+    /// to a clean buffer.
+    ///
+    /// Returns whether the caller holds the last other reference to a dirty
+    /// buffer, which it is then up to the caller to commit.
+    fn release(&self, ino: i64, buffer: &Arc<InodeWriteBuffer>) -> bool {
+        let mut inodes = self.inodes.lock().unwrap();
+        if Arc::strong_count(buffer) != 2 {
+            return false;
+        }
+        if buffer.is_dirty() {
+            return true;
+        }
+        inodes.remove(&ino);
+        false
+    }
+
+    /// Drop the registry entries of clean buffers no handle uses
+    fn prune(&self) {
+        self.inodes
             .lock()
             .unwrap()
-            .pop(&(parent_ino, name.to_string()));
+            .retain(|_, buffer| Arc::strong_count(buffer) > 1 || buffer.is_dirty());
+    }
+
+    /// Drop the buffer of `ino` and what it holds, once the last link to
+    /// the inode is removed along with its data
+    fn discard(&self, ino: i64) {
+        let buffer = self.inodes.lock().unwrap().remove(&ino);
+        if let Some(buffer) = buffer {
+            *buffer.pending.lock().unwrap() = PendingWrites::default();
+        }
+    }
+
+    /// Overlay buffered size and mtime onto stats read from the database
+    fn apply(&self, stats: &mut Stats) {
+        if (stats.mode & S_IFMT) != S_IFREG {
+            return;
+        }
+        if let Some(buffer) = self.get(stats.ino) {
+            buffer.apply(stats);
+        }
+    }
+}
+
+/// How a new filesystem database stores file data.
+///
+/// Fixed when the database is created; opening an existing database keeps
+/// its settings.
+#[derive(Debug, Clone, Copy)]
+pub struct StorageOptions {
+    /// Size of file data chunks in bytes, of every file unless
+    /// `size_classes` is set
+    pub chunk_size: usize,
+    /// Store identical chunks once, shared by reference count
+    pub dedup: bool,
+    /// Codec to compress chunks with
+    pub compression: Compression,
+    /// Queue the chunks of large removals and truncations for a background
+    /// reaper instead of freeing them in the same transaction
+    pub deferred_reclaim: bool,
+    /// Give each file chunks that grow with its size class, from
+    /// `chunk_size` for small files up to 1 MiB for large ones
+    pub size_classes: bool,
+}
+
+impl Default for StorageOptions {
+    fn default() -> Self {
+        Self {
+            chunk_size: DEFAULT_CHUNK_SIZE,
+            dedup: false,
+            compression: Compression::None,
+            deferred_reclaim: false,
+            size_classes: false,
+        }
     }
 }
 
@@ -68,9 +676,45 @@ impl DentryCache {
 #[derive(Clone)]
 pub struct AgentFS {
     pool: ConnectionPool,
-    chunk_size: usize,
+    /// How file data chunks are stored
+    chunk_store: ChunkStore,
     /// Cache for directory entry lookups (shared across clones)
     dentry_cache: Arc<DentryCache>,
+    /// Cache for inode attributes (shared across clones)
+    attr_cache: Arc<AttrCache>,
+    /// Write-back buffers of open files (shared across clones)
+    write_buffers: Arc<WriteBuffers>,
+}
+
+/// An open directory stream for AgentFS.
+///
+/// Remembers the name of the last entry returned and resumes after it, so
+/// every page is a short index range scan however deep into the directory it
+/// starts. Entries added or removed while the stream is open show up or not
+/// depending on whether they sort after its position, as POSIX allows.
+pub struct AgentFSDirectory {
+    fs: AgentFS,
+    ino: i64,
+    /// Name of the last entry returned, empty before the first page
+    after: Mutex<String>,
+}
+
+#[async_trait]
+impl Directory for AgentFSDirectory {
+    async fn next_entries(&self, limit: usize) -> Result<Vec<DirEntry>> {
+        let after = self.after.lock().unwrap().clone();
+        let conn = self.fs.pool.get_read_connection().await?;
+        let entries = self.fs.readdir_page(&conn, self.ino, &after, limit).await?;
+        if let Some(last) = entries.last() {
+            *self.after.lock().unwrap() = last.name.clone();
+        }
+        Ok(entries)
+    }
+
+    async fn rewind(&self) -> Result<()> {
+        self.after.lock().unwrap().clear();
+        Ok(())
+    }
 }
 
 /// An open file handle for AgentFS.
@@ -80,26 +724,51 @@ pub struct AgentFS {
 pub struct AgentFSFile {
     pool: ConnectionPool,
     ino: i64,
-    chunk_size: usize,
+    chunk_store: ChunkStore,
+    attr_cache: Arc<AttrCache>,
+    write_buffers: Arc<WriteBuffers>,
+    /// Dirty chunk buffer of the inode, if write-back was enabled at open
+    buffer: Option<Arc<InodeWriteBuffer>>,
+    /// Chunks read ahead of sequential reads through this handle
+    readahead: readahead::ReadAhead,
 }
 
 #[async_trait]
 impl File for AgentFSFile {
     async fn pread(&self, offset: u64, size: u64) -> Result<Vec<u8>> {
-        let conn = self.pool.get_connection().await?;
+        // Snapshot buffered chunks before reading committed data, so a flush
+        // racing with this read can't leave us with neither version
+        let pending = self
+            .buffer
+            .as_ref()
+            .map(|buffer| buffer.snapshot(offset, size));
 
-        // Get the file size to avoid returning data beyond EOF
+        let conn = self.pool.get_read_connection().await?;
+
+        // Get the file size to avoid returning data beyond EOF, and the times
+        // that tell whether chunks read ahead are still current
         let mut size_stmt = conn
-            .prepare_cached("SELECT size FROM fs_inode WHERE ino = ?")
+            .prepare_cached(
+                "SELECT size, mtime, mtime_nsec, ctime, ctime_nsec FROM fs_inode WHERE ino = ?",
+            )
             .await?;
         let mut size_rows = size_stmt.query((self.ino,)).await?;
-        let file_size = if let Some(row) = size_rows.next().await? {
-            row.get_value(0)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .unwrap_or(0) as u64
-        } else {
-            0
+        let mut stamp: readahead::Stamp = [0; 5];
+        if let Some(row) = size_rows.next().await? {
+            for (i, value) in stamp.iter_mut().enumerate() {
+                *value = row
+                    .get_value(i)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0);
+            }
+        }
+        drop(size_rows);
+        size_stmt.reset()?;
+        let file_size = stamp[0] as u64;
+        let file_size = match &pending {
+            Some((_, end, _)) => std::cmp::max(file_size, *end),
+            None => file_size,
         };
 
         // If offset is at or beyond EOF, return empty
@@ -110,27 +779,34 @@ impl File for AgentFSFile {
         // Limit size to not exceed EOF
         let size = std::cmp::min(size, file_size - offset);
 
-        let chunk_size = self.chunk_size as u64;
+        // Buffered chunks are cut in the size that committed ones have, or
+        // will have once the first flush of an empty file commits them
+        let chunk_size = match &pending {
+            Some((_, _, Some(chunk_size))) => *chunk_size,
+            _ => self.chunk_store.chunk_size(&conn, self.ino).await?,
+        } as u64;
         let start_chunk = offset / chunk_size;
         let end_chunk = (offset + size).saturating_sub(1) / chunk_size;
 
-        let mut stmt = conn
-            .prepare_cached("SELECT chunk_index, data FROM fs_data WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ? ORDER BY chunk_index")
-            .await?;
-        let mut rows = stmt
-            .query((self.ino, start_chunk as i64, end_chunk as i64))
+        let chunks = self
+            .read_chunks(
+                &conn,
+                stamp,
+                offset,
+                size,
+                file_size,
+                chunk_size,
+                start_chunk as i64,
+                end_chunk as i64,
+            )
             .await?;
 
         let mut result = Vec::with_capacity(size as usize);
         let start_offset_in_chunk = (offset % chunk_size) as usize;
         let mut next_expected_chunk = start_chunk;
 
-        while let Some(row) = rows.next().await? {
-            let chunk_index = row
-                .get_value(0)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .unwrap_or(0) as u64;
+        for (chunk_index, chunk_data) in chunks {
+            let chunk_index = chunk_index as u64;
 
             // Fill gaps with zeros for sparse files
             while next_expected_chunk < chunk_index && result.len() < size as usize {
@@ -145,31 +821,29 @@ impl File for AgentFSFile {
                 next_expected_chunk += 1;
             }
 
-            if let Ok(Value::Blob(chunk_data)) = row.get_value(1) {
-                let skip = if chunk_index == start_chunk {
-                    start_offset_in_chunk
-                } else {
-                    0
-                };
-                if skip >= chunk_data.len() {
-                    // Chunk is smaller than skip offset, fill with zeros
-                    let zeros_needed =
-                        std::cmp::min(chunk_size as usize - skip, size as usize - result.len());
+            let skip = if chunk_index == start_chunk {
+                start_offset_in_chunk
+            } else {
+                0
+            };
+            if skip >= chunk_data.len() {
+                // Chunk is smaller than skip offset, fill with zeros
+                let zeros_needed =
+                    std::cmp::min(chunk_size as usize - skip, size as usize - result.len());
+                result.extend(std::iter::repeat_n(0u8, zeros_needed));
+            } else {
+                let remaining = size as usize - result.len();
+                let take = std::cmp::min(chunk_data.len() - skip, remaining);
+                result.extend_from_slice(&chunk_data[skip..skip + take]);
+
+                // If chunk is smaller than chunk_size, pad with zeros
+                let chunk_end = skip + take;
+                if chunk_end < chunk_size as usize && result.len() < size as usize {
+                    let zeros_needed = std::cmp::min(
+                        chunk_size as usize - chunk_end,
+                        size as usize - result.len(),
+                    );
                     result.extend(std::iter::repeat_n(0u8, zeros_needed));
-                } else {
-                    let remaining = size as usize - result.len();
-                    let take = std::cmp::min(chunk_data.len() - skip, remaining);
-                    result.extend_from_slice(&chunk_data[skip..skip + take]);
-
-                    // If chunk is smaller than chunk_size, pad with zeros
-                    let chunk_end = skip + take;
-                    if chunk_end < chunk_size as usize && result.len() < size as usize {
-                        let zeros_needed = std::cmp::min(
-                            chunk_size as usize - chunk_end,
-                            size as usize - result.len(),
-                        );
-                        result.extend(std::iter::repeat_n(0u8, zeros_needed));
-                    }
                 }
             }
             next_expected_chunk = chunk_index + 1;
@@ -180,6 +854,23 @@ impl File for AgentFSFile {
             result.resize(size as usize, 0);
         }
 
+        // Buffered chunks replace whatever is committed for them
+        if let Some((chunks, _, _)) = pending {
+            for (chunk_index, data) in chunks {
+                let chunk_start = chunk_index as u64 * chunk_size;
+                let from = std::cmp::max(chunk_start, offset);
+                let to = std::cmp::min(chunk_start + chunk_size, offset + size);
+                if from >= to {
+                    continue;
+                }
+                let dst = &mut result[(from - offset) as usize..(to - offset) as usize];
+                let src_start = (from - chunk_start) as usize;
+                let take = std::cmp::min(data.len().saturating_sub(src_start), dst.len());
+                dst[..take].copy_from_slice(&data[src_start..src_start + take]);
+                dst[take..].fill(0);
+            }
+        }
+
         Ok(result)
     }
 
@@ -187,6 +878,9 @@ impl File for AgentFSFile {
         if data.is_empty() {
             return Ok(());
         }
+        if let Some(buffer) = &self.buffer {
+            return self.buffered_pwrite(buffer, offset, data).await;
+        }
 
         let conn = self.pool.get_connection().await?;
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
@@ -203,14 +897,21 @@ impl File for AgentFSFile {
         } else {
             0
         };
+        drop(rows);
+        stmt.reset()?;
+        let end = offset + data.len() as u64;
+        let chunk_size = self
+            .chunk_store
+            .chunk_size_for(&conn, self.ino, current_size, end)
+            .await?;
 
         // Write the actual data (sparse gaps are handled by pread which fills
         // missing chunks with zeros, so no need to zero-fill here)
-        self.write_data_at_offset_with_conn(&conn, offset, data)
+        self.write_data_at_offset_with_conn(&conn, chunk_size, offset, data)
             .await?;
 
         // Update file size and mtime
-        let new_size = std::cmp::max(current_size, offset + data.len() as u64);
+        let new_size = std::cmp::max(current_size, end);
         let dur = SystemTime::now().duration_since(UNIX_EPOCH)?;
         let now_secs = dur.as_secs() as i64;
         let now_nsec = dur.subsec_nanos() as i64;
@@ -220,11 +921,99 @@ impl File for AgentFSFile {
         stmt.execute((new_size as i64, now_secs, now_nsec, self.ino))
             .await?;
         txn.commit().await?;
+        self.attr_cache.update(self.ino, |stats| {
+            stats.size = new_size as i64;
+            stats.mtime = now_secs;
+            stats.mtime_nsec = now_nsec as u32;
+        });
 
         Ok(())
     }
 
     async fn truncate(&self, new_size: u64) -> Result<()> {
+        let buffer = match &self.buffer {
+            Some(buffer) => buffer,
+            None => return self.truncate_committed(new_size).await,
+        };
+        let _io = buffer.io.lock().await;
+        buffer
+            .flush_locked(&self.pool, &self.chunk_store, &self.attr_cache, self.ino)
+            .await?;
+        self.truncate_committed(new_size).await?;
+        buffer.pending.lock().unwrap().end = 0;
+        Ok(())
+    }
+
+    async fn fsync(&self) -> Result<()> {
+        if let Some(buffer) = &self.buffer {
+            buffer
+                .flush(&self.pool, &self.chunk_store, &self.attr_cache, self.ino)
+                .await?;
+        }
+        let conn = self.pool.get_connection().await?;
+        conn.prepare_cached("PRAGMA synchronous = FULL")
+            .await?
+            .execute(())
+            .await?;
+        conn.prepare_cached("BEGIN").await?.execute(()).await?;
+        conn.prepare_cached("COMMIT").await?.execute(()).await?;
+        conn.prepare_cached("PRAGMA synchronous = OFF")
+            .await?
+            .execute(())
+            .await?;
+        Ok(())
+    }
+
+    async fn flush(&self) -> Result<()> {
+        match &self.buffer {
+            Some(buffer) => {
+                buffer
+                    .flush(&self.pool, &self.chunk_store, &self.attr_cache, self.ino)
+                    .await
+            }
+            None => Ok(()),
+        }
+    }
+
+    async fn fstat(&self) -> Result<Stats> {
+        let stats = match self.attr_cache.get(self.ino) {
+            Some(stats) => stats,
+            None => {
+                let conn = self.pool.get_read_connection().await?;
+                self.attr_cache
+                    .load(&conn, self.ino)
+                    .await?
+                    .ok_or(FsError::NotFound)?
+            }
+        };
+        let mut stats = stats;
+        if let Some(buffer) = &self.buffer {
+            buffer.apply(&mut stats);
+        }
+        Ok(stats)
+    }
+}
+
+impl Drop for AgentFSFile {
+    fn drop(&mut self) {
+        if let Some(buffer) = self.buffer.take() {
+            if self.write_buffers.release(self.ino, &buffer) {
+                flusher::flush_released(
+                    &self.pool,
+                    &self.chunk_store,
+                    &self.attr_cache,
+                    &self.write_buffers,
+                    self.ino,
+                    buffer,
+                );
+            }
+        }
+    }
+}
+
+impl AgentFSFile {
+    /// Truncate the committed file data, bypassing the write-back buffer
+    async fn truncate_committed(&self, new_size: u64) -> Result<()> {
         let conn = self.pool.get_connection().await?;
 
         // Get current size
@@ -241,45 +1030,50 @@ impl File for AgentFSFile {
             0
         };
 
-        let chunk_size = self.chunk_size as u64;
+        drop(rows);
+        stmt.reset()?;
+        let dur = SystemTime::now().duration_since(UNIX_EPOCH)?;
+        let now_secs = dur.as_secs() as i64;
+        let now_nsec = dur.subsec_nanos() as i64;
 
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
 
         let result: Result<()> = async {
+            let chunk_size = self
+                .chunk_store
+                .chunk_size_for(&conn, self.ino, current_size, new_size)
+                .await? as u64;
             if new_size == 0 {
                 // Special case: truncate to zero - just delete all chunks
-                let mut stmt = conn
-                    .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                    .await?;
-                stmt.execute((self.ino,)).await?;
+                if self.chunk_store.discard_all(&conn, self.ino).await? {
+                    reaper::wake(&self.pool, &self.chunk_store);
+                }
             } else if new_size < current_size {
                 // Shrinking: delete excess chunks and truncate last chunk if needed
                 let last_chunk_idx = (new_size - 1) / chunk_size;
 
                 // Delete all chunks beyond the last one we need
-                conn.execute(
-                    "DELETE FROM fs_data WHERE ino = ? AND chunk_index > ?",
-                    (self.ino, last_chunk_idx as i64),
-                )
-                .await?;
+                if self
+                    .chunk_store
+                    .discard_from(&conn, self.ino, last_chunk_idx as i64 + 1)
+                    .await?
+                {
+                    reaper::wake(&self.pool, &self.chunk_store);
+                }
 
                 // Truncate the last chunk if needed
                 let offset_in_chunk = (new_size % chunk_size) as usize;
                 if offset_in_chunk > 0 {
-                    let mut stmt = conn
-                        .prepare_cached("SELECT data FROM fs_data WHERE ino = ? AND chunk_index = ?")
+                    let chunk = self
+                        .chunk_store
+                        .read(&conn, self.ino, last_chunk_idx as i64)
                         .await?;
-                    let mut rows = stmt.query((self.ino, last_chunk_idx as i64)).await?;
-
-                    if let Some(row) = rows.next().await? {
-                        if let Ok(Value::Blob(mut chunk_data)) = row.get_value(0) {
-                            if chunk_data.len() > offset_in_chunk {
-                                chunk_data.truncate(offset_in_chunk);
-                                let mut stmt = conn
-                                    .prepare_cached("UPDATE fs_data SET data = ? WHERE ino = ? AND chunk_index = ?")
-                                    .await?;
-                                stmt.execute((Value::Blob(chunk_data), self.ino, last_chunk_idx as i64)).await?;
-                            }
+                    if let Some(mut chunk_data) = chunk {
+                        if chunk_data.len() > offset_in_chunk {
+                            chunk_data.truncate(offset_in_chunk);
+                            self.chunk_store
+                                .write(&conn, self.ino, last_chunk_idx as i64, &chunk_data)
+                                .await?;
                         }
                     }
                 }
@@ -288,9 +1082,6 @@ impl File for AgentFSFile {
             // The sparse regions will be handled by pread returning zeros
 
             // Update the inode size, mtime, and ctime
-            let dur = SystemTime::now().duration_since(UNIX_EPOCH)?;
-            let now_secs = dur.as_secs() as i64;
-            let now_nsec = dur.subsec_nanos() as i64;
             let mut stmt = conn
                 .prepare_cached("UPDATE fs_inode SET size = ?, mtime = ?, ctime = ?, mtime_nsec = ?, ctime_nsec = ? WHERE ino = ?")
                 .await?;
@@ -305,94 +1096,51 @@ impl File for AgentFSFile {
             return result;
         }
         txn.commit().await?;
+        self.attr_cache.update(self.ino, |stats| {
+            stats.size = new_size as i64;
+            stats.mtime = now_secs;
+            stats.ctime = now_secs;
+            stats.mtime_nsec = now_nsec as u32;
+            stats.ctime_nsec = now_nsec as u32;
+        });
         Ok(())
     }
 
-    async fn fsync(&self) -> Result<()> {
-        let conn = self.pool.get_connection().await?;
-        conn.prepare_cached("PRAGMA synchronous = FULL")
-            .await?
-            .execute(())
-            .await?;
-        conn.prepare_cached("BEGIN").await?.execute(()).await?;
-        conn.prepare_cached("COMMIT").await?.execute(()).await?;
-        conn.prepare_cached("PRAGMA synchronous = OFF")
-            .await?
-            .execute(())
-            .await?;
-        Ok(())
-    }
-
-    async fn fstat(&self) -> Result<Stats> {
-        let conn = self.pool.get_connection().await?;
-        let mut stmt = conn
-            .prepare_cached("SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?")
-            .await?;
-        let mut rows = stmt.query((self.ino,)).await?;
-
-        if let Some(row) = rows.next().await? {
-            AgentFS::build_stats_from_row(&row)
-        } else {
-            Err(FsError::NotFound.into())
-        }
-    }
-}
-
-impl AgentFSFile {
-    /// Write data at a specific offset, handling chunk boundaries.
+    /// Write data at a specific offset, handling chunk boundaries of
+    /// `chunk_size` byte chunks.
     /// Uses a provided connection to allow reuse within a transaction.
     async fn write_data_at_offset_with_conn(
         &self,
-        conn: &Connection,
+        conn: &PooledConnection,
+        chunk_size: usize,
         offset: u64,
         data: &[u8],
     ) -> Result<()> {
-        let chunk_size = self.chunk_size as u64;
+        let chunk_size = chunk_size as u64;
         let mut written = 0usize;
 
         if data.is_empty() {
             return Ok(());
         }
 
-        // get statements only once (in order to avoid heavy clone on every while iteration)
-        let mut select_stmt = conn
-            .prepare_cached("SELECT data FROM fs_data WHERE ino = ? AND chunk_index = ?")
-            .await?;
-        let mut insert_stmt = conn
-            .prepare_cached(
-                "INSERT OR REPLACE INTO fs_data (ino, chunk_index, data) VALUES (?, ?, ?)",
-            )
-            .await?;
         while written < data.len() {
             let current_offset = offset + written as u64;
             let chunk_index = (current_offset / chunk_size) as i64;
             let offset_in_chunk = (current_offset % chunk_size) as usize;
 
             // How much can we write in this chunk?
-            let remaining_in_chunk = self.chunk_size - offset_in_chunk;
+            let remaining_in_chunk = chunk_size as usize - offset_in_chunk;
             let remaining_data = data.len() - written;
             let to_write = std::cmp::min(remaining_in_chunk, remaining_data);
 
             let mut chunk_data;
             if to_write != chunk_size as usize {
                 // Get existing chunk data (if any)
-                let mut rows = select_stmt.query((self.ino, chunk_index)).await?;
-
-                chunk_data = if let Some(row) = rows.next().await? {
-                    row.get_value(0)
-                        .ok()
-                        .and_then(|v| {
-                            if let Value::Blob(b) = v {
-                                Some(b)
-                            } else {
-                                None
-                            }
-                        })
-                        .unwrap_or_default()
-                } else {
-                    Vec::new()
-                };
-                select_stmt.reset()?;
+                chunk_data = self
+                    .chunk_store
+                    .read(conn, self.ino, chunk_index)
+                    .await?
+                    .unwrap_or_default();
 
                 // Extend chunk if needed
                 if chunk_data.len() < offset_in_chunk + to_write {
@@ -407,16 +1155,143 @@ impl AgentFSFile {
             }
 
             // Save chunk
-            insert_stmt
-                .execute((self.ino, chunk_index, Value::Blob(chunk_data)))
+            self.chunk_store
+                .write(conn, self.ino, chunk_index, &chunk_data)
                 .await?;
-            insert_stmt.reset()?;
 
             written += to_write;
         }
 
         Ok(())
     }
+
+    /// Merge a write into the inode's write-back buffer.
+    ///
+    /// Partially overwritten chunks start from their committed contents, so
+    /// each chunk is read from the database at most once between flushes.
+    async fn buffered_pwrite(
+        &self,
+        buffer: &InodeWriteBuffer,
+        offset: u64,
+        data: &[u8],
+    ) -> Result<()> {
+        let _io = buffer.io.lock().await;
+        let end = offset + data.len() as u64;
+        let chunk_size = self.buffered_chunk_size(buffer, end).await?;
+        let chunk_size = chunk_size as u64;
+        let first = (offset / chunk_size) as i64;
+        let last = ((end - 1) / chunk_size) as i64;
+
+        // Chunks at either edge of the write that are only partially
+        // overwritten and not buffered yet
+        let missing: Vec<i64> = {
+            let pending = buffer.pending.lock().unwrap();
+            let head_partial = offset % chunk_size != 0;
+            let tail_partial = end % chunk_size != 0;
+            let mut edges = Vec::with_capacity(2);
+            if head_partial || (first == last && tail_partial) {
+                edges.push(first);
+            }
+            if first != last && tail_partial {
+                edges.push(last);
+            }
+            edges.retain(|chunk_index| !pending.chunks.contains_key(chunk_index));
+            edges
+        };
+
+        let mut committed = HashMap::new();
+        if !missing.is_empty() {
+            let conn = self.pool.get_read_connection().await?;
+            for chunk_index in missing {
+                if let Some(chunk_data) =
+                    self.chunk_store.read(&conn, self.ino, chunk_index).await?
+                {
+                    committed.insert(chunk_index, chunk_data);
+                }
+            }
+        }
+
+        let dur = SystemTime::now().duration_since(UNIX_EPOCH)?;
+        let should_flush = {
+            let mut pending = buffer.pending.lock().unwrap();
+            let mut written = 0usize;
+            while written < data.len() {
+                let current_offset = offset + written as u64;
+                let chunk_index = (current_offset / chunk_size) as i64;
+                let offset_in_chunk = (current_offset % chunk_size) as usize;
+                let to_write =
+                    std::cmp::min(chunk_size as usize - offset_in_chunk, data.len() - written);
+                let src = &data[written..written + to_write];
+
+                if to_write == chunk_size as usize {
+                    pending.chunks.insert(chunk_index, src.to_vec());
+                } else {
+                    let chunk_data = pending
+                        .chunks
+                        .entry(chunk_index)
+                        .or_insert_with(|| committed.remove(&chunk_index).unwrap_or_default());
+                    if chunk_data.len() < offset_in_chunk + to_write {
+                        chunk_data.resize(offset_in_chunk + to_write, 0);
+                    }
+                    chunk_data[offset_in_chunk..offset_in_chunk + to_write].copy_from_slice(src);
+                }
+                written += to_write;
+            }
+
+            pending.end = std::cmp::max(pending.end, end);
+            pending.chunk_size = Some(chunk_size as usize);
+            pending.mtime = Some((dur.as_secs() as i64, dur.subsec_nanos()));
+            let dirty_since = *pending.dirty_since.get_or_insert_with(Instant::now);
+            pending.chunks.len() * chunk_size as usize
+                >= write_buffer_max_bytes(chunk_size as usize)
+                || dirty_since.elapsed() >= WRITE_BUFFER_MAX_AGE
+        };
+
+        if should_flush {
+            buffer
+                .flush_locked(&self.pool, &self.chunk_store, &self.attr_cache, self.ino)
+                .await?;
+        }
+        Ok(())
+    }
+
+    /// Chunk size to buffer a write ending at `end` in.
+    ///
+    /// The caller must hold the buffer's `io`. An empty file gets the size
+    /// class of the end of its first write, recorded by the flush that
+    /// commits it.
+    async fn buffered_chunk_size(&self, buffer: &InodeWriteBuffer, end: u64) -> Result<usize> {
+        let buffered_end = {
+            let pending = buffer.pending.lock().unwrap();
+            if let Some(chunk_size) = pending.chunk_size {
+                return Ok(chunk_size);
+            }
+            pending.end
+        };
+        if !self.chunk_store.is_sized() {
+            return Ok(self.chunk_store.base_chunk_size());
+        }
+        let conn = self.pool.get_read_connection().await?;
+        let mut stmt = conn
+            .prepare_cached("SELECT size FROM fs_inode WHERE ino = ?")
+            .await?;
+        let mut rows = stmt.query((self.ino,)).await?;
+        let current_size = match rows.next().await? {
+            Some(row) => row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .unwrap_or(0) as u64,
+            None => 0,
+        };
+        drop(rows);
+        stmt.reset()?;
+        if current_size == 0 && buffered_end == 0 {
+            Ok(self.chunk_store.size_class(end))
+        } else {
+            self.chunk_store.chunk_size(&conn, self.ino).await
+        }
+    }
 }
 
 impl AgentFS {
@@ -428,10 +1303,45 @@ impl AgentFS {
 
     /// Create a filesystem from a connection pool
     pub async fn from_pool(pool: ConnectionPool) -> Result<Self> {
+        Self::from_pool_with_chunk_size(pool, DEFAULT_CHUNK_SIZE).await
+    }
+
+    /// Create a filesystem from a connection pool, storing file data in
+    /// `chunk_size` byte chunks if the database is new.
+    ///
+    /// An existing database keeps the chunk size it was created with.
+    ///
+    /// The size applies to every file. Unlike `dedup`, `compression` and
+    /// `size_classes`, which are formats only readers that know them can
+    /// open, any chunk size keeps the database in the base format of
+    /// SPEC.md.
+    pub async fn from_pool_with_chunk_size(
+        pool: ConnectionPool,
+        chunk_size: usize,
+    ) -> Result<Self> {
+        let storage = StorageOptions {
+            chunk_size,
+            ..Default::default()
+        };
+        Self::from_pool_with_storage(pool, storage).await
+    }
+
+    /// Create a filesystem from a connection pool, storing file data as
+    /// `storage` says if the database is new.
+    ///
+    /// An existing database keeps the storage it was created with.
+    pub async fn from_pool_with_storage(
+        pool: ConnectionPool,
+        storage: StorageOptions,
+    ) -> Result<Self> {
+        let chunk_size = storage.chunk_size;
+        if !(MIN_CHUNK_SIZE..=MAX_CHUNK_SIZE).contains(&chunk_size) {
+            return Err(Error::InvalidChunkSize(chunk_size));
+        }
         let conn = pool.get_connection().await?;
 
         // Initialize schema first
-        Self::initialize_schema(&conn).await?;
+        Self::initialize_schema_with_storage(&conn, storage).await?;
 
         // Disable synchronous mode for filesystem fsync() semantics.
         conn.execute("PRAGMA synchronous = OFF", ()).await?;
@@ -442,18 +1352,45 @@ impl AgentFS {
 
         // Get chunk_size from config (or use default)
         let chunk_size = Self::read_chunk_size(&conn).await?;
+        let chunk_store = ChunkStore::open(&conn, chunk_size).await?;
 
         let fs = Self {
             pool,
-            chunk_size,
+            chunk_store,
             dentry_cache: Arc::new(DentryCache::new(DENTRY_CACHE_MAX_SIZE)),
+            attr_cache: Arc::new(AttrCache::new(ATTR_CACHE_MAX_SIZE)),
+            write_buffers: Arc::new(WriteBuffers::new()),
         };
+        // Free data left queued by the last session
+        fs.wake_reaper();
         Ok(fs)
     }
 
-    /// Get the configured chunk size
-    pub fn chunk_size(&self) -> usize {
-        self.chunk_size
+    /// Get the configured chunk size, that of small files if files get the
+    /// chunk size of their size class
+    pub fn chunk_size(&self) -> usize {
+        self.chunk_store.base_chunk_size()
+    }
+
+    /// Whether identical chunks of file data are stored once
+    pub fn is_dedup(&self) -> bool {
+        self.chunk_store.is_dedup()
+    }
+
+    /// Codec chunks of file data are compressed with
+    pub fn compression(&self) -> Compression {
+        self.chunk_store.compression()
+    }
+
+    /// Whether the chunks of large removals and truncations are freed in the
+    /// background
+    pub fn is_deferred_reclaim(&self) -> bool {
+        self.chunk_store.is_deferred()
+    }
+
+    /// Whether files get the chunk size of their size class
+    pub fn has_size_classes(&self) -> bool {
+        self.chunk_store.is_sized()
     }
 
     /// Get a database connection from the pool
@@ -461,13 +1398,81 @@ impl AgentFS {
         self.pool.get_connection().await
     }
 
+    /// Get a read-only database connection from the pool
+    pub async fn get_read_connection(&self) -> Result<crate::connection_pool::PooledConnection> {
+        self.pool.get_read_connection().await
+    }
+
     /// Get the connection pool
     pub fn get_pool(&self) -> ConnectionPool {
         self.pool.clone()
     }
 
+    /// Set the maximum number of directory entries kept in the lookup cache
+    pub fn set_dentry_cache_size(&self, max_entries: usize) {
+        self.dentry_cache.resize(max_entries.max(1));
+    }
+
+    /// Enable or disable write-back buffering for files opened from now on.
+    ///
+    /// With write-back enabled, writes through a file handle are coalesced in
+    /// memory and committed by `File::flush()`, `File::fsync()`, truncation,
+    /// a later write once the buffer has grown too large or too old, or in
+    /// the background: by a flusher about a second or two after the oldest
+    /// buffered write, and as soon as the last handle of a dirty buffer is
+    /// dropped. Callers that need the data committed at a given point still
+    /// flush handles they write through; the FUSE adapter does this on
+    /// `flush` and `release`, and the NFS adapter on COMMIT and from its own
+    /// periodic flusher.
+    pub fn set_write_back(&self, enabled: bool) {
+        self.write_buffers.enabled.store(enabled, Ordering::Relaxed);
+        if enabled {
+            flusher::start(self);
+        }
+    }
+
+    fn new_file(&self, ino: i64) -> BoxedFile {
+        Arc::new(AgentFSFile {
+            pool: self.pool.clone(),
+            ino,
+            chunk_store: self.chunk_store.clone(),
+            attr_cache: self.attr_cache.clone(),
+            write_buffers: self.write_buffers.clone(),
+            buffer: self.write_buffers.acquire(ino),
+            readahead: Default::default(),
+        })
+    }
+
+    /// Commit buffered writes of the file at `path`, before a path-based
+    /// operation reads or rewrites its data directly
+    async fn flush_write_buffer(&self, path: &str) -> Result<()> {
+        if self.write_buffers.inodes.lock().unwrap().is_empty() {
+            return Ok(());
+        }
+        let ino = match self.resolve_path(path).await? {
+            Some(ino) => ino,
+            None => return Ok(()),
+        };
+        if let Some(buffer) = self.write_buffers.get(ino) {
+            buffer
+                .flush(&self.pool, &self.chunk_store, &self.attr_cache, ino)
+                .await?;
+            self.write_buffers.release(ino, &buffer);
+        }
+        Ok(())
+    }
+
     /// Initialize the database schema
     pub async fn initialize_schema(conn: &Connection) -> Result<()> {
+        Self::initialize_schema_with_storage(conn, StorageOptions::default()).await
+    }
+
+    /// Initialize the database schema, recording `storage` if the filesystem
+    /// is new
+    async fn initialize_schema_with_storage(
+        conn: &Connection,
+        storage: StorageOptions,
+    ) -> Result<()> {
         // Create config table
         conn.execute(
             "CREATE TABLE IF NOT EXISTS fs_config (
@@ -543,12 +1548,31 @@ impl AgentFS {
                 ino INTEGER NOT NULL,
                 chunk_index INTEGER NOT NULL,
                 data BLOB NOT NULL,
+                codec INTEGER NOT NULL DEFAULT 0,
+                generation INTEGER NOT NULL DEFAULT 0,
                 PRIMARY KEY (ino, chunk_index)
             )",
             (),
         )
         .await?;
 
+        // Add the codec column of compressed chunks (backward compatible migration)
+        conn.execute(
+            "ALTER TABLE fs_data ADD COLUMN codec INTEGER NOT NULL DEFAULT 0",
+            (),
+        )
+        .await
+        .ok();
+
+        // Add the generation column of queued discards (backward compatible
+        // migration)
+        conn.execute(
+            "ALTER TABLE fs_data ADD COLUMN generation INTEGER NOT NULL DEFAULT 0",
+            (),
+        )
+        .await
+        .ok();
+
         // Create symlink table
         conn.execute(
             "CREATE TABLE IF NOT EXISTS fs_symlink (
@@ -567,7 +1591,15 @@ impl AgentFS {
         if rows.next().await?.is_none() {
             conn.execute(
                 "INSERT INTO fs_config (key, value) VALUES ('chunk_size', ?)",
-                (DEFAULT_CHUNK_SIZE.to_string(),),
+                (storage.chunk_size.to_string(),),
+            )
+            .await?;
+            ChunkStore::initialize(
+                conn,
+                storage.dedup,
+                storage.compression,
+                storage.deferred_reclaim,
+                storage.size_classes,
             )
             .await?;
         }
@@ -693,7 +1725,7 @@ impl AgentFS {
     /// as it avoids re-resolving all parent path components.
     async fn lookup_child(
         &self,
-        conn: &Connection,
+        conn: &PooledConnection,
         parent_ino: i64,
         name: &str,
     ) -> Result<Option<i64>> {
@@ -718,7 +1750,7 @@ impl AgentFS {
     }
 
     /// Get link count for an inode
-    async fn get_link_count(&self, conn: &Connection, ino: i64) -> Result<u32> {
+    async fn get_link_count(&self, conn: &PooledConnection, ino: i64) -> Result<u32> {
         let mut stmt = conn
             .prepare_cached("SELECT nlink FROM fs_inode WHERE ino = ?")
             .await?;
@@ -737,20 +1769,178 @@ impl AgentFS {
     }
 
     /// Get file attributes by inode using an existing connection
-    async fn getattr_with_conn(&self, conn: &Connection, ino: i64) -> Result<Option<Stats>> {
+    async fn getattr_with_conn(&self, conn: &PooledConnection, ino: i64) -> Result<Option<Stats>> {
         let mut stmt = conn
             .prepare_cached("SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?")
             .await?;
         let mut rows = stmt.query((ino,)).await?;
 
         if let Some(row) = rows.next().await? {
-            let stats = Self::build_stats_from_row(&row)?;
+            let mut stats = Self::build_stats_from_row(&row)?;
+            self.write_buffers.apply(&mut stats);
             Ok(Some(stats))
         } else {
             Ok(None)
         }
     }
 
+    /// Check that `ino` exists and is a directory
+    ///
+    /// Returns `Ok(false)` if the inode does not exist.
+    async fn check_directory(&self, conn: &PooledConnection, ino: i64) -> Result<bool> {
+        let mut stmt = conn
+            .prepare_cached("SELECT mode FROM fs_inode WHERE ino = ?")
+            .await?;
+        let mut rows = stmt.query((ino,)).await?;
+
+        if let Some(row) = rows.next().await? {
+            let mode = row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .unwrap_or(0) as u32;
+
+            if (mode & S_IFMT) != super::S_IFDIR {
+                return Err(FsError::NotADirectory.into());
+            }
+            Ok(true)
+        } else {
+            Ok(false)
+        }
+    }
+
+    /// Read up to `limit` entries of directory `ino` whose names sort after
+    /// `after`, in name order, with their stats
+    ///
+    /// This is a keyset scan over the `(parent_ino, name)` index, so reading
+    /// a directory a page at a time costs no more than reading it at once.
+    async fn readdir_page(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        after: &str,
+        limit: usize,
+    ) -> Result<Vec<DirEntry>> {
+        let mut entries = self.readdir_page_committed(conn, ino, after, limit).await?;
+        for entry in &mut entries {
+            self.write_buffers.apply(&mut entry.stats);
+        }
+        Ok(entries)
+    }
+
+    /// Like `readdir_page()`, but with the committed stats of the entries,
+    /// without buffered writes applied
+    async fn readdir_page_committed(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        after: &str,
+        limit: usize,
+    ) -> Result<Vec<DirEntry>> {
+        let limit = i64::try_from(limit).unwrap_or(i64::MAX);
+        let mut stmt = conn.prepare_cached("SELECT d.name, i.ino, i.mode, i.nlink, i.uid, i.gid, i.size, i.atime, i.mtime, i.ctime, i.rdev, i.atime_nsec, i.mtime_nsec, i.ctime_nsec
+            FROM fs_dentry d
+            JOIN fs_inode i ON d.ino = i.ino
+            WHERE d.parent_ino = ? AND d.name > ?
+            ORDER BY d.name
+            LIMIT ?"
+        ).await?;
+        let mut rows = stmt.query((ino, after, limit)).await?;
+
+        let mut entries = Vec::new();
+        while let Some(row) = rows.next().await? {
+            let name = row
+                .get_value(0)
+                .ok()
+                .and_then(|v| {
+                    if let Value::Text(s) = v {
+                        Some(s.clone())
+                    } else {
+                        None
+                    }
+                })
+                .unwrap_or_default();
+
+            if name.is_empty() {
+                continue;
+            }
+
+            let entry_ino = row
+                .get_value(1)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .unwrap_or(0);
+
+            let stats = Stats {
+                ino: entry_ino,
+                mode: row
+                    .get_value(2)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                nlink: row
+                    .get_value(3)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(1) as u32,
+                uid: row
+                    .get_value(4)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                gid: row
+                    .get_value(5)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                size: row
+                    .get_value(6)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0),
+                atime: row
+                    .get_value(7)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0),
+                mtime: row
+                    .get_value(8)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0),
+                ctime: row
+                    .get_value(9)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0),
+                atime_nsec: row
+                    .get_value(11)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                mtime_nsec: row
+                    .get_value(12)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                ctime_nsec: row
+                    .get_value(13)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u32,
+                rdev: row
+                    .get_value(10)
+                    .ok()
+                    .and_then(|v| v.as_integer().copied())
+                    .unwrap_or(0) as u64,
+            };
+
+            entries.push(DirEntry { name, stats });
+        }
+
+        Ok(entries)
+    }
+
     /// Build a Stats object from a database row
     ///
     /// The row should contain columns in this order:
@@ -827,12 +2017,16 @@ impl AgentFS {
 
     /// Resolve a path to an inode number
     async fn resolve_path(&self, path: &str) -> Result<Option<i64>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         self.resolve_path_with_conn(&conn, path).await
     }
 
     /// Resolve a path to an inode number using a provided connection
-    async fn resolve_path_with_conn(&self, conn: &Connection, path: &str) -> Result<Option<i64>> {
+    async fn resolve_path_with_conn(
+        &self,
+        conn: &PooledConnection,
+        path: &str,
+    ) -> Result<Option<i64>> {
         let components = self.split_path(path);
         if components.is_empty() {
             return Ok(Some(ROOT_INO));
@@ -842,10 +2036,15 @@ impl AgentFS {
         let mut current_ino = ROOT_INO;
         for component in components {
             // Check cache first
-            if let Some(cached_ino) = self.dentry_cache.get(current_ino, &component) {
-                current_ino = cached_ino;
-                continue;
+            match self.dentry_cache.get(current_ino, &component) {
+                Some(CachedDentry::Found(cached_ino)) => {
+                    current_ino = cached_ino;
+                    continue;
+                }
+                Some(CachedDentry::Missing) => return Ok(None),
+                None => {}
             }
+            let generation = self.dentry_cache.generation(current_ino, &component);
 
             // Cache miss - query database
             if let Some(statement) = &mut statement {
@@ -881,9 +2080,20 @@ impl AgentFS {
                     .unwrap_or(0);
 
                 // Populate cache
-                self.dentry_cache.insert(current_ino, &component, child_ino);
+                self.dentry_cache.insert_if_current(
+                    generation,
+                    current_ino,
+                    &component,
+                    CachedDentry::Found(child_ino),
+                );
                 current_ino = child_ino;
             } else {
+                self.dentry_cache.insert_if_current(
+                    generation,
+                    current_ino,
+                    &component,
+                    CachedDentry::Missing,
+                );
                 return Ok(None);
             }
         }
@@ -893,56 +2103,38 @@ impl AgentFS {
 
     /// Get file statistics without following symlinks
     pub async fn lstat(&self, path: &str) -> Result<Option<Stats>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let path = self.normalize_path(path);
         let ino = match self.resolve_path_with_conn(&conn, &path).await? {
             Some(ino) => ino,
             None => return Ok(None),
         };
 
-        let mut stmt = conn
-            .prepare_cached("SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?")
-            .await?;
-        let mut rows = stmt.query((ino,)).await?;
-
-        if let Some(row) = rows.next().await? {
-            let stats = Self::build_stats_from_row(&row)?;
-            Ok(Some(stats))
-        } else {
-            Ok(None)
-        }
+        let stats = self.attr_cache.load(&conn, ino).await?;
+        Ok(stats.map(|mut stats| {
+            self.write_buffers.apply(&mut stats);
+            stats
+        }))
     }
 
     /// Get file statistics, following symlinks
     pub async fn stat(&self, path: &str) -> Result<Option<Stats>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let path = self.normalize_path(path);
 
         // Follow symlinks with a maximum depth to prevent infinite loops
         let mut current_path = path;
         let max_symlink_depth = 40; // Standard limit for symlink following
 
-        let mut stmt = conn.prepare_cached(
-            "SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?",
-        ).await?;
         for _ in 0..max_symlink_depth {
             let ino = match self.resolve_path_with_conn(&conn, &current_path).await? {
                 Some(ino) => ino,
                 None => return Ok(None),
             };
 
-            stmt.reset()?;
-            let mut rows = stmt.query((ino,)).await?;
-
-            if let Some(row) = rows.next().await? {
-                let mode = row
-                    .get_value(1)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32;
-
+            if let Some(mut stats) = self.attr_cache.load(&conn, ino).await? {
                 // Check if this is a symlink
-                if (mode & S_IFMT) == S_IFLNK {
+                if stats.is_symlink() {
                     // Read the symlink target
                     let target = self
                         .readlink_with_conn(&conn, &current_path)
@@ -964,7 +2156,7 @@ impl AgentFS {
                 }
 
                 // Not a symlink, return the stats
-                let stats = Self::build_stats_from_row(&row)?;
+                self.write_buffers.apply(&mut stats);
                 return Ok(Some(stats));
             } else {
                 return Ok(None);
@@ -976,7 +2168,7 @@ impl AgentFS {
     }
 
     /// Get file statistics, following symlinks (using provided connection)
-    async fn stat_with_conn(&self, conn: &Connection, path: &str) -> Result<Option<Stats>> {
+    async fn stat_with_conn(&self, conn: &PooledConnection, path: &str) -> Result<Option<Stats>> {
         let path = self.normalize_path(path);
 
         // Follow symlinks with a maximum depth to prevent infinite loops
@@ -1026,7 +2218,8 @@ impl AgentFS {
                 }
 
                 // Not a symlink, return the stats
-                let stats = Self::build_stats_from_row(&row)?;
+                let mut stats = Self::build_stats_from_row(&row)?;
+                self.write_buffers.apply(&mut stats);
                 return Ok(Some(stats));
             } else {
                 return Ok(None);
@@ -1118,6 +2311,8 @@ impl AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -1195,6 +2390,8 @@ impl AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -1280,6 +2477,8 @@ impl AgentFS {
         txn.commit().await?;
 
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         let stats = Stats {
             ino,
@@ -1297,35 +2496,25 @@ impl AgentFS {
             rdev: 0,
         };
 
-        let file: BoxedFile = Arc::new(AgentFSFile {
-            pool: self.pool.clone(),
-            ino,
-            chunk_size: self.chunk_size,
-        });
+        let file = self.new_file(ino);
 
         Ok((stats, file))
     }
 
     /// Read data from a file
     pub async fn read_file(&self, path: &str) -> Result<Option<Vec<u8>>> {
-        let conn = self.pool.get_connection().await?;
+        self.flush_write_buffer(path).await?;
+        let conn = self.pool.get_read_connection().await?;
         let ino = match self.resolve_path_with_conn(&conn, path).await? {
             Some(ino) => ino,
             None => return Ok(None),
         };
 
-        let mut rows = conn
-            .query(
-                "SELECT data FROM fs_data WHERE ino = ? ORDER BY chunk_index",
-                (ino,),
-            )
-            .await?;
+        let chunks = self.chunk_store.read_range(&conn, ino, 0, i64::MAX).await?;
 
         let mut data = Vec::new();
-        while let Some(row) = rows.next().await? {
-            if let Ok(Value::Blob(chunk)) = row.get_value(0) {
-                data.extend_from_slice(&chunk);
-            }
+        for (_, chunk) in chunks {
+            data.extend_from_slice(&chunk);
         }
 
         Ok(Some(data))
@@ -1338,41 +2527,38 @@ impl AgentFS {
     ///
     /// Returns `Ok(None)` if the file does not exist.
     pub async fn pread(&self, path: &str, offset: u64, size: u64) -> Result<Option<Vec<u8>>> {
-        let conn = self.pool.get_connection().await?;
+        self.flush_write_buffer(path).await?;
+        let conn = self.pool.get_read_connection().await?;
         let ino = match self.resolve_path_with_conn(&conn, path).await? {
             Some(ino) => ino,
             None => return Ok(None),
         };
 
         // Calculate which chunks we need
-        let chunk_size = self.chunk_size as u64;
+        let chunk_size = self.chunk_store.chunk_size(&conn, ino).await? as u64;
         let start_chunk = offset / chunk_size;
         let end_chunk = (offset + size).saturating_sub(1) / chunk_size;
 
-        let mut rows = conn
-            .query(
-                "SELECT chunk_index, data FROM fs_data WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ? ORDER BY chunk_index",
-                (ino, start_chunk as i64, end_chunk as i64),
-            )
+        let chunks = self
+            .chunk_store
+            .read_range(&conn, ino, start_chunk as i64, end_chunk as i64)
             .await?;
 
         let mut result = Vec::with_capacity(size as usize);
         let start_offset_in_chunk = (offset % chunk_size) as usize;
 
-        while let Some(row) = rows.next().await? {
-            if let Ok(Value::Blob(chunk_data)) = row.get_value(1) {
-                let skip = if result.is_empty() {
-                    start_offset_in_chunk
-                } else {
-                    0
-                };
-                if skip >= chunk_data.len() {
-                    continue;
-                }
-                let remaining = size as usize - result.len();
-                let take = std::cmp::min(chunk_data.len() - skip, remaining);
-                result.extend_from_slice(&chunk_data[skip..skip + take]);
+        for (_, chunk_data) in chunks {
+            let skip = if result.is_empty() {
+                start_offset_in_chunk
+            } else {
+                0
+            };
+            if skip >= chunk_data.len() {
+                continue;
             }
+            let remaining = size as usize - result.len();
+            let take = std::cmp::min(chunk_data.len() - skip, remaining);
+            result.extend_from_slice(&chunk_data[skip..skip + take]);
         }
 
         Ok(Some(result))
@@ -1386,6 +2572,7 @@ impl AgentFS {
     /// If the offset is beyond the current file size, the file is extended with zeros.
     /// If the file does not exist, it will be created.
     pub async fn pwrite(&self, path: &str, offset: u64, data: &[u8]) -> Result<()> {
+        self.flush_write_buffer(path).await?;
         let conn = self.pool.get_connection().await?;
         let path = self.normalize_path(path);
         let components = self.split_path(&path);
@@ -1409,7 +2596,7 @@ impl AgentFS {
 
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
 
-        let result: Result<()> = async {
+        let result: Result<i64> = async {
             // Calculate the final size upfront
             let write_end = offset + data.len() as u64;
 
@@ -1472,10 +2659,13 @@ impl AgentFS {
                     .await?
                     .execute((now_secs, now_nsec, ino))
                     .await?;
-                return Ok(());
+                return Ok(ino);
             }
 
-            let chunk_size = self.chunk_size as u64;
+            let chunk_size = self
+                .chunk_store
+                .chunk_size_for(&conn, ino, current_size, write_end)
+                .await? as u64;
 
             // Calculate affected chunk range
             let start_chunk = offset / chunk_size;
@@ -1505,26 +2695,14 @@ impl AgentFS {
                 // Read existing chunk if we need to preserve some data
                 let needs_read = data_start > 0 || data_end < chunk_size as usize;
                 let mut chunk_data = if needs_read {
-                    let mut rows = conn
-                        .query(
-                            "SELECT data FROM fs_data WHERE ino = ? AND chunk_index = ?",
-                            (ino, chunk_idx as i64),
-                        )
-                        .await?;
-                    if let Some(row) = rows.next().await? {
-                        if let Ok(Value::Blob(data)) = row.get_value(0) {
-                            let mut v = data.clone();
-                            v.resize(chunk_size as usize, 0);
-                            v
-                        } else {
-                            vec![0u8; chunk_size as usize]
-                        }
-                    } else {
-                        vec![0u8; chunk_size as usize]
-                    }
+                    self.chunk_store
+                        .read(&conn, ino, chunk_idx as i64)
+                        .await?
+                        .unwrap_or_default()
                 } else {
-                    vec![0u8; chunk_size as usize]
+                    Vec::new()
                 };
+                chunk_data.resize(chunk_size as usize, 0);
 
                 // Copy the new data into the chunk
                 chunk_data[data_start..data_end].copy_from_slice(&data[src_start..src_end]);
@@ -1542,17 +2720,10 @@ impl AgentFS {
                     chunk_size as usize
                 };
 
-                // Write the chunk - delete existing then insert
-                conn.execute(
-                    "DELETE FROM fs_data WHERE ino = ? AND chunk_index = ?",
-                    (ino, chunk_idx as i64),
-                )
-                .await?;
-                conn.execute(
-                    "INSERT INTO fs_data (ino, chunk_index, data) VALUES (?, ?, ?)",
-                    (ino, chunk_idx as i64, &chunk_data[..actual_len]),
-                )
-                .await?;
+                // Write the chunk
+                self.chunk_store
+                    .write(&conn, ino, chunk_idx as i64, &chunk_data[..actual_len])
+                    .await?;
             }
 
             // Update size and mtime (only if not new, since new inodes already have correct values)
@@ -1567,13 +2738,16 @@ impl AgentFS {
                 stmt.execute((new_size as i64, now_secs, now_nsec, ino)).await?;
             }
 
-            Ok(())
+            Ok(ino)
         }
         .await;
 
         match result {
-            Ok(()) => {
+            Ok(ino) => {
                 txn.commit().await?;
+                // The write may have created the file; drop any cached miss
+                self.dentry_cache.remove(parent_ino, name);
+                self.attr_cache.remove(ino);
                 Ok(())
             }
             Err(e) => {
@@ -1589,12 +2763,24 @@ impl AgentFS {
     /// - Shrinking: deletes chunks beyond new size, truncates the last chunk if needed
     /// - Extending: pads with zeros up to the new size
     pub async fn truncate(&self, path: &str, new_size: u64) -> Result<()> {
-        let conn = self.pool.get_connection().await?;
         let path = self.normalize_path(path);
-        let ino = self
-            .resolve_path_with_conn(&conn, &path)
-            .await?
-            .ok_or(FsError::NotFound)?;
+        let ino = self.resolve_path(&path).await?.ok_or(FsError::NotFound)?;
+
+        // Like `AgentFSFile::truncate`, hold the buffer of the inode across
+        // the flush, the truncate and resetting its end, so no buffered write
+        // lands in between
+        let buffer = self.write_buffers.get(ino);
+        let io = match &buffer {
+            Some(buffer) => {
+                let io = buffer.io.lock().await;
+                buffer
+                    .flush_locked(&self.pool, &self.chunk_store, &self.attr_cache, ino)
+                    .await?;
+                Some(io)
+            }
+            None => None,
+        };
+        let conn = self.pool.get_connection().await?;
 
         // Get current size
         let mut stmt = conn
@@ -1610,27 +2796,33 @@ impl AgentFS {
             0
         };
 
-        let chunk_size = self.chunk_size as u64;
+        drop(rows);
+        stmt.reset()?;
 
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
 
         let result: Result<()> = async {
+            let chunk_size = self
+                .chunk_store
+                .chunk_size_for(&conn, ino, current_size, new_size)
+                .await? as u64;
             if new_size == 0 {
                 // Special case: truncate to zero - just delete all chunks
-                let mut stmt = conn
-                    .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                    .await?;
-                stmt.execute((ino,)).await?;
+                if self.chunk_store.discard_all(&conn, ino).await? {
+                    self.wake_reaper();
+                }
             } else if new_size < current_size {
                 // Shrinking: delete excess chunks and truncate last chunk if needed
                 let last_chunk_idx = (new_size - 1) / chunk_size;
 
                 // Delete all chunks beyond the last one we need
-                conn.execute(
-                    "DELETE FROM fs_data WHERE ino = ? AND chunk_index > ?",
-                    (ino, last_chunk_idx as i64),
-                )
-                .await?;
+                if self
+                    .chunk_store
+                    .discard_from(&conn, ino, last_chunk_idx as i64 + 1)
+                    .await?
+                {
+                    self.wake_reaper();
+                }
 
                 // Calculate where in the last chunk the file should end
                 let end_in_last_chunk = ((new_size - 1) % chunk_size) + 1;
@@ -1638,20 +2830,16 @@ impl AgentFS {
                 // If the last chunk needs to be truncated (not a full chunk),
                 // read it, truncate, and rewrite
                 if end_in_last_chunk < chunk_size {
-                    let mut stmt = conn
-                        .prepare_cached("SELECT data FROM fs_data WHERE ino = ? AND chunk_index = ?")
+                    let chunk = self
+                        .chunk_store
+                        .read(&conn, ino, last_chunk_idx as i64)
                         .await?;
-                    let mut rows = stmt.query((ino, last_chunk_idx as i64)).await?;
-
-                    if let Some(row) = rows.next().await? {
-                        if let Ok(Value::Blob(chunk_data)) = row.get_value(0) {
-                            if chunk_data.len() > end_in_last_chunk as usize {
-                                let truncated = &chunk_data[..end_in_last_chunk as usize];
-                                let mut stmt = conn
-                                    .prepare_cached("UPDATE fs_data SET data = ? WHERE ino = ? AND chunk_index = ?")
-                                    .await?;
-                                stmt.execute((truncated, ino, last_chunk_idx as i64)).await?;
-                            }
+                    if let Some(chunk_data) = chunk {
+                        if chunk_data.len() > end_in_last_chunk as usize {
+                            let truncated = &chunk_data[..end_in_last_chunk as usize];
+                            self.chunk_store
+                                .write(&conn, ino, last_chunk_idx as i64, truncated)
+                                .await?;
                         }
                     }
                 }
@@ -1666,30 +2854,21 @@ impl AgentFS {
 
                 // Pad the last existing chunk with zeros if it's not full
                 if let Some(last_idx) = last_existing_chunk {
-                    let mut stmt = conn
-                        .prepare_cached("SELECT data FROM fs_data WHERE ino = ? AND chunk_index = ?")
-                        .await?;
-                    let mut rows = stmt.query((ino, last_idx as i64)).await?;
-
-                    if let Some(row) = rows.next().await? {
-                        if let Ok(Value::Blob(chunk_data)) = row.get_value(0) {
-                            let current_chunk_len = chunk_data.len();
-                            let needed_len = if last_idx == last_new_chunk {
-                                // Last existing chunk is also the last new chunk
-                                ((new_size - 1) % chunk_size + 1) as usize
-                            } else {
-                                // Need to fill this chunk completely
-                                chunk_size as usize
-                            };
-
-                            if needed_len > current_chunk_len {
-                                let mut padded = chunk_data.clone();
-                                padded.resize(needed_len, 0);
-                                let mut stmt = conn
-                                    .prepare_cached("UPDATE fs_data SET data = ? WHERE ino = ? AND chunk_index = ?")
-                                    .await?;
-                                stmt.execute((&padded[..], ino, last_idx as i64)).await?;
-                            }
+                    let chunk = self.chunk_store.read(&conn, ino, last_idx as i64).await?;
+                    if let Some(mut chunk_data) = chunk {
+                        let needed_len = if last_idx == last_new_chunk {
+                            // Last existing chunk is also the last new chunk
+                            ((new_size - 1) % chunk_size + 1) as usize
+                        } else {
+                            // Need to fill this chunk completely
+                            chunk_size as usize
+                        };
+
+                        if needed_len > chunk_data.len() {
+                            chunk_data.resize(needed_len, 0);
+                            self.chunk_store
+                                .write(&conn, ino, last_idx as i64, &chunk_data)
+                                .await?;
                         }
                     }
                 }
@@ -1703,11 +2882,9 @@ impl AgentFS {
                         chunk_size as usize
                     };
                     let zeros = vec![0u8; chunk_len];
-                    conn.execute(
-                        "INSERT INTO fs_data (ino, chunk_index, data) VALUES (?, ?, ?)",
-                        (ino, chunk_idx as i64, &zeros[..]),
-                    )
-                    .await?;
+                    self.chunk_store
+                        .write(&conn, ino, chunk_idx as i64, &zeros)
+                        .await?;
                 }
             }
             // else: new_size == current_size, nothing to do for data
@@ -1717,29 +2894,82 @@ impl AgentFS {
             let now_secs = dur.as_secs() as i64;
             let now_nsec = dur.subsec_nanos() as i64;
             let mut stmt = conn
-                .prepare_cached("UPDATE fs_inode SET size = ?, mtime = ?, mtime_nsec = ? WHERE ino = ?")
+                .prepare_cached(
+                    "UPDATE fs_inode SET size = ?, mtime = ?, mtime_nsec = ? WHERE ino = ?",
+                )
+                .await?;
+            stmt.execute((new_size as i64, now_secs, now_nsec, ino))
                 .await?;
-            stmt.execute((new_size as i64, now_secs, now_nsec, ino)).await?;
 
             Ok(())
         }
         .await;
 
-        match result {
+        let outcome = match result {
             Ok(()) => {
                 txn.commit().await?;
+                self.attr_cache.remove(ino);
+                if let Some(buffer) = &buffer {
+                    buffer.pending.lock().unwrap().end = 0;
+                }
                 Ok(())
             }
             Err(e) => {
                 let _ = txn.rollback().await;
                 Err(e)
             }
+        };
+        drop(io);
+        if let Some(buffer) = &buffer {
+            self.write_buffers.release(ino, buffer);
+        }
+        outcome
+    }
+
+    /// Copy the regular file at `src` to a new file at `dst`, like `cp`.
+    ///
+    /// The copy gets the mode and ownership of `src`. With deduplicated
+    /// storage it shares the chunks of `src` instead of storing its data
+    /// again, so copying only adds a reference per chunk.
+    pub async fn copy_file(&self, src: &str, dst: &str) -> Result<Stats> {
+        self.flush_write_buffer(src).await?;
+        let src_stats = self.stat(src).await?.ok_or(FsError::NotFound)?;
+        if src_stats.is_directory() {
+            return Err(FsError::IsADirectory.into());
+        }
+        let (dst_stats, _) = self
+            .create_file(dst, src_stats.mode, src_stats.uid, src_stats.gid)
+            .await?;
+
+        let conn = self.pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+        let result: Result<()> = async {
+            self.chunk_store
+                .copy(&conn, src_stats.ino, dst_stats.ino)
+                .await?;
+            let mut stmt = conn
+                .prepare_cached("UPDATE fs_inode SET size = ? WHERE ino = ?")
+                .await?;
+            stmt.execute((src_stats.size, dst_stats.ino)).await?;
+            Ok(())
+        }
+        .await;
+        if let Err(e) = result {
+            let _ = txn.rollback().await;
+            return Err(e);
         }
+        txn.commit().await?;
+        self.attr_cache.remove(dst_stats.ino);
+
+        Ok(Stats {
+            size: src_stats.size,
+            ..dst_stats
+        })
     }
 
     /// List directory contents
     pub async fn readdir(&self, ino: i64) -> Result<Option<Vec<String>>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn
             .query(
                 "SELECT name FROM fs_dentry WHERE parent_ino = ? ORDER BY name",
@@ -1772,7 +3002,7 @@ impl AgentFS {
     ///
     /// Returns entries with their stats in a single JOIN query, avoiding N+1 queries.
     pub async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut stmt = conn.prepare_cached("SELECT d.name, i.ino, i.mode, i.nlink, i.uid, i.gid, i.size, i.atime, i.mtime, i.ctime, i.rdev, i.atime_nsec, i.mtime_nsec, i.ctime_nsec
             FROM fs_dentry d
             JOIN fs_inode i ON d.ino = i.ino
@@ -1812,7 +3042,7 @@ impl AgentFS {
                 .and_then(|v| v.as_integer().copied())
                 .unwrap_or(1) as u32;
 
-            let stats = Stats {
+            let mut stats = Stats {
                 ino: entry_ino,
                 mode: row
                     .get_value(2)
@@ -1872,12 +3102,56 @@ impl AgentFS {
                     .unwrap_or(0) as u64,
             };
 
+            self.write_buffers.apply(&mut stats);
             entries.push(DirEntry { name, stats });
         }
 
         Ok(Some(entries))
     }
 
+    /// List directory contents with full statistics like `readdir_plus()`,
+    /// caching every entry for later lookups
+    ///
+    /// Used to warm the dentry and attribute caches ahead of the lookups of a
+    /// directory's children, reading the directory a page of `fs_dentry JOIN
+    /// fs_inode` rows at a time. Returns `None` if `ino` does not exist.
+    pub async fn prefetch_dir(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
+        let conn = self.pool.get_read_connection().await?;
+        if !self.check_directory(&conn, ino).await? {
+            return Ok(None);
+        }
+
+        let mut entries: Vec<DirEntry> = Vec::new();
+        loop {
+            let dentry_generations = self.dentry_cache.generations();
+            let attr_generation = self.attr_cache.generation.load(Ordering::Acquire);
+            let after = entries.last().map(|e| e.name.clone()).unwrap_or_default();
+            let page = self
+                .readdir_page_committed(&conn, ino, &after, PREFETCH_PAGE_SIZE)
+                .await?;
+            for entry in &page {
+                self.dentry_cache.insert_if_current_in(
+                    &dentry_generations,
+                    ino,
+                    &entry.name,
+                    CachedDentry::Found(entry.stats.ino),
+                );
+                self.attr_cache
+                    .insert_if_current(attr_generation, &entry.stats);
+            }
+            let last_page = page.len() < PREFETCH_PAGE_SIZE;
+            entries.extend(page);
+            if last_page {
+                break;
+            }
+        }
+
+        for entry in &mut entries {
+            self.write_buffers.apply(&mut entry.stats);
+        }
+        Ok(Some(entries))
+    }
+
     /// Create a symbolic link with the specified ownership
     pub async fn symlink(&self, target: &str, linkpath: &str, uid: u32, gid: u32) -> Result<()> {
         let conn = self.pool.get_connection().await?;
@@ -1957,6 +3231,8 @@ impl AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -2036,18 +3312,24 @@ impl AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
 
     /// Read the target of a symbolic link
     pub async fn readlink(&self, path: &str) -> Result<Option<String>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         self.readlink_with_conn(&conn, path).await
     }
 
     /// Read the target of a symbolic link using a provided connection
-    async fn readlink_with_conn(&self, conn: &Connection, path: &str) -> Result<Option<String>> {
+    async fn readlink_with_conn(
+        &self,
+        conn: &PooledConnection,
+        path: &str,
+    ) -> Result<Option<String>> {
         let path = self.normalize_path(path);
 
         let ino = match self.resolve_path_with_conn(conn, &path).await? {
@@ -2184,11 +3466,10 @@ impl AgentFS {
         let link_count = self.get_link_count(&conn, ino).await?;
         if link_count == 0 {
             // Manually handle cascading deletes since we don't use foreign keys
-            // Delete data blocks
-            let mut stmt = conn
-                .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                .await?;
-            stmt.execute((ino,)).await?;
+            // Free data blocks, or queue them for the reaper
+            if self.chunk_store.discard_all(&conn, ino).await? {
+                self.wake_reaper();
+            }
 
             // Delete symlink if exists
             let mut stmt = conn
@@ -2201,7 +3482,10 @@ impl AgentFS {
                 .prepare_cached("DELETE FROM fs_inode WHERE ino = ?")
                 .await?;
             stmt.execute((ino,)).await?;
+            self.write_buffers.discard(ino);
         }
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -2233,6 +3517,10 @@ impl AgentFS {
         values.push(Value::Integer(ino));
         let sql = format!("UPDATE fs_inode SET {} WHERE ino = ?", updates.join(", "));
         conn.execute(&sql, values).await?;
+        self.attr_cache.update(ino, |stats| {
+            stats.uid = uid.unwrap_or(stats.uid);
+            stats.gid = gid.unwrap_or(stats.gid);
+        });
 
         Ok(())
     }
@@ -2308,9 +3596,12 @@ impl AgentFS {
 
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
 
+        let mut replaced_ino = None;
+        let mut removed_ino = None;
         let result: Result<()> = async {
             // Check if destination exists (inside transaction for atomicity)
             if let Some(dst_ino) = self.resolve_path_with_conn(&conn, &to_path).await? {
+                replaced_ino = Some(dst_ino);
                 let dst_stats = self.stat_with_conn(&conn, &to_path).await?.ok_or(FsError::NotFound)?;
 
                 // Can't replace directory with non-directory
@@ -2357,10 +3648,9 @@ impl AgentFS {
                 // Clean up destination inode if no more links
                 let link_count = self.get_link_count(&conn, dst_ino).await?;
                 if link_count == 0 {
-                    let mut stmt = conn
-                        .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                        .await?;
-                    stmt.execute((dst_ino,)).await?;
+                    if self.chunk_store.discard_all(&conn, dst_ino).await? {
+                        self.wake_reaper();
+                    }
                     let mut stmt = conn
                         .prepare_cached("DELETE FROM fs_symlink WHERE ino = ?")
                         .await?;
@@ -2369,6 +3659,7 @@ impl AgentFS {
                         .prepare_cached("DELETE FROM fs_inode WHERE ino = ?")
                         .await?;
                     stmt.execute((dst_ino,)).await?;
+                    removed_ino = Some(dst_ino);
                 }
             }
 
@@ -2440,6 +3731,16 @@ impl AgentFS {
                 // Add new entry to cache (source inode is now at destination)
                 self.dentry_cache.insert(dst_parent_ino, &dst_name, src_ino);
 
+                for ino in [src_parent_ino, dst_parent_ino, src_ino]
+                    .into_iter()
+                    .chain(replaced_ino)
+                {
+                    self.attr_cache.remove(ino);
+                }
+                if let Some(ino) = removed_ino {
+                    self.write_buffers.discard(ino);
+                }
+
                 Ok(())
             }
             Err(e) => {
@@ -2453,7 +3754,7 @@ impl AgentFS {
     ///
     /// Returns the total number of inodes and bytes used by file contents.
     pub async fn statfs(&self) -> Result<FilesystemStats> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         // Count total inodes
         let mut stmt = conn.prepare_cached("SELECT COUNT(*) FROM fs_inode").await?;
         let mut rows = stmt.query(()).await?;
@@ -2515,30 +3816,16 @@ impl AgentFS {
         let path = self.normalize_path(path);
         let ino = self.resolve_path(&path).await?.ok_or(FsError::NotFound)?;
 
-        Ok(Arc::new(AgentFSFile {
-            pool: self.pool.clone(),
-            ino,
-            chunk_size: self.chunk_size,
-        }))
+        Ok(self.new_file(ino))
     }
 
-    /// Get the number of chunks for a given inode (for testing)
+    /// Get the number of chunks for a given inode, once queued ones are
+    /// freed (for testing)
     #[cfg(test)]
     async fn get_chunk_count(&self, ino: i64) -> Result<i64> {
-        let conn = self.pool.get_connection().await?;
-        let mut rows = conn
-            .query("SELECT COUNT(*) FROM fs_data WHERE ino = ?", (ino,))
-            .await?;
-
-        if let Some(row) = rows.next().await? {
-            Ok(row
-                .get_value(0)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .unwrap_or(0))
-        } else {
-            Ok(0)
-        }
+        self.reclaim().await?;
+        let conn = self.pool.get_read_connection().await?;
+        self.chunk_store.count(&conn, ino).await
     }
 }
 
@@ -2548,7 +3835,8 @@ impl FileSystem for AgentFS {
         if name.len() > MAX_NAME_LEN {
             return Err(FsError::NameTooLong.into());
         }
-        let conn = self.pool.get_connection().await?;
+        let generation = self.dentry_cache.generation(parent_ino, name);
+        let conn = self.pool.get_read_connection().await?;
 
         // Handle ".." by finding the parent of parent_ino
         if name == ".." {
@@ -2571,22 +3859,36 @@ impl FileSystem for AgentFS {
             return self.getattr_with_conn(&conn, parent).await;
         }
 
-        // Look up the child inode
-        let child_ino = match self.lookup_child(&conn, parent_ino, name).await? {
-            Some(ino) => ino,
-            None => return Ok(None),
+        // Look up the child inode, consulting the dentry cache first
+        let (child_ino, cached) = match self.dentry_cache.get(parent_ino, name) {
+            Some(CachedDentry::Found(ino)) => (ino, true),
+            Some(CachedDentry::Missing) => return Ok(None),
+            None => match self.lookup_child(&conn, parent_ino, name).await? {
+                Some(ino) => (ino, false),
+                None => {
+                    self.dentry_cache.insert_if_current(
+                        generation,
+                        parent_ino,
+                        name,
+                        CachedDentry::Missing,
+                    );
+                    return Ok(None);
+                }
+            },
         };
 
         // Get stats for the child inode
-        let mut stmt = conn
-            .prepare_cached("SELECT ino, mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec FROM fs_inode WHERE ino = ?")
-            .await?;
-        let mut rows = stmt.query((child_ino,)).await?;
-
-        if let Some(row) = rows.next().await? {
-            let stats = Self::build_stats_from_row(&row)?;
+        if let Some(mut stats) = self.attr_cache.load(&conn, child_ino).await? {
+            self.write_buffers.apply(&mut stats);
             // Cache the lookup result
-            self.dentry_cache.insert(parent_ino, name, child_ino);
+            if !cached {
+                self.dentry_cache.insert_if_current(
+                    generation,
+                    parent_ino,
+                    name,
+                    CachedDentry::Found(child_ino),
+                );
+            }
             Ok(Some(stats))
         } else {
             Ok(None)
@@ -2594,12 +3896,21 @@ impl FileSystem for AgentFS {
     }
 
     async fn getattr(&self, ino: i64) -> Result<Option<Stats>> {
-        let conn = self.pool.get_connection().await?;
-        self.getattr_with_conn(&conn, ino).await
+        let stats = match self.attr_cache.get(ino) {
+            Some(stats) => Some(stats),
+            None => {
+                let conn = self.pool.get_read_connection().await?;
+                self.attr_cache.load(&conn, ino).await?
+            }
+        };
+        Ok(stats.map(|mut stats| {
+            self.write_buffers.apply(&mut stats);
+            stats
+        }))
     }
 
     async fn readlink(&self, ino: i64) -> Result<Option<String>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
 
         // Check if the inode exists and is a symlink
         let mut stmt = conn
@@ -2643,7 +3954,7 @@ impl FileSystem for AgentFS {
     }
 
     async fn readdir(&self, ino: i64) -> Result<Option<Vec<String>>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
 
         // Check if inode exists and is a directory
         let mut stmt = conn
@@ -2692,128 +4003,24 @@ impl FileSystem for AgentFS {
     }
 
     async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
-        let conn = self.pool.get_connection().await?;
-
-        // Check if inode exists and is a directory
-        let mut stmt = conn
-            .prepare_cached("SELECT mode FROM fs_inode WHERE ino = ?")
-            .await?;
-        let mut rows = stmt.query((ino,)).await?;
-
-        if let Some(row) = rows.next().await? {
-            let mode = row
-                .get_value(0)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .unwrap_or(0) as u32;
-
-            if (mode & S_IFMT) != super::S_IFDIR {
-                return Err(FsError::NotADirectory.into());
-            }
-        } else {
+        let conn = self.pool.get_read_connection().await?;
+        if !self.check_directory(&conn, ino).await? {
             return Ok(None);
         }
+        let entries = self.readdir_page(&conn, ino, "", usize::MAX).await?;
+        Ok(Some(entries))
+    }
 
-        let mut stmt = conn.prepare_cached("SELECT d.name, i.ino, i.mode, i.nlink, i.uid, i.gid, i.size, i.atime, i.mtime, i.ctime, i.rdev, i.atime_nsec, i.mtime_nsec, i.ctime_nsec
-            FROM fs_dentry d
-            JOIN fs_inode i ON d.ino = i.ino
-            WHERE d.parent_ino = ?
-            ORDER BY d.name"
-        ).await?;
-        let mut rows = stmt.query((ino,)).await?;
-
-        let mut entries = Vec::new();
-        while let Some(row) = rows.next().await? {
-            let name = row
-                .get_value(0)
-                .ok()
-                .and_then(|v| {
-                    if let Value::Text(s) = v {
-                        Some(s.clone())
-                    } else {
-                        None
-                    }
-                })
-                .unwrap_or_default();
-
-            if name.is_empty() {
-                continue;
-            }
-
-            let entry_ino = row
-                .get_value(1)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .unwrap_or(0);
-
-            let stats = Stats {
-                ino: entry_ino,
-                mode: row
-                    .get_value(2)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                nlink: row
-                    .get_value(3)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(1) as u32,
-                uid: row
-                    .get_value(4)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                gid: row
-                    .get_value(5)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                size: row
-                    .get_value(6)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0),
-                atime: row
-                    .get_value(7)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0),
-                mtime: row
-                    .get_value(8)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0),
-                ctime: row
-                    .get_value(9)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0),
-                atime_nsec: row
-                    .get_value(11)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                mtime_nsec: row
-                    .get_value(12)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                ctime_nsec: row
-                    .get_value(13)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u32,
-                rdev: row
-                    .get_value(10)
-                    .ok()
-                    .and_then(|v| v.as_integer().copied())
-                    .unwrap_or(0) as u64,
-            };
-
-            entries.push(DirEntry { name, stats });
+    async fn opendir(&self, ino: i64) -> Result<Option<BoxedDirectory>> {
+        let conn = self.pool.get_read_connection().await?;
+        if !self.check_directory(&conn, ino).await? {
+            return Ok(None);
         }
-
-        Ok(Some(entries))
+        Ok(Some(Arc::new(AgentFSDirectory {
+            fs: self.clone(),
+            ino,
+            after: Mutex::new(String::new()),
+        })))
     }
 
     async fn chmod(&self, ino: i64, mode: u32) -> Result<()> {
@@ -2845,6 +4052,11 @@ impl FileSystem for AgentFS {
             .await?;
         stmt.execute((new_mode as i64, now_secs, now_nsec, ino))
             .await?;
+        self.attr_cache.update(ino, |stats| {
+            stats.mode = new_mode;
+            stats.ctime = now_secs;
+            stats.ctime_nsec = now_nsec as u32;
+        });
 
         Ok(())
     }
@@ -2890,6 +4102,12 @@ impl FileSystem for AgentFS {
         values.push(Value::Integer(ino));
         let sql = format!("UPDATE fs_inode SET {} WHERE ino = ?", updates.join(", "));
         conn.execute(&sql, values).await?;
+        self.attr_cache.update(ino, |stats| {
+            stats.uid = uid.unwrap_or(stats.uid);
+            stats.gid = gid.unwrap_or(stats.gid);
+            stats.ctime = now_secs;
+            stats.ctime_nsec = now_nsec as u32;
+        });
 
         Ok(())
     }
@@ -2920,16 +4138,16 @@ impl FileSystem for AgentFS {
             }
         };
 
-        if !matches!(atime, TimeChange::Omit) {
-            let (secs, nsec) = resolve(atime);
+        let atime = (!matches!(atime, TimeChange::Omit)).then(|| resolve(atime));
+        if let Some((secs, nsec)) = atime {
             updates.push("atime = ?");
             values.push(Value::Integer(secs));
             updates.push("atime_nsec = ?");
             values.push(Value::Integer(nsec));
         }
 
-        if !matches!(mtime, TimeChange::Omit) {
-            let (secs, nsec) = resolve(mtime);
+        let mtime = (!matches!(mtime, TimeChange::Omit)).then(|| resolve(mtime));
+        if let Some((secs, nsec)) = mtime {
             updates.push("mtime = ?");
             values.push(Value::Integer(secs));
             updates.push("mtime_nsec = ?");
@@ -2950,12 +4168,24 @@ impl FileSystem for AgentFS {
         values.push(Value::Integer(ino));
         let sql = format!("UPDATE fs_inode SET {} WHERE ino = ?", updates.join(", "));
         conn.execute(&sql, values).await?;
+        self.attr_cache.update(ino, |stats| {
+            if let Some((secs, nsec)) = atime {
+                stats.atime = secs;
+                stats.atime_nsec = nsec as u32;
+            }
+            if let Some((secs, nsec)) = mtime {
+                stats.mtime = secs;
+                stats.mtime_nsec = nsec as u32;
+            }
+            stats.ctime = dur.as_secs() as i64;
+            stats.ctime_nsec = dur.subsec_nanos();
+        });
 
         Ok(())
     }
 
     async fn open(&self, ino: i64, _flags: i32) -> Result<BoxedFile> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
 
         // Verify inode exists
         let mut stmt = conn
@@ -2967,11 +4197,7 @@ impl FileSystem for AgentFS {
             return Err(FsError::NotFound.into());
         }
 
-        Ok(Arc::new(AgentFSFile {
-            pool: self.pool.clone(),
-            ino,
-            chunk_size: self.chunk_size,
-        }))
+        Ok(self.new_file(ino))
     }
 
     async fn mkdir(
@@ -3046,6 +4272,8 @@ impl FileSystem for AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(Stats {
             ino,
@@ -3132,6 +4360,8 @@ impl FileSystem for AgentFS {
         txn.commit().await?;
 
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         let stats = Stats {
             ino,
@@ -3149,11 +4379,7 @@ impl FileSystem for AgentFS {
             rdev: 0,
         };
 
-        let file: BoxedFile = Arc::new(AgentFSFile {
-            pool: self.pool.clone(),
-            ino,
-            chunk_size: self.chunk_size,
-        });
+        let file = self.new_file(ino);
 
         Ok((stats, file))
     }
@@ -3229,6 +4455,8 @@ impl FileSystem for AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(Stats {
             ino,
@@ -3320,6 +4548,8 @@ impl FileSystem for AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(parent_ino, name, ino);
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(Stats {
             ino,
@@ -3398,11 +4628,10 @@ impl FileSystem for AgentFS {
         // Check if this was the last link to the inode
         let link_count = self.get_link_count(&conn, ino).await?;
         if link_count == 0 {
-            // Delete data blocks
-            let mut stmt = conn
-                .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                .await?;
-            stmt.execute((ino,)).await?;
+            // Free data blocks, or queue them for the reaper
+            if self.chunk_store.discard_all(&conn, ino).await? {
+                self.wake_reaper();
+            }
 
             // Delete symlink if exists
             let mut stmt = conn
@@ -3415,7 +4644,10 @@ impl FileSystem for AgentFS {
                 .prepare_cached("DELETE FROM fs_inode WHERE ino = ?")
                 .await?;
             stmt.execute((ino,)).await?;
+            self.write_buffers.discard(ino);
         }
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -3508,6 +4740,8 @@ impl FileSystem for AgentFS {
                 .await?;
             stmt.execute((ino,)).await?;
         }
+        self.attr_cache.remove(parent_ino);
+        self.attr_cache.remove(ino);
 
         Ok(())
     }
@@ -3573,6 +4807,8 @@ impl FileSystem for AgentFS {
 
         // Populate dentry cache
         self.dentry_cache.insert(newparent_ino, newname, ino);
+        self.attr_cache.remove(newparent_ino);
+        self.attr_cache.remove(ino);
 
         // Return updated stats
         self.getattr_with_conn(&conn, ino)
@@ -3610,9 +4846,12 @@ impl FileSystem for AgentFS {
 
         let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
 
+        let mut replaced_ino = None;
+        let mut removed_ino = None;
         let result: Result<()> = async {
             // Check if destination exists
             if let Some(dst_ino) = self.lookup_child(&conn, newparent_ino, newname).await? {
+                replaced_ino = Some(dst_ino);
                 let dst_stats = self.getattr_with_conn(&conn, dst_ino).await?.ok_or(FsError::NotFound)?;
 
                 // Can't replace directory with non-directory
@@ -3663,11 +4902,10 @@ impl FileSystem for AgentFS {
 
                 // Clean up destination inode if no more links
                 let link_count = self.get_link_count(&conn, dst_ino).await?;
-                if link_count == 0 {
-                    let mut stmt = conn
-                        .prepare_cached("DELETE FROM fs_data WHERE ino = ?")
-                        .await?;
-                    stmt.execute((dst_ino,)).await?;
+                if link_count == 0 {
+                    if self.chunk_store.discard_all(&conn, dst_ino).await? {
+                        self.wake_reaper();
+                    }
                     let mut stmt = conn
                         .prepare_cached("DELETE FROM fs_symlink WHERE ino = ?")
                         .await?;
@@ -3676,6 +4914,7 @@ impl FileSystem for AgentFS {
                         .prepare_cached("DELETE FROM fs_inode WHERE ino = ?")
                         .await?;
                     stmt.execute((dst_ino,)).await?;
+                    removed_ino = Some(dst_ino);
                 }
             }
 
@@ -3743,6 +4982,16 @@ impl FileSystem for AgentFS {
                 // Add new entry to cache (source inode is now at destination)
                 self.dentry_cache.insert(newparent_ino, newname, src_ino);
 
+                for ino in [oldparent_ino, newparent_ino, src_ino]
+                    .into_iter()
+                    .chain(replaced_ino)
+                {
+                    self.attr_cache.remove(ino);
+                }
+                if let Some(ino) = removed_ino {
+                    self.write_buffers.discard(ino);
+                }
+
                 Ok(())
             }
             Err(e) => {
@@ -3769,6 +5018,182 @@ mod tests {
         Ok((fs, dir))
     }
 
+    // ==================== Configurable Chunk Size Tests ====================
+
+    #[tokio::test]
+    async fn test_custom_chunk_size_persists() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let fs = AgentFS::from_pool_with_chunk_size(ConnectionPool::new(db), 65536).await?;
+        assert_eq!(fs.chunk_size(), 65536);
+
+        let data: Vec<u8> = (0..200_000).map(|i| (i % 251) as u8).collect();
+        let (stats, file) = fs.create_file("/big.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &data).await?;
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 4);
+        assert_eq!(file.pread(65000, 1000).await?, &data[65000..66000]);
+        drop(file);
+        drop(fs);
+
+        // Reopening keeps the chunk size the database was created with
+        let fs = AgentFS::new(db_path.to_str().unwrap()).await?;
+        assert_eq!(fs.chunk_size(), 65536);
+        assert_eq!(fs.read_file("/big.bin").await?.unwrap(), data);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_invalid_chunk_size_rejected() -> Result<()> {
+        let db = Builder::new_local(":memory:").build().await?;
+        let result = AgentFS::from_pool_with_chunk_size(ConnectionPool::new(db), 100).await;
+        assert!(matches!(result, Err(Error::InvalidChunkSize(100))));
+        Ok(())
+    }
+
+    async fn blob_count(fs: &AgentFS) -> Result<i64> {
+        let conn = fs.pool.get_read_connection().await?;
+        let mut rows = conn
+            .query(
+                "SELECT COUNT(*), COALESCE(SUM(refcount), 0) FROM fs_blob",
+                (),
+            )
+            .await?;
+        let row = rows.next().await?.unwrap();
+        let blobs = row.get_value(0)?.as_integer().copied().unwrap_or(0);
+        let refs = row.get_value(1)?.as_integer().copied().unwrap_or(0);
+        let chunks = {
+            let mut rows = conn.query("SELECT COUNT(*) FROM fs_chunk", ()).await?;
+            let row = rows.next().await?.unwrap();
+            row.get_value(0)?.as_integer().copied().unwrap_or(0)
+        };
+        // Every chunk holds one reference to its blob
+        assert_eq!(refs, chunks);
+        Ok(blobs)
+    }
+
+    #[tokio::test]
+    async fn test_dedup_shares_identical_chunks() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let storage = StorageOptions {
+            chunk_size: 4096,
+            dedup: true,
+            ..Default::default()
+        };
+        let fs = AgentFS::from_pool_with_storage(ConnectionPool::new(db), storage).await?;
+        assert!(fs.is_dedup());
+
+        // Four distinct chunks, the last one partial
+        let data: Vec<u8> = (0..4096 * 3 + 100).map(|i| (i / 4096 + 1) as u8).collect();
+        for path in ["/a.bin", "/b.bin"] {
+            let (_, file) = fs.create_file(path, DEFAULT_FILE_MODE, 0, 0).await?;
+            file.pwrite(0, &data).await?;
+        }
+        assert_eq!(blob_count(&fs).await?, 4);
+
+        let stats = fs.copy_file("/a.bin", "/c.bin").await?;
+        assert_eq!(stats.size, data.len() as i64);
+        assert_eq!(fs.read_file("/c.bin").await?.unwrap(), data);
+        assert_eq!(blob_count(&fs).await?, 4);
+
+        // Writing to a copy leaves the other files alone
+        fs.pwrite("/c.bin", 10, b"changed").await?;
+        assert_eq!(blob_count(&fs).await?, 5);
+        assert_eq!(fs.read_file("/a.bin").await?.unwrap(), data);
+        assert_eq!(&fs.read_file("/c.bin").await?.unwrap()[10..17], b"changed");
+
+        // Blobs go away with the last chunk referring to them
+        fs.truncate("/a.bin", 4096).await?;
+        fs.remove("/b.bin").await?;
+        assert_eq!(blob_count(&fs).await?, 5);
+        fs.remove("/c.bin").await?;
+        assert_eq!(blob_count(&fs).await?, 1);
+        drop(fs);
+
+        // Reopening keeps the storage the database was created with
+        let fs = AgentFS::new(db_path.to_str().unwrap()).await?;
+        assert!(fs.is_dedup());
+        assert_eq!(fs.read_file("/a.bin").await?.unwrap(), &data[..4096]);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_compressed_chunks() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let storage = StorageOptions {
+            compression: Compression::Lz4,
+            ..Default::default()
+        };
+        let fs = AgentFS::from_pool_with_storage(ConnectionPool::new(db), storage).await?;
+        assert_eq!(fs.compression(), Compression::Lz4);
+
+        let text: Vec<u8> = b"{\"key\": \"value\"}\n".repeat(1000);
+        let (stats, file) = fs.create_file("/log.json", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &text).await?;
+        assert_eq!(file.pread(5000, 100).await?, &text[5000..5100]);
+        file.fsync().await?;
+        drop(file);
+
+        // Incompressible chunks are stored as they are
+        let noise: Vec<u8> = (0..4096u32)
+            .map(|i| (i.wrapping_mul(2654435761) >> 13) as u8)
+            .collect();
+        let (noise_stats, file) = fs.create_file("/noise", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &noise).await?;
+        file.fsync().await?;
+        drop(file);
+
+        let conn = fs.get_connection().await?;
+        let mut rows = conn
+            .query(
+                "SELECT ino, codec, SUM(LENGTH(data)) FROM fs_data GROUP BY ino, codec",
+                (),
+            )
+            .await?;
+        let mut stored = Vec::new();
+        while let Some(row) = rows.next().await? {
+            stored.push((
+                row.get_value(0)?.as_integer().copied().unwrap(),
+                row.get_value(1)?.as_integer().copied().unwrap(),
+                row.get_value(2)?.as_integer().copied().unwrap(),
+            ));
+        }
+        drop(rows);
+        assert_eq!(stored.len(), 2);
+        assert!(stored.contains(&(noise_stats.ino, 0, 4096)));
+        let (_, codec, len) = stored.iter().find(|(ino, ..)| *ino == stats.ino).unwrap();
+        assert_eq!(*codec, 1);
+        assert!((*len as usize) < text.len() / 4);
+
+        // Rows written without compression still read
+        conn.execute(
+            "UPDATE fs_data SET data = ?, codec = 0 WHERE ino = ? AND chunk_index = 0",
+            (&text[..4096], stats.ino),
+        )
+        .await?;
+        drop(conn);
+        drop(fs);
+
+        let fs = AgentFS::new(db_path.to_str().unwrap()).await?;
+        assert_eq!(fs.compression(), Compression::Lz4);
+        assert_eq!(fs.read_file("/log.json").await?.unwrap(), text);
+        assert_eq!(fs.read_file("/noise").await?.unwrap(), noise);
+
+        Ok(())
+    }
+
     // ==================== Chunk Size Boundary Tests ====================
 
     #[tokio::test]
@@ -4228,6 +5653,209 @@ mod tests {
         Ok(())
     }
 
+    #[tokio::test]
+    async fn test_large_removal_and_truncation_are_freed_inline() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        assert!(!fs.is_deferred_reclaim());
+
+        let chunk_size = fs.chunk_size();
+        let data: Vec<u8> = (0..chunk_size * 600).map(|i| (i % 251 + 1) as u8).collect();
+        let (stats, file) = fs.create_file("/big.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &data).await?;
+        fs.truncate("/big.bin", chunk_size as u64 * 3 / 2).await?;
+
+        // Freed before the truncation returns, across several batches
+        let conn = fs.get_connection().await?;
+        assert_eq!(fs.chunk_store.count(&conn, stats.ino).await?, 2);
+        drop(conn);
+        drop(file);
+        fs.remove("/big.bin").await?;
+        let conn = fs.get_connection().await?;
+        assert_eq!(fs.chunk_store.count(&conn, stats.ino).await?, 0);
+
+        // The base format has no queue
+        let mut rows = conn
+            .query(
+                "SELECT COUNT(*) FROM sqlite_master WHERE name = 'fs_orphan'",
+                (),
+            )
+            .await?;
+        let tables = rows.next().await?.unwrap().get_value(0)?;
+        assert_eq!(tables.as_integer().copied(), Some(0));
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_large_removal_and_truncation_are_queued() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let storage = StorageOptions {
+            deferred_reclaim: true,
+            ..Default::default()
+        };
+        let fs = AgentFS::from_pool_with_storage(ConnectionPool::new(db), storage).await?;
+        assert!(fs.is_deferred_reclaim());
+
+        let chunk_size = fs.chunk_size();
+        let data: Vec<u8> = (0..chunk_size * 40).map(|i| (i % 251 + 1) as u8).collect();
+        let end = chunk_size * 3 / 2;
+
+        // Chunks queued by shrinking never show up again
+        let (stats, file) = fs.create_file("/big.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &data).await?;
+        fs.truncate("/big.bin", end as u64).await?;
+        fs.truncate("/big.bin", data.len() as u64).await?;
+        let read = fs.read_file("/big.bin").await?.unwrap();
+        assert_eq!(&read[..end], &data[..end]);
+        assert!(read[end..].iter().all(|&b| b == 0));
+
+        // Writing where chunks are queued only replaces the chunk written
+        let offset = chunk_size as u64 * 30;
+        file.pwrite(offset + 10, b"new").await?;
+        let read = file.pread(offset, 16).await?;
+        assert_eq!(&read[..10], &[0u8; 10]);
+        assert_eq!(&read[10..13], b"new");
+        let read = file.pread(chunk_size as u64 * 20, 16).await?;
+        assert_eq!(read, [0u8; 16]);
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 3);
+        drop(file);
+
+        // Rewriting a file truncated to nothing leaves its old chunks queued,
+        // with the reaper held off to count them
+        let reaping = &fs.chunk_store.orphans().reaping;
+        reaping.store(true, std::sync::atomic::Ordering::Release);
+        let (stats, file) = fs.create_file("/redo.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &data).await?;
+        file.truncate(0).await?;
+        file.pwrite(0, b"again").await?;
+        file.truncate(chunk_size as u64 * 2).await?;
+        let read = file.pread(0, chunk_size as u64 * 2).await?;
+        assert_eq!(&read[..5], b"again");
+        assert!(read[5..].iter().all(|&b| b == 0));
+        let conn = fs.get_connection().await?;
+        assert_eq!(fs.chunk_store.count(&conn, stats.ino).await?, 40);
+        drop(conn);
+        reaping.store(false, std::sync::atomic::Ordering::Release);
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 1);
+        assert_eq!(&file.pread(0, 5).await?, b"again");
+        drop(file);
+
+        // Removing a large file queues all of its chunks
+        let (stats, file) = fs.create_file("/gone.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, &data).await?;
+        drop(file);
+        fs.remove("/gone.bin").await?;
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 0);
+
+        let conn = fs.get_connection().await?;
+        let mut rows = conn.query("SELECT COUNT(*) FROM fs_orphan", ()).await?;
+        let queued = rows.next().await?.unwrap().get_value(0)?;
+        assert_eq!(queued.as_integer().copied(), Some(0));
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_size_classes() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let storage = StorageOptions {
+            size_classes: true,
+            ..Default::default()
+        };
+        let fs = AgentFS::from_pool_with_storage(ConnectionPool::new(db), storage).await?;
+        assert!(fs.has_size_classes());
+        let chunk_size = fs.chunk_size();
+        const MIB: usize = 1024 * 1024;
+
+        // A file first written to 2 MiB gets 64 KiB chunks
+        let data: Vec<u8> = (0..2 * MIB).map(|i| (i % 251 + 1) as u8).collect();
+        let (medium, file) = fs
+            .create_file("/medium.bin", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        file.pwrite(0, &data).await?;
+        file.pwrite(100, b"edit").await?;
+        let mut expected = data.clone();
+        expected[100..104].copy_from_slice(b"edit");
+        assert_eq!(fs.get_chunk_count(medium.ino).await?, 32);
+        assert_eq!(fs.read_file("/medium.bin").await?.unwrap(), expected);
+        let offset = 64 * 1024 - 10;
+        assert_eq!(
+            file.pread(offset as u64, 20).await?,
+            &expected[offset..offset + 20]
+        );
+        drop(file);
+
+        // A small file keeps the configured chunk size
+        let (small, file) = fs
+            .create_file("/small.bin", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        file.pwrite(0, &data[..chunk_size * 3]).await?;
+        assert_eq!(fs.get_chunk_count(small.ino).await?, 3);
+        drop(file);
+
+        // A file sized up front gets the class of that size, and loses it
+        // with its data
+        let (large, file) = fs
+            .create_file("/large.bin", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        file.truncate(80 * MIB as u64).await?;
+        file.pwrite(70 * MIB as u64 + 5, b"far").await?;
+        assert_eq!(fs.get_chunk_count(large.ino).await?, 1);
+        assert_eq!(
+            fs.pread("/large.bin", 70 * MIB as u64, 8).await?.unwrap(),
+            b"\0\0\0\0\0far"
+        );
+        file.truncate(0).await?;
+        file.pwrite(0, &data[..chunk_size * 2]).await?;
+        assert_eq!(fs.get_chunk_count(large.ino).await?, 2);
+        drop(file);
+
+        // Buffered writes are cut in the class of the first one
+        fs.set_write_back(true);
+        let (buffered, file) = fs
+            .create_file("/buffered.bin", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        file.pwrite(0, &data).await?;
+        assert_eq!(&file.pread(MIB as u64, 16).await?, &data[MIB..MIB + 16]);
+        file.flush().await?;
+        assert_eq!(fs.get_chunk_count(buffered.ino).await?, 32);
+        drop(file);
+        fs.set_write_back(false);
+
+        // Copies keep the chunk size of their source
+        fs.copy_file("/medium.bin", "/copy.bin").await?;
+        assert_eq!(fs.read_file("/copy.bin").await?.unwrap(), expected);
+
+        // Reopening knows the classes chosen
+        drop(fs);
+        let db = Builder::new_local(db_path.to_str().unwrap())
+            .build()
+            .await?;
+        let fs = AgentFS::from_pool(ConnectionPool::new(db)).await?;
+        assert!(fs.has_size_classes());
+        assert_eq!(fs.read_file("/medium.bin").await?.unwrap(), expected);
+        assert_eq!(fs.read_file("/buffered.bin").await?.unwrap(), data);
+        let conn = fs.get_read_connection().await?;
+        assert_eq!(
+            fs.chunk_store.chunk_size(&conn, medium.ino).await?,
+            64 * 1024
+        );
+        assert_eq!(
+            fs.chunk_store.chunk_size(&conn, large.ino).await?,
+            chunk_size
+        );
+
+        Ok(())
+    }
+
     #[tokio::test]
     async fn test_multiple_files_different_sizes() -> Result<()> {
         let (fs, _dir) = create_test_fs().await?;
@@ -4915,4 +6543,380 @@ mod tests {
 
         Ok(())
     }
+
+    // ==================== Concurrent Reader Tests ====================
+
+    #[tokio::test]
+    async fn test_reads_proceed_while_writer_held() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        let (_, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, b"hello").await?;
+
+        // Hold the writer; lookups and reads must still complete
+        let _writer = fs.get_connection().await?;
+        let stats = tokio::time::timeout(
+            std::time::Duration::from_secs(5),
+            fs.lookup(ROOT_INO, "a.txt"),
+        )
+        .await
+        .expect("lookup blocked on writer")?
+        .unwrap();
+        assert_eq!(stats.size, 5);
+
+        let data = tokio::time::timeout(std::time::Duration::from_secs(5), file.pread(0, 5))
+            .await
+            .expect("pread blocked on writer")?;
+        assert_eq!(data, b"hello");
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_dentry_cache_rejects_stale_insert() -> Result<()> {
+        let cache = DentryCache::new(16);
+
+        // A reader samples the generation, then a writer removes the entry
+        let generation = cache.generation(ROOT_INO, "a");
+        cache.remove(ROOT_INO, "a");
+
+        // The reader's late insert must not resurrect it
+        cache.insert_if_current(generation, ROOT_INO, "a", CachedDentry::Found(42));
+        assert_eq!(cache.get(ROOT_INO, "a"), None);
+
+        // A fresh read populates normally
+        let generation = cache.generation(ROOT_INO, "a");
+        cache.insert_if_current(generation, ROOT_INO, "a", CachedDentry::Found(42));
+        assert_eq!(cache.get(ROOT_INO, "a"), Some(CachedDentry::Found(42)));
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_dentry_cache_negative_entries() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+
+        // A miss is cached as a negative entry
+        assert!(fs.lookup(ROOT_INO, "later.txt").await?.is_none());
+        assert_eq!(
+            fs.dentry_cache.get(ROOT_INO, "later.txt"),
+            Some(CachedDentry::Missing)
+        );
+
+        // Creating the name invalidates the negative entry
+        let (stats, _file) = fs
+            .create_file("/later.txt", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        let found = fs.lookup(ROOT_INO, "later.txt").await?.unwrap();
+        assert_eq!(found.ino, stats.ino);
+
+        // Path-based creation must not leave a stale miss behind either
+        assert!(fs.stat("/other.txt").await?.is_none());
+        fs.pwrite("/other.txt", 0, b"x").await?;
+        assert!(fs.lookup(ROOT_INO, "other.txt").await?.is_some());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_dentry_cache_resize() -> Result<()> {
+        let cache = DentryCache::new(DENTRY_CACHE_SHARDS);
+        for i in 0..64 {
+            cache.insert(ROOT_INO, &format!("f{}", i), i);
+        }
+        cache.resize(DENTRY_CACHE_SHARDS * 2);
+        let cached = (0..64)
+            .filter(|i| cache.get(ROOT_INO, &format!("f{}", i)).is_some())
+            .count();
+        assert!(cached <= DENTRY_CACHE_SHARDS * 2);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_opendir_pages() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        for name in ["e", "b", "d", "a", "c"] {
+            fs.create_file(&format!("/{}", name), DEFAULT_FILE_MODE, 0, 0)
+                .await?;
+        }
+
+        let dir = FileSystem::opendir(&fs, ROOT_INO).await?.unwrap();
+        let names = |entries: Vec<DirEntry>| -> Vec<String> {
+            entries.into_iter().map(|e| e.name).collect()
+        };
+        assert_eq!(names(dir.next_entries(2).await?), ["a", "b"]);
+
+        // Entries sorting after the position show up in later pages
+        fs.create_file("/bb", DEFAULT_FILE_MODE, 0, 0).await?;
+        assert_eq!(names(dir.next_entries(2).await?), ["bb", "c"]);
+        assert_eq!(names(dir.next_entries(10).await?), ["d", "e"]);
+        assert!(dir.next_entries(10).await?.is_empty());
+
+        dir.rewind().await?;
+        assert_eq!(dir.next_entries(10).await?.len(), 6);
+
+        assert!(FileSystem::opendir(&fs, 9999).await?.is_none());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_prefetch_dir_warms_caches() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.mkdir("/hot", 0, 0).await?;
+        for i in 0..PREFETCH_PAGE_SIZE + 3 {
+            fs.create_file(&format!("/hot/{}", i), DEFAULT_FILE_MODE, 0, 0)
+                .await?;
+        }
+        let hot = fs.stat("/hot").await?.unwrap().ino;
+
+        let entries = fs.prefetch_dir(hot).await?.unwrap();
+        assert_eq!(entries.len(), PREFETCH_PAGE_SIZE + 3);
+
+        // Entries of every page are cached with their attributes
+        let last = entries.last().unwrap();
+        assert_eq!(
+            fs.dentry_cache.get(hot, &last.name),
+            Some(CachedDentry::Found(last.stats.ino))
+        );
+        assert!(fs.attr_cache.get(last.stats.ino).is_some());
+
+        // Writers still invalidate prefetched entries
+        FileSystem::unlink(&fs, hot, &last.name).await?;
+        assert!(fs.lookup(hot, &last.name).await?.is_none());
+
+        assert!(fs.prefetch_dir(9999).await?.is_none());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_attr_cache_write_through() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        let (stats, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+        let ino = stats.ino;
+
+        // The first getattr populates the cache
+        FileSystem::getattr(&fs, ino).await?.unwrap();
+        assert!(fs.attr_cache.get(ino).is_some());
+
+        // Metadata changes update the cached entry in place
+        FileSystem::chmod(&fs, ino, 0o600).await?;
+        FileSystem::chown(&fs, ino, Some(7), None).await?;
+        FileSystem::utimens(&fs, ino, TimeChange::Set(100, 5), TimeChange::Omit).await?;
+        let cached = fs.attr_cache.get(ino).unwrap();
+        assert_eq!(cached.mode, S_IFREG | 0o600);
+        assert_eq!(cached.uid, 7);
+        assert_eq!((cached.atime, cached.atime_nsec), (100, 5));
+
+        // So do data writes and truncation through a handle
+        file.pwrite(0, b"hello world").await?;
+        assert_eq!(fs.attr_cache.get(ino).unwrap().size, 11);
+        file.truncate(5).await?;
+        assert_eq!(file.fstat().await?.size, 5);
+
+        // The cache agrees with the database
+        let conn = fs.get_connection().await?;
+        let stored = fs.getattr_with_conn(&conn, ino).await?.unwrap();
+        drop(conn);
+        let cached = FileSystem::getattr(&fs, ino).await?.unwrap();
+        assert_eq!(cached.mode, stored.mode);
+        assert_eq!(cached.uid, stored.uid);
+        assert_eq!(cached.size, stored.size);
+        assert_eq!(
+            (cached.mtime, cached.mtime_nsec),
+            (stored.mtime, stored.mtime_nsec)
+        );
+
+        // Removing the file drops the entry
+        FileSystem::unlink(&fs, ROOT_INO, "a.txt").await?;
+        assert!(FileSystem::getattr(&fs, ino).await?.is_none());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_attr_cache_link_count() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        let root = FileSystem::getattr(&fs, ROOT_INO).await?.unwrap();
+
+        // Structural changes invalidate the parent's cached link count
+        FileSystem::mkdir(&fs, ROOT_INO, "sub", DEFAULT_DIR_MODE, 0, 0).await?;
+        let after = FileSystem::getattr(&fs, ROOT_INO).await?.unwrap();
+        assert_eq!(after.nlink, root.nlink + 1);
+
+        FileSystem::rmdir(&fs, ROOT_INO, "sub").await?;
+        let after = FileSystem::getattr(&fs, ROOT_INO).await?.unwrap();
+        assert_eq!(after.nlink, root.nlink);
+
+        Ok(())
+    }
+
+    // ==================== Write-Back Buffer Tests ====================
+
+    #[tokio::test]
+    async fn test_write_back_coalesces_until_flush() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.set_write_back(true);
+        let (stats, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+
+        // Many small sequential writes stay in memory
+        for i in 0..100u8 {
+            file.pwrite(i as u64 * 100, &[i; 100]).await?;
+        }
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 0);
+
+        // Reads and stats see the buffered data
+        let data = file.pread(4000, 200).await?;
+        assert_eq!(&data[..100], &[40u8; 100][..]);
+        assert_eq!(&data[100..], &[41u8; 100][..]);
+        assert_eq!(file.fstat().await?.size, 10000);
+        assert_eq!(fs.getattr(stats.ino).await?.unwrap().size, 10000);
+
+        // Flushing commits every chunk at once
+        file.flush().await?;
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, 3);
+        let content = fs.read_file("/a.txt").await?.unwrap();
+        assert_eq!(content.len(), 10000);
+        assert_eq!(&content[9900..], &[99u8; 100][..]);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_merges_with_committed_chunk() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        let (_, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, b"hello world").await?;
+        drop(file);
+
+        fs.set_write_back(true);
+        let file = fs.open("/a.txt").await?;
+        file.pwrite(6, b"there").await?;
+        assert_eq!(file.pread(0, 100).await?, b"hello there");
+
+        // Dropping the handle keeps the buffer for path-based reads
+        drop(file);
+        assert_eq!(fs.read_file("/a.txt").await?.unwrap(), b"hello there");
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_truncate_flushes_first() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.set_write_back(true);
+        let (_, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+
+        file.pwrite(0, &[b'x'; 5000]).await?;
+        file.truncate(10).await?;
+        assert_eq!(file.fstat().await?.size, 10);
+        assert_eq!(file.pread(0, 100).await?, vec![b'x'; 10]);
+
+        file.pwrite(20, b"y").await?;
+        let data = file.pread(0, 100).await?;
+        assert_eq!(data.len(), 21);
+        assert_eq!(&data[10..20], &[0u8; 10][..]);
+        assert_eq!(data[20], b'y');
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_path_truncate_commits_buffer_first() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.set_write_back(true);
+        let (_, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+
+        file.pwrite(0, &[b'x'; 5000]).await?;
+        fs.truncate("/a.txt", 10).await?;
+        assert_eq!(file.fstat().await?.size, 10);
+        assert_eq!(fs.read_file("/a.txt").await?.unwrap(), vec![b'x'; 10]);
+
+        // The buffered end was reset, so a write below it sets the size
+        file.pwrite(0, b"y").await?;
+        assert_eq!(file.fstat().await?.size, 10);
+        file.flush().await?;
+        let data = fs.read_file("/a.txt").await?.unwrap();
+        assert_eq!(data.len(), 10);
+        assert_eq!(data[0], b'y');
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_flushes_at_size_threshold() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.set_write_back(true);
+        let (stats, file) = fs.create_file("/a.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+
+        file.pwrite(0, &vec![1u8; WRITE_BUFFER_MAX_BYTES]).await?;
+        let expected = (WRITE_BUFFER_MAX_BYTES / fs.chunk_size()) as i64;
+        assert_eq!(fs.get_chunk_count(stats.ino).await?, expected);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_commits_in_background() -> Result<()> {
+        let (fs, _dir) = create_test_fs().await?;
+        fs.set_write_back(true);
+
+        // The flusher commits what an idle handle buffered
+        let (idle, file) = fs.create_file("/idle.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+        file.pwrite(0, b"idle").await?;
+        assert_eq!(fs.get_chunk_count(idle.ino).await?, 0);
+        tokio::time::sleep(WRITE_BUFFER_MAX_AGE * 3).await;
+        assert_eq!(fs.get_chunk_count(idle.ino).await?, 1);
+
+        // Dropping the last handle of a dirty buffer commits it
+        let (dropped, other) = fs
+            .create_file("/dropped.txt", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        other.pwrite(0, b"dropped").await?;
+        drop(other);
+        tokio::time::sleep(Duration::from_millis(200)).await;
+        assert_eq!(fs.get_chunk_count(dropped.ino).await?, 1);
+        assert!(fs.write_buffers.get(dropped.ino).is_none());
+
+        // Removing the last link drops the buffer along with the data
+        let (gone, other) = fs.create_file("/gone.txt", DEFAULT_FILE_MODE, 0, 0).await?;
+        other.pwrite(0, b"gone").await?;
+        fs.remove("/gone.txt").await?;
+        assert!(fs.write_buffers.get(gone.ino).is_none());
+        assert!(other.fstat().await.is_err());
+        drop(other);
+        assert_eq!(fs.get_chunk_count(gone.ino).await?, 0);
+
+        drop(file);
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_write_back_coalesces_large_chunks() -> Result<()> {
+        let db = Builder::new_local(":memory:").build().await?;
+        let fs =
+            AgentFS::from_pool_with_chunk_size(ConnectionPool::new(db), MAX_CHUNK_SIZE).await?;
+        fs.set_write_back(true);
+        let (stats, file) = fs.create_file("/a.bin", DEFAULT_FILE_MODE, 0, 0).await?;
+
+        // Writes of whole chunks stay buffered up to the chunk threshold
+        let chunk = vec![1u8; MAX_CHUNK_SIZE];
+        for i in 0..WRITE_BUFFER_MIN_CHUNKS as u64 - 1 {
+            file.pwrite(i * MAX_CHUNK_SIZE as u64, &chunk).await?;
+        }
+        let conn = fs.get_connection().await?;
+        assert_eq!(fs.chunk_store.count(&conn, stats.ino).await?, 0);
+        drop(conn);
+
+        let last = WRITE_BUFFER_MIN_CHUNKS as u64 - 1;
+        file.pwrite(last * MAX_CHUNK_SIZE as u64, &chunk).await?;
+        let conn = fs.get_connection().await?;
+        assert_eq!(
+            fs.chunk_store.count(&conn, stats.ino).await?,
+            WRITE_BUFFER_MIN_CHUNKS as i64
+        );
+
+        Ok(())
+    }
 }
@@ -0,0 +1,118 @@
+//! Background commits of write-back buffers.
+//!
+//! Buffered writes are committed by flushes, truncations and the writes that
+//! fill a buffer (see the write-back buffers). The flusher commits the rest:
+//! it starts when write-back is enabled and, every [`WRITE_BUFFER_MAX_AGE`],
+//! commits the buffers whose oldest write is at least that old, so the data
+//! written through a handle that then stays open idle still reaches the
+//! database, and with it auto-sync. It also drops the clean buffers no
+//! handle uses any more. It stops with the filesystem, or once write-back is
+//! disabled and no buffer is left.
+//!
+//! A buffer whose last handle is dropped while dirty doesn't wait for the
+//! flusher: it is committed straight away in a task of its own.
+
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+
+use super::super::chunks::ChunkStore;
+use super::{AgentFS, AttrCache, InodeWriteBuffer, WriteBuffers, WRITE_BUFFER_MAX_AGE};
+use crate::connection_pool::ConnectionPool;
+use crate::metrics::Counter;
+
+static BACKGROUND_FLUSHES: Counter = Counter::new("write_back.background_flushes");
+
+/// Start the flusher of `fs` on the current runtime, unless one is running.
+///
+/// Without a runtime buffers are only committed by flushes and writes.
+pub(super) fn start(fs: &AgentFS) {
+    if fs.write_buffers.flusher.swap(true, Ordering::AcqRel) {
+        return;
+    }
+    let Ok(runtime) = tokio::runtime::Handle::try_current() else {
+        fs.write_buffers.flusher.store(false, Ordering::Release);
+        return;
+    };
+    // Weak references, so an idle flusher doesn't keep the database open
+    let pool = fs.pool.downgrade();
+    let attrs = Arc::downgrade(&fs.attr_cache);
+    let buffers = Arc::downgrade(&fs.write_buffers);
+    let chunk_store = fs.chunk_store.clone();
+    runtime.spawn(async move {
+        loop {
+            tokio::time::sleep(WRITE_BUFFER_MAX_AGE).await;
+            let (Some(pool), Some(attrs), Some(buffers)) =
+                (pool.upgrade(), attrs.upgrade(), buffers.upgrade())
+            else {
+                return;
+            };
+            sweep(&pool, &chunk_store, &attrs, &buffers).await;
+
+            if !buffers.enabled.load(Ordering::Relaxed) && buffers.is_empty() {
+                buffers.flusher.store(false, Ordering::Release);
+                // Write-back may have been enabled again meanwhile
+                if !buffers.enabled.load(Ordering::Relaxed)
+                    || buffers.flusher.swap(true, Ordering::AcqRel)
+                {
+                    return;
+                }
+            }
+        }
+    });
+}
+
+/// Commit the buffers dirty for [`WRITE_BUFFER_MAX_AGE`] or more, then drop
+/// the clean ones no handle uses
+async fn sweep(
+    pool: &ConnectionPool,
+    chunk_store: &ChunkStore,
+    attrs: &AttrCache,
+    buffers: &WriteBuffers,
+) {
+    let stale: Vec<(i64, Arc<InodeWriteBuffer>)> = buffers
+        .inodes
+        .lock()
+        .unwrap()
+        .iter()
+        .filter(|(_, buffer)| buffer.is_dirty_for(WRITE_BUFFER_MAX_AGE))
+        .map(|(ino, buffer)| (*ino, buffer.clone()))
+        .collect();
+    for (ino, buffer) in stale {
+        match buffer.flush(pool, chunk_store, attrs, ino).await {
+            Ok(()) => BACKGROUND_FLUSHES.increment(),
+            // Left buffered for the next sweep
+            Err(e) => tracing::warn!("Failed to commit buffered writes of inode {}: {}", ino, e),
+        }
+    }
+    buffers.prune();
+}
+
+/// Commit the buffer of `ino` after its last handle was dropped with it
+/// dirty, on the current runtime.
+///
+/// Without a runtime the buffer is left to the next flush of the inode.
+pub(super) fn flush_released(
+    pool: &ConnectionPool,
+    chunk_store: &ChunkStore,
+    attrs: &Arc<AttrCache>,
+    buffers: &Arc<WriteBuffers>,
+    ino: i64,
+    buffer: Arc<InodeWriteBuffer>,
+) {
+    let Ok(runtime) = tokio::runtime::Handle::try_current() else {
+        return;
+    };
+    let pool = pool.clone();
+    let chunk_store = chunk_store.clone();
+    let attrs = attrs.clone();
+    let buffers = buffers.clone();
+    runtime.spawn(async move {
+        match buffer.flush(&pool, &chunk_store, &attrs, ino).await {
+            Ok(()) => BACKGROUND_FLUSHES.increment(),
+            // Left buffered for the flusher
+            Err(e) => tracing::warn!("Failed to commit buffered writes of inode {}: {}", ino, e),
+        }
+        drop(buffer);
+        buffers.prune();
+    });
+}
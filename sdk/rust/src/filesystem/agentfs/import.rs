@@ -0,0 +1,666 @@
+//! Bulk import of a host directory tree.
+//!
+//! [`AgentFS::import_tree()`] seeds a filesystem from a host directory far
+//! faster than creating its files one at a time. The host tree is listed by
+//! a pool of threads, one level of directories at a time, and files are read
+//! and their chunks encoded on blocking threads ahead of the writer. The
+//! writer stores everything in large transactions, with entries and chunks
+//! inserted many rows per statement.
+
+use std::collections::VecDeque;
+use std::os::unix::fs::{FileExt, MetadataExt};
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::{Instant, SystemTime, UNIX_EPOCH};
+
+use tokio::task::JoinHandle;
+use turso::transaction::{Transaction, TransactionBehavior};
+use turso::Value;
+
+use super::super::chunks::{ChunkStore, PreparedChunk};
+use super::super::{FsError, MAX_NAME_LEN, S_IFDIR, S_IFMT, S_IFREG};
+use super::AgentFS;
+use crate::connection_pool::PooledConnection;
+use crate::error::{Error, Result};
+
+/// Entries after which an import commits its transaction
+const IMPORT_BATCH_ENTRIES: usize = 10_000;
+/// Bytes of file data after which an import commits its transaction
+const IMPORT_BATCH_BYTES: usize = 64 * 1024 * 1024;
+/// Files read ahead of the writer, per thread of the host
+const READ_AHEAD_PER_THREAD: usize = 4;
+/// Bytes of files read ahead of the writer, at most
+const READ_AHEAD_BYTES: u64 = 64 * 1024 * 1024;
+/// Files larger than this are read by the writer in pieces of about this
+/// size, instead of whole by a read-ahead thread
+const LARGE_FILE_SIZE: u64 = 8 * 1024 * 1024;
+/// Directory entries per multi-row insert
+const DENTRY_INSERT_ROWS: usize = 256;
+
+/// What [`AgentFS::import_tree()`] added to the filesystem
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct ImportStats {
+    /// Directories, files, symlinks and special files created
+    pub entries: u64,
+    /// Bytes of file data stored
+    pub bytes: u64,
+}
+
+/// Metadata of a host file, as stored in its inode
+#[derive(Debug, Clone, Copy)]
+struct HostMeta {
+    mode: u32,
+    uid: u32,
+    gid: u32,
+    size: u64,
+    rdev: u64,
+    atime: (i64, i64),
+    mtime: (i64, i64),
+    ctime: (i64, i64),
+}
+
+impl From<&std::fs::Metadata> for HostMeta {
+    fn from(metadata: &std::fs::Metadata) -> Self {
+        Self {
+            mode: metadata.mode(),
+            uid: metadata.uid(),
+            gid: metadata.gid(),
+            size: metadata.size(),
+            rdev: metadata.rdev(),
+            atime: (metadata.atime(), metadata.atime_nsec()),
+            mtime: (metadata.mtime(), metadata.mtime_nsec()),
+            ctime: (metadata.ctime(), metadata.ctime_nsec()),
+        }
+    }
+}
+
+/// A host file found by the walk
+struct HostEntry {
+    /// Index of the parent directory in the walk, `None` at the top
+    parent: Option<usize>,
+    name: String,
+    path: PathBuf,
+    meta: HostMeta,
+    /// Target of a symlink
+    target: Option<String>,
+    /// Subdirectories of a directory
+    subdirs: u32,
+}
+
+impl HostEntry {
+    fn file_type(&self) -> u32 {
+        self.meta.mode & S_IFMT
+    }
+
+    /// Whether a read-ahead thread reads the whole file
+    fn reads_ahead(&self) -> bool {
+        self.file_type() == S_IFREG && self.meta.size <= LARGE_FILE_SIZE
+    }
+}
+
+/// Host directory entry as `(name, metadata, symlink target)`
+type Listing = Vec<(String, HostMeta, Option<String>)>;
+
+/// List the tree under `root`, parents before their children, with
+/// `threads` threads listing the directories of each level.
+fn walk(root: &Path, threads: usize) -> Result<Vec<HostEntry>> {
+    let mut entries: Vec<HostEntry> = Vec::new();
+    // Directories of the current level, as index in `entries` and path
+    let mut level: Vec<(Option<usize>, PathBuf)> = vec![(None, root.to_path_buf())];
+    while !level.is_empty() {
+        let listings = list_dirs(&level, threads)?;
+        let mut next = Vec::new();
+        for ((parent, dir), listing) in level.into_iter().zip(listings) {
+            for (name, meta, target) in listing {
+                let path = dir.join(&name);
+                if meta.mode & S_IFMT == S_IFDIR {
+                    if let Some(parent) = parent {
+                        entries[parent].subdirs += 1;
+                    }
+                    next.push((Some(entries.len()), path.clone()));
+                }
+                entries.push(HostEntry {
+                    parent,
+                    name,
+                    path,
+                    meta,
+                    target,
+                    subdirs: 0,
+                });
+            }
+        }
+        level = next;
+    }
+    Ok(entries)
+}
+
+/// List `dirs` on up to `threads` threads, in order
+fn list_dirs(dirs: &[(Option<usize>, PathBuf)], threads: usize) -> Result<Vec<Listing>> {
+    let per_thread = dirs.len().div_ceil(threads.max(1));
+    std::thread::scope(|scope| {
+        let workers: Vec<_> = dirs
+            .chunks(per_thread)
+            .map(|part| {
+                scope.spawn(move || {
+                    part.iter()
+                        .map(|(_, dir)| list_dir(dir))
+                        .collect::<Result<Vec<_>>>()
+                })
+            })
+            .collect();
+        let mut listings = Vec::with_capacity(dirs.len());
+        for worker in workers {
+            let part = worker
+                .join()
+                .map_err(|_| Error::Internal("import walker panicked".to_string()))?;
+            listings.extend(part?);
+        }
+        Ok(listings)
+    })
+}
+
+/// List the entries of `dir`, sorted by name
+fn list_dir(dir: &Path) -> Result<Listing> {
+    let utf8 = |path: &Path, name: std::ffi::OsString| {
+        name.into_string().map_err(|name| {
+            Error::Internal(format!(
+                "{}: name is not valid UTF-8",
+                path.join(name).display()
+            ))
+        })
+    };
+
+    let mut listing = Vec::new();
+    for entry in std::fs::read_dir(dir)? {
+        let entry = entry?;
+        let name = utf8(dir, entry.file_name())?;
+        if name.len() > MAX_NAME_LEN {
+            return Err(FsError::NameTooLong.into());
+        }
+        // Doesn't follow symlinks
+        let metadata = entry.metadata()?;
+        let target = if metadata.file_type().is_symlink() {
+            let target = std::fs::read_link(entry.path())?;
+            Some(utf8(dir, target.into_os_string())?)
+        } else {
+            None
+        };
+        listing.push((name, HostMeta::from(&metadata), target));
+    }
+    listing.sort_by(|a, b| a.0.cmp(&b.0));
+    Ok(listing)
+}
+
+/// Read the file at `path` and prepare its chunks
+fn read_chunks(
+    path: &Path,
+    chunk_store: &ChunkStore,
+    chunk_size: usize,
+) -> Result<Vec<PreparedChunk>> {
+    let data = std::fs::read(path)?;
+    Ok(split_chunks(data, chunk_store, chunk_size))
+}
+
+/// Prepare the chunks of `data`, the first one at a chunk boundary
+fn split_chunks(data: Vec<u8>, chunk_store: &ChunkStore, chunk_size: usize) -> Vec<PreparedChunk> {
+    if data.is_empty() {
+        Vec::new()
+    } else if data.len() <= chunk_size {
+        vec![chunk_store.prepare(data)]
+    } else {
+        data.chunks(chunk_size)
+            .map(|chunk| chunk_store.prepare(chunk.to_vec()))
+            .collect()
+    }
+}
+
+fn join_error(e: tokio::task::JoinError) -> Error {
+    Error::Internal(e.to_string())
+}
+
+/// Rows of an import not yet written, and the size of its transaction
+#[derive(Default)]
+struct ImportBatch {
+    dentries: Vec<(String, i64, i64)>,
+    chunks: Vec<(i64, i64, PreparedChunk)>,
+    /// Entries and links the batch adds to the directory imported into
+    root_entries: usize,
+    root_links: i64,
+    entries: usize,
+    bytes: usize,
+}
+
+impl ImportBatch {
+    fn is_full(&self) -> bool {
+        self.entries >= IMPORT_BATCH_ENTRIES || self.bytes >= IMPORT_BATCH_BYTES
+    }
+
+    /// Write out the buffered directory entries and chunks
+    async fn write(&mut self, conn: &PooledConnection, chunk_store: &ChunkStore) -> Result<()> {
+        for rows in self.dentries.chunks(DENTRY_INSERT_ROWS) {
+            let sql = format!(
+                "INSERT INTO fs_dentry (name, parent_ino, ino) VALUES {}",
+                vec!["(?, ?, ?)"; rows.len()].join(", ")
+            );
+            let params: Vec<Value> = rows
+                .iter()
+                .flat_map(|(name, parent_ino, ino)| {
+                    [
+                        Value::Text(name.clone()),
+                        Value::Integer(*parent_ino),
+                        Value::Integer(*ino),
+                    ]
+                })
+                .collect();
+            let mut stmt = conn.prepare_cached(&sql).await?;
+            stmt.execute(params).await?;
+            stmt.reset()?;
+        }
+        self.dentries.clear();
+        chunk_store
+            .insert_many(conn, std::mem::take(&mut self.chunks))
+            .await
+    }
+
+    /// Write out the batch and the links it adds to `root_ino`, and commit
+    async fn commit(
+        &mut self,
+        conn: &PooledConnection,
+        txn: Transaction<'_>,
+        chunk_store: &ChunkStore,
+        root_ino: i64,
+    ) -> Result<()> {
+        self.write(conn, chunk_store).await?;
+        if self.root_entries > 0 {
+            let dur = SystemTime::now().duration_since(UNIX_EPOCH)?;
+            let now_secs = dur.as_secs() as i64;
+            let now_nsec = dur.subsec_nanos() as i64;
+            let mut stmt = conn
+                .prepare_cached(
+                    "UPDATE fs_inode SET nlink = nlink + ?, ctime = ?, mtime = ?, ctime_nsec = ?, mtime_nsec = ? WHERE ino = ?",
+                )
+                .await?;
+            stmt.execute((
+                self.root_links,
+                now_secs,
+                now_secs,
+                now_nsec,
+                now_nsec,
+                root_ino,
+            ))
+            .await?;
+            stmt.reset()?;
+        }
+        txn.commit().await?;
+        *self = Self::default();
+        Ok(())
+    }
+}
+
+impl AgentFS {
+    /// Copy the tree under the host directory `host_dir` into the directory
+    /// at `path`, keeping modes, ownership and timestamps.
+    ///
+    /// Much faster than creating the files one by one: the host tree is
+    /// listed and read on a pool of threads, and the writer stores entries
+    /// and chunks in large transactions with multi-row inserts. Symlinks are
+    /// copied as symlinks and special files as inodes; hard links become
+    /// separate files, like `cp -R` makes them.
+    ///
+    /// Fails with [`FsError::AlreadyExists`] before writing anything if an
+    /// entry at the top of `host_dir` exists in `path`. The import is not
+    /// atomic: an error while reading the host tree leaves the transactions
+    /// committed so far.
+    pub async fn import_tree(&self, host_dir: impl AsRef<Path>, path: &str) -> Result<ImportStats> {
+        let started = Instant::now();
+        let threads = std::thread::available_parallelism().map_or(4, |n| n.get());
+        let root = host_dir.as_ref().to_path_buf();
+        let entries = tokio::task::spawn_blocking(move || walk(&root, threads))
+            .await
+            .map_err(join_error)??;
+
+        let conn = self.pool.get_connection().await?;
+        let path = self.normalize_path(path);
+        let root_ino = self
+            .resolve_path_with_conn(&conn, &path)
+            .await?
+            .ok_or(FsError::NotFound)?;
+        self.check_directory(&conn, root_ino).await?;
+        for entry in entries.iter().take_while(|entry| entry.parent.is_none()) {
+            if self
+                .lookup_child(&conn, root_ino, &entry.name)
+                .await?
+                .is_some()
+            {
+                return Err(FsError::AlreadyExists.into());
+            }
+        }
+
+        let entries = Arc::new(entries);
+        let result = self
+            .import_entries(&conn, root_ino, entries.clone(), threads)
+            .await;
+
+        // Entries at the top may have been cached as missing
+        let top = entries.iter().take_while(|entry| entry.parent.is_none());
+        match &result {
+            Ok((_, inos)) => {
+                for (entry, ino) in top.zip(inos) {
+                    self.dentry_cache.insert(root_ino, &entry.name, *ino);
+                }
+            }
+            Err(_) => {
+                for entry in top {
+                    self.dentry_cache.remove(root_ino, &entry.name);
+                }
+            }
+        }
+        self.attr_cache.remove(root_ino);
+
+        let (stats, _) = result?;
+        tracing::debug!(
+            "Imported {} entries ({} bytes) in {:?}",
+            stats.entries,
+            stats.bytes,
+            started.elapsed()
+        );
+        Ok(stats)
+    }
+
+    /// Store the walked `entries` under `root_ino`, returning what was added
+    /// and the inode of each entry
+    async fn import_entries(
+        &self,
+        conn: &PooledConnection,
+        root_ino: i64,
+        entries: Arc<Vec<HostEntry>>,
+        threads: usize,
+    ) -> Result<(ImportStats, Vec<i64>)> {
+        let chunk_store = &self.chunk_store;
+
+        // Files being read ahead of the writer, in walk order
+        let mut reads: VecDeque<(usize, JoinHandle<Result<Vec<PreparedChunk>>>)> = VecDeque::new();
+        let mut reads_bytes = 0u64;
+        let mut next_read = 0;
+        let max_reads = threads * READ_AHEAD_PER_THREAD;
+
+        let mut inos = vec![0i64; entries.len()];
+        let mut stats = ImportStats::default();
+        let mut batch = ImportBatch::default();
+        let mut txn = Some(Transaction::new_unchecked(conn, TransactionBehavior::Immediate).await?);
+
+        for (i, entry) in entries.iter().enumerate() {
+            while next_read < entries.len()
+                && reads.len() < max_reads
+                && (reads.is_empty() || reads_bytes < READ_AHEAD_BYTES)
+            {
+                let index = next_read;
+                next_read += 1;
+                if !entries[index].reads_ahead() {
+                    continue;
+                }
+                reads_bytes += entries[index].meta.size;
+                let chunk_size = chunk_store.size_class(entries[index].meta.size);
+                let entries = entries.clone();
+                let chunk_store = chunk_store.clone();
+                let read = tokio::task::spawn_blocking(move || {
+                    read_chunks(&entries[index].path, &chunk_store, chunk_size)
+                });
+                reads.push_back((index, read));
+            }
+
+            let chunks = if entry.reads_ahead() {
+                let (index, read) = reads.pop_front().expect("file read ahead");
+                debug_assert_eq!(index, i);
+                reads_bytes -= entry.meta.size;
+                Some(read.await.map_err(join_error)??)
+            } else {
+                None
+            };
+
+            let file_type = entry.file_type();
+            let (nlink, size) = match (file_type, &chunks, &entry.target) {
+                (S_IFDIR, ..) => (2 + entry.subdirs as i64, 0),
+                (_, Some(chunks), _) => (
+                    1,
+                    chunks.iter().map(PreparedChunk::len).sum::<usize>() as u64,
+                ),
+                (_, _, Some(target)) => (1, target.len() as u64),
+                _ => (
+                    1,
+                    if file_type == S_IFREG {
+                        entry.meta.size
+                    } else {
+                        0
+                    },
+                ),
+            };
+            let meta = &entry.meta;
+            let mut stmt = conn
+                .prepare_cached(
+                    "INSERT INTO fs_inode (mode, nlink, uid, gid, size, atime, mtime, ctime, rdev, atime_nsec, mtime_nsec, ctime_nsec)
+                     VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?) RETURNING ino",
+                )
+                .await?;
+            let row = stmt
+                .query_row((
+                    meta.mode as i64,
+                    nlink,
+                    meta.uid,
+                    meta.gid,
+                    size as i64,
+                    meta.atime.0,
+                    meta.mtime.0,
+                    meta.ctime.0,
+                    meta.rdev as i64,
+                    meta.atime.1,
+                    meta.mtime.1,
+                    meta.ctime.1,
+                ))
+                .await?;
+            let ino = row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .ok_or_else(|| Error::Internal("failed to get inode".to_string()))?;
+            inos[i] = ino;
+            if file_type == S_IFREG {
+                let chunk_size = chunk_store.size_class(meta.size);
+                if chunk_size != chunk_store.base_chunk_size() {
+                    chunk_store.set_chunk_size(conn, ino, chunk_size).await?;
+                }
+            }
+
+            let parent_ino = match entry.parent {
+                Some(parent) => inos[parent],
+                None => {
+                    batch.root_entries += 1;
+                    if file_type == S_IFDIR {
+                        batch.root_links += 1;
+                    }
+                    root_ino
+                }
+            };
+            batch.dentries.push((entry.name.clone(), parent_ino, ino));
+            batch.entries += 1;
+            stats.entries += 1;
+
+            if let Some(target) = &entry.target {
+                let mut stmt = conn
+                    .prepare_cached("INSERT INTO fs_symlink (ino, target) VALUES (?, ?)")
+                    .await?;
+                stmt.execute((ino, target.as_str())).await?;
+                stmt.reset()?;
+            }
+
+            if let Some(chunks) = chunks {
+                stats.bytes += size;
+                batch.bytes += size as usize;
+                batch
+                    .chunks
+                    .extend((0..).zip(chunks).map(|(index, chunk)| (ino, index, chunk)));
+            } else if file_type == S_IFREG {
+                // Large files are stored a piece at a time
+                let read = self
+                    .import_large_file(conn, &mut txn, &mut batch, root_ino, entry, ino)
+                    .await?;
+                stats.bytes += read;
+                if read != size {
+                    let mut stmt = conn
+                        .prepare_cached("UPDATE fs_inode SET size = ? WHERE ino = ?")
+                        .await?;
+                    stmt.execute((read as i64, ino)).await?;
+                    stmt.reset()?;
+                }
+            }
+
+            if batch.dentries.len() >= DENTRY_INSERT_ROWS {
+                batch.write(conn, chunk_store).await?;
+            }
+            if batch.is_full() {
+                let full = txn.take().expect("import transaction");
+                batch.commit(conn, full, chunk_store, root_ino).await?;
+                txn = Some(Transaction::new_unchecked(conn, TransactionBehavior::Immediate).await?);
+            }
+        }
+
+        let last = txn.take().expect("import transaction");
+        batch.commit(conn, last, chunk_store, root_ino).await?;
+        Ok((stats, inos))
+    }
+
+    /// Store the data of the large host file of `entry` as inode `ino`, in
+    /// pieces read on a blocking thread, committing `batch` when it fills.
+    ///
+    /// Returns the bytes stored.
+    async fn import_large_file<'a>(
+        &self,
+        conn: &'a PooledConnection,
+        txn: &mut Option<Transaction<'a>>,
+        batch: &mut ImportBatch,
+        root_ino: i64,
+        entry: &HostEntry,
+        ino: i64,
+    ) -> Result<u64> {
+        let chunk_store = &self.chunk_store;
+        let chunk_size = chunk_store.size_class(entry.meta.size);
+        let piece_size = (LARGE_FILE_SIZE as usize / chunk_size).max(1) * chunk_size;
+        let path = entry.path.clone();
+        let file = Arc::new(
+            tokio::task::spawn_blocking(move || std::fs::File::open(path))
+                .await
+                .map_err(join_error)??,
+        );
+
+        let mut offset = 0u64;
+        loop {
+            let file = file.clone();
+            let data = tokio::task::spawn_blocking(move || -> Result<Vec<u8>> {
+                let mut data = vec![0u8; piece_size];
+                let mut len = 0;
+                while len < data.len() {
+                    match file.read_at(&mut data[len..], offset + len as u64)? {
+                        0 => break,
+                        n => len += n,
+                    }
+                }
+                data.truncate(len);
+                Ok(data)
+            })
+            .await
+            .map_err(join_error)??;
+            if data.is_empty() {
+                break;
+            }
+
+            let first = (offset / chunk_size as u64) as i64;
+            let len = data.len();
+            let piece_store = chunk_store.clone();
+            let chunks =
+                tokio::task::spawn_blocking(move || split_chunks(data, &piece_store, chunk_size))
+                    .await
+                    .map_err(join_error)?;
+            batch.chunks.extend(
+                (first..)
+                    .zip(chunks)
+                    .map(|(index, chunk)| (ino, index, chunk)),
+            );
+            batch.bytes += len;
+            offset += len as u64;
+
+            if batch.is_full() {
+                let full = txn.take().expect("import transaction");
+                batch.commit(conn, full, chunk_store, root_ino).await?;
+                *txn =
+                    Some(Transaction::new_unchecked(conn, TransactionBehavior::Immediate).await?);
+            }
+            if len < piece_size {
+                break;
+            }
+        }
+        Ok(offset)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::tempdir;
+
+    #[tokio::test]
+    async fn test_import_tree() -> Result<()> {
+        let host = tempdir()?;
+        std::fs::create_dir_all(host.path().join("src/nested"))?;
+        std::fs::create_dir(host.path().join("empty"))?;
+        std::fs::write(host.path().join("README.md"), b"hello")?;
+        std::fs::write(host.path().join("src/empty.rs"), b"")?;
+        std::fs::write(host.path().join("src/nested/lib.rs"), b"fn main() {}")?;
+        std::os::unix::fs::symlink("src/nested/lib.rs", host.path().join("link"))?;
+        // Read by the writer in pieces
+        let large: Vec<u8> = (0..LARGE_FILE_SIZE as usize + 5000)
+            .map(|i| (i % 253) as u8)
+            .collect();
+        std::fs::write(host.path().join("src/large.bin"), &large)?;
+
+        let dir = tempdir()?;
+        let fs = AgentFS::new(dir.path().join("test.db").to_str().unwrap()).await?;
+        fs.mkdir("/project", 0, 0).await?;
+
+        let stats = fs.import_tree(host.path(), "/project").await?;
+        assert_eq!(stats.entries, 8);
+        assert_eq!(stats.bytes, 5 + 12 + large.len() as u64);
+
+        assert_eq!(fs.read_file("/project/README.md").await?.unwrap(), b"hello");
+        assert_eq!(
+            fs.read_file("/project/src/nested/lib.rs").await?.unwrap(),
+            b"fn main() {}"
+        );
+        assert_eq!(
+            fs.read_file("/project/src/large.bin").await?.unwrap(),
+            large
+        );
+        assert!(fs
+            .read_file("/project/src/empty.rs")
+            .await?
+            .unwrap()
+            .is_empty());
+        assert_eq!(
+            fs.readlink("/project/link").await?.as_deref(),
+            Some("src/nested/lib.rs")
+        );
+
+        // Directories count the links of their subdirectories
+        let project = fs.stat("/project").await?.unwrap();
+        assert_eq!(project.nlink, 4);
+        assert_eq!(fs.stat("/project/src").await?.unwrap().nlink, 3);
+        let readme = fs.stat("/project/README.md").await?.unwrap();
+        let host_readme = std::fs::metadata(host.path().join("README.md"))?;
+        assert_eq!(readme.mode, host_readme.mode());
+        assert_eq!(readme.mtime, host_readme.mtime());
+
+        // Entries at the top must not exist yet
+        let result = fs.import_tree(host.path(), "/project").await;
+        assert!(matches!(result, Err(Error::Fs(FsError::AlreadyExists))));
+        Ok(())
+    }
+}
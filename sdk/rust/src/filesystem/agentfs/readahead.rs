@@ -0,0 +1,275 @@
+//! Read-ahead of files read sequentially through a handle.
+//!
+//! The kernel reads a file in requests of 128 KiB at most, and each
+//! `pread()` looks up exactly the chunks it covers. Once a handle is read
+//! sequentially, each read also starts reading the chunks after it in the
+//! background, so the next reads find them already there. The window read
+//! ahead starts at the size of the read and doubles while the reads stay
+//! sequential, up to [`READAHEAD_MAX_BYTES`].
+//!
+//! Only committed chunks are read ahead, along with the size and times the
+//! inode had. Every write, truncation or change of times changes these, and
+//! chunks read at other ones are dropped. Buffered chunks are still laid
+//! over the committed ones by the read itself.
+
+use std::sync::Mutex;
+
+use tokio::task::JoinHandle;
+
+use super::AgentFSFile;
+use crate::connection_pool::PooledConnection;
+use crate::error::Result;
+use crate::metrics::Counter;
+
+/// Bytes read ahead of a sequential reader, at most
+const READAHEAD_MAX_BYTES: u64 = 1024 * 1024;
+
+static HITS: Counter = Counter::new("readahead.hits");
+static MISSES: Counter = Counter::new("readahead.misses");
+
+/// Size, mtime, mtime_nsec, ctime and ctime_nsec of an inode, which change
+/// along with its data
+pub(super) type Stamp = [i64; 5];
+
+/// Committed chunks `first..=last` of a file, read at `stamp`
+struct Window {
+    stamp: Stamp,
+    first: i64,
+    last: i64,
+    /// The chunks present in the range, by index; the others are holes
+    chunks: Vec<(i64, Vec<u8>)>,
+}
+
+impl Window {
+    fn covers(&self, stamp: &Stamp, first: i64, last: i64) -> bool {
+        self.stamp == *stamp && self.first <= first && last <= self.last
+    }
+
+    /// Chunks `first..=last`, dropping those before `last`, which a
+    /// sequential reader is past
+    fn take(&mut self, first: i64, last: i64) -> Vec<(i64, Vec<u8>)> {
+        let start = self.chunks.partition_point(|(index, _)| *index < first);
+        let end = self.chunks.partition_point(|(index, _)| *index < last);
+        let mut chunks: Vec<_> = self.chunks.drain(..end).skip(start).collect();
+        // The next read may start within the last chunk
+        if let Some(chunk) = self.chunks.first().filter(|(index, _)| *index == last) {
+            chunks.push(chunk.clone());
+        }
+        self.first = last;
+        chunks
+    }
+
+    /// Append the window right after this one, or replace this one
+    fn extend(&mut self, next: Window) {
+        if next.stamp == self.stamp && next.first == self.last + 1 {
+            self.last = next.last;
+            self.chunks.extend(next.chunks);
+        } else {
+            *self = next;
+        }
+    }
+}
+
+/// A window being read ahead
+struct Loading {
+    stamp: Stamp,
+    first: i64,
+    last: i64,
+    task: JoinHandle<Result<Window>>,
+}
+
+/// Read-ahead state of a file handle
+#[derive(Default)]
+pub(super) struct ReadAhead {
+    state: Mutex<State>,
+}
+
+#[derive(Default)]
+struct State {
+    /// Offset the next sequential read starts at
+    next_offset: u64,
+    /// Bytes to keep read ahead, zero until reads are sequential
+    window: u64,
+    ready: Option<Window>,
+    loading: Option<Loading>,
+}
+
+impl Drop for ReadAhead {
+    fn drop(&mut self) {
+        if let Ok(state) = self.state.get_mut() {
+            if let Some(loading) = state.loading.take() {
+                loading.task.abort();
+            }
+        }
+    }
+}
+
+impl AgentFSFile {
+    /// Committed chunks `first..=last` for a read of `size` bytes at
+    /// `offset`, served from read-ahead where possible, given the inode's
+    /// `stamp`, `file_size` and `chunk_size`.
+    #[allow(clippy::too_many_arguments)]
+    pub(super) async fn read_chunks(
+        &self,
+        conn: &PooledConnection,
+        stamp: Stamp,
+        offset: u64,
+        size: u64,
+        file_size: u64,
+        chunk_size: u64,
+        first: i64,
+        last: i64,
+    ) -> Result<Vec<(i64, Vec<u8>)>> {
+        let (sequential, loading) = {
+            let mut state = self.readahead.state.lock().unwrap();
+            let sequential = offset == state.next_offset;
+            state.next_offset = offset + size;
+            state.window = if sequential {
+                (state.window * 2).max(size).min(READAHEAD_MAX_BYTES)
+            } else {
+                0
+            };
+            // Wait for the window being read if this read needs it, and give
+            // up on it if it is already stale
+            let loading = match state.loading.take() {
+                Some(loading) if loading.stamp != stamp => {
+                    loading.task.abort();
+                    None
+                }
+                Some(loading) if loading.first <= last && first <= loading.last => Some(loading),
+                other => {
+                    state.loading = other;
+                    None
+                }
+            };
+            (sequential, loading)
+        };
+        if let Some(loading) = loading {
+            if let Ok(Ok(window)) = loading.task.await {
+                let mut state = self.readahead.state.lock().unwrap();
+                match &mut state.ready {
+                    Some(ready) => ready.extend(window),
+                    ready => *ready = Some(window),
+                }
+            }
+        }
+
+        let cached = {
+            let mut state = self.readahead.state.lock().unwrap();
+            if state
+                .ready
+                .as_ref()
+                .is_some_and(|ready| ready.stamp != stamp)
+            {
+                state.ready = None;
+            }
+            state
+                .ready
+                .as_mut()
+                .filter(|ready| ready.covers(&stamp, first, last))
+                .map(|ready| ready.take(first, last))
+        };
+        let chunks = match cached {
+            Some(chunks) => {
+                HITS.increment();
+                chunks
+            }
+            None => {
+                if sequential {
+                    MISSES.increment();
+                }
+                self.chunk_store
+                    .read_range(conn, self.ino, first, last)
+                    .await?
+            }
+        };
+
+        if sequential {
+            self.read_ahead(stamp, last, file_size, chunk_size);
+        }
+        Ok(chunks)
+    }
+
+    /// Start reading the window of `chunk_size` byte chunks after chunk
+    /// `last`, unless enough of it is ready or being read already
+    fn read_ahead(&self, stamp: Stamp, last: i64, file_size: u64, chunk_size: u64) {
+        let last_chunk = (file_size.saturating_sub(1) / chunk_size) as i64;
+        let mut state = self.readahead.state.lock().unwrap();
+        if state.loading.is_some() {
+            return;
+        }
+        let window_chunks = state.window.div_ceil(chunk_size).max(1) as i64;
+        let ready_last = state
+            .ready
+            .as_ref()
+            .filter(|ready| ready.stamp == stamp && ready.first <= last + 1)
+            .map_or(last, |ready| ready.last.max(last));
+        // Keep at least half a window ahead of the reader
+        if ready_last - last >= window_chunks / 2 + 1 || ready_last >= last_chunk {
+            return;
+        }
+
+        let first = ready_last + 1;
+        let end = (ready_last + window_chunks).min(last_chunk);
+        let pool = self.pool.clone();
+        let chunk_store = self.chunk_store.clone();
+        let ino = self.ino;
+        let task = tokio::spawn(async move {
+            let conn = pool.get_read_connection().await?;
+            let chunks = chunk_store.read_range(&conn, ino, first, end).await?;
+            Ok(Window {
+                stamp,
+                first,
+                last: end,
+                chunks,
+            })
+        });
+        state.loading = Some(Loading {
+            stamp,
+            first,
+            last: end,
+            task,
+        });
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn window(first: i64, last: i64, present: &[i64]) -> Window {
+        Window {
+            stamp: [4096, 1, 2, 3, 4],
+            first,
+            last,
+            chunks: present.iter().map(|&i| (i, vec![i as u8])).collect(),
+        }
+    }
+
+    #[test]
+    fn test_window_take_and_extend() {
+        let mut ready = window(0, 7, &[0, 1, 2, 5, 6, 7]);
+        let stamp = ready.stamp;
+        assert!(ready.covers(&stamp, 0, 3));
+        assert!(!ready.covers(&[0, 1, 2, 3, 4], 0, 3));
+        assert!(!ready.covers(&stamp, 4, 8));
+
+        // Holes stay holes, and the last chunk is kept for the next read
+        let chunks = ready.take(0, 3);
+        let indexes: Vec<i64> = chunks.iter().map(|(i, _)| *i).collect();
+        assert_eq!(indexes, [0, 1, 2]);
+        assert!(ready.covers(&stamp, 3, 7));
+        assert!(!ready.covers(&stamp, 2, 7));
+        let chunks = ready.take(3, 5);
+        let indexes: Vec<i64> = chunks.iter().map(|(i, _)| *i).collect();
+        assert_eq!(indexes, [5]);
+        assert_eq!(ready.chunks.len(), 3);
+
+        // The next window is appended, anything else replaces it
+        ready.extend(window(8, 9, &[9]));
+        assert!(ready.covers(&stamp, 5, 9));
+        ready.extend(window(20, 21, &[]));
+        assert!(!ready.covers(&stamp, 5, 9));
+        assert!(ready.covers(&stamp, 20, 21));
+    }
+}
@@ -0,0 +1,104 @@
+//! Background reclamation of the data of removed and truncated files.
+//!
+//! In a filesystem created with deferred reclamation, removing the last link
+//! to a large file, or truncating one, only queues its chunks for the reaper
+//! (see the chunk storage). The reaper frees them
+//! in batches of [`REAP_BATCH_CHUNKS`], one short transaction each with a
+//! pause after it, so requests waiting for the writer connection get their
+//! turn between batches. It starts when chunks are queued, or when a
+//! filesystem with chunks still queued from before a crash is opened, and
+//! stops once nothing is left.
+
+use std::sync::atomic::Ordering;
+use std::time::Duration;
+
+use turso::transaction::{Transaction, TransactionBehavior};
+
+use super::super::chunks::ChunkStore;
+use super::AgentFS;
+use crate::connection_pool::ConnectionPool;
+use crate::error::Result;
+use crate::metrics::Counter;
+
+/// Chunks freed per transaction of the reaper
+const REAP_BATCH_CHUNKS: usize = 256;
+/// Pause of the reaper after each batch
+const REAP_PAUSE: Duration = Duration::from_millis(1);
+
+static REAPED_CHUNKS: Counter = Counter::new("reaper.chunks");
+
+/// Start a reaper on the current runtime, unless one is running or nothing
+/// is queued.
+///
+/// Without a runtime the chunks stay queued until the next wake-up or
+/// [`AgentFS::reclaim()`].
+pub(super) fn wake(pool: &ConnectionPool, chunk_store: &ChunkStore) {
+    if !chunk_store.has_orphans() || chunk_store.orphans().reaping.swap(true, Ordering::AcqRel) {
+        return;
+    }
+    let Ok(runtime) = tokio::runtime::Handle::try_current() else {
+        chunk_store
+            .orphans()
+            .reaping
+            .store(false, Ordering::Release);
+        return;
+    };
+    let pool = pool.clone();
+    let chunk_store = chunk_store.clone();
+    runtime.spawn(async move {
+        let result = loop {
+            match reap_batch(&pool, &chunk_store).await {
+                Ok(Some(_)) => tokio::time::sleep(REAP_PAUSE).await,
+                Ok(None) => break Ok(()),
+                Err(e) => break Err(e),
+            }
+        };
+        chunk_store
+            .orphans()
+            .reaping
+            .store(false, Ordering::Release);
+        match result {
+            // Chunks may have been queued after the last batch looked
+            Ok(()) => wake(&pool, &chunk_store),
+            // Left queued for the next wake-up
+            Err(e) => tracing::warn!("Failed to free queued file data: {}", e),
+        }
+    });
+}
+
+/// Free one batch of queued chunks, returning how many, or `None` once
+/// nothing is queued
+async fn reap_batch(pool: &ConnectionPool, chunk_store: &ChunkStore) -> Result<Option<u64>> {
+    let conn = pool.get_connection().await?;
+    let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+    match chunk_store.reap(&conn, REAP_BATCH_CHUNKS).await {
+        Ok(freed) => {
+            txn.commit().await?;
+            if let Some(freed) = freed {
+                REAPED_CHUNKS.add(freed);
+            }
+            Ok(freed)
+        }
+        Err(e) => {
+            let _ = txn.rollback().await;
+            Err(e)
+        }
+    }
+}
+
+impl AgentFS {
+    /// Free all file data queued for the background reaper now, returning
+    /// the number of chunks freed.
+    pub async fn reclaim(&self) -> Result<u64> {
+        let mut total = 0;
+        while let Some(freed) = reap_batch(&self.pool, &self.chunk_store).await? {
+            total += freed;
+        }
+        Ok(total)
+    }
+
+    /// Start freeing queued file data in the background
+    pub(super) fn wake_reaper(&self) {
+        wake(&self.pool, &self.chunk_store);
+    }
+}
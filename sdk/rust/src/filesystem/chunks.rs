@@ -0,0 +1,1081 @@
+//! Storage of file data chunks.
+//!
+//! File data is split into `chunk_size` byte chunks, addressed by inode and
+//! chunk index. By default every chunk is a row of `fs_data` holding its
+//! bytes. A filesystem created with deduplication instead stores each
+//! distinct chunk once, as a reference-counted row of `fs_blob`, and maps
+//! `(ino, chunk_index)` to it in `fs_chunk`. Identical files, copies and
+//! copied-up base files then share their chunks, and copying a file's data
+//! only adds references.
+//!
+//! Blobs are looked up by a 64-bit hash of their contents and compared byte
+//! for byte before being shared, so a hash collision costs a second blob,
+//! never wrong data.
+//!
+//! A filesystem created with compression stores chunks compressed where that
+//! makes them smaller. Every row records the codec of its bytes, so rows
+//! written without compression, by older versions or other SDKs, read as
+//! they are, and reads only decompress the chunks they touch.
+//!
+//! Chunks left behind by removing the last link to a file or by truncating
+//! one are freed in the same transaction, in batches. A filesystem created
+//! with deferred reclamation instead frees them right away only when there
+//! are few of them. Otherwise they are queued in `fs_orphan` and freed later
+//! by a background reaper, so removal and truncation don't wait for the
+//! deletes of a large file.
+//!
+//! Each queued discard starts a generation of the inode's chunks, numbered
+//! by its `fs_orphan` id. Chunks are stored with the generation they were
+//! written in, and those from the discarded index on written before it are
+//! never read again. A write after a truncation therefore only replaces the
+//! row it writes, and leaves the rest of the queued chunks to the reaper.
+//!
+//! A filesystem created with size classes gives each file the chunk size of
+//! its class instead of the configured one: larger files get larger chunks,
+//! so reading or writing them touches fewer rows, while small files keep
+//! small chunks and small rewrites. A file's class is chosen from the size
+//! it first grows to, and kept until all its data is discarded. Files whose
+//! chunk size differs from the configured one are listed in
+//! `fs_chunk_size`.
+//!
+//! All methods run on the caller's connection, inside its transaction.
+
+use crate::connection_pool::PooledConnection;
+use crate::error::{Error, Result};
+use std::borrow::Cow;
+use std::collections::{HashMap, HashSet};
+use std::sync::atomic::AtomicBool;
+use std::sync::{Arc, Mutex};
+use turso::{Connection, Value};
+
+/// `fs_config` key recording how chunks are stored
+const CHUNK_STORAGE_KEY: &str = "chunk_storage";
+
+/// `fs_config` value of deduplicated chunk storage
+const CHUNK_STORAGE_DEDUP: &str = "dedup";
+
+/// `fs_config` key recording the codec chunks are compressed with
+const COMPRESSION_KEY: &str = "compression";
+
+/// `fs_config` key recording how discarded chunks are freed
+const RECLAIM_KEY: &str = "chunk_reclaim";
+
+/// `fs_config` value of discarded chunks queued in `fs_orphan`
+const RECLAIM_DEFERRED: &str = "deferred";
+
+/// `fs_config` key recording how files are given their chunk size
+const CHUNK_SIZING_KEY: &str = "chunk_sizing";
+
+/// `fs_config` value of chunk sizes chosen per file by size class
+const CHUNK_SIZING_CLASSES: &str = "size_class";
+
+/// Size classes as `(smallest file size, chunk size)`, largest first.
+///
+/// Files smaller than every class, and classes whose chunks would be
+/// smaller than the configured size, use the configured chunk size.
+const SIZE_CLASSES: [(u64, usize); 2] = [(64 * 1024 * 1024, 1024 * 1024), (1024 * 1024, 64 * 1024)];
+
+/// Codec of a row holding chunk bytes as they are
+const CODEC_RAW: i64 = 0;
+
+/// Codec of a row holding a chunk compressed with LZ4, prefixed with its
+/// uncompressed size
+const CODEC_LZ4: i64 = 1;
+
+/// Rows per statement of [`ChunkStore::insert_many()`]
+const INSERT_MANY_ROWS: usize = 64;
+
+/// Most chunks [`ChunkStore::discard_from()`] frees right away instead of
+/// queuing them
+const DISCARD_INLINE_CHUNKS: usize = 16;
+
+/// Chunks [`ChunkStore::discard_from()`] frees per batch when it doesn't
+/// queue them
+const DISCARD_BATCH_CHUNKS: usize = 256;
+
+/// Generation of chunks written while no discard of their inode is queued
+const GENERATION_NONE: i64 = 0;
+
+/// How a new filesystem compresses its chunks.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub enum Compression {
+    /// Chunks are stored as they are
+    #[default]
+    None,
+    /// Chunks are compressed with LZ4 where that makes them smaller
+    Lz4,
+}
+
+impl Compression {
+    /// Name of the codec, as recorded in `fs_config`
+    pub fn as_str(&self) -> &'static str {
+        match self {
+            Compression::None => "none",
+            Compression::Lz4 => "lz4",
+        }
+    }
+}
+
+impl std::str::FromStr for Compression {
+    type Err = Error;
+
+    fn from_str(s: &str) -> Result<Self> {
+        match s {
+            "none" => Ok(Compression::None),
+            "lz4" => Ok(Compression::Lz4),
+            _ => Err(Error::UnsupportedCompression(s.to_string())),
+        }
+    }
+}
+
+/// A chunk made ready to store by [`ChunkStore::prepare()`]
+pub(crate) struct PreparedChunk {
+    data: Vec<u8>,
+    codec: i64,
+    /// `data` encoded with `codec`, if that changes it
+    encoded: Option<Vec<u8>>,
+    /// Hash of `data` if deduplicated
+    hash: i64,
+}
+
+impl PreparedChunk {
+    /// Size of the chunk's data
+    pub(crate) fn len(&self) -> usize {
+        self.data.len()
+    }
+
+    /// Bytes to store
+    fn stored(&self) -> &[u8] {
+        self.encoded.as_deref().unwrap_or(&self.data)
+    }
+
+    fn into_stored(self) -> Vec<u8> {
+        self.encoded.unwrap_or(self.data)
+    }
+}
+
+/// How the chunks of a filesystem are stored, fixed at creation.
+#[derive(Debug, Clone)]
+pub(crate) struct ChunkStore {
+    /// Configured chunk size
+    chunk_size: usize,
+    /// Whether files are given the chunk size of their size class
+    sized: bool,
+    dedup: bool,
+    compression: Compression,
+    /// Whether large discards are queued for the reaper
+    deferred: bool,
+    /// Chunks queued for the reaper (shared across clones)
+    orphans: Arc<Orphans>,
+}
+
+/// What is known in memory about queued chunks.
+#[derive(Debug, Default)]
+pub(crate) struct Orphans {
+    /// Inodes that may have queued chunks, a superset of those that do
+    inos: Mutex<HashSet<i64>>,
+    /// Whether a reaper is running
+    pub(crate) reaping: AtomicBool,
+}
+
+/// Discards of an inode's chunks queued for the reaper, as
+/// `(first_chunk, generation)`.
+#[derive(Debug, Default)]
+struct Discards(Vec<(i64, i64)>);
+
+impl Discards {
+    /// Generation chunks of the inode are written in now
+    fn generation(&self) -> i64 {
+        self.0
+            .iter()
+            .map(|&(_, generation)| generation)
+            .max()
+            .unwrap_or(GENERATION_NONE)
+    }
+
+    /// Whether chunk `chunk_index`, written in `generation`, was discarded
+    fn covers(&self, chunk_index: i64, generation: i64) -> bool {
+        self.0
+            .iter()
+            .any(|&(first, discard)| chunk_index >= first && generation < discard)
+    }
+
+    /// SQL condition on `chunk_index` and `generation` matching the chunks
+    /// not discarded
+    fn live_condition(&self) -> String {
+        if self.0.is_empty() {
+            return "1".to_string();
+        }
+        let discarded: Vec<String> = self
+            .0
+            .iter()
+            .map(|(first, generation)| {
+                format!("(chunk_index >= {first} AND generation < {generation})")
+            })
+            .collect();
+        format!("NOT ({})", discarded.join(" OR "))
+    }
+}
+
+impl ChunkStore {
+    /// Record the storage of a new filesystem
+    pub(crate) async fn initialize(
+        conn: &Connection,
+        dedup: bool,
+        compression: Compression,
+        deferred: bool,
+        sized: bool,
+    ) -> Result<()> {
+        if dedup {
+            conn.execute(
+                "INSERT OR IGNORE INTO fs_config (key, value) VALUES (?, ?)",
+                (CHUNK_STORAGE_KEY, CHUNK_STORAGE_DEDUP),
+            )
+            .await?;
+        }
+        if compression != Compression::None {
+            conn.execute(
+                "INSERT OR IGNORE INTO fs_config (key, value) VALUES (?, ?)",
+                (COMPRESSION_KEY, compression.as_str()),
+            )
+            .await?;
+        }
+        if deferred {
+            conn.execute(
+                "INSERT OR IGNORE INTO fs_config (key, value) VALUES (?, ?)",
+                (RECLAIM_KEY, RECLAIM_DEFERRED),
+            )
+            .await?;
+        }
+        if sized {
+            conn.execute(
+                "INSERT OR IGNORE INTO fs_config (key, value) VALUES (?, ?)",
+                (CHUNK_SIZING_KEY, CHUNK_SIZING_CLASSES),
+            )
+            .await?;
+        }
+        Ok(())
+    }
+
+    /// Value of `key` in `fs_config`
+    async fn config_value(conn: &Connection, key: &str) -> Result<Option<String>> {
+        let mut rows = conn
+            .query("SELECT value FROM fs_config WHERE key = ?", (key,))
+            .await?;
+        Ok(match rows.next().await? {
+            Some(row) => match row.get_value(0)? {
+                Value::Text(s) => Some(s),
+                _ => None,
+            },
+            None => None,
+        })
+    }
+
+    /// Read the storage of an existing filesystem of `chunk_size` byte
+    /// chunks, creating the tables of deduplicated storage, of deferred
+    /// reclamation and of size classes if it uses them
+    pub(crate) async fn open(conn: &Connection, chunk_size: usize) -> Result<Self> {
+        let dedup = Self::config_value(conn, CHUNK_STORAGE_KEY)
+            .await?
+            .as_deref()
+            == Some(CHUNK_STORAGE_DEDUP);
+        let compression = match Self::config_value(conn, COMPRESSION_KEY).await? {
+            Some(codec) => codec.parse()?,
+            None => Compression::None,
+        };
+        let deferred =
+            Self::config_value(conn, RECLAIM_KEY).await?.as_deref() == Some(RECLAIM_DEFERRED);
+        let sized = Self::config_value(conn, CHUNK_SIZING_KEY).await?.as_deref()
+            == Some(CHUNK_SIZING_CLASSES);
+
+        if dedup {
+            conn.execute(
+                "CREATE TABLE IF NOT EXISTS fs_blob (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    hash INTEGER NOT NULL,
+                    refcount INTEGER NOT NULL,
+                    codec INTEGER NOT NULL DEFAULT 0,
+                    data BLOB NOT NULL
+                )",
+                (),
+            )
+            .await?;
+            conn.execute(
+                "CREATE INDEX IF NOT EXISTS idx_fs_blob_hash ON fs_blob(hash)",
+                (),
+            )
+            .await?;
+            conn.execute(
+                "CREATE TABLE IF NOT EXISTS fs_chunk (
+                    ino INTEGER NOT NULL,
+                    chunk_index INTEGER NOT NULL,
+                    blob_id INTEGER NOT NULL,
+                    generation INTEGER NOT NULL DEFAULT 0,
+                    PRIMARY KEY (ino, chunk_index)
+                )",
+                (),
+            )
+            .await?;
+            // Add the generation column of queued discards (backward
+            // compatible migration)
+            conn.execute(
+                "ALTER TABLE fs_chunk ADD COLUMN generation INTEGER NOT NULL DEFAULT 0",
+                (),
+            )
+            .await
+            .ok();
+        }
+
+        if sized {
+            conn.execute(
+                "CREATE TABLE IF NOT EXISTS fs_chunk_size (
+                    ino INTEGER PRIMARY KEY,
+                    chunk_size INTEGER NOT NULL
+                )",
+                (),
+            )
+            .await?;
+        }
+
+        let mut inos = HashSet::new();
+        if deferred {
+            conn.execute(
+                "CREATE TABLE IF NOT EXISTS fs_orphan (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    ino INTEGER NOT NULL,
+                    first_chunk INTEGER NOT NULL
+                )",
+                (),
+            )
+            .await?;
+            conn.execute(
+                "CREATE INDEX IF NOT EXISTS idx_fs_orphan_ino ON fs_orphan(ino)",
+                (),
+            )
+            .await?;
+            // Chunks queued before a crash or an unmount are still to be freed
+            let mut rows = conn.query("SELECT DISTINCT ino FROM fs_orphan", ()).await?;
+            while let Some(row) = rows.next().await? {
+                if let Some(ino) = row.get_value(0)?.as_integer().copied() {
+                    inos.insert(ino);
+                }
+            }
+        }
+
+        Ok(Self {
+            chunk_size,
+            sized,
+            dedup,
+            compression,
+            deferred,
+            orphans: Arc::new(Orphans {
+                inos: Mutex::new(inos),
+                reaping: AtomicBool::new(false),
+            }),
+        })
+    }
+
+    /// Configured chunk size
+    pub(crate) fn base_chunk_size(&self) -> usize {
+        self.chunk_size
+    }
+
+    /// Whether files are given the chunk size of their size class
+    pub(crate) fn is_sized(&self) -> bool {
+        self.sized
+    }
+
+    /// Chunk size of a file that first grows to `size` bytes
+    pub(crate) fn size_class(&self, size: u64) -> usize {
+        if !self.sized {
+            return self.chunk_size;
+        }
+        SIZE_CLASSES
+            .iter()
+            .find(|&&(min_size, _)| size >= min_size)
+            .map_or(self.chunk_size, |&(_, class)| class.max(self.chunk_size))
+    }
+
+    /// Chunk size of the data of `ino`
+    pub(crate) async fn chunk_size(&self, conn: &PooledConnection, ino: i64) -> Result<usize> {
+        if !self.sized {
+            return Ok(self.chunk_size);
+        }
+        let mut stmt = conn
+            .prepare_cached("SELECT chunk_size FROM fs_chunk_size WHERE ino = ?")
+            .await?;
+        let mut rows = stmt.query((ino,)).await?;
+        let chunk_size = match rows.next().await? {
+            Some(row) => row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .map_or(self.chunk_size, |size| size as usize),
+            None => self.chunk_size,
+        };
+        drop(rows);
+        stmt.reset()?;
+        Ok(chunk_size)
+    }
+
+    /// Record that the data of `ino` is stored in `chunk_size` byte chunks,
+    /// while it has none or as it is all discarded
+    pub(crate) async fn set_chunk_size(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        chunk_size: usize,
+    ) -> Result<()> {
+        if !self.sized {
+            return Ok(());
+        }
+        if chunk_size == self.chunk_size {
+            let mut stmt = conn
+                .prepare_cached("DELETE FROM fs_chunk_size WHERE ino = ?")
+                .await?;
+            stmt.execute((ino,)).await?;
+            stmt.reset()?;
+        } else {
+            let mut stmt = conn
+                .prepare_cached(
+                    "INSERT OR REPLACE INTO fs_chunk_size (ino, chunk_size) VALUES (?, ?)",
+                )
+                .await?;
+            stmt.execute((ino, chunk_size as i64)).await?;
+            stmt.reset()?;
+        }
+        Ok(())
+    }
+
+    /// Chunk size of `ino` for data written up to `end` while the file
+    /// holds `current_size` bytes, choosing its class if it is empty
+    pub(crate) async fn chunk_size_for(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        current_size: u64,
+        end: u64,
+    ) -> Result<usize> {
+        if current_size > 0 {
+            return self.chunk_size(conn, ino).await;
+        }
+        let chunk_size = self.size_class(end);
+        self.set_chunk_size(conn, ino, chunk_size).await?;
+        Ok(chunk_size)
+    }
+
+    /// Whether identical chunks are stored once
+    pub(crate) fn is_dedup(&self) -> bool {
+        self.dedup
+    }
+
+    /// Codec chunks are compressed with
+    pub(crate) fn compression(&self) -> Compression {
+        self.compression
+    }
+
+    /// Whether large discards are queued for the reaper
+    pub(crate) fn is_deferred(&self) -> bool {
+        self.deferred
+    }
+
+    /// Queue state shared with the reaper
+    pub(crate) fn orphans(&self) -> &Orphans {
+        &self.orphans
+    }
+
+    /// Whether chunks may be queued for the reaper
+    pub(crate) fn has_orphans(&self) -> bool {
+        !self.orphans.inos.lock().unwrap().is_empty()
+    }
+
+    /// Queued discards of the chunks of `ino`
+    async fn discards(&self, conn: &PooledConnection, ino: i64) -> Result<Discards> {
+        if !self.orphans.inos.lock().unwrap().contains(&ino) {
+            return Ok(Discards::default());
+        }
+        let mut stmt = conn
+            .prepare_cached("SELECT first_chunk, id FROM fs_orphan WHERE ino = ?")
+            .await?;
+        let mut rows = stmt.query((ino,)).await?;
+        let mut discards = Vec::new();
+        while let Some(row) = rows.next().await? {
+            let get = |i| row.get_value(i).ok().and_then(|v| v.as_integer().copied());
+            if let Some(discard) = get(0).zip(get(1)) {
+                discards.push(discard);
+            }
+        }
+        drop(rows);
+        stmt.reset()?;
+        Ok(Discards(discards))
+    }
+
+    /// `data` compressed, if that makes it smaller
+    fn compress(&self, data: &[u8]) -> Option<Vec<u8>> {
+        match self.compression {
+            Compression::None => None,
+            Compression::Lz4 => Some(lz4_flex::block::compress_prepend_size(data))
+                .filter(|compressed| compressed.len() < data.len()),
+        }
+    }
+
+    /// Codec and bytes to store `data` as
+    fn encode<'a>(&self, data: &'a [u8]) -> (i64, Cow<'a, [u8]>) {
+        match self.compress(data) {
+            Some(compressed) => (CODEC_LZ4, Cow::Owned(compressed)),
+            None => (CODEC_RAW, Cow::Borrowed(data)),
+        }
+    }
+
+    /// Hash blobs are looked up by
+    fn hash(data: &[u8]) -> i64 {
+        twox_hash::XxHash3_64::oneshot(data) as i64
+    }
+
+    /// Encode `data`, and hash it if deduplicated, for [`Self::insert_many()`].
+    ///
+    /// Needs no connection, so callers can prepare chunks on other threads.
+    pub(crate) fn prepare(&self, data: Vec<u8>) -> PreparedChunk {
+        let encoded = self.compress(&data);
+        PreparedChunk {
+            codec: if encoded.is_some() {
+                CODEC_LZ4
+            } else {
+                CODEC_RAW
+            },
+            encoded,
+            hash: if self.dedup { Self::hash(&data) } else { 0 },
+            data,
+        }
+    }
+
+    /// Chunk stored in columns `at` (codec) and `at + 1` (bytes) of `row`
+    fn decode(row: &turso::Row, at: usize) -> Result<Option<Vec<u8>>> {
+        let codec = row
+            .get_value(at)?
+            .as_integer()
+            .copied()
+            .unwrap_or(CODEC_RAW);
+        let Value::Blob(data) = row.get_value(at + 1)? else {
+            return Ok(None);
+        };
+        match codec {
+            CODEC_RAW => Ok(Some(data)),
+            CODEC_LZ4 => lz4_flex::block::decompress_size_prepended(&data)
+                .map(Some)
+                .map_err(|e| Error::Internal(format!("corrupt chunk: {e}"))),
+            _ => Err(Error::Internal(format!("unknown chunk codec {codec}"))),
+        }
+    }
+
+    /// Generation stored in column `at` of `row`
+    fn generation_of(row: &turso::Row, at: usize) -> i64 {
+        row.get_value(at)
+            .ok()
+            .and_then(|v| v.as_integer().copied())
+            .unwrap_or(GENERATION_NONE)
+    }
+
+    /// Read chunk `chunk_index` of `ino`
+    pub(crate) async fn read(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        chunk_index: i64,
+    ) -> Result<Option<Vec<u8>>> {
+        let discards = self.discards(conn, ino).await?;
+        let sql = if self.dedup {
+            "SELECT b.codec, b.data, c.generation FROM fs_chunk c JOIN fs_blob b ON b.id = c.blob_id
+            WHERE c.ino = ? AND c.chunk_index = ?"
+        } else {
+            "SELECT codec, data, generation FROM fs_data WHERE ino = ? AND chunk_index = ?"
+        };
+        let mut stmt = conn.prepare_cached(sql).await?;
+        let mut rows = stmt.query((ino, chunk_index)).await?;
+        let data = match rows.next().await? {
+            Some(row) if !discards.covers(chunk_index, Self::generation_of(&row, 2)) => {
+                Self::decode(&row, 0)?
+            }
+            _ => None,
+        };
+        drop(rows);
+        stmt.reset()?;
+        Ok(data)
+    }
+
+    /// Read the chunks of `ino` with indexes in `[first, last]`, in order
+    pub(crate) async fn read_range(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        first: i64,
+        last: i64,
+    ) -> Result<Vec<(i64, Vec<u8>)>> {
+        let discards = self.discards(conn, ino).await?;
+        let sql = if self.dedup {
+            "SELECT c.chunk_index, b.codec, b.data, c.generation
+            FROM fs_chunk c JOIN fs_blob b ON b.id = c.blob_id
+            WHERE c.ino = ? AND c.chunk_index >= ? AND c.chunk_index <= ?
+            ORDER BY c.chunk_index"
+        } else {
+            "SELECT chunk_index, codec, data, generation FROM fs_data
+            WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ?
+            ORDER BY chunk_index"
+        };
+        let mut stmt = conn.prepare_cached(sql).await?;
+        let mut rows = stmt.query((ino, first, last)).await?;
+        let mut chunks = Vec::new();
+        while let Some(row) = rows.next().await? {
+            let chunk_index = row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .unwrap_or(0);
+            if discards.covers(chunk_index, Self::generation_of(&row, 3)) {
+                continue;
+            }
+            if let Some(data) = Self::decode(&row, 1)? {
+                chunks.push((chunk_index, data));
+            }
+        }
+        Ok(chunks)
+    }
+
+    /// Store `data` as chunk `chunk_index` of `ino`, replacing the chunk.
+    ///
+    /// A discarded chunk at the same index is replaced too, the others are
+    /// left queued.
+    pub(crate) async fn write(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        chunk_index: i64,
+        data: &[u8],
+    ) -> Result<()> {
+        let generation = self.discards(conn, ino).await?.generation();
+        if !self.dedup {
+            let (codec, stored) = self.encode(data);
+            let mut stmt = conn
+                .prepare_cached(
+                    "INSERT OR REPLACE INTO fs_data (ino, chunk_index, codec, data, generation)
+                    VALUES (?, ?, ?, ?, ?)",
+                )
+                .await?;
+            stmt.execute((ino, chunk_index, codec, &*stored, generation))
+                .await?;
+            stmt.reset()?;
+            return Ok(());
+        }
+
+        let old = self.blob_of(conn, ino, chunk_index).await?;
+        let blob_id = self.intern(conn, Self::hash(data), data, None).await?;
+        let mut stmt = conn
+            .prepare_cached(
+                "INSERT OR REPLACE INTO fs_chunk (ino, chunk_index, blob_id, generation)
+                VALUES (?, ?, ?, ?)",
+            )
+            .await?;
+        stmt.execute((ino, chunk_index, blob_id, generation))
+            .await?;
+        stmt.reset()?;
+        if let Some(old) = old {
+            Self::release(conn, old, 1).await?;
+        }
+        Ok(())
+    }
+
+    /// Drop the chunks of `ino` with indexes in `[first, last]` written before
+    /// generation `before`
+    async fn delete_range(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        first: i64,
+        last: i64,
+        before: i64,
+    ) -> Result<()> {
+        if !self.dedup {
+            let mut stmt = conn
+                .prepare_cached(
+                    "DELETE FROM fs_data
+                    WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ? AND generation < ?",
+                )
+                .await?;
+            stmt.execute((ino, first, last, before)).await?;
+            stmt.reset()?;
+            return Ok(());
+        }
+
+        let refs = self.blob_refs(conn, ino, first, last, before).await?;
+        let mut stmt = conn
+            .prepare_cached(
+                "DELETE FROM fs_chunk
+                WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ? AND generation < ?",
+            )
+            .await?;
+        stmt.execute((ino, first, last, before)).await?;
+        stmt.reset()?;
+        for (blob_id, count) in refs {
+            Self::release(conn, blob_id, count).await?;
+        }
+        Ok(())
+    }
+
+    /// Indexes and generations of up to `limit` chunks of `ino` from index
+    /// `first` on
+    async fn chunk_indexes(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        first: i64,
+        limit: usize,
+    ) -> Result<Vec<(i64, i64)>> {
+        let sql = if self.dedup {
+            "SELECT chunk_index, generation FROM fs_chunk WHERE ino = ? AND chunk_index >= ?
+            ORDER BY chunk_index LIMIT ?"
+        } else {
+            "SELECT chunk_index, generation FROM fs_data WHERE ino = ? AND chunk_index >= ?
+            ORDER BY chunk_index LIMIT ?"
+        };
+        let mut stmt = conn.prepare_cached(sql).await?;
+        let mut rows = stmt.query((ino, first, limit as i64)).await?;
+        let mut indexes = Vec::new();
+        while let Some(row) = rows.next().await? {
+            if let Some(chunk_index) = row.get_value(0)?.as_integer().copied() {
+                indexes.push((chunk_index, Self::generation_of(&row, 1)));
+            }
+        }
+        drop(rows);
+        stmt.reset()?;
+        Ok(indexes)
+    }
+
+    /// Drop the chunks of `ino` with indexes from `first` on.
+    ///
+    /// Without deferred reclamation all of them are freed, in batches. With
+    /// it, a few chunks are freed right away and more are queued for the
+    /// reaper, in a new generation of the inode's chunks that the chunks
+    /// written from now on belong to. Returns whether any were queued.
+    pub(crate) async fn discard_from(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        first: i64,
+    ) -> Result<bool> {
+        if !self.deferred {
+            let mut next = first;
+            loop {
+                let indexes = self
+                    .chunk_indexes(conn, ino, next, DISCARD_BATCH_CHUNKS)
+                    .await?;
+                let Some(&(last, _)) = indexes.last() else {
+                    return Ok(false);
+                };
+                self.delete_range(conn, ino, next, last, i64::MAX).await?;
+                if indexes.len() < DISCARD_BATCH_CHUNKS {
+                    return Ok(false);
+                }
+                next = last + 1;
+            }
+        }
+
+        let indexes = self
+            .chunk_indexes(conn, ino, first, DISCARD_INLINE_CHUNKS + 1)
+            .await?;
+        if indexes.len() <= DISCARD_INLINE_CHUNKS {
+            if let Some(&(last, _)) = indexes.last() {
+                self.delete_range(conn, ino, first, last, i64::MAX).await?;
+            }
+            return Ok(false);
+        }
+
+        let mut stmt = conn
+            .prepare_cached("INSERT INTO fs_orphan (ino, first_chunk) VALUES (?, ?)")
+            .await?;
+        stmt.execute((ino, first)).await?;
+        stmt.reset()?;
+        // Before the transaction commits, so no reader can miss it after
+        self.orphans.inos.lock().unwrap().insert(ino);
+        Ok(true)
+    }
+
+    /// Drop all chunks of `ino`, as [`Self::discard_from()`], and forget its
+    /// size class
+    pub(crate) async fn discard_all(&self, conn: &PooledConnection, ino: i64) -> Result<bool> {
+        self.set_chunk_size(conn, ino, self.chunk_size).await?;
+        self.discard_from(conn, ino, 0).await
+    }
+
+    /// Look at up to `limit` chunks of the earliest queued discard, freeing
+    /// those it discarded.
+    ///
+    /// Returns the number of chunks freed, or `None` once nothing is queued.
+    pub(crate) async fn reap(&self, conn: &PooledConnection, limit: usize) -> Result<Option<u64>> {
+        let mut stmt = conn
+            .prepare_cached("SELECT id, ino, first_chunk FROM fs_orphan ORDER BY id LIMIT 1")
+            .await?;
+        let mut rows = stmt.query(()).await?;
+        let queued = match rows.next().await? {
+            Some(row) => {
+                let get = |i| row.get_value(i).ok().and_then(|v| v.as_integer().copied());
+                get(0).zip(get(1)).zip(get(2))
+            }
+            None => None,
+        };
+        drop(rows);
+        stmt.reset()?;
+        let Some(((id, ino), first)) = queued else {
+            // Writers are excluded until this transaction ends, so no inode
+            // can be queued meanwhile
+            self.orphans.inos.lock().unwrap().clear();
+            return Ok(None);
+        };
+
+        // Chunks written since the discard are skipped, not freed
+        let indexes = self.chunk_indexes(conn, ino, first, limit).await?;
+        let freed = indexes
+            .iter()
+            .filter(|&&(_, generation)| generation < id)
+            .count();
+        if let Some(&(last, _)) = indexes.last() {
+            if freed > 0 {
+                self.delete_range(conn, ino, first, last, id).await?;
+            }
+        }
+        if indexes.len() < limit {
+            // These were the last of them
+            let mut stmt = conn
+                .prepare_cached("DELETE FROM fs_orphan WHERE id = ?")
+                .await?;
+            stmt.execute((id,)).await?;
+            stmt.reset()?;
+        } else {
+            let next = indexes.last().map_or(first, |&(last, _)| last + 1);
+            let mut stmt = conn
+                .prepare_cached("UPDATE fs_orphan SET first_chunk = ? WHERE id = ?")
+                .await?;
+            stmt.execute((next, id)).await?;
+            stmt.reset()?;
+        }
+        Ok(Some(freed as u64))
+    }
+
+    /// Store `chunks` of inodes as `(ino, chunk_index, chunk)`, for chunks
+    /// that don't exist yet, in multi-row inserts
+    pub(crate) async fn insert_many(
+        &self,
+        conn: &PooledConnection,
+        chunks: Vec<(i64, i64, PreparedChunk)>,
+    ) -> Result<()> {
+        if self.dedup {
+            for (ino, chunk_index, chunk) in chunks {
+                let encoded = Some((chunk.codec, chunk.stored()));
+                let blob_id = self.intern(conn, chunk.hash, &chunk.data, encoded).await?;
+                let mut stmt = conn
+                    .prepare_cached(
+                        "INSERT INTO fs_chunk (ino, chunk_index, blob_id) VALUES (?, ?, ?)",
+                    )
+                    .await?;
+                stmt.execute((ino, chunk_index, blob_id)).await?;
+                stmt.reset()?;
+            }
+            return Ok(());
+        }
+
+        let mut chunks = chunks.into_iter().peekable();
+        while chunks.peek().is_some() {
+            let mut params: Vec<Value> = Vec::with_capacity(INSERT_MANY_ROWS * 4);
+            for (ino, chunk_index, chunk) in chunks.by_ref().take(INSERT_MANY_ROWS) {
+                params.push(Value::Integer(ino));
+                params.push(Value::Integer(chunk_index));
+                params.push(Value::Integer(chunk.codec));
+                params.push(Value::Blob(chunk.into_stored()));
+            }
+            let sql = format!(
+                "INSERT INTO fs_data (ino, chunk_index, codec, data) VALUES {}",
+                vec!["(?, ?, ?, ?)"; params.len() / 4].join(", ")
+            );
+            let mut stmt = conn.prepare_cached(&sql).await?;
+            stmt.execute(params).await?;
+            stmt.reset()?;
+        }
+        Ok(())
+    }
+
+    /// Give `dst`, which has no chunks, the same data and chunk size as
+    /// `src`.
+    ///
+    /// With deduplication this only adds references to the blobs of `src`.
+    pub(crate) async fn copy(&self, conn: &PooledConnection, src: i64, dst: i64) -> Result<()> {
+        let chunk_size = self.chunk_size(conn, src).await?;
+        self.set_chunk_size(conn, dst, chunk_size).await?;
+        let live = self.discards(conn, src).await?.live_condition();
+        let generation = self.discards(conn, dst).await?.generation();
+        if !self.dedup {
+            let sql = format!(
+                "INSERT INTO fs_data (ino, chunk_index, codec, data, generation)
+                SELECT ?, chunk_index, codec, data, ? FROM fs_data WHERE ino = ? AND {live}"
+            );
+            let mut stmt = conn.prepare_cached(&sql).await?;
+            stmt.execute((dst, generation, src)).await?;
+            return Ok(());
+        }
+
+        let sql = format!("SELECT blob_id FROM fs_chunk WHERE ino = ? AND {live}");
+        let mut stmt = conn.prepare_cached(&sql).await?;
+        let mut rows = stmt.query((src,)).await?;
+        let mut refs: HashMap<i64, i64> = HashMap::new();
+        while let Some(row) = rows.next().await? {
+            if let Some(blob_id) = row.get_value(0)?.as_integer().copied() {
+                *refs.entry(blob_id).or_insert(0) += 1;
+            }
+        }
+        drop(rows);
+        stmt.reset()?;
+        let sql = format!(
+            "INSERT INTO fs_chunk (ino, chunk_index, blob_id, generation)
+            SELECT ?, chunk_index, blob_id, ? FROM fs_chunk WHERE ino = ? AND {live}"
+        );
+        let mut stmt = conn.prepare_cached(&sql).await?;
+        stmt.execute((dst, generation, src)).await?;
+        let mut stmt = conn
+            .prepare_cached("UPDATE fs_blob SET refcount = refcount + ? WHERE id = ?")
+            .await?;
+        for (blob_id, count) in refs {
+            stmt.execute((count, blob_id)).await?;
+            stmt.reset()?;
+        }
+        Ok(())
+    }
+
+    /// Number of chunks stored for `ino`
+    #[cfg(test)]
+    pub(crate) async fn count(&self, conn: &PooledConnection, ino: i64) -> Result<i64> {
+        let sql = if self.dedup {
+            "SELECT COUNT(*) FROM fs_chunk WHERE ino = ?"
+        } else {
+            "SELECT COUNT(*) FROM fs_data WHERE ino = ?"
+        };
+        let mut rows = conn.query(sql, (ino,)).await?;
+        Ok(match rows.next().await? {
+            Some(row) => row
+                .get_value(0)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+                .unwrap_or(0),
+            None => 0,
+        })
+    }
+
+    /// Blob chunk `chunk_index` of `ino` refers to
+    async fn blob_of(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        chunk_index: i64,
+    ) -> Result<Option<i64>> {
+        let mut stmt = conn
+            .prepare_cached("SELECT blob_id FROM fs_chunk WHERE ino = ? AND chunk_index = ?")
+            .await?;
+        let mut rows = stmt.query((ino, chunk_index)).await?;
+        let blob_id = match rows.next().await? {
+            Some(row) => row.get_value(0)?.as_integer().copied(),
+            None => None,
+        };
+        drop(rows);
+        stmt.reset()?;
+        Ok(blob_id)
+    }
+
+    /// References from the chunks of `ino` with indexes in `[first, last]`
+    /// written before generation `before`, per blob
+    async fn blob_refs(
+        &self,
+        conn: &PooledConnection,
+        ino: i64,
+        first: i64,
+        last: i64,
+        before: i64,
+    ) -> Result<HashMap<i64, i64>> {
+        let mut stmt = conn
+            .prepare_cached(
+                "SELECT blob_id FROM fs_chunk
+                WHERE ino = ? AND chunk_index >= ? AND chunk_index <= ? AND generation < ?",
+            )
+            .await?;
+        let mut rows = stmt.query((ino, first, last, before)).await?;
+        let mut refs = HashMap::new();
+        while let Some(row) = rows.next().await? {
+            if let Some(blob_id) = row.get_value(0)?.as_integer().copied() {
+                *refs.entry(blob_id).or_insert(0) += 1;
+            }
+        }
+        Ok(refs)
+    }
+
+    /// Take a reference to the blob holding `data`, whose hash is `hash`,
+    /// storing it if there is none yet.
+    ///
+    /// `encoded` is the codec and bytes to store a new blob as, `data`
+    /// encoded here if `None`.
+    async fn intern(
+        &self,
+        conn: &PooledConnection,
+        hash: i64,
+        data: &[u8],
+        encoded: Option<(i64, &[u8])>,
+    ) -> Result<i64> {
+        let mut stmt = conn
+            .prepare_cached("SELECT id, codec, data FROM fs_blob WHERE hash = ?")
+            .await?;
+        let mut rows = stmt.query((hash,)).await?;
+        let mut existing = None;
+        while let Some(row) = rows.next().await? {
+            if Self::decode(&row, 1)?.as_deref() == Some(data) {
+                existing = row.get_value(0)?.as_integer().copied();
+                break;
+            }
+        }
+        drop(rows);
+        stmt.reset()?;
+
+        if let Some(blob_id) = existing {
+            let mut stmt = conn
+                .prepare_cached("UPDATE fs_blob SET refcount = refcount + 1 WHERE id = ?")
+                .await?;
+            stmt.execute((blob_id,)).await?;
+            stmt.reset()?;
+            return Ok(blob_id);
+        }
+
+        let (codec, stored) = match encoded {
+            Some((codec, stored)) => (codec, Cow::Borrowed(stored)),
+            None => self.encode(data),
+        };
+        let mut stmt = conn
+            .prepare_cached(
+                "INSERT INTO fs_blob (hash, refcount, codec, data) VALUES (?, 1, ?, ?) RETURNING id",
+            )
+            .await?;
+        let row = stmt.query_row((hash, codec, &*stored)).await?;
+        row.get_value(0)
+            .ok()
+            .and_then(|v| v.as_integer().copied())
+            .ok_or_else(|| Error::Internal("failed to get blob id".to_string()))
+    }
+
+    /// Drop `count` references to `blob_id`, and the blob with the last one
+    async fn release(conn: &PooledConnection, blob_id: i64, count: i64) -> Result<()> {
+        let mut stmt = conn
+            .prepare_cached("UPDATE fs_blob SET refcount = refcount - ? WHERE id = ?")
+            .await?;
+        stmt.execute((count, blob_id)).await?;
+        stmt.reset()?;
+        let mut stmt = conn
+            .prepare_cached("DELETE FROM fs_blob WHERE id = ? AND refcount <= 0")
+            .await?;
+        stmt.execute((blob_id,)).await?;
+        stmt.reset()?;
+        Ok(())
+    }
+}
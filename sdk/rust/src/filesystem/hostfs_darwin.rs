@@ -147,6 +147,10 @@ impl File for HostFSFile {
         .await
         .map_err(|e| Error::Internal(e.to_string()))?
     }
+
+    fn raw_fd(&self) -> Option<std::os::unix::io::RawFd> {
+        Some(self.fd.as_raw_fd())
+    }
 }
 
 /// Convert libc::stat to our Stats struct
@@ -1,7 +1,7 @@
 use super::{BoxedFile, DirEntry, File, FileSystem, FilesystemStats, FsError, Stats, TimeChange};
 use crate::error::{Error, Result};
 use async_trait::async_trait;
-use std::collections::HashMap;
+use std::collections::{HashMap, VecDeque};
 use std::ffi::{CStr, CString};
 use std::os::unix::ffi::OsStrExt;
 use std::os::unix::io::{AsRawFd, FromRawFd, OwnedFd, RawFd};
@@ -13,6 +13,12 @@ use std::sync::RwLock;
 /// Root inode number (matches FUSE convention)
 pub const ROOT_INO: i64 = 1;
 
+/// Directory entries stat'ed per blocking task by `readdir_plus()`
+const STAT_BATCH: usize = 256;
+
+/// Blocking tasks stat'ing the entries of one directory at a time
+const STAT_CONCURRENCY: usize = 8;
+
 /// Source file identity (inode + device), used to detect hardlinks
 #[derive(Clone, Copy, PartialEq, Eq, Hash)]
 struct SrcId {
@@ -45,8 +51,9 @@ pub struct HostFS {
     root_fd: OwnedFd,
     /// Map from our inode numbers to Inode structs
     inodes: RwLock<HashMap<i64, Inode>>,
-    /// Map from source identity (ino, dev) to our inode number (for hardlink detection)
-    src_to_ino: RwLock<HashMap<SrcId, i64>>,
+    /// Map from source identity (ino, dev) to our inode number (for hardlink detection),
+    /// shared with the blocking tasks of `readdir_plus()`
+    src_to_ino: Arc<RwLock<HashMap<SrcId, i64>>>,
     /// Next inode number to allocate
     next_ino: AtomicU64,
     /// FUSE mountpoint inode to avoid deadlock when overlaying
@@ -144,6 +151,10 @@ impl File for HostFSFile {
         .await
         .map_err(|e| Error::Internal(e.to_string()))?
     }
+
+    fn raw_fd(&self) -> Option<RawFd> {
+        Some(self.fd.as_raw_fd())
+    }
 }
 
 /// Convert libc::stat to our Stats struct
@@ -225,7 +236,7 @@ impl HostFS {
             root,
             root_fd,
             inodes: RwLock::new(inodes),
-            src_to_ino: RwLock::new(src_to_ino),
+            src_to_ino: Arc::new(RwLock::new(src_to_ino)),
             next_ino: AtomicU64::new(2), // 1 is root
             fuse_mountpoint_inode: None,
         })
@@ -290,16 +301,8 @@ impl HostFS {
         };
 
         // Check if we already have this source file
-        {
-            let src_map = self.src_to_ino.read().unwrap();
-            if let Some(&ino) = src_map.get(&src_id) {
-                // Increment nlookup on existing inode
-                let inodes = self.inodes.read().unwrap();
-                if let Some(inode) = inodes.get(&ino) {
-                    inode.nlookup.fetch_add(1, Ordering::Relaxed);
-                    return (ino, false);
-                }
-            }
+        if let Some(ino) = self.reuse_inode(stat) {
+            return (ino, false);
         }
 
         // Create new inode
@@ -323,6 +326,102 @@ impl HostFS {
         (ino, true)
     }
 
+    /// Count one more lookup on the inode of a source file already cached
+    fn reuse_inode(&self, stat: &libc::stat) -> Option<i64> {
+        let src_id = SrcId {
+            ino: stat.st_ino,
+            dev: stat.st_dev,
+        };
+        let src_map = self.src_to_ino.read().unwrap();
+        let ino = *src_map.get(&src_id)?;
+        let inodes = self.inodes.read().unwrap();
+        let inode = inodes.get(&ino)?;
+        inode.nlookup.fetch_add(1, Ordering::Relaxed);
+        Some(ino)
+    }
+
+    /// Open an O_PATH fd for `name` in the directory `dir_fd`
+    fn open_path_fd(dir_fd: RawFd, name: &CStr) -> Option<OwnedFd> {
+        let fd = unsafe { libc::openat(dir_fd, name.as_ptr(), libc::O_PATH | libc::O_NOFOLLOW) };
+        (fd >= 0).then(|| unsafe { OwnedFd::from_raw_fd(fd) })
+    }
+
+    /// Read the names of a directory, without "." and ".."
+    fn read_dir_names(dir_fd: OwnedFd) -> Result<Vec<CString>> {
+        let dir = unsafe { libc::fdopendir(dir_fd.as_raw_fd()) };
+        if dir.is_null() {
+            return Err(std::io::Error::last_os_error().into());
+        }
+
+        // Prevent the DIR* from closing our fd when dropped
+        std::mem::forget(dir_fd);
+
+        let mut names = Vec::new();
+
+        loop {
+            // Clear errno before readdir
+            unsafe { *libc::__errno_location() = 0 };
+            let entry = unsafe { libc::readdir(dir) };
+
+            if entry.is_null() {
+                let errno = unsafe { *libc::__errno_location() };
+                if errno != 0 {
+                    unsafe { libc::closedir(dir) };
+                    return Err(std::io::Error::from_raw_os_error(errno).into());
+                }
+                break;
+            }
+
+            let name = unsafe { CStr::from_ptr((*entry).d_name.as_ptr()) };
+
+            // Skip . and ..
+            if name == c"." || name == c".." {
+                continue;
+            }
+
+            names.push(name.to_owned());
+        }
+
+        unsafe { libc::closedir(dir) };
+        Ok(names)
+    }
+
+    /// Stat a batch of entries of the directory `dir_fd`, with O_PATH fds
+    /// for the ones whose source file isn't cached yet. Entries that can't be
+    /// stat'ed and the FUSE mountpoint are skipped.
+    fn stat_entries(
+        dir_fd: RawFd,
+        names: Vec<CString>,
+        fuse_mountpoint_inode: Option<u64>,
+        src_to_ino: &RwLock<HashMap<SrcId, i64>>,
+    ) -> Vec<(CString, libc::stat, Option<OwnedFd>)> {
+        let mut entries = Vec::with_capacity(names.len());
+        for name in names {
+            let mut stat: libc::stat = unsafe { std::mem::zeroed() };
+            let result = unsafe {
+                libc::fstatat(dir_fd, name.as_ptr(), &mut stat, libc::AT_SYMLINK_NOFOLLOW)
+            };
+            if result != 0 || fuse_mountpoint_inode == Some(stat.st_ino) {
+                continue;
+            }
+
+            let src_id = SrcId {
+                ino: stat.st_ino,
+                dev: stat.st_dev,
+            };
+            let child_fd = if src_to_ino.read().unwrap().contains_key(&src_id) {
+                None
+            } else {
+                match Self::open_path_fd(dir_fd, &name) {
+                    Some(fd) => Some(fd),
+                    None => continue, // Skip entries we can't open
+                }
+            };
+            entries.push((name, stat, child_fd));
+        }
+        entries
+    }
+
     /// Remove an inode from the cache
     #[allow(dead_code)]
     fn remove_inode(&self, ino: i64) {
@@ -447,48 +546,16 @@ impl FileSystem for HostFS {
         // Open a real fd for reading directory
         let dir_fd = Self::open_real_fd(fd, libc::O_RDONLY | libc::O_DIRECTORY)?;
 
-        tokio::task::spawn_blocking(move || {
-            let dir = unsafe { libc::fdopendir(dir_fd.as_raw_fd()) };
-            if dir.is_null() {
-                return Err::<_, Error>(std::io::Error::last_os_error().into());
-            }
-
-            // Prevent the DIR* from closing our fd when dropped
-            std::mem::forget(dir_fd);
-
-            let mut entries = Vec::new();
-
-            loop {
-                // Clear errno before readdir
-                unsafe { *libc::__errno_location() = 0 };
-                let entry = unsafe { libc::readdir(dir) };
-
-                if entry.is_null() {
-                    let errno = unsafe { *libc::__errno_location() };
-                    if errno != 0 {
-                        unsafe { libc::closedir(dir) };
-                        return Err(std::io::Error::from_raw_os_error(errno).into());
-                    }
-                    break;
-                }
+        let names = tokio::task::spawn_blocking(move || Self::read_dir_names(dir_fd))
+            .await
+            .map_err(|e| Error::Internal(e.to_string()))??;
 
-                let name = unsafe { CStr::from_ptr((*entry).d_name.as_ptr()) };
-                let name_str = name.to_string_lossy();
-
-                // Skip . and ..
-                if name_str == "." || name_str == ".." {
-                    continue;
-                }
-
-                entries.push(name_str.to_string());
-            }
-
-            unsafe { libc::closedir(dir) };
-            entries.sort();
-            Ok(Some(entries))
-        })
-        .await
-        .map_err(|e| Error::Internal(e.to_string()))?
+        let mut entries: Vec<String> = names
+            .iter()
+            .map(|name| name.to_string_lossy().into_owned())
+            .collect();
+        entries.sort();
+        Ok(Some(entries))
     }
 
     async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
@@ -499,88 +566,53 @@ impl FileSystem for HostFS {
 
         // Open a real fd for reading directory
         let dir_fd = Self::open_real_fd(fd, libc::O_RDONLY | libc::O_DIRECTORY)?;
-        let dir_fd_raw = dir_fd.as_raw_fd();
+        let names = tokio::task::spawn_blocking(move || Self::read_dir_names(dir_fd))
+            .await
+            .map_err(|e| Error::Internal(e.to_string()))??;
 
         #[cfg(target_family = "unix")]
         let fuse_mountpoint_inode = self.fuse_mountpoint_inode;
 
-        let entries_raw: Vec<(String, libc::stat)> = tokio::task::spawn_blocking(move || {
-            let dir = unsafe { libc::fdopendir(dir_fd.as_raw_fd()) };
-            if dir.is_null() {
-                return Err::<_, Error>(std::io::Error::last_os_error().into());
+        // Stat the entries in batches, several blocking tasks at a time, so
+        // large directories don't pay a thread hop per entry nor wait on a
+        // single thread. Only entries not cached yet get an O_PATH fd.
+        let mut names = names.into_iter().peekable();
+        let mut batches = VecDeque::new();
+        let mut result = Vec::new();
+        loop {
+            while batches.len() < STAT_CONCURRENCY && names.peek().is_some() {
+                let batch: Vec<CString> = names.by_ref().take(STAT_BATCH).collect();
+                let src_to_ino = self.src_to_ino.clone();
+                batches.push_back(tokio::task::spawn_blocking(move || {
+                    Self::stat_entries(fd, batch, fuse_mountpoint_inode, &src_to_ino)
+                }));
             }
-            std::mem::forget(dir_fd);
-
-            let mut entries = Vec::new();
-
-            loop {
-                unsafe { *libc::__errno_location() = 0 };
-                let entry = unsafe { libc::readdir(dir) };
-
-                if entry.is_null() {
-                    let errno = unsafe { *libc::__errno_location() };
-                    if errno != 0 {
-                        unsafe { libc::closedir(dir) };
-                        return Err(std::io::Error::from_raw_os_error(errno).into());
-                    }
-                    break;
-                }
-
-                let name = unsafe { CStr::from_ptr((*entry).d_name.as_ptr()) };
-                let name_str = name.to_string_lossy();
-
-                if name_str == "." || name_str == ".." {
-                    continue;
-                }
+            let Some(batch) = batches.pop_front() else {
+                break;
+            };
 
-                // Get stats for this entry
-                let mut stat: libc::stat = unsafe { std::mem::zeroed() };
-                let result = unsafe {
-                    libc::fstatat(
-                        dir_fd_raw,
-                        (*entry).d_name.as_ptr(),
-                        &mut stat,
-                        libc::AT_SYMLINK_NOFOLLOW,
-                    )
+            // Now create/lookup inodes for each entry
+            for (name, stat, child_fd) in batch.await.map_err(|e| Error::Internal(e.to_string()))? {
+                let child_ino = match child_fd {
+                    Some(child_fd) => self.get_or_create_inode(child_fd, &stat).0,
+                    None => match self.reuse_inode(&stat) {
+                        Some(child_ino) => child_ino,
+                        // Forgotten since the batch looked, open it after all
+                        None => match Self::open_path_fd(fd, &name) {
+                            Some(child_fd) => self.get_or_create_inode(child_fd, &stat).0,
+                            None => continue,
+                        },
+                    },
                 };
 
-                if result == 0 {
-                    #[cfg(target_family = "unix")]
-                    if let Some(fuse_ino) = fuse_mountpoint_inode {
-                        if stat.st_ino == fuse_ino {
-                            continue;
-                        }
-                    }
+                let mut stats = stat_to_stats(&stat);
+                stats.ino = child_ino;
 
-                    entries.push((name_str.to_string(), stat));
-                }
-            }
-
-            unsafe { libc::closedir(dir) };
-            Ok(entries)
-        })
-        .await
-        .map_err(|e| Error::Internal(e.to_string()))??;
-
-        // Now create/lookup inodes for each entry
-        let mut result = Vec::new();
-        for (name, stat) in entries_raw {
-            // Open O_PATH fd for this entry
-            let c_name = CString::new(name.as_str()).map_err(|_| FsError::InvalidPath)?;
-            let child_fd =
-                unsafe { libc::openat(fd, c_name.as_ptr(), libc::O_PATH | libc::O_NOFOLLOW) };
-
-            if child_fd < 0 {
-                continue; // Skip entries we can't open
+                result.push(DirEntry {
+                    name: name.to_string_lossy().into_owned(),
+                    stats,
+                });
             }
-
-            let child_fd = unsafe { OwnedFd::from_raw_fd(child_fd) };
-            let (child_ino, _) = self.get_or_create_inode(child_fd, &stat);
-
-            let mut stats = stat_to_stats(&stat);
-            stats.ino = child_ino;
-
-            result.push(DirEntry { name, stats });
         }
 
         result.sort_by(|a, b| a.name.cmp(&b.name));
@@ -1066,4 +1098,33 @@ mod tests {
 
         Ok(())
     }
+
+    #[tokio::test]
+    async fn test_hostfs_readdir_plus_large_dir() -> Result<()> {
+        let dir = tempdir()?;
+        let count = STAT_BATCH * 3 + 7;
+        for i in 0..count {
+            std::fs::write(dir.path().join(format!("file{i:04}")), b"x")?;
+        }
+        let fs = HostFS::new(dir.path())?;
+
+        // Inodes already looked up are reused, the others are created
+        let looked_up = fs.lookup(ROOT_INO, "file0300").await?.unwrap();
+        let entries = fs.readdir_plus(ROOT_INO).await?.unwrap();
+        assert_eq!(entries.len(), count);
+        assert!(entries.windows(2).all(|w| w[0].name < w[1].name));
+        assert_eq!(entries[300].name, "file0300");
+        assert_eq!(entries[300].stats.ino, looked_up.ino);
+        assert_eq!(entries[0].stats.size, 1);
+
+        // Listing again maps every entry to the same inode
+        let again = fs.readdir_plus(ROOT_INO).await?.unwrap();
+        for (a, b) in entries.iter().zip(&again) {
+            assert_eq!(a.stats.ino, b.stats.ino);
+        }
+
+        assert_eq!(fs.readdir(ROOT_INO).await?.unwrap().len(), count);
+
+        Ok(())
+    }
 }
@@ -0,0 +1,268 @@
+//! A filesystem wrapper recording per-method metrics.
+
+use crate::error::Result;
+use crate::op_metrics;
+use async_trait::async_trait;
+use std::sync::Arc;
+
+use super::{
+    BoxedDirectory, BoxedFile, DirEntry, Directory, File, FileSystem, FilesystemStats, Stats,
+    TimeChange,
+};
+
+/// Time `$call` in the `fs.$name` metrics, counting `$bytes(&value)` bytes
+/// on success.
+macro_rules! metered {
+    ($name:literal, $call:expr) => {
+        metered!($name, $call, |_| 0)
+    };
+    ($name:literal, $call:expr, $bytes:expr) => {{
+        let timer = op_metrics!(concat!("fs.", $name)).start();
+        let result = $call.await;
+        match &result {
+            Ok(value) => timer.finish(true, $bytes(value)),
+            Err(_) => timer.finish(false, 0),
+        }
+        result
+    }};
+}
+
+/// Forwards every call to the wrapped filesystem, recording its latency and
+/// result in the `fs.*` [metrics](crate::metrics).
+///
+/// Files and directory streams it opens are wrapped too, so reads, writes
+/// and listings through them are recorded (with the bytes they move).
+pub struct MeteredFileSystem {
+    inner: Arc<dyn FileSystem>,
+}
+
+impl MeteredFileSystem {
+    pub fn new(inner: Arc<dyn FileSystem>) -> Self {
+        Self { inner }
+    }
+}
+
+struct MeteredFile {
+    inner: BoxedFile,
+}
+
+fn metered_file(inner: BoxedFile) -> BoxedFile {
+    Arc::new(MeteredFile { inner })
+}
+
+#[async_trait]
+impl File for MeteredFile {
+    async fn pread(&self, offset: u64, size: u64) -> Result<Vec<u8>> {
+        metered!("pread", self.inner.pread(offset, size), |data: &Vec<u8>| {
+            data.len() as u64
+        })
+    }
+
+    async fn pwrite(&self, offset: u64, data: &[u8]) -> Result<()> {
+        metered!("pwrite", self.inner.pwrite(offset, data), |_| data.len()
+            as u64)
+    }
+
+    async fn truncate(&self, size: u64) -> Result<()> {
+        metered!("truncate", self.inner.truncate(size))
+    }
+
+    async fn fsync(&self) -> Result<()> {
+        metered!("fsync", self.inner.fsync())
+    }
+
+    async fn flush(&self) -> Result<()> {
+        metered!("flush", self.inner.flush())
+    }
+
+    async fn fstat(&self) -> Result<Stats> {
+        metered!("fstat", self.inner.fstat())
+    }
+
+    #[cfg(unix)]
+    fn raw_fd(&self) -> Option<std::os::unix::io::RawFd> {
+        self.inner.raw_fd()
+    }
+}
+
+struct MeteredDirectory {
+    inner: BoxedDirectory,
+}
+
+#[async_trait]
+impl Directory for MeteredDirectory {
+    async fn next_entries(&self, limit: usize) -> Result<Vec<DirEntry>> {
+        metered!("next_entries", self.inner.next_entries(limit))
+    }
+
+    async fn rewind(&self) -> Result<()> {
+        metered!("rewind", self.inner.rewind())
+    }
+}
+
+#[async_trait]
+impl FileSystem for MeteredFileSystem {
+    async fn lookup(&self, parent_ino: i64, name: &str) -> Result<Option<Stats>> {
+        metered!("lookup", self.inner.lookup(parent_ino, name))
+    }
+
+    async fn getattr(&self, ino: i64) -> Result<Option<Stats>> {
+        metered!("getattr", self.inner.getattr(ino))
+    }
+
+    async fn readlink(&self, ino: i64) -> Result<Option<String>> {
+        metered!("readlink", self.inner.readlink(ino))
+    }
+
+    async fn readdir(&self, ino: i64) -> Result<Option<Vec<String>>> {
+        metered!("readdir", self.inner.readdir(ino))
+    }
+
+    async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
+        metered!("readdir_plus", self.inner.readdir_plus(ino))
+    }
+
+    async fn opendir(&self, ino: i64) -> Result<Option<BoxedDirectory>> {
+        let dir = metered!("opendir", self.inner.opendir(ino))?;
+        Ok(dir.map(|inner| Arc::new(MeteredDirectory { inner }) as BoxedDirectory))
+    }
+
+    async fn chmod(&self, ino: i64, mode: u32) -> Result<()> {
+        metered!("chmod", self.inner.chmod(ino, mode))
+    }
+
+    async fn chown(&self, ino: i64, uid: Option<u32>, gid: Option<u32>) -> Result<()> {
+        metered!("chown", self.inner.chown(ino, uid, gid))
+    }
+
+    async fn utimens(&self, ino: i64, atime: TimeChange, mtime: TimeChange) -> Result<()> {
+        metered!("utimens", self.inner.utimens(ino, atime, mtime))
+    }
+
+    async fn open(&self, ino: i64, flags: i32) -> Result<BoxedFile> {
+        metered!("open", self.inner.open(ino, flags)).map(metered_file)
+    }
+
+    async fn mkdir(
+        &self,
+        parent_ino: i64,
+        name: &str,
+        mode: u32,
+        uid: u32,
+        gid: u32,
+    ) -> Result<Stats> {
+        metered!("mkdir", self.inner.mkdir(parent_ino, name, mode, uid, gid))
+    }
+
+    async fn create_file(
+        &self,
+        parent_ino: i64,
+        name: &str,
+        mode: u32,
+        uid: u32,
+        gid: u32,
+    ) -> Result<(Stats, BoxedFile)> {
+        let (stats, file) = metered!(
+            "create_file",
+            self.inner.create_file(parent_ino, name, mode, uid, gid)
+        )?;
+        Ok((stats, metered_file(file)))
+    }
+
+    async fn mknod(
+        &self,
+        parent_ino: i64,
+        name: &str,
+        mode: u32,
+        rdev: u64,
+        uid: u32,
+        gid: u32,
+    ) -> Result<Stats> {
+        metered!(
+            "mknod",
+            self.inner.mknod(parent_ino, name, mode, rdev, uid, gid)
+        )
+    }
+
+    async fn symlink(
+        &self,
+        parent_ino: i64,
+        name: &str,
+        target: &str,
+        uid: u32,
+        gid: u32,
+    ) -> Result<Stats> {
+        metered!(
+            "symlink",
+            self.inner.symlink(parent_ino, name, target, uid, gid)
+        )
+    }
+
+    async fn unlink(&self, parent_ino: i64, name: &str) -> Result<()> {
+        metered!("unlink", self.inner.unlink(parent_ino, name))
+    }
+
+    async fn rmdir(&self, parent_ino: i64, name: &str) -> Result<()> {
+        metered!("rmdir", self.inner.rmdir(parent_ino, name))
+    }
+
+    async fn link(&self, ino: i64, newparent_ino: i64, newname: &str) -> Result<Stats> {
+        metered!("link", self.inner.link(ino, newparent_ino, newname))
+    }
+
+    async fn rename(
+        &self,
+        oldparent_ino: i64,
+        oldname: &str,
+        newparent_ino: i64,
+        newname: &str,
+    ) -> Result<()> {
+        metered!(
+            "rename",
+            self.inner
+                .rename(oldparent_ino, oldname, newparent_ino, newname)
+        )
+    }
+
+    async fn statfs(&self) -> Result<FilesystemStats> {
+        metered!("statfs", self.inner.statfs())
+    }
+
+    async fn forget(&self, ino: i64, nlookup: u64) {
+        self.inner.forget(ino, nlookup).await
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::filesystem::{AgentFS, DEFAULT_FILE_MODE};
+    use crate::metrics;
+    use tempfile::tempdir;
+
+    #[tokio::test]
+    async fn test_metered_filesystem_records_calls_and_bytes() -> Result<()> {
+        let dir = tempdir()?;
+        let db_path = dir.path().join("test.db");
+        let agentfs = AgentFS::new(db_path.to_str().unwrap()).await?;
+        let fs = MeteredFileSystem::new(Arc::new(agentfs));
+
+        let (stats, file) = fs
+            .create_file(1, "metered.txt", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        file.pwrite(0, b"hello").await?;
+        assert_eq!(file.pread(0, 5).await?, b"hello");
+        assert!(fs.lookup(1, "metered.txt").await?.is_some());
+        assert!(fs.getattr(stats.ino).await?.is_some());
+        assert!(fs.unlink(1, "missing").await.is_err());
+
+        let snapshot = metrics::snapshot();
+        let op = |name: &str| snapshot.ops.iter().find(|o| o.name == name).unwrap();
+        assert!(op("fs.create_file").calls >= 1);
+        assert!(op("fs.pwrite").bytes >= 5);
+        assert!(op("fs.pread").bytes >= 5);
+        assert!(op("fs.lookup").calls >= 1);
+        assert!(op("fs.unlink").errors >= 1);
+        Ok(())
+    }
+}
@@ -1,21 +1,27 @@
 pub mod agentfs;
+mod chunks;
 #[cfg(target_os = "macos")]
 pub mod hostfs_darwin;
 #[cfg(target_os = "linux")]
 pub mod hostfs_linux;
+pub mod metered;
 pub mod overlayfs;
 
 use crate::error::Result;
 use async_trait::async_trait;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex};
 use thiserror::Error;
 
 // Re-export implementations
-pub use agentfs::AgentFS;
+#[cfg(unix)]
+pub use agentfs::ImportStats;
+pub use agentfs::{AgentFS, StorageOptions};
+pub use chunks::Compression;
 #[cfg(target_os = "macos")]
 pub use hostfs_darwin::HostFS;
 #[cfg(target_os = "linux")]
 pub use hostfs_linux::HostFS;
+pub use metered::MeteredFileSystem;
 pub use overlayfs::OverlayFS;
 
 /// Filesystem-specific errors with errno semantics
@@ -171,13 +177,81 @@ pub trait File: Send + Sync {
     /// Synchronize file data to persistent storage.
     async fn fsync(&self) -> Result<()>;
 
+    /// Commit writes buffered by this handle (like closing a file descriptor).
+    ///
+    /// Unlike `fsync()`, this does not force data to stable storage. Handles
+    /// that write through directly don't need to override it.
+    async fn flush(&self) -> Result<()> {
+        Ok(())
+    }
+
     /// Get file statistics.
     async fn fstat(&self) -> Result<Stats>;
+
+    /// Host file descriptor holding exactly the data `pread()` returns, if any.
+    ///
+    /// Handles backed directly by a host file return it, so callers can move
+    /// data with `splice(2)` instead of copying it through `pread()`. The
+    /// descriptor is only valid while the handle is alive.
+    #[cfg(unix)]
+    fn raw_fd(&self) -> Option<std::os::unix::io::RawFd> {
+        None
+    }
 }
 
 /// A boxed File trait object for dynamic dispatch.
 pub type BoxedFile = Arc<dyn File>;
 
+/// An open directory stream for reading entries a page at a time.
+///
+/// Like a `DIR*` from opendir(3), the stream remembers its position, so reading
+/// the next page doesn't revisit the entries before it.
+#[async_trait]
+pub trait Directory: Send + Sync {
+    /// Return up to `limit` entries (with statistics) following the ones
+    /// already returned.
+    ///
+    /// Fewer than `limit` entries are only returned at the end of the directory.
+    async fn next_entries(&self, limit: usize) -> Result<Vec<DirEntry>>;
+
+    /// Restart the stream at the first entry (like rewinddir(3)).
+    async fn rewind(&self) -> Result<()>;
+}
+
+/// A boxed Directory trait object for dynamic dispatch.
+pub type BoxedDirectory = Arc<dyn Directory>;
+
+/// A directory stream over a listing taken when the directory was opened.
+pub struct DirSnapshot {
+    entries: Vec<DirEntry>,
+    position: Mutex<usize>,
+}
+
+impl DirSnapshot {
+    pub fn new(entries: Vec<DirEntry>) -> Self {
+        Self {
+            entries,
+            position: Mutex::new(0),
+        }
+    }
+}
+
+#[async_trait]
+impl Directory for DirSnapshot {
+    async fn next_entries(&self, limit: usize) -> Result<Vec<DirEntry>> {
+        let mut position = self.position.lock().unwrap();
+        let start = (*position).min(self.entries.len());
+        let end = start.saturating_add(limit).min(self.entries.len());
+        *position = end;
+        Ok(self.entries[start..end].to_vec())
+    }
+
+    async fn rewind(&self) -> Result<()> {
+        *self.position.lock().unwrap() = 0;
+        Ok(())
+    }
+}
+
 /// A trait defining filesystem operations using inode semantics.
 ///
 /// This trait uses inode-based operations rather than path-based operations,
@@ -218,6 +292,18 @@ pub trait FileSystem: Send + Sync {
     /// Returns `Ok(None)` if the directory does not exist.
     async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>>;
 
+    /// Open a directory stream by inode, for listing it a page at a time.
+    ///
+    /// The default implementation snapshots `readdir_plus()` once, so paging
+    /// through the stream doesn't list the directory again. Filesystems that
+    /// can resume a listing cheaply should return a live stream instead.
+    ///
+    /// Returns `Ok(None)` if the directory does not exist.
+    async fn opendir(&self, ino: i64) -> Result<Option<BoxedDirectory>> {
+        let entries = self.readdir_plus(ino).await?;
+        Ok(entries.map(|entries| Arc::new(DirSnapshot::new(entries)) as BoxedDirectory))
+    }
+
     /// Change file mode/permissions by inode.
     async fn chmod(&self, ino: i64, mode: u32) -> Result<()>;
 
@@ -2,22 +2,38 @@ use crate::error::Result;
 use async_trait::async_trait;
 use std::{
     collections::{HashMap, HashSet},
-    sync::{
-        atomic::{AtomicI64, Ordering},
-        Arc, RwLock,
-    },
+    sync::{Arc, Mutex, OnceLock, RwLock, Weak},
     time::{SystemTime, UNIX_EPOCH},
 };
+use tokio::sync::OnceCell;
 use tracing::trace;
+use turso::transaction::{Transaction, TransactionBehavior};
 use turso::{Connection, Value};
 
 use super::{
-    agentfs::AgentFS, BoxedFile, DirEntry, FileSystem, FilesystemStats, FsError, Stats, TimeChange,
+    agentfs::AgentFS, BoxedFile, DirEntry, File, FileSystem, FilesystemStats, FsError, Stats,
+    TimeChange,
 };
+use crate::metrics::OpMetrics;
 
 /// Root inode number (matches FUSE convention)
 const ROOT_INO: i64 = 1;
 
+/// Bytes copied per read/write when copying a base file up to the delta
+const COPY_UP_CHUNK_SIZE: u64 = 1024 * 1024;
+
+/// Most hot paths recorded in a session and kept in the database
+const MAX_HOT_PATHS: usize = 4096;
+
+/// Directories warmed up at a time
+const WARM_UP_CONCURRENCY: usize = 16;
+
+/// Copy-ups of base files to the delta
+static COPY_UP: OpMetrics = OpMetrics::new("overlay.copy_up");
+
+/// Directories listed by `warm_up()`
+static WARM_UP: OpMetrics = OpMetrics::new("overlay.warm_up");
+
 /// Which layer an inode belongs to
 #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 enum Layer {
@@ -36,6 +52,505 @@ struct InodeInfo {
     path: String,
 }
 
+/// Whiteout paths held as a trie of path components.
+///
+/// Checking whether a path or any of its ancestors is whited out walks one
+/// node per component, and listing the whiteouts of a directory only visits
+/// that directory's children, independent of the total number of whiteouts.
+#[derive(Default)]
+struct WhiteoutTree {
+    /// Set if this exact path is whited out
+    whiteout: bool,
+    children: HashMap<String, WhiteoutTree>,
+}
+
+impl WhiteoutTree {
+    fn components(path: &str) -> impl Iterator<Item = &str> {
+        path.split('/').filter(|s| !s.is_empty())
+    }
+
+    fn insert(&mut self, path: &str) {
+        let mut node = self;
+        for component in Self::components(path) {
+            node = node.children.entry(component.to_string()).or_default();
+        }
+        node.whiteout = true;
+    }
+
+    /// Remove a whiteout, pruning branches left empty. Returns true if the
+    /// path was whited out.
+    fn remove(&mut self, path: &str) -> bool {
+        let components: Vec<&str> = Self::components(path).collect();
+        self.remove_components(&components)
+    }
+
+    fn remove_components(&mut self, components: &[&str]) -> bool {
+        let Some((first, rest)) = components.split_first() else {
+            return std::mem::take(&mut self.whiteout);
+        };
+        let Some(child) = self.children.get_mut(*first) else {
+            return false;
+        };
+        let removed = child.remove_components(rest);
+        if !child.whiteout && child.children.is_empty() {
+            self.children.remove(*first);
+        }
+        removed
+    }
+
+    /// Whether this exact path is whited out
+    fn contains(&self, path: &str) -> bool {
+        self.find(path).is_some_and(|node| node.whiteout)
+    }
+
+    /// Whether the path or any of its ancestors is whited out
+    fn covers(&self, path: &str) -> bool {
+        let mut node = self;
+        for component in Self::components(path) {
+            match node.children.get(component) {
+                Some(child) if child.whiteout => return true,
+                Some(child) => node = child,
+                None => return false,
+            }
+        }
+        false
+    }
+
+    /// Names of whited out direct children of a directory
+    fn children_of(&self, dir_path: &str) -> HashSet<String> {
+        self.find(dir_path)
+            .map(|node| {
+                node.children
+                    .iter()
+                    .filter(|(_, child)| child.whiteout)
+                    .map(|(name, _)| name.clone())
+                    .collect()
+            })
+            .unwrap_or_default()
+    }
+
+    fn find(&self, path: &str) -> Option<&WhiteoutTree> {
+        let mut node = self;
+        for component in Self::components(path) {
+            node = node.children.get(component)?;
+        }
+        Some(node)
+    }
+}
+
+/// An overlay inode, placed in the [`InodeTree`] under the directory it was
+/// last seen in
+struct Node {
+    layer: Layer,
+    underlying_ino: i64,
+    /// Base inode still mapped to this inode after a copy-up
+    origin: Option<i64>,
+    /// Overlay inode of the directory holding the entry, the root's own
+    parent: i64,
+    /// Name of the entry in its parent, empty for the root
+    name: Arc<str>,
+    /// Lookups the kernel holds on the inode
+    lookups: u64,
+    /// Nodes placed under this one
+    children: u32,
+}
+
+/// Overlay inodes as a tree of parent pointers.
+///
+/// Each inode only records its parent and its name, interned so entries of
+/// the same name share it, and paths are rebuilt by walking up to the root.
+/// A rename moves one node however much lies below it. An inode stays while
+/// the kernel holds lookups on it or while it has children, so the tree is as
+/// large as the set of inodes the kernel knows about; inodes only resolved
+/// for the overlay's own use, such as while warming up, are kept.
+struct InodeTree {
+    nodes: HashMap<i64, Node>,
+    /// Overlay inode of each layer inode
+    by_layer: HashMap<(Layer, i64), i64>,
+    /// Overlay inode placed at each (parent, name)
+    by_entry: HashMap<(i64, Arc<str>), i64>,
+    /// Names in use, each held once
+    names: HashSet<Arc<str>>,
+    /// Next inode number to allocate
+    next_ino: i64,
+}
+
+impl InodeTree {
+    fn new() -> Self {
+        let root = Node {
+            // Root inode maps to delta's root (inode 1)
+            layer: Layer::Delta,
+            underlying_ino: 1,
+            origin: None,
+            parent: ROOT_INO,
+            name: Arc::from(""),
+            lookups: 0,
+            children: 0,
+        };
+        Self {
+            nodes: HashMap::from([(ROOT_INO, root)]),
+            by_layer: HashMap::from([((Layer::Delta, 1), ROOT_INO)]),
+            by_entry: HashMap::new(),
+            names: HashSet::new(),
+            next_ino: ROOT_INO + 1,
+        }
+    }
+
+    /// Layer, underlying inode and path of an overlay inode
+    fn info(&self, ino: i64) -> Option<InodeInfo> {
+        let node = self.nodes.get(&ino)?;
+        Some(InodeInfo {
+            layer: node.layer,
+            underlying_ino: node.underlying_ino,
+            path: self.path(ino)?,
+        })
+    }
+
+    /// Rebuild the path of an overlay inode from its ancestors
+    fn path(&self, mut ino: i64) -> Option<String> {
+        let mut names = Vec::new();
+        while ino != ROOT_INO {
+            let node = self.nodes.get(&ino)?;
+            names.push(&*node.name);
+            ino = node.parent;
+        }
+        if names.is_empty() {
+            return Some("/".to_string());
+        }
+        let mut path = String::new();
+        for name in names.iter().rev() {
+            path.push('/');
+            path.push_str(name);
+        }
+        Some(path)
+    }
+
+    /// Overlay inode placed at `path`, if any
+    fn resolve(&self, path: &str) -> Option<i64> {
+        let mut ino = ROOT_INO;
+        for component in path.split('/').filter(|s| !s.is_empty()) {
+            let name = self.names.get(component)?.clone();
+            ino = *self.by_entry.get(&(ino, name))?;
+        }
+        Some(ino)
+    }
+
+    /// Overlay inode of a layer inode found as `name` in `parent`, allocated
+    /// if new, holding `lookups` more kernel lookups. Returns `None` if the
+    /// parent is gone.
+    fn map(
+        &mut self,
+        layer: Layer,
+        underlying_ino: i64,
+        parent: i64,
+        name: &str,
+        lookups: u64,
+    ) -> Option<i64> {
+        if !self.nodes.contains_key(&parent) {
+            return None;
+        }
+        let existing = self
+            .by_layer
+            .get(&(layer, underlying_ino))
+            .copied()
+            .filter(|ino| self.nodes.contains_key(ino));
+        let ino = match existing {
+            Some(ino) => {
+                self.place(ino, parent, name);
+                ino
+            }
+            None => {
+                let ino = self.next_ino;
+                self.next_ino += 1;
+                let name = self.intern(name);
+                self.nodes.insert(
+                    ino,
+                    Node {
+                        layer,
+                        underlying_ino,
+                        origin: None,
+                        parent,
+                        name: name.clone(),
+                        lookups: 0,
+                        children: 0,
+                    },
+                );
+                self.nodes.get_mut(&parent)?.children += 1;
+                self.by_layer.insert((layer, underlying_ino), ino);
+                self.by_entry.insert((parent, name), ino);
+                ino
+            }
+        };
+        self.hold(ino, lookups);
+        Some(ino)
+    }
+
+    /// Count `lookups` more kernel lookups on an overlay inode
+    fn hold(&mut self, ino: i64, lookups: u64) {
+        if let Some(node) = self.nodes.get_mut(&ino) {
+            node.lookups += lookups;
+        }
+    }
+
+    /// Point an overlay inode at another layer inode, keeping its base inode
+    /// mapped to it
+    fn remap(&mut self, ino: i64, layer: Layer, underlying_ino: i64) {
+        let Some(node) = self.nodes.get_mut(&ino) else {
+            return;
+        };
+        let old = (node.layer, node.underlying_ino);
+        node.layer = layer;
+        node.underlying_ino = underlying_ino;
+        if old.0 == Layer::Base {
+            node.origin = Some(old.1);
+        } else if old != (layer, underlying_ino) && self.by_layer.get(&old) == Some(&ino) {
+            self.by_layer.remove(&old);
+        }
+        self.by_layer.insert((layer, underlying_ino), ino);
+    }
+
+    /// Point an overlay inode of a base directory at its delta copy
+    fn promote(&mut self, ino: i64, delta_ino: i64) {
+        let Some(node) = self.nodes.get_mut(&ino) else {
+            return;
+        };
+        if node.layer != Layer::Base {
+            return;
+        }
+        let base_ino = std::mem::replace(&mut node.underlying_ino, delta_ino);
+        node.layer = Layer::Delta;
+        self.by_layer.remove(&(Layer::Base, base_ino));
+        self.by_layer.insert((Layer::Delta, delta_ino), ino);
+    }
+
+    /// Move an overlay inode to `name` in `parent`, along with everything
+    /// below it
+    fn place(&mut self, ino: i64, parent: i64, name: &str) {
+        let Some(node) = self.nodes.get(&ino) else {
+            return;
+        };
+        if node.parent == parent && &*node.name == name {
+            let key = (parent, node.name.clone());
+            self.by_entry.insert(key, ino);
+            return;
+        }
+        // Never under itself, which would detach it from the root
+        let mut ancestor = parent;
+        while ancestor != ROOT_INO {
+            if ancestor == ino {
+                return;
+            }
+            match self.nodes.get(&ancestor) {
+                Some(node) => ancestor = node.parent,
+                None => return,
+            }
+        }
+        if ino == ROOT_INO || !self.nodes.contains_key(&parent) {
+            return;
+        }
+
+        let name = self.intern(name);
+        let node = self.nodes.get_mut(&ino).unwrap();
+        let old_parent = std::mem::replace(&mut node.parent, parent);
+        let old_name = std::mem::replace(&mut node.name, name.clone());
+        self.by_entry.insert((parent, name), ino);
+        self.nodes.get_mut(&parent).unwrap().children += 1;
+        self.unplace(ino, old_parent, old_name);
+        self.prune(old_parent);
+    }
+
+    /// Drop the entry a node had at `name` in `parent`
+    fn unplace(&mut self, ino: i64, parent: i64, name: Arc<str>) {
+        let key = (parent, name);
+        if self.by_entry.get(&key) == Some(&ino) {
+            self.by_entry.remove(&key);
+        }
+        if let Some(parent) = self.nodes.get_mut(&key.0) {
+            parent.children -= 1;
+        }
+        // Held by the set and by `key` alone
+        if Arc::strong_count(&key.1) == 2 {
+            self.names.remove(&key.1);
+        }
+    }
+
+    /// Release `lookups` kernel lookups on an overlay inode, returning the
+    /// layer inode it maps to
+    fn forget(&mut self, ino: i64, lookups: u64) -> Option<(Layer, i64)> {
+        let node = self.nodes.get_mut(&ino)?;
+        node.lookups = node.lookups.saturating_sub(lookups);
+        let layer_ino = (node.layer, node.underlying_ino);
+        self.prune(ino);
+        Some(layer_ino)
+    }
+
+    /// Remove an overlay inode the kernel no longer holds and that has no
+    /// children, then its parents as they are left the same way
+    fn prune(&mut self, mut ino: i64) {
+        while ino != ROOT_INO {
+            match self.nodes.get(&ino) {
+                Some(node) if node.lookups == 0 && node.children == 0 => {}
+                _ => return,
+            }
+            let node = self.nodes.remove(&ino).unwrap();
+            let layer_keys = [
+                Some((node.layer, node.underlying_ino)),
+                node.origin.map(|base_ino| (Layer::Base, base_ino)),
+            ];
+            for key in layer_keys.into_iter().flatten() {
+                if self.by_layer.get(&key) == Some(&ino) {
+                    self.by_layer.remove(&key);
+                }
+            }
+            self.unplace(ino, node.parent, node.name);
+            ino = node.parent;
+        }
+    }
+
+    /// The shared copy of a name
+    fn intern(&mut self, name: &str) -> Arc<str> {
+        if let Some(name) = self.names.get(name) {
+            return name.clone();
+        }
+        let name: Arc<str> = Arc::from(name);
+        self.names.insert(name.clone());
+        name
+    }
+}
+
+/// Copy-up state of base files with open read-only handles: base_ino ->
+/// delta_ino once copied up. Entries go away with the last handle.
+type BaseCopies = Mutex<HashMap<i64, Weak<OnceLock<i64>>>>;
+
+/// Locks of paths being copied up or created in the delta, held by the
+/// tasks working on each and going away with the last of them.
+///
+/// Copy-up and parent creation look a path up in the delta and create it
+/// when missing, which two concurrent requests would otherwise both do.
+#[derive(Default)]
+struct PathLocks(Mutex<HashMap<String, Arc<tokio::sync::Mutex<()>>>>);
+
+impl PathLocks {
+    /// Wait for the lock of `path`
+    async fn lock(&self, path: &str) -> PathGuard<'_> {
+        let lock = self
+            .0
+            .lock()
+            .unwrap()
+            .entry(path.to_string())
+            .or_default()
+            .clone();
+        let guard = lock.clone().lock_owned().await;
+        PathGuard {
+            locks: self,
+            path: path.to_string(),
+            lock,
+            guard: Some(guard),
+        }
+    }
+}
+
+/// Lock of a path, from [`PathLocks::lock()`]
+struct PathGuard<'a> {
+    locks: &'a PathLocks,
+    path: String,
+    lock: Arc<tokio::sync::Mutex<()>>,
+    guard: Option<tokio::sync::OwnedMutexGuard<()>>,
+}
+
+impl Drop for PathGuard<'_> {
+    fn drop(&mut self) {
+        self.guard.take();
+        // Waiters clone the lock under the map's lock, so none is left if
+        // only the map and this guard hold it
+        let mut locks = self.locks.0.lock().unwrap();
+        if Arc::strong_count(&self.lock) == 2 {
+            locks.remove(&self.path);
+        }
+    }
+}
+
+/// Handle of a base-layer file opened read-only, without copying it up.
+///
+/// Reads go straight to the base file. If the file is copied up while the
+/// handle is open (by a writable open, truncate, link or rename), the handle
+/// switches to the delta copy, so it never misses writes made to the copy.
+struct BaseFile {
+    base: BoxedFile,
+    base_ino: i64,
+    overlay_ino: i64,
+    delta: AgentFS,
+    /// Delta inode of the copy, set once the file has been copied up
+    copied_up: Arc<OnceLock<i64>>,
+    copies: Arc<BaseCopies>,
+    delta_file: OnceCell<BoxedFile>,
+}
+
+impl Drop for BaseFile {
+    fn drop(&mut self) {
+        // Handles are only counted under the lock, so this is the last one
+        // if no other holds the state
+        let mut copies = self.copies.lock().unwrap();
+        if Arc::strong_count(&self.copied_up) == 1 {
+            copies.remove(&self.base_ino);
+        }
+    }
+}
+
+impl BaseFile {
+    /// The delta copy of the file, if it has been copied up
+    async fn delta_file(&self) -> Result<Option<&BoxedFile>> {
+        let Some(&delta_ino) = self.copied_up.get() else {
+            return Ok(None);
+        };
+        let file = self
+            .delta_file
+            .get_or_try_init(|| FileSystem::open(&self.delta, delta_ino, libc::O_RDONLY))
+            .await?;
+        Ok(Some(file))
+    }
+}
+
+#[async_trait]
+impl File for BaseFile {
+    async fn pread(&self, offset: u64, size: u64) -> Result<Vec<u8>> {
+        match self.delta_file().await? {
+            Some(file) => file.pread(offset, size).await,
+            None => self.base.pread(offset, size).await,
+        }
+    }
+
+    async fn pwrite(&self, _offset: u64, _data: &[u8]) -> Result<()> {
+        Err(std::io::Error::from_raw_os_error(libc::EBADF).into())
+    }
+
+    async fn truncate(&self, _size: u64) -> Result<()> {
+        Err(std::io::Error::from_raw_os_error(libc::EBADF).into())
+    }
+
+    async fn fsync(&self) -> Result<()> {
+        // Nothing is ever written through this handle
+        Ok(())
+    }
+
+    async fn fstat(&self) -> Result<Stats> {
+        let mut stats = match self.delta_file().await? {
+            Some(file) => file.fstat().await?,
+            None => self.base.fstat().await?,
+        };
+        stats.ino = self.overlay_ino;
+        Ok(stats)
+    }
+
+    #[cfg(unix)]
+    fn raw_fd(&self) -> Option<std::os::unix::io::RawFd> {
+        if self.copied_up.get().is_some() {
+            return None;
+        }
+        self.base.raw_fd()
+    }
+}
+
 /// A copy-on-write overlay filesystem using inode-based operations.
 ///
 /// Combines a read-only base layer with a writable delta layer (AgentFS).
@@ -46,48 +561,33 @@ pub struct OverlayFS {
     base: Arc<dyn FileSystem>,
     /// The delta layer where modifications go
     delta: AgentFS,
-    /// Map from overlay inode to underlying layer info
-    inode_map: RwLock<HashMap<i64, InodeInfo>>,
-    /// Reverse map: (layer, underlying_ino) -> overlay_ino
-    reverse_map: RwLock<HashMap<(Layer, i64), i64>>,
-    /// Map from path to overlay inode (for path-based operations)
-    path_map: RwLock<HashMap<String, i64>>,
-    /// Next inode number to allocate
-    next_ino: AtomicI64,
-    /// Set of whiteout paths (deleted from base)
-    whiteouts: RwLock<HashSet<String>>,
+    /// Overlay inodes and where they are in the tree
+    inodes: RwLock<InodeTree>,
+    /// Whiteout paths (deleted from base)
+    whiteouts: RwLock<WhiteoutTree>,
     /// Origin mapping: delta_ino -> base_ino (for copy-up consistency)
     origin_map: RwLock<HashMap<i64, i64>>,
+    /// Copy-up state of base files opened read-only, shared with their
+    /// `BaseFile` handles
+    base_copies: Arc<BaseCopies>,
+    /// Paths being copied up or created in the delta
+    path_locks: PathLocks,
+    /// Directories looked up this session, if recording hot paths
+    hot_paths: Mutex<Option<HashSet<String>>>,
 }
 
 impl OverlayFS {
     /// Create a new overlay filesystem
     pub fn new(base: Arc<dyn FileSystem>, delta: AgentFS) -> Self {
-        let mut inode_map = HashMap::new();
-        let mut reverse_map = HashMap::new();
-        let mut path_map = HashMap::new();
-
-        // Root inode maps to delta's root (inode 1)
-        inode_map.insert(
-            ROOT_INO,
-            InodeInfo {
-                layer: Layer::Delta,
-                underlying_ino: 1,
-                path: "/".to_string(),
-            },
-        );
-        reverse_map.insert((Layer::Delta, 1), ROOT_INO);
-        path_map.insert("/".to_string(), ROOT_INO);
-
         Self {
             base,
             delta,
-            inode_map: RwLock::new(inode_map),
-            reverse_map: RwLock::new(reverse_map),
-            path_map: RwLock::new(path_map),
-            next_ino: AtomicI64::new(2),
-            whiteouts: RwLock::new(HashSet::new()),
+            inodes: RwLock::new(InodeTree::new()),
+            whiteouts: RwLock::new(WhiteoutTree::default()),
             origin_map: RwLock::new(HashMap::new()),
+            base_copies: Arc::default(),
+            path_locks: PathLocks::default(),
+            hot_paths: Mutex::new(None),
         }
     }
 
@@ -122,6 +622,14 @@ impl OverlayFS {
             (),
         )
         .await?;
+        conn.execute(
+            "CREATE TABLE IF NOT EXISTS fs_hot_path (
+                path TEXT PRIMARY KEY,
+                last_used INTEGER NOT NULL
+            )",
+            (),
+        )
+        .await?;
         Ok(())
     }
 
@@ -148,21 +656,21 @@ impl OverlayFS {
         }
         let mut whiteouts = self.whiteouts.write().unwrap();
         for path in paths {
-            whiteouts.insert(path);
+            whiteouts.insert(&path);
         }
         Ok(())
     }
 
     /// Load existing whiteouts (public interface)
     pub async fn load_whiteouts_public(&self) -> Result<()> {
-        let conn = self.delta.get_connection().await?;
+        let conn = self.delta.get_read_connection().await?;
         self.load_whiteouts(&conn).await
     }
 
     /// Load persisted state (whiteouts and origin mappings) from database.
     /// Call this after creating an OverlayFS for an existing database.
     pub async fn load(&self) -> Result<()> {
-        let conn = self.delta.get_connection().await?;
+        let conn = self.delta.get_read_connection().await?;
         self.load_whiteouts(&conn).await?;
         self.load_origins(&conn).await?;
         Ok(())
@@ -190,18 +698,347 @@ impl OverlayFS {
         Ok(())
     }
 
+    /// Start recording the directories looked up, to be saved as hot paths
+    /// by `save_hot_paths()`
+    pub fn record_hot_paths(&self) {
+        self.hot_paths
+            .lock()
+            .unwrap()
+            .get_or_insert_with(HashSet::new);
+    }
+
+    /// Record a directory looked up, if recording hot paths
+    fn note_hot_path(&self, path: &str) {
+        let mut hot_paths = self.hot_paths.lock().unwrap();
+        if let Some(hot_paths) = hot_paths.as_mut() {
+            if hot_paths.len() < MAX_HOT_PATHS && !hot_paths.contains(path) {
+                hot_paths.insert(path.to_string());
+            }
+        }
+    }
+
+    /// Save the directories recorded since `record_hot_paths()` as the hot
+    /// paths of the database, keeping the `MAX_HOT_PATHS` most recently used
+    /// across sessions
+    pub async fn save_hot_paths(&self) -> Result<()> {
+        let paths: Vec<String> = match self.hot_paths.lock().unwrap().as_ref() {
+            Some(paths) if !paths.is_empty() => paths.iter().cloned().collect(),
+            _ => return Ok(()),
+        };
+        let conn = self.delta.get_connection().await?;
+        let now = SystemTime::now().duration_since(UNIX_EPOCH)?.as_secs() as i64;
+
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+        let mut stmt = conn
+            .prepare_cached("INSERT OR REPLACE INTO fs_hot_path (path, last_used) VALUES (?, ?)")
+            .await?;
+        for path in &paths {
+            stmt.execute((path.as_str(), now)).await?;
+        }
+        let stale = Self::query_hot_paths(&conn, usize::MAX).await?;
+        let mut stmt = conn
+            .prepare_cached("DELETE FROM fs_hot_path WHERE path = ?")
+            .await?;
+        for path in stale.iter().skip(MAX_HOT_PATHS) {
+            stmt.execute((path.as_str(),)).await?;
+        }
+        txn.commit().await?;
+        Ok(())
+    }
+
+    /// Load the hot paths saved by previous sessions, most recently used
+    /// first
+    pub async fn load_hot_paths(&self) -> Result<Vec<String>> {
+        let conn = self.delta.get_read_connection().await?;
+        Self::query_hot_paths(&conn, MAX_HOT_PATHS).await
+    }
+
+    /// Read up to `limit` hot paths, most recently used first
+    async fn query_hot_paths(conn: &Connection, limit: usize) -> Result<Vec<String>> {
+        let limit = i64::try_from(limit).unwrap_or(i64::MAX);
+        let mut rows = conn
+            .query(
+                "SELECT path FROM fs_hot_path ORDER BY last_used DESC LIMIT ?",
+                (limit,),
+            )
+            .await?;
+        let mut paths = Vec::new();
+        while let Some(row) = rows.next().await? {
+            if let Some(path) = row.get_value(0).ok().and_then(|v| match v {
+                Value::Text(s) => Some(s.clone()),
+                _ => None,
+            }) {
+                paths.push(path);
+            }
+        }
+        Ok(paths)
+    }
+
+    /// Warm up the directories at `paths`: resolve them through the overlay
+    /// and list them, so the inode mappings of their entries exist and the
+    /// delta's dentry and attribute caches hold them before they are looked
+    /// up.
+    ///
+    /// Directories are warmed `WARM_UP_CONCURRENCY` at a time, each walking
+    /// the base and delta layers on its own task, and shallow ones first.
+    /// Paths that no longer exist or aren't directories are skipped. Returns
+    /// the number of directories warmed.
+    pub async fn warm_up(self: Arc<Self>, mut paths: Vec<String>) -> usize {
+        paths.sort_by_key(|path| path.matches('/').count());
+
+        let limit = Arc::new(tokio::sync::Semaphore::new(WARM_UP_CONCURRENCY));
+        let mut tasks = tokio::task::JoinSet::new();
+        for path in paths {
+            let Ok(permit) = limit.clone().acquire_owned().await else {
+                break;
+            };
+            let fs = self.clone();
+            tasks.spawn(async move {
+                let _permit = permit;
+                let timer = WARM_UP.start();
+                let warmed = fs.warm_dir(&path).await;
+                timer.finish(warmed.is_ok(), 0);
+                if let Err(e) = &warmed {
+                    trace!("OverlayFS::warm_up: path={}: {}", path, e);
+                }
+                matches!(warmed, Ok(true))
+            });
+        }
+
+        let mut warmed = 0;
+        while let Some(result) = tasks.join_next().await {
+            if matches!(result, Ok(true)) {
+                warmed += 1;
+            }
+        }
+        warmed
+    }
+
+    /// Resolve and list the directory at `path`, returning false if it is
+    /// gone
+    async fn warm_dir(&self, path: &str) -> Result<bool> {
+        let mut ino = ROOT_INO;
+        for component in path.split('/').filter(|c| !c.is_empty()) {
+            match self.lookup_entry(ino, component, false).await? {
+                Some(stats) if stats.is_directory() => ino = stats.ino,
+                _ => return Ok(false),
+            }
+        }
+        Ok(self.list_dir_plus(ino, true).await?.is_some())
+    }
+
+    /// Look up `name` in directory `parent_ino`
+    ///
+    /// With `reply`, the entry is for the kernel, which then holds a lookup
+    /// on its inode until it forgets it, and directories are recorded as hot
+    /// paths.
+    async fn lookup_entry(
+        &self,
+        parent_ino: i64,
+        name: &str,
+        reply: bool,
+    ) -> Result<Option<Stats>> {
+        let parent_info = self.get_inode_info(parent_ino).ok_or(FsError::NotFound)?;
+        let path = self.build_path(parent_ino, name)?;
+
+        // Check for whiteout
+        if self.is_whiteout(&path) {
+            return Ok(None);
+        }
+
+        // Try delta first
+        let delta_parent_ino = self.resolve_delta_parent(&parent_info).await?;
+
+        // Look up in delta (only if we resolved the correct parent)
+        if let Some(delta_stats) = match delta_parent_ino {
+            Some(ino) => self.delta.lookup(ino, name).await?,
+            None => None,
+        } {
+            let delta_ino = delta_stats.ino;
+            let mut stats = delta_stats;
+
+            // Origin mapping: reuse an existing Base overlay inode for stable
+            // numbering within a session.  After remount the base_ino stored in
+            // the mapping may be stale (the new HostFS has a fresh inode cache),
+            // so only use it when the tree already contains a live entry.
+            // Otherwise keep the Delta overlay inode — the downstream code
+            // already walks base from root when the parent is tagged Delta.
+            let existing_ino = self.get_origin_ino(delta_ino).and_then(|base_ino| {
+                let inodes = self.inodes.read().unwrap();
+                inodes.by_layer.get(&(Layer::Base, base_ino)).copied()
+            });
+            stats.ino = match existing_ino {
+                Some(existing_ino) => {
+                    self.refresh_overlay_mapping(
+                        existing_ino,
+                        Layer::Delta,
+                        delta_ino,
+                        parent_ino,
+                        name,
+                        u64::from(reply),
+                    );
+                    existing_ino
+                }
+                None => self.get_or_create_overlay_ino(
+                    Layer::Delta,
+                    delta_ino,
+                    parent_ino,
+                    name,
+                    u64::from(reply),
+                )?,
+            };
+
+            if reply && stats.is_directory() {
+                self.note_hot_path(&path);
+            }
+            return Ok(Some(stats));
+        }
+
+        // Try base
+        let base_parent_ino = if parent_info.layer == Layer::Base {
+            parent_info.underlying_ino
+        } else {
+            // Need to find corresponding base parent by path
+            // For root, use base root (1)
+            if parent_info.path == "/" {
+                1
+            } else {
+                // Walk the base to find the parent
+                let mut base_ino: i64 = 1;
+                for comp in parent_info.path.split('/').filter(|s| !s.is_empty()) {
+                    if let Some(s) = self.base.lookup(base_ino, comp).await? {
+                        base_ino = s.ino;
+                    } else {
+                        return Ok(None);
+                    }
+                }
+                base_ino
+            }
+        };
+
+        if let Some(base_stats) = self.base.lookup(base_parent_ino, name).await? {
+            let ino = self.get_or_create_overlay_ino(
+                Layer::Base,
+                base_stats.ino,
+                parent_ino,
+                name,
+                u64::from(reply),
+            )?;
+            let mut stats = base_stats;
+            stats.ino = ino;
+            if reply && stats.is_directory() {
+                self.note_hot_path(&path);
+            }
+            return Ok(Some(stats));
+        }
+
+        Ok(None)
+    }
+
+    /// List a directory with the stats of its entries, mapping every entry
+    /// to an overlay inode
+    ///
+    /// With `prefetch`, the delta's entries are also cached for lookups.
+    /// Otherwise the listing is for the kernel, which holds a lookup on each
+    /// entry.
+    async fn list_dir_plus(&self, ino: i64, prefetch: bool) -> Result<Option<Vec<DirEntry>>> {
+        let info = self.get_inode_info(ino).ok_or(FsError::NotFound)?;
+        let lookups = u64::from(!prefetch);
+        let child_whiteouts = self.get_child_whiteouts(&info.path);
+
+        let mut entries_map: HashMap<String, DirEntry> = HashMap::new();
+
+        // Get base entries first (so delta can override)
+        let base_ino = if info.layer == Layer::Base {
+            Some(info.underlying_ino)
+        } else {
+            let components: Vec<&str> = info.path.split('/').filter(|s| !s.is_empty()).collect();
+            let mut ino: i64 = 1;
+            let mut found_all = true;
+            for comp in &components {
+                if let Some(s) = self.base.lookup(ino, comp).await? {
+                    ino = s.ino;
+                } else {
+                    found_all = false;
+                    break;
+                }
+            }
+            if found_all {
+                Some(ino)
+            } else {
+                None
+            }
+        };
+
+        if let Some(base_ino) = base_ino {
+            if let Some(base_entries) = self.base.readdir_plus(base_ino).await? {
+                for mut entry in base_entries {
+                    let entry_path = if info.path == "/" {
+                        format!("/{}", entry.name)
+                    } else {
+                        format!("{}/{}", info.path, entry.name)
+                    };
+
+                    if !self.is_whiteout(&entry_path) && !child_whiteouts.contains(&entry.name) {
+                        let overlay_ino = self.get_or_create_overlay_ino(
+                            Layer::Base,
+                            entry.stats.ino,
+                            ino,
+                            &entry.name,
+                            lookups,
+                        )?;
+                        entry.stats.ino = overlay_ino;
+                        entries_map.insert(entry.name.clone(), entry);
+                    }
+                }
+            }
+        }
+
+        // Get delta entries (override base)
+        if info.layer == Layer::Delta {
+            let delta_entries = if prefetch {
+                self.delta.prefetch_dir(info.underlying_ino).await?
+            } else {
+                self.delta.readdir_plus(info.underlying_ino).await?
+            };
+            if let Some(delta_entries) = delta_entries {
+                for mut entry in delta_entries {
+                    let entry_path = if info.path == "/" {
+                        format!("/{}", entry.name)
+                    } else {
+                        format!("{}/{}", info.path, entry.name)
+                    };
+                    if self.is_whiteout(&entry_path) || child_whiteouts.contains(&entry.name) {
+                        continue;
+                    }
+
+                    // Check for origin mapping
+                    let (layer, layer_ino) = match self.get_origin_ino(entry.stats.ino) {
+                        Some(base_ino) => (Layer::Base, base_ino),
+                        None => (Layer::Delta, entry.stats.ino),
+                    };
+                    entry.stats.ino = self.get_or_create_overlay_ino(
+                        layer,
+                        layer_ino,
+                        ino,
+                        &entry.name,
+                        lookups,
+                    )?;
+
+                    entries_map.insert(entry.name.clone(), entry);
+                }
+            }
+        }
+
+        let mut result: Vec<_> = entries_map.into_values().collect();
+        result.sort_by(|a, b| a.name.cmp(&b.name));
+        Ok(Some(result))
+    }
+
     /// Check if a path is whiteout (deleted from base)
     fn is_whiteout(&self, path: &str) -> bool {
-        let whiteouts = self.whiteouts.read().unwrap();
         // Check path and all ancestors
-        let mut current = String::new();
-        for component in path.split('/').filter(|s| !s.is_empty()) {
-            current = format!("{}/{}", current, component);
-            if whiteouts.contains(&current) {
-                return true;
-            }
-        }
-        false
+        self.whiteouts.read().unwrap().covers(path)
     }
 
     /// Create a whiteout for a path
@@ -213,7 +1050,7 @@ impl OverlayFS {
             (path, now),
         )
         .await?;
-        self.whiteouts.write().unwrap().insert(path.to_string());
+        self.whiteouts.write().unwrap().insert(path);
         Ok(())
     }
 
@@ -231,78 +1068,40 @@ impl OverlayFS {
 
     /// Get child whiteouts for a directory
     fn get_child_whiteouts(&self, dir_path: &str) -> HashSet<String> {
-        let whiteouts = self.whiteouts.read().unwrap();
-        let prefix = if dir_path == "/" {
-            "/".to_string()
-        } else {
-            format!("{}/", dir_path)
-        };
-        whiteouts
-            .iter()
-            .filter_map(|p| {
-                if dir_path == "/" {
-                    // Direct children of root
-                    let trimmed = p.trim_start_matches('/');
-                    if !trimmed.contains('/') {
-                        Some(trimmed.to_string())
-                    } else {
-                        None
-                    }
-                } else if p.starts_with(&prefix) {
-                    let rest = &p[prefix.len()..];
-                    if !rest.contains('/') {
-                        Some(rest.to_string())
-                    } else {
-                        None
-                    }
-                } else {
-                    None
-                }
-            })
-            .collect()
-    }
-
-    /// Allocate a new overlay inode number
-    fn alloc_ino(&self) -> i64 {
-        self.next_ino.fetch_add(1, Ordering::Relaxed)
+        self.whiteouts.read().unwrap().children_of(dir_path)
     }
 
-    /// Get or create an overlay inode for a layer inode
-    fn get_or_create_overlay_ino(&self, layer: Layer, underlying_ino: i64, path: &str) -> i64 {
-        // Check reverse map first
+    /// Get or create an overlay inode for a layer inode found as `name` in
+    /// `parent_ino`, holding `lookups` more kernel lookups on it
+    fn get_or_create_overlay_ino(
+        &self,
+        layer: Layer,
+        underlying_ino: i64,
+        parent_ino: i64,
+        name: &str,
+        lookups: u64,
+    ) -> Result<i64> {
         {
-            let reverse = self.reverse_map.read().unwrap();
-            if let Some(&ino) = reverse.get(&(layer, underlying_ino)) {
-                return ino;
+            // Inodes already in place only change when looked up
+            let inodes = self.inodes.read().unwrap();
+            if let Some(&ino) = inodes.by_layer.get(&(layer, underlying_ino)) {
+                let placed = inodes
+                    .nodes
+                    .get(&ino)
+                    .is_some_and(|node| node.parent == parent_ino && &*node.name == name);
+                if lookups == 0 && placed {
+                    return Ok(ino);
+                }
             }
         }
-
-        // Allocate new inode
-        let ino = self.alloc_ino();
-        {
-            let mut inode_map = self.inode_map.write().unwrap();
-            inode_map.insert(
-                ino,
-                InodeInfo {
-                    layer,
-                    underlying_ino,
-                    path: path.to_string(),
-                },
-            );
-        }
-        {
-            let mut reverse = self.reverse_map.write().unwrap();
-            reverse.insert((layer, underlying_ino), ino);
-        }
-        {
-            let mut path_map = self.path_map.write().unwrap();
-            path_map.insert(path.to_string(), ino);
-        }
-
-        ino
+        let mut inodes = self.inodes.write().unwrap();
+        inodes
+            .map(layer, underlying_ino, parent_ino, name, lookups)
+            .ok_or(FsError::NotFound.into())
     }
 
-    /// Refresh an existing overlay inode mapping to point at a new backing inode/path.
+    /// Refresh an existing overlay inode mapping to point at a new backing
+    /// inode, found as `name` in `parent_ino`.
     ///
     /// This is used when we intentionally reuse an existing overlay inode number
     /// (for stability), but the underlying layer/path has changed (for example after
@@ -312,46 +1111,33 @@ impl OverlayFS {
         overlay_ino: i64,
         new_layer: Layer,
         new_underlying_ino: i64,
-        new_path: &str,
+        parent_ino: i64,
+        name: &str,
+        lookups: u64,
     ) {
-        let old_path = {
-            let mut inode_map = self.inode_map.write().unwrap();
-            let Some(info) = inode_map.get_mut(&overlay_ino) else {
-                return;
-            };
-            let old_path = info.path.clone();
-            info.layer = new_layer;
-            info.underlying_ino = new_underlying_ino;
-            info.path = new_path.to_string();
-            old_path
-        };
-
-        {
-            let mut reverse = self.reverse_map.write().unwrap();
-            reverse.insert((new_layer, new_underlying_ino), overlay_ino);
-        }
-
-        {
-            let mut path_map = self.path_map.write().unwrap();
-            if path_map.get(&old_path).copied() == Some(overlay_ino) {
-                path_map.remove(&old_path);
-            }
-            path_map.insert(new_path.to_string(), overlay_ino);
-        }
+        let mut inodes = self.inodes.write().unwrap();
+        inodes.remap(overlay_ino, new_layer, new_underlying_ino);
+        inodes.place(overlay_ino, parent_ino, name);
+        inodes.hold(overlay_ino, lookups);
     }
 
     /// Get inode info for an overlay inode
     fn get_inode_info(&self, ino: i64) -> Option<InodeInfo> {
-        self.inode_map.read().unwrap().get(&ino).cloned()
+        self.inodes.read().unwrap().info(ino)
     }
 
     /// Build path from parent inode and name
     fn build_path(&self, parent_ino: i64, name: &str) -> Result<String> {
-        let info = self.get_inode_info(parent_ino).ok_or(FsError::NotFound)?;
-        Ok(if info.path == "/" {
+        let path = self
+            .inodes
+            .read()
+            .unwrap()
+            .path(parent_ino)
+            .ok_or(FsError::NotFound)?;
+        Ok(if path == "/" {
             format!("/{}", name)
         } else {
-            format!("{}/{}", info.path, name)
+            format!("{}/{}", path, name)
         })
     }
 
@@ -389,27 +1175,10 @@ impl OverlayFS {
     /// we need to update the overlay inode to point to delta. This ensures
     /// that operations like readdir and unlink will check the delta layer.
     fn promote_to_delta(&self, path: &str, delta_ino: i64) {
-        let path_map = self.path_map.read().unwrap();
-        let overlay_ino = match path_map.get(path) {
-            Some(&ino) => ino,
-            None => return, // No existing mapping, nothing to promote
-        };
-        drop(path_map);
-
-        // Update the inode mapping to point to delta
-        let mut inode_map = self.inode_map.write().unwrap();
-        if let Some(info) = inode_map.get_mut(&overlay_ino) {
-            if info.layer == Layer::Base {
-                let old_base_ino = info.underlying_ino;
-                info.layer = Layer::Delta;
-                info.underlying_ino = delta_ino;
-
-                // Update reverse map: add delta mapping (keep base mapping for origin lookups)
-                drop(inode_map);
-                let mut reverse = self.reverse_map.write().unwrap();
-                reverse.remove(&(Layer::Base, old_base_ino));
-                reverse.insert((Layer::Delta, delta_ino), overlay_ino);
-            }
+        let mut inodes = self.inodes.write().unwrap();
+        // No existing mapping, nothing to promote
+        if let Some(overlay_ino) = inodes.resolve(path) {
+            inodes.promote(overlay_ino, delta_ino);
         }
     }
 
@@ -433,7 +1202,10 @@ impl OverlayFS {
         Ok(Some(ino))
     }
 
-    /// Ensure parent directories exist in delta layer
+    /// Ensure parent directories exist in delta layer.
+    ///
+    /// Each directory is looked up and created under its path lock, so
+    /// concurrent requests below the same base directory create it once.
     async fn ensure_parent_dirs(&self, path: &str, uid: u32, gid: u32) -> Result<()> {
         let components: Vec<&str> = path.split('/').filter(|s| !s.is_empty()).collect();
 
@@ -443,6 +1215,7 @@ impl OverlayFS {
 
         for component in components.iter().take(components.len().saturating_sub(1)) {
             current_path = format!("{}/{}", current_path, component);
+            let _lock = self.path_locks.lock(&current_path).await;
 
             // Remove any whiteout for this path
             self.remove_whiteout(&current_path).await?;
@@ -499,6 +1272,13 @@ impl OverlayFS {
 
     /// Copy a file from base to delta for modification
     async fn copy_up(&self, path: &str, base_ino: i64) -> Result<i64> {
+        let timer = COPY_UP.start();
+        let result = self.copy_up_untimed(path, base_ino).await;
+        timer.finish(result.is_ok(), 0);
+        result
+    }
+
+    async fn copy_up_untimed(&self, path: &str, base_ino: i64) -> Result<i64> {
         // Parse path to get parent and name
         let components: Vec<&str> = path.split('/').filter(|s| !s.is_empty()).collect();
         if components.is_empty() {
@@ -506,6 +1286,11 @@ impl OverlayFS {
         }
         let name = components.last().unwrap();
 
+        // A concurrent copy-up of the same path finishes first, and this one
+        // then finds its copy. Parents are locked after this, so deeper paths
+        // are always locked first.
+        let _lock = self.path_locks.lock(path).await;
+
         // Check if already copied up - walk delta to find parent and check for file
         let mut parent_ino: i64 = 1;
         let mut found_parent = true;
@@ -575,9 +1360,9 @@ impl OverlayFS {
             .await?;
             stats.ino
         } else {
-            // Regular file - read content and create
+            // Regular file - create and stream content across in bounded
+            // pieces, so memory use doesn't scale with the file size
             let base_file = self.base.open(base_ino, libc::O_RDONLY).await?;
-            let content = base_file.pread(0, base_stats.size as u64).await?;
 
             let (stats, delta_file) = FileSystem::create_file(
                 &self.delta,
@@ -588,39 +1373,115 @@ impl OverlayFS {
                 base_stats.gid,
             )
             .await?;
-            delta_file.pwrite(0, &content).await?;
+
+            let copied = async {
+                // Sized up front, so the copy gets the chunk size of its
+                // whole size, and all-zero ranges are left as holes, which
+                // read back as zeros
+                let size = base_stats.size as u64;
+                if size > 0 {
+                    delta_file.truncate(size).await?;
+                }
+                let mut offset = 0u64;
+                while offset < size {
+                    let len = std::cmp::min(COPY_UP_CHUNK_SIZE, size - offset);
+                    let data = base_file.pread(offset, len).await?;
+                    if data.is_empty() {
+                        break;
+                    }
+                    if data.iter().any(|&b| b != 0) {
+                        delta_file.pwrite(offset, &data).await?;
+                    }
+                    offset += data.len() as u64;
+                }
+                if offset < size {
+                    // The base file shrank while it was copied
+                    delta_file.truncate(offset).await?;
+                }
+                delta_file.flush().await
+            }
+            .await;
+            if let Err(e) = copied {
+                // Removed while the handle is open, so a write it buffered
+                // is discarded rather than committed when it is dropped
+                self.discard_copy_up(parent_ino, name, false).await;
+                return Err(e);
+            }
             stats.ino
         };
 
         // Store origin mapping
-        self.add_origin_mapping(delta_ino, base_ino).await?;
+        if let Err(e) = self.add_origin_mapping(delta_ino, base_ino).await {
+            self.discard_copy_up(parent_ino, name, base_stats.is_directory())
+                .await;
+            return Err(e);
+        }
 
         Ok(delta_ino)
     }
 
+    /// Remove the delta entry of a copy-up that failed partway, so the next
+    /// copy-up of the path starts over instead of finding it copied.
+    async fn discard_copy_up(&self, parent_ino: i64, name: &str, is_dir: bool) {
+        let result = if is_dir {
+            FileSystem::rmdir(&self.delta, parent_ino, name).await
+        } else {
+            FileSystem::unlink(&self.delta, parent_ino, name).await
+        };
+        if let Err(e) = result {
+            tracing::warn!("Failed to remove partial copy-up of {}: {}", name, e);
+        }
+    }
+
+    /// Copy-up state of a base file, shared by its read-only handles
+    fn base_copy(&self, base_ino: i64) -> Arc<OnceLock<i64>> {
+        let mut copies = self.base_copies.lock().unwrap();
+        if let Some(copy) = copies.get(&base_ino).and_then(Weak::upgrade) {
+            return copy;
+        }
+        let copy = Arc::new(OnceLock::new());
+        copies.insert(base_ino, Arc::downgrade(&copy));
+        copy
+    }
+
+    /// Open a base-layer file read-only, without copying it up
+    async fn open_base(&self, overlay_ino: i64, info: &InodeInfo, flags: i32) -> Result<BoxedFile> {
+        let base = self.base.open(info.underlying_ino, flags).await?;
+        let copied_up = self.base_copy(info.underlying_ino);
+        // A copy-up since `info` was looked up has remapped the inode before
+        // switching the handles it found over
+        if let Some(now) = self.get_inode_info(overlay_ino) {
+            if now.layer == Layer::Delta {
+                let _ = copied_up.set(now.underlying_ino);
+            }
+        }
+        Ok(Arc::new(BaseFile {
+            base,
+            base_ino: info.underlying_ino,
+            overlay_ino,
+            delta: self.delta.clone(),
+            copied_up,
+            copies: self.base_copies.clone(),
+            delta_file: OnceCell::new(),
+        }))
+    }
+
     /// Copy-up a file and update the inode mapping so subsequent operations
     /// go to the delta layer. Returns the delta inode.
     async fn copy_up_and_update_mapping(&self, overlay_ino: i64, info: &InodeInfo) -> Result<i64> {
         let delta_ino = self.copy_up(&info.path, info.underlying_ino).await?;
 
-        // Update the inode mapping to point to delta
-        {
-            let mut inode_map = self.inode_map.write().unwrap();
-            inode_map.insert(
-                overlay_ino,
-                InodeInfo {
-                    layer: Layer::Delta,
-                    underlying_ino: delta_ino,
-                    path: info.path.clone(),
-                },
-            );
-        }
-        {
-            let mut reverse_map = self.reverse_map.write().unwrap();
-            // Keep the base mapping so lookups via origin still return the same overlay inode
-            // (Layer::Base, base_ino) -> overlay_ino is kept
-            // Add the delta mapping as well
-            reverse_map.insert((Layer::Delta, delta_ino), overlay_ino);
+        // Update the inode mapping to point to delta. The base mapping is
+        // kept so lookups via origin still return the same overlay inode.
+        self.inodes
+            .write()
+            .unwrap()
+            .remap(overlay_ino, Layer::Delta, delta_ino);
+
+        // Switch read-only handles of the base file over to the copy
+        let copies = self.base_copies.lock().unwrap();
+        if let Some(copy) = copies.get(&info.underlying_ino).and_then(Weak::upgrade) {
+            let _ = copy.set(delta_ino);
         }
 
         Ok(delta_ino)
@@ -636,78 +1497,7 @@ impl FileSystem for OverlayFS {
             name
         );
 
-        let parent_info = self.get_inode_info(parent_ino).ok_or(FsError::NotFound)?;
-        let path = self.build_path(parent_ino, name)?;
-
-        // Check for whiteout
-        if self.is_whiteout(&path) {
-            return Ok(None);
-        }
-
-        // Try delta first
-        let delta_parent_ino = self.resolve_delta_parent(&parent_info).await?;
-
-        // Look up in delta (only if we resolved the correct parent)
-        if let Some(delta_stats) = match delta_parent_ino {
-            Some(ino) => self.delta.lookup(ino, name).await?,
-            None => None,
-        } {
-            let delta_ino = delta_stats.ino;
-            let ino = self.get_or_create_overlay_ino(Layer::Delta, delta_ino, &path);
-            let mut stats = delta_stats;
-
-            // Origin mapping: reuse an existing Base overlay inode for stable
-            // numbering within a session.  After remount the base_ino stored in
-            // the mapping may be stale (the new HostFS has a fresh inode cache),
-            // so only use it when the reverse_map already contains a live entry.
-            // Otherwise keep the Delta overlay inode — the downstream code
-            // already walks base from root when the parent is tagged Delta.
-            if let Some(base_ino) = self.get_origin_ino(stats.ino) {
-                let reverse = self.reverse_map.read().unwrap();
-                if let Some(existing_ino) = reverse.get(&(Layer::Base, base_ino)).copied() {
-                    drop(reverse);
-                    self.refresh_overlay_mapping(existing_ino, Layer::Delta, delta_ino, &path);
-                    stats.ino = existing_ino;
-                } else {
-                    stats.ino = ino;
-                }
-            } else {
-                stats.ino = ino;
-            }
-
-            return Ok(Some(stats));
-        }
-
-        // Try base
-        let base_parent_ino = if parent_info.layer == Layer::Base {
-            parent_info.underlying_ino
-        } else {
-            // Need to find corresponding base parent by path
-            // For root, use base root (1)
-            if parent_info.path == "/" {
-                1
-            } else {
-                // Walk the base to find the parent
-                let mut base_ino: i64 = 1;
-                for comp in parent_info.path.split('/').filter(|s| !s.is_empty()) {
-                    if let Some(s) = self.base.lookup(base_ino, comp).await? {
-                        base_ino = s.ino;
-                    } else {
-                        return Ok(None);
-                    }
-                }
-                base_ino
-            }
-        };
-
-        if let Some(base_stats) = self.base.lookup(base_parent_ino, name).await? {
-            let ino = self.get_or_create_overlay_ino(Layer::Base, base_stats.ino, &path);
-            let mut stats = base_stats;
-            stats.ino = ino;
-            return Ok(Some(stats));
-        }
-
-        Ok(None)
+        self.lookup_entry(parent_ino, name, true).await
     }
 
     async fn getattr(&self, ino: i64) -> Result<Option<Stats>> {
@@ -815,90 +1605,7 @@ impl FileSystem for OverlayFS {
 
     async fn readdir_plus(&self, ino: i64) -> Result<Option<Vec<DirEntry>>> {
         trace!("OverlayFS::readdir_plus: ino={}", ino);
-
-        let info = self.get_inode_info(ino).ok_or(FsError::NotFound)?;
-        let child_whiteouts = self.get_child_whiteouts(&info.path);
-
-        let mut entries_map: HashMap<String, DirEntry> = HashMap::new();
-
-        // Get base entries first (so delta can override)
-        let base_ino = if info.layer == Layer::Base {
-            Some(info.underlying_ino)
-        } else {
-            let components: Vec<&str> = info.path.split('/').filter(|s| !s.is_empty()).collect();
-            let mut ino: i64 = 1;
-            let mut found_all = true;
-            for comp in &components {
-                if let Some(s) = self.base.lookup(ino, comp).await? {
-                    ino = s.ino;
-                } else {
-                    found_all = false;
-                    break;
-                }
-            }
-            if found_all {
-                Some(ino)
-            } else {
-                None
-            }
-        };
-
-        if let Some(base_ino) = base_ino {
-            if let Some(base_entries) = self.base.readdir_plus(base_ino).await? {
-                for mut entry in base_entries {
-                    let entry_path = if info.path == "/" {
-                        format!("/{}", entry.name)
-                    } else {
-                        format!("{}/{}", info.path, entry.name)
-                    };
-
-                    if !self.is_whiteout(&entry_path) && !child_whiteouts.contains(&entry.name) {
-                        let overlay_ino = self.get_or_create_overlay_ino(
-                            Layer::Base,
-                            entry.stats.ino,
-                            &entry_path,
-                        );
-                        entry.stats.ino = overlay_ino;
-                        entries_map.insert(entry.name.clone(), entry);
-                    }
-                }
-            }
-        }
-
-        // Get delta entries (override base)
-        if info.layer == Layer::Delta {
-            if let Some(delta_entries) = self.delta.readdir_plus(info.underlying_ino).await? {
-                for mut entry in delta_entries {
-                    let entry_path = if info.path == "/" {
-                        format!("/{}", entry.name)
-                    } else {
-                        format!("{}/{}", info.path, entry.name)
-                    };
-                    if self.is_whiteout(&entry_path) || child_whiteouts.contains(&entry.name) {
-                        continue;
-                    }
-
-                    // Check for origin mapping
-                    if let Some(base_ino) = self.get_origin_ino(entry.stats.ino) {
-                        entry.stats.ino =
-                            self.get_or_create_overlay_ino(Layer::Base, base_ino, &entry_path);
-                    } else {
-                        let overlay_ino = self.get_or_create_overlay_ino(
-                            Layer::Delta,
-                            entry.stats.ino,
-                            &entry_path,
-                        );
-                        entry.stats.ino = overlay_ino;
-                    }
-
-                    entries_map.insert(entry.name.clone(), entry);
-                }
-            }
-        }
-
-        let mut result: Vec<_> = entries_map.into_values().collect();
-        result.sort_by(|a, b| a.name.cmp(&b.name));
-        Ok(Some(result))
+        self.list_dir_plus(ino, false).await
     }
 
     async fn chmod(&self, ino: i64, mode: u32) -> Result<()> {
@@ -962,8 +1669,11 @@ impl FileSystem for OverlayFS {
             return Err(FsError::NotFound.into());
         }
 
+        // Read-only opens of base files are served from the base layer
+        let read_only = flags & libc::O_ACCMODE == libc::O_RDONLY && flags & libc::O_TRUNC == 0;
         let delta_ino = match info.layer {
             Layer::Delta => info.underlying_ino,
+            Layer::Base if read_only => return self.open_base(ino, &info, flags).await,
             Layer::Base => self.copy_up_and_update_mapping(ino, &info).await?,
         };
 
@@ -984,7 +1694,7 @@ impl FileSystem for OverlayFS {
         let path = self.build_path(parent_ino, name)?;
 
         // Check if already exists
-        if self.lookup(parent_ino, name).await?.is_some() {
+        if self.lookup_entry(parent_ino, name, false).await?.is_some() {
             return Err(FsError::AlreadyExists.into());
         }
 
@@ -1001,8 +1711,7 @@ impl FileSystem for OverlayFS {
 
         let mut stats =
             FileSystem::mkdir(&self.delta, delta_parent_ino, name, mode, uid, gid).await?;
-        let overlay_ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, &path);
-        stats.ino = overlay_ino;
+        stats.ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, parent_ino, name, 1)?;
 
         Ok(stats)
     }
@@ -1037,8 +1746,7 @@ impl FileSystem for OverlayFS {
 
         let (mut stats, file) =
             FileSystem::create_file(&self.delta, delta_parent_ino, name, mode, uid, gid).await?;
-        let overlay_ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, &path);
-        stats.ino = overlay_ino;
+        stats.ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, parent_ino, name, 1)?;
 
         Ok((stats, file))
     }
@@ -1067,8 +1775,7 @@ impl FileSystem for OverlayFS {
 
         let mut stats =
             FileSystem::mknod(&self.delta, delta_parent_ino, name, mode, rdev, uid, gid).await?;
-        let overlay_ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, &path);
-        stats.ino = overlay_ino;
+        stats.ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, parent_ino, name, 1)?;
 
         Ok(stats)
     }
@@ -1101,8 +1808,7 @@ impl FileSystem for OverlayFS {
 
         let mut stats =
             FileSystem::symlink(&self.delta, delta_parent_ino, name, target, uid, gid).await?;
-        let overlay_ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, &path);
-        stats.ino = overlay_ino;
+        stats.ino = self.get_or_create_overlay_ino(Layer::Delta, stats.ino, parent_ino, name, 1)?;
 
         Ok(stats)
     }
@@ -1119,7 +1825,7 @@ impl FileSystem for OverlayFS {
 
         // Check if it exists
         let stats = self
-            .lookup(parent_ino, name)
+            .lookup_entry(parent_ino, name, false)
             .await?
             .ok_or(FsError::NotFound)?;
         if stats.is_directory() {
@@ -1138,7 +1844,7 @@ impl FileSystem for OverlayFS {
 
         // If the file is still visible through the overlay after delta removal,
         // it must be coming from the base layer — create a whiteout to hide it.
-        if self.lookup(parent_ino, name).await?.is_some() {
+        if self.lookup_entry(parent_ino, name, false).await?.is_some() {
             self.create_whiteout(&path).await?;
         }
 
@@ -1153,7 +1859,7 @@ impl FileSystem for OverlayFS {
 
         // Check if it exists and is a directory
         let stats = self
-            .lookup(parent_ino, name)
+            .lookup_entry(parent_ino, name, false)
             .await?
             .ok_or(FsError::NotFound)?;
         if !stats.is_directory() {
@@ -1178,7 +1884,7 @@ impl FileSystem for OverlayFS {
 
         // If the directory is still visible through the overlay after delta removal,
         // it must be coming from the base layer — create a whiteout to hide it.
-        if self.lookup(parent_ino, name).await?.is_some() {
+        if self.lookup_entry(parent_ino, name, false).await?.is_some() {
             self.create_whiteout(&path).await?;
         }
 
@@ -1203,7 +1909,7 @@ impl FileSystem for OverlayFS {
         let delta_ino = if info.layer == Layer::Delta {
             info.underlying_ino
         } else {
-            self.copy_up(&info.path, info.underlying_ino).await?
+            self.copy_up_and_update_mapping(ino, &info).await?
         };
 
         self.remove_whiteout(&new_path).await?;
@@ -1217,6 +1923,7 @@ impl FileSystem for OverlayFS {
 
         let mut stats = FileSystem::link(&self.delta, delta_ino, delta_parent_ino, newname).await?;
         stats.ino = ino; // Keep original overlay inode
+        self.inodes.write().unwrap().hold(ino, 1);
 
         Ok(stats)
     }
@@ -1247,7 +1954,7 @@ impl FileSystem for OverlayFS {
 
         // Get source stats
         let src_stats = self
-            .lookup(oldparent_ino, oldname)
+            .lookup_entry(oldparent_ino, oldname, false)
             .await?
             .ok_or(FsError::NotFound)?;
         let src_info = self
@@ -1256,7 +1963,8 @@ impl FileSystem for OverlayFS {
 
         // If source is in base, copy to delta first
         if src_info.layer == Layer::Base {
-            self.copy_up(&old_path, src_info.underlying_ino).await?;
+            self.copy_up_and_update_mapping(src_stats.ino, &src_info)
+                .await?;
         }
 
         // Remove whiteout at destination
@@ -1286,10 +1994,21 @@ impl FileSystem for OverlayFS {
 
         // If the old file is still visible through the overlay after the rename,
         // it must be coming from the base layer — create a whiteout to hide it.
-        if self.lookup(oldparent_ino, oldname).await?.is_some() {
+        if self
+            .lookup_entry(oldparent_ino, oldname, false)
+            .await?
+            .is_some()
+        {
             self.create_whiteout(&old_path).await?;
         }
 
+        // Move the source, and everything below it, once the old name can no
+        // longer map back to it
+        self.inodes
+            .write()
+            .unwrap()
+            .place(src_stats.ino, newparent_ino, newname);
+
         Ok(())
     }
 
@@ -1298,27 +2017,33 @@ impl FileSystem for OverlayFS {
     }
 
     async fn forget(&self, ino: i64, nlookup: u64) {
-        // Look up the inode info to determine which layer it belongs to
-        let info = match self.get_inode_info(ino) {
-            Some(i) => i,
-            None => return, // Unknown inode, nothing to forget
+        // Release the lookups, dropping the inode once the kernel holds none,
+        // and find which layer it belongs to
+        let Some((layer, underlying_ino)) = self.inodes.write().unwrap().forget(ino, nlookup)
+        else {
+            return; // Unknown inode, nothing to forget
         };
 
         // Pass through to the appropriate layer
-        match info.layer {
+        match layer {
             Layer::Delta => {
                 // Delta (AgentFS) doesn't cache fds, but call it anyway for completeness
-                FileSystem::forget(&self.delta, info.underlying_ino, nlookup).await;
+                FileSystem::forget(&self.delta, underlying_ino, nlookup).await;
             }
             Layer::Base => {
+                // Drop the copy-up state of the file if no handle is left
+                let mut copies = self.base_copies.lock().unwrap();
+                if copies
+                    .get(&underlying_ino)
+                    .is_some_and(|copy| copy.strong_count() == 0)
+                {
+                    copies.remove(&underlying_ino);
+                }
+                drop(copies);
                 // Base layer (HostFS) caches O_PATH fds and needs forget
-                self.base.forget(info.underlying_ino, nlookup).await;
+                self.base.forget(underlying_ino, nlookup).await;
             }
         }
-
-        // Note: We don't remove from inode_map here because the overlay layer's
-        // inode mapping is relatively lightweight (no fd). The base layer's
-        // forget handles the actual fd cleanup.
     }
 }
 
@@ -1348,6 +2073,73 @@ mod tests {
         Ok((overlay, base_dir, delta_dir))
     }
 
+    #[test]
+    fn test_whiteout_tree() {
+        let mut tree = WhiteoutTree::default();
+        tree.insert("/a/b");
+        tree.insert("/a/c/d");
+        tree.insert("/e");
+
+        assert!(tree.contains("/a/b"));
+        assert!(!tree.contains("/a"));
+        assert!(!tree.contains("/a/c"));
+
+        // Ancestors cover their descendants
+        assert!(tree.covers("/a/b"));
+        assert!(tree.covers("/a/b/x/y"));
+        assert!(!tree.covers("/a"));
+        assert!(!tree.covers("/a/c"));
+        assert!(tree.covers("/a/c/d"));
+
+        let mut children: Vec<String> = tree.children_of("/a").into_iter().collect();
+        children.sort();
+        assert_eq!(children, vec!["b".to_string()]);
+        let root_children: Vec<String> = tree.children_of("/").into_iter().collect();
+        assert_eq!(root_children, vec!["e".to_string()]);
+        assert!(tree.children_of("/missing").is_empty());
+
+        // Removal prunes empty branches but keeps siblings
+        assert!(tree.remove("/a/c/d"));
+        assert!(!tree.remove("/a/c/d"));
+        assert!(tree.find("/a/c").is_none());
+        assert!(tree.contains("/a/b"));
+    }
+
+    #[test]
+    fn test_inode_tree() {
+        let mut tree = InodeTree::new();
+        let dir = tree.map(Layer::Base, 10, ROOT_INO, "dir", 1).unwrap();
+        let sub = tree.map(Layer::Base, 11, dir, "sub", 1).unwrap();
+        let file = tree.map(Layer::Delta, 20, sub, "file", 1).unwrap();
+        assert_eq!(tree.path(file).unwrap(), "/dir/sub/file");
+        assert_eq!(tree.resolve("/dir/sub/file"), Some(file));
+        assert_eq!(tree.map(Layer::Delta, 20, sub, "file", 1), Some(file));
+        assert!(tree.map(Layer::Delta, 21, 999, "orphan", 1).is_none());
+
+        // Renaming a directory moves everything below it
+        tree.place(dir, ROOT_INO, "moved");
+        assert_eq!(tree.path(file).unwrap(), "/moved/sub/file");
+        assert_eq!(tree.resolve("/dir/sub/file"), None);
+        assert_eq!(tree.resolve("/moved/sub/file"), Some(file));
+
+        // A directory is never moved below itself
+        tree.place(dir, sub, "loop");
+        assert_eq!(tree.path(dir).unwrap(), "/moved");
+
+        // Inodes go once the kernel forgets them and nothing below them is
+        // held, taking their names along
+        assert_eq!(tree.forget(dir, 1), Some((Layer::Base, 10)));
+        assert_eq!(tree.forget(sub, 1), Some((Layer::Base, 11)));
+        assert_eq!(tree.forget(file, 1), Some((Layer::Delta, 20)));
+        assert_eq!(tree.nodes.len(), 4);
+        tree.forget(file, 1);
+        assert_eq!(tree.nodes.len(), 1);
+        assert_eq!(tree.by_layer.len(), 1);
+        assert!(tree.by_entry.is_empty());
+        assert!(tree.names.is_empty());
+        assert_eq!(tree.forget(file, 1), None);
+    }
+
     #[tokio::test]
     async fn test_overlay_lookup_base() -> Result<()> {
         let (overlay, _base_dir, _delta_dir) = create_test_overlay().await?;
@@ -1421,6 +2213,122 @@ mod tests {
         Ok(())
     }
 
+    #[tokio::test]
+    async fn test_overlay_copy_on_write_large_sparse_file() -> Result<()> {
+        let (overlay, base_dir, _delta_dir) = create_test_overlay().await?;
+
+        // Spans several copy-up pieces, with a zero-filled middle and tail
+        let piece = COPY_UP_CHUNK_SIZE as usize;
+        let mut content = vec![0u8; piece * 3 + 100];
+        content[..piece].fill(b'a');
+        content[piece * 2..piece * 2 + 10].fill(b'b');
+        std::fs::write(base_dir.path().join("large.bin"), &content)?;
+
+        let stats = overlay.lookup(ROOT_INO, "large.bin").await?.unwrap();
+        let file = overlay.open(stats.ino, libc::O_RDWR).await?;
+        file.pwrite(0, b"x").await?;
+        content[0] = b'x';
+
+        assert_eq!(file.fstat().await?.size, content.len() as i64);
+        assert_eq!(file.pread(0, content.len() as u64).await?, content);
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_overlay_read_only_open_skips_copy_up() -> Result<()> {
+        let (overlay, _base_dir, _delta_dir) = create_test_overlay().await?;
+        let stats = overlay.lookup(ROOT_INO, "base.txt").await?.unwrap();
+
+        // A read-only open is served from the base file
+        let reader = overlay.open(stats.ino, libc::O_RDONLY).await?;
+        assert_eq!(reader.pread(0, 100).await?, b"base content");
+        assert!(reader.raw_fd().is_some());
+        assert_eq!(reader.fstat().await?.ino, stats.ino);
+        assert!(FileSystem::lookup(&overlay.delta, ROOT_INO, "base.txt")
+            .await?
+            .is_none());
+        assert!(reader.pwrite(0, b"x").await.is_err());
+
+        // Once a writer copies the file up, the reader follows the copy
+        let writer = overlay.open(stats.ino, libc::O_RDWR).await?;
+        writer.pwrite(0, b"BASE").await?;
+        writer.flush().await?;
+        assert_eq!(reader.pread(0, 100).await?, b"BASE content");
+        assert!(reader.raw_fd().is_none());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_overlay_base_copies_go_with_last_handle() -> Result<()> {
+        let (overlay, _base_dir, _delta_dir) = create_test_overlay().await?;
+        let stats = overlay.lookup(ROOT_INO, "base.txt").await?.unwrap();
+
+        // Read-only handles of a base file share its copy-up state
+        let first = overlay.open(stats.ino, libc::O_RDONLY).await?;
+        let second = overlay.open(stats.ino, libc::O_RDONLY).await?;
+        assert_eq!(overlay.base_copies.lock().unwrap().len(), 1);
+        drop(first);
+        assert_eq!(overlay.base_copies.lock().unwrap().len(), 1);
+        drop(second);
+        assert!(overlay.base_copies.lock().unwrap().is_empty());
+
+        // A handle open across a copy-up follows it, then goes away too
+        let reader = overlay.open(stats.ino, libc::O_RDONLY).await?;
+        overlay.chmod(stats.ino, 0o600).await?;
+        assert!(reader.raw_fd().is_none());
+        assert_eq!(reader.pread(0, 100).await?, b"base content");
+        drop(reader);
+        assert!(overlay.base_copies.lock().unwrap().is_empty());
+
+        Ok(())
+    }
+
+    #[tokio::test(flavor = "multi_thread", worker_threads = 4)]
+    async fn test_overlay_concurrent_copy_ups_of_siblings() -> Result<()> {
+        let (overlay, base_dir, _delta_dir) = create_test_overlay().await?;
+        std::fs::create_dir_all(base_dir.path().join("pkg/src"))?;
+        for i in 0..16 {
+            let path = base_dir.path().join(format!("pkg/src/f{i:02}"));
+            std::fs::write(path, format!("base {i:02}"))?;
+        }
+        let overlay = Arc::new(overlay);
+
+        // Every file is opened for writing twice at once, so parents and
+        // files are copied up by overlapping requests
+        let mut tasks = tokio::task::JoinSet::new();
+        for i in 0..32 {
+            let overlay = overlay.clone();
+            tasks.spawn(async move {
+                let pkg = overlay.lookup(ROOT_INO, "pkg").await?.unwrap();
+                let src = overlay.lookup(pkg.ino, "src").await?.unwrap();
+                let name = format!("f{:02}", i % 16);
+                let stats = overlay.lookup(src.ino, &name).await?.unwrap();
+                let file = overlay.open(stats.ino, libc::O_RDWR).await?;
+                let mark = if i < 16 { (0, b"A") } else { (1, b"B") };
+                file.pwrite(mark.0, mark.1).await?;
+                Ok::<_, crate::error::Error>(())
+            });
+        }
+        while let Some(result) = tasks.join_next().await {
+            result.expect("copy-up task panicked")?;
+        }
+
+        let pkg = overlay.lookup(ROOT_INO, "pkg").await?.unwrap();
+        let src = overlay.lookup(pkg.ino, "src").await?.unwrap();
+        let mut names = overlay.readdir(src.ino).await?.unwrap();
+        names.sort();
+        assert_eq!(names.len(), 16);
+        for (i, name) in names.iter().enumerate() {
+            let stats = overlay.lookup(src.ino, name).await?.unwrap();
+            let file = overlay.open(stats.ino, libc::O_RDONLY).await?;
+            assert_eq!(file.pread(0, 100).await?, format!("ABse {i:02}").as_bytes());
+        }
+
+        Ok(())
+    }
+
     #[tokio::test]
     async fn test_overlay_copy_on_write_inode_stability() -> Result<()> {
         let (overlay, _base_dir, _delta_dir) = create_test_overlay().await?;
@@ -2201,6 +3109,91 @@ mod tests {
         Ok(())
     }
 
+    #[tokio::test]
+    async fn test_overlay_warm_up_from_saved_hot_paths() -> Result<()> {
+        let base_dir = tempdir()?;
+        std::fs::create_dir_all(base_dir.path().join("dir/sub"))?;
+        std::fs::write(base_dir.path().join("dir/sub/base.txt"), b"base")?;
+
+        let delta_dir = tempdir()?;
+        let db_path = delta_dir.path().join("delta.db");
+
+        // Session 1: record the directories looked up
+        let base = Arc::new(HostFS::new(base_dir.path())?);
+        let delta = AgentFS::new(db_path.to_str().unwrap()).await?;
+        let overlay = OverlayFS::new(base, delta);
+        overlay.init(base_dir.path().to_str().unwrap()).await?;
+        overlay.record_hot_paths();
+
+        let dir = overlay.lookup(ROOT_INO, "dir").await?.unwrap();
+        overlay.lookup(dir.ino, "sub").await?.unwrap();
+        overlay
+            .create_file(dir.ino, "delta.txt", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        overlay.save_hot_paths().await?;
+
+        // Session 2: warm up from them
+        let base = Arc::new(HostFS::new(base_dir.path())?);
+        let delta = AgentFS::new(db_path.to_str().unwrap()).await?;
+        let overlay = Arc::new(OverlayFS::new(base, delta));
+        overlay.init(base_dir.path().to_str().unwrap()).await?;
+        overlay.record_hot_paths();
+
+        let mut hot_paths = overlay.load_hot_paths().await?;
+        hot_paths.sort();
+        assert_eq!(hot_paths, ["/dir", "/dir/sub"]);
+
+        hot_paths.push("/gone".to_string());
+        assert_eq!(overlay.clone().warm_up(hot_paths).await, 2);
+
+        // Entries of both layers are mapped before they are looked up
+        let inodes = overlay.inodes.read().unwrap();
+        assert!(inodes.resolve("/dir/delta.txt").is_some());
+        assert!(inodes.resolve("/dir/sub/base.txt").is_some());
+        drop(inodes);
+
+        // Warming up doesn't count as using the paths
+        assert!(overlay
+            .hot_paths
+            .lock()
+            .unwrap()
+            .as_ref()
+            .unwrap()
+            .is_empty());
+
+        Ok(())
+    }
+
+    #[tokio::test]
+    async fn test_overlay_rename_dir_moves_inodes_and_forget_drops_them() -> Result<()> {
+        let (overlay, _base_dir, _delta_dir) = create_test_overlay().await?;
+
+        let dir = overlay.mkdir(ROOT_INO, "a", 0o755, 0, 0).await?;
+        let (file, _) = overlay
+            .create_file(dir.ino, "f", DEFAULT_FILE_MODE, 0, 0)
+            .await?;
+        overlay.rename(ROOT_INO, "a", ROOT_INO, "b").await?;
+
+        // Inodes below the renamed directory are found at their new path
+        assert_eq!(overlay.get_inode_info(file.ino).unwrap().path, "/b/f");
+        let f = overlay.open(file.ino, libc::O_RDWR).await?;
+        f.pwrite(0, b"moved").await?;
+        let stats = overlay.lookup(ROOT_INO, "b").await?.unwrap();
+        assert_eq!(stats.ino, dir.ino);
+        let stats = overlay.lookup(dir.ino, "f").await?.unwrap();
+        assert_eq!(stats.ino, file.ino);
+        assert_eq!(stats.size, 5);
+
+        // Once the kernel forgets them, only the root is left
+        overlay.forget(file.ino, 2).await;
+        assert!(overlay.get_inode_info(dir.ino).is_some());
+        overlay.forget(dir.ino, 2).await;
+        assert!(overlay.get_inode_info(dir.ino).is_none());
+        assert_eq!(overlay.inodes.read().unwrap().nodes.len(), 1);
+
+        Ok(())
+    }
+
     /// Test unlink of a BASE file after the parent directory has been promoted
     /// from Base to Delta layer.
     ///
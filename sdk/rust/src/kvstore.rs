@@ -1,12 +1,93 @@
 use crate::connection_pool::ConnectionPool;
 use crate::error::Result;
+use crate::metrics::Counter;
+use lru::LruCache;
 use serde::{Deserialize, Serialize};
-use turso::Builder;
+use std::collections::HashMap;
+use std::num::NonZeroUsize;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use turso::transaction::{Transaction, TransactionBehavior};
+use turso::{Builder, Value};
+
+static KV_CACHE_HITS: Counter = Counter::new("kv_cache.hits");
+static KV_CACHE_MISSES: Counter = Counter::new("kv_cache.misses");
+
+/// Most keys looked up by one query of `get_many()`
+const GET_MANY_BATCH_SIZE: usize = 256;
 
 /// A key-value store backed by SQLite
 #[derive(Clone)]
 pub struct KvStore {
     pool: ConnectionPool,
+    cache: Option<Arc<KvCache>>,
+}
+
+/// Decoded values of recently used keys, `None` for keys known to be absent.
+///
+/// Lookups run on reader connections concurrently with the writer, so a
+/// lookup may finish after a write changed the key. Writers bump the
+/// generation after committing, and lookups populate the cache with
+/// `insert_if_current()` to avoid caching a value from an older snapshot.
+struct KvCache {
+    entries: Mutex<LruCache<String, Option<Arc<serde_json::Value>>>>,
+    generation: AtomicU64,
+}
+
+impl KvCache {
+    fn get(&self, key: &str) -> Option<Option<Arc<serde_json::Value>>> {
+        let entry = self.entries.lock().unwrap().get(key).cloned();
+        match entry {
+            Some(_) => KV_CACHE_HITS.increment(),
+            None => KV_CACHE_MISSES.increment(),
+        }
+        entry
+    }
+
+    fn generation(&self) -> u64 {
+        self.generation.load(Ordering::Acquire)
+    }
+
+    /// Cache a value read at `generation`, unless a write happened since
+    fn insert_if_current(&self, generation: u64, key: &str, value: Option<Arc<serde_json::Value>>) {
+        let mut entries = self.entries.lock().unwrap();
+        if self.generation() == generation {
+            entries.put(key.to_string(), value);
+        }
+    }
+
+    /// Record committed writes of `values` to their keys
+    fn written<'a>(&self, values: impl IntoIterator<Item = (&'a str, Option<serde_json::Value>)>) {
+        let mut entries = self.entries.lock().unwrap();
+        self.generation.fetch_add(1, Ordering::AcqRel);
+        for (key, value) in values {
+            entries.put(key.to_string(), value.map(Arc::new));
+        }
+    }
+}
+
+/// Smallest string greater than every string starting with `prefix`, `None`
+/// if there is none.
+///
+/// Keys compare by their UTF-8 bytes, which orders them like their chars.
+fn prefix_end(prefix: &str) -> Option<String> {
+    let mut chars: Vec<char> = prefix.chars().collect();
+    while let Some(last) = chars.pop() {
+        let next = (last as u32 + 1..=char::MAX as u32).find_map(char::from_u32);
+        if let Some(next) = next {
+            chars.push(next);
+            return Some(chars.into_iter().collect());
+        }
+    }
+    None
+}
+
+fn text_value(value: &Value) -> Option<&str> {
+    if let Value::Text(s) = value {
+        Some(s.as_str())
+    } else {
+        None
+    }
 }
 
 impl KvStore {
@@ -14,18 +95,32 @@ impl KvStore {
     pub async fn new(db_path: &str) -> Result<Self> {
         let db = Builder::new_local(db_path).build().await?;
         let pool = ConnectionPool::new(db);
-        let kv = Self { pool };
+        let kv = Self { pool, cache: None };
         kv.initialize().await?;
         Ok(kv)
     }
 
     /// Create a KV store from a connection pool
     pub async fn from_pool(pool: ConnectionPool) -> Result<Self> {
-        let kv = Self { pool };
+        let kv = Self { pool, cache: None };
         kv.initialize().await?;
         Ok(kv)
     }
 
+    /// Cache the decoded values of up to `capacity` recently used keys
+    ///
+    /// Reads of cached keys skip the database. The cache is kept up to date
+    /// with writes through this store and its clones, so only enable it when
+    /// no other process or store writes the same database.
+    pub fn with_cache(mut self, capacity: usize) -> Self {
+        let capacity = NonZeroUsize::new(capacity).expect("cache size must be > 0");
+        self.cache = Some(Arc::new(KvCache {
+            entries: Mutex::new(LruCache::new(capacity)),
+            generation: AtomicU64::new(0),
+        }));
+        self
+    }
+
     /// Initialize the database schema
     async fn initialize(&self) -> Result<()> {
         let conn = self.pool.get_connection().await?;
@@ -63,12 +158,65 @@ impl KvStore {
             (key, serialized.as_str()),
         )
         .await?;
+        if let Some(cache) = &self.cache {
+            cache.written([(key, Some(serde_json::from_str(&serialized)?))]);
+        }
+        Ok(())
+    }
+
+    /// Set many key-value pairs in one transaction
+    pub async fn set_many<K: AsRef<str>, V: Serialize>(&self, entries: &[(K, V)]) -> Result<()> {
+        let mut serialized = Vec::with_capacity(entries.len());
+        for (_, value) in entries {
+            serialized.push(serde_json::to_string(value)?);
+        }
+
+        let conn = self.pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+        let mut stmt = conn
+            .prepare_cached(
+                "INSERT INTO kv_store (key, value, updated_at)
+                VALUES (?, ?, unixepoch())
+                ON CONFLICT(key) DO UPDATE SET
+                    value = excluded.value,
+                    updated_at = unixepoch()",
+            )
+            .await?;
+        for ((key, _), value) in entries.iter().zip(&serialized) {
+            stmt.execute((key.as_ref(), value.as_str())).await?;
+        }
+        txn.commit().await?;
+
+        if let Some(cache) = &self.cache {
+            let mut values = Vec::with_capacity(entries.len());
+            for ((key, _), value) in entries.iter().zip(&serialized) {
+                values.push((key.as_ref(), Some(serde_json::from_str(value)?)));
+            }
+            cache.written(values);
+        }
         Ok(())
     }
 
     /// Get a value by key
     pub async fn get<V: for<'de> Deserialize<'de>>(&self, key: &str) -> Result<Option<V>> {
-        let conn = self.pool.get_connection().await?;
+        let Some(cache) = &self.cache else {
+            return self.get_uncached(key).await;
+        };
+        if let Some(value) = cache.get(key) {
+            return Ok(value.map(|v| V::deserialize(&*v)).transpose()?);
+        }
+
+        let generation = cache.generation();
+        let value = self
+            .get_uncached::<serde_json::Value>(key)
+            .await?
+            .map(Arc::new);
+        cache.insert_if_current(generation, key, value.clone());
+        Ok(value.map(|v| V::deserialize(&*v)).transpose()?)
+    }
+
+    async fn get_uncached<V: for<'de> Deserialize<'de>>(&self, key: &str) -> Result<Option<V>> {
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn
             .query("SELECT value FROM kv_store WHERE key = ?", (key,))
             .await?;
@@ -91,17 +239,147 @@ impl KvStore {
         }
     }
 
+    /// Get the values of many keys, in the order of `keys`
+    ///
+    /// Keys missing from the cache are looked up with a few `IN` queries,
+    /// read in one transaction so that they see the same snapshot.
+    pub async fn get_many<K: AsRef<str>, V: for<'de> Deserialize<'de>>(
+        &self,
+        keys: &[K],
+    ) -> Result<Vec<Option<V>>> {
+        let mut values: Vec<Option<Arc<serde_json::Value>>> = vec![None; keys.len()];
+        let mut missing = Vec::new();
+        for (i, key) in keys.iter().enumerate() {
+            match self
+                .cache
+                .as_ref()
+                .and_then(|cache| cache.get(key.as_ref()))
+            {
+                Some(value) => values[i] = value,
+                None => missing.push(i),
+            }
+        }
+
+        if !missing.is_empty() {
+            let generation = self.cache.as_ref().map(|cache| cache.generation());
+            let conn = self.pool.get_read_connection().await?;
+            let txn = if missing.len() > GET_MANY_BATCH_SIZE {
+                Some(Transaction::new_unchecked(&conn, TransactionBehavior::Deferred).await?)
+            } else {
+                None
+            };
+
+            let mut found = HashMap::new();
+            for batch in missing.chunks(GET_MANY_BATCH_SIZE) {
+                let sql = format!(
+                    "SELECT key, value FROM kv_store WHERE key IN ({})",
+                    vec!["?"; batch.len()].join(", ")
+                );
+                let params: Vec<Value> = batch
+                    .iter()
+                    .map(|&i| Value::Text(keys[i].as_ref().to_string()))
+                    .collect();
+                let mut rows = conn.query(&sql, params).await?;
+                while let Some(row) = rows.next().await? {
+                    let (Ok(key), Ok(value)) = (row.get_value(0), row.get_value(1)) else {
+                        continue;
+                    };
+                    if let (Some(key), Some(value)) = (text_value(&key), text_value(&value)) {
+                        let value: serde_json::Value = serde_json::from_str(value)?;
+                        found.insert(key.to_string(), Arc::new(value));
+                    }
+                }
+            }
+            if let Some(txn) = txn {
+                txn.commit().await?;
+            }
+
+            for &i in &missing {
+                let key = keys[i].as_ref();
+                values[i] = found.get(key).cloned();
+                if let (Some(cache), Some(generation)) = (&self.cache, generation) {
+                    cache.insert_if_current(generation, key, values[i].clone());
+                }
+            }
+        }
+
+        let mut decoded = Vec::with_capacity(values.len());
+        for value in values {
+            decoded.push(value.map(|v| V::deserialize(&*v)).transpose()?);
+        }
+        Ok(decoded)
+    }
+
+    /// Get the entries with keys starting with `prefix`, in key order
+    pub async fn scan_prefix<V: for<'de> Deserialize<'de>>(
+        &self,
+        prefix: &str,
+        limit: Option<usize>,
+    ) -> Result<Vec<(String, V)>> {
+        self.scan_range(Some(prefix), prefix_end(prefix).as_deref(), limit)
+            .await
+    }
+
+    /// Get the entries with keys from `start` (inclusive) to `end`
+    /// (exclusive), in key order, up to `limit` of them
+    ///
+    /// Either bound can be left open. The scan walks the primary key index,
+    /// so it reads only the entries it returns.
+    pub async fn scan_range<V: for<'de> Deserialize<'de>>(
+        &self,
+        start: Option<&str>,
+        end: Option<&str>,
+        limit: Option<usize>,
+    ) -> Result<Vec<(String, V)>> {
+        let mut conditions = Vec::new();
+        let mut params: Vec<Value> = Vec::new();
+        if let Some(start) = start {
+            conditions.push("key >= ?");
+            params.push(Value::Text(start.to_string()));
+        }
+        if let Some(end) = end {
+            conditions.push("key < ?");
+            params.push(Value::Text(end.to_string()));
+        }
+
+        let mut sql = "SELECT key, value FROM kv_store".to_string();
+        if !conditions.is_empty() {
+            sql.push_str(&format!(" WHERE {}", conditions.join(" AND ")));
+        }
+        sql.push_str(" ORDER BY key");
+        if let Some(limit) = limit {
+            sql.push_str(" LIMIT ?");
+            params.push(Value::Integer(limit as i64));
+        }
+
+        let conn = self.pool.get_read_connection().await?;
+        let mut rows = conn.query(&sql, params).await?;
+        let mut entries = Vec::new();
+        while let Some(row) = rows.next().await? {
+            let (Ok(key), Ok(value)) = (row.get_value(0), row.get_value(1)) else {
+                continue;
+            };
+            if let (Some(key), Some(value)) = (text_value(&key), text_value(&value)) {
+                entries.push((key.to_string(), serde_json::from_str(value)?));
+            }
+        }
+        Ok(entries)
+    }
+
     /// Delete a key
     pub async fn delete(&self, key: &str) -> Result<()> {
         let conn = self.pool.get_connection().await?;
         conn.execute("DELETE FROM kv_store WHERE key = ?", (key,))
             .await?;
+        if let Some(cache) = &self.cache {
+            cache.written([(key, None)]);
+        }
         Ok(())
     }
 
     /// List all keys
     pub async fn keys(&self) -> Result<Vec<String>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn.query("SELECT key FROM kv_store", ()).await?;
         let mut keys = Vec::new();
         while let Some(row) = rows.next().await? {
@@ -118,3 +396,17 @@ impl KvStore {
         Ok(keys)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_prefix_end() {
+        assert_eq!(prefix_end("user:").as_deref(), Some("user;"));
+        assert_eq!(prefix_end("a\u{d7ff}").as_deref(), Some("a\u{e000}"));
+        assert_eq!(prefix_end("a\u{10ffff}").as_deref(), Some("b"));
+        assert_eq!(prefix_end("\u{10ffff}"), None);
+        assert_eq!(prefix_end(""), None);
+    }
+}
@@ -1,7 +1,9 @@
+pub mod autosync;
 pub mod connection_pool;
 pub mod error;
 pub mod filesystem;
 pub mod kvstore;
+pub mod metrics;
 pub mod schema;
 pub mod toolcalls;
 
@@ -15,17 +17,23 @@ use turso::{Builder, EncryptionOpts, Value};
 // Re-export turso sync types for CLI usage
 pub use turso::sync::{DatabaseSyncStats, PartialBootstrapStrategy, PartialSyncOpts};
 
+pub use autosync::{AutoSync, AutoSyncOptions};
+
 // Re-export filesystem types
 #[cfg(any(target_os = "linux", target_os = "macos"))]
 pub use filesystem::HostFS;
+#[cfg(unix)]
+pub use filesystem::ImportStats;
 pub use filesystem::{
-    BoxedFile, DirEntry, File, FileSystem, FilesystemStats, FsError, OverlayFS, Stats, TimeChange,
-    DEFAULT_DIR_MODE, DEFAULT_FILE_MODE, S_IFBLK, S_IFCHR, S_IFDIR, S_IFIFO, S_IFLNK, S_IFMT,
-    S_IFREG, S_IFSOCK,
+    BoxedDirectory, BoxedFile, Compression, DirEntry, Directory, File, FileSystem, FilesystemStats,
+    FsError, MeteredFileSystem, OverlayFS, Stats, TimeChange, DEFAULT_DIR_MODE, DEFAULT_FILE_MODE,
+    S_IFBLK, S_IFCHR, S_IFDIR, S_IFIFO, S_IFLNK, S_IFMT, S_IFREG, S_IFSOCK,
 };
 pub use kvstore::KvStore;
 pub use schema::{SchemaVersion, AGENTFS_SCHEMA_VERSION};
-pub use toolcalls::{ToolCall, ToolCallStats, ToolCallStatus, ToolCalls};
+pub use toolcalls::{
+    CompletedToolCall, LatencyBucket, ToolCall, ToolCallStats, ToolCallStatus, ToolCalls,
+};
 
 /// Directory containing agentfs databases
 pub fn agentfs_dir() -> &'static std::path::Path {
@@ -116,6 +124,21 @@ pub struct AgentFSOptions {
     pub sync: SyncOptions,
     /// Encryption configuration for database at rest
     pub encryption: Option<EncryptionConfig>,
+    /// Size of file data chunks for a new database (default 4096 bytes).
+    /// Ignored for existing databases, whose chunk size is fixed at creation.
+    pub chunk_size: Option<usize>,
+    /// Store identical chunks of file data once in a new database.
+    /// Ignored for existing databases, like `chunk_size`.
+    pub dedup: bool,
+    /// Codec to compress file data with in a new database.
+    /// Ignored for existing databases, like `chunk_size`.
+    pub compression: Compression,
+    /// Free the data of large removals and truncations in the background in
+    /// a new database. Ignored for existing databases, like `chunk_size`.
+    pub deferred_reclaim: bool,
+    /// Give each file chunks that grow with its size in a new database.
+    /// Ignored for existing databases, like `chunk_size`.
+    pub size_classes: bool,
 }
 
 impl AgentFSOptions {
@@ -157,6 +180,11 @@ impl AgentFSOptions {
             base: None,
             sync: SyncOptions::default(),
             encryption: None,
+            chunk_size: None,
+            dedup: false,
+            compression: Compression::None,
+            deferred_reclaim: false,
+            size_classes: false,
         }
     }
 
@@ -168,6 +196,11 @@ impl AgentFSOptions {
             base: None,
             sync: SyncOptions::default(),
             encryption: None,
+            chunk_size: None,
+            dedup: false,
+            compression: Compression::None,
+            deferred_reclaim: false,
+            size_classes: false,
         }
     }
 
@@ -179,6 +212,11 @@ impl AgentFSOptions {
             base: None,
             sync: SyncOptions::default(),
             encryption: None,
+            chunk_size: None,
+            dedup: false,
+            compression: Compression::None,
+            deferred_reclaim: false,
+            size_classes: false,
         }
     }
 
@@ -213,6 +251,61 @@ impl AgentFSOptions {
         self
     }
 
+    /// Set the chunk size used to store file data in a new database
+    ///
+    /// Larger chunks mean fewer `fs_data` rows and index lookups for big
+    /// files, at the cost of rewriting more data on small random writes.
+    pub fn with_chunk_size(mut self, chunk_size: usize) -> Self {
+        self.chunk_size = Some(chunk_size);
+        self
+    }
+
+    /// Deduplicate file data in a new database
+    ///
+    /// Chunks with the same contents are stored once and shared by every
+    /// file holding them, which suits databases full of copies of the same
+    /// packages. Writes pay for hashing and a lookup per chunk.
+    pub fn with_dedup(mut self) -> Self {
+        self.dedup = true;
+        self
+    }
+
+    /// Compress file data in a new database with `compression`
+    ///
+    /// Chunks are stored compressed where that makes them smaller, which
+    /// shrinks databases of source trees, JSON and logs several times over,
+    /// and with them sync transfers and checkpoints. Reads decompress the
+    /// chunks they touch.
+    pub fn with_compression(mut self, compression: Compression) -> Self {
+        self.compression = compression;
+        self
+    }
+
+    /// Free the data of large removals and truncations in the background in
+    /// a new database
+    ///
+    /// Removing or truncating a large file then only queues its chunks, and
+    /// a background task frees them in short transactions, so the operation
+    /// doesn't hold the writer for the deletes. Other implementations of the
+    /// format must know the queue to read such a database.
+    pub fn with_deferred_reclaim(mut self) -> Self {
+        self.deferred_reclaim = true;
+        self
+    }
+
+    /// Give each file chunks that grow with its size in a new database
+    ///
+    /// Files of 1 MiB or more get 64 KiB chunks and files of 64 MiB or more
+    /// 1 MiB chunks, or the configured chunk size if that is larger, so
+    /// large files take far fewer rows to read, write and remove, while
+    /// small files keep small chunks. A file's class is chosen from the size
+    /// it first grows to. Other implementations of the format must know
+    /// size classes to read such a database.
+    pub fn with_size_classes(mut self) -> Self {
+        self.size_classes = true;
+        self
+    }
+
     /// Resolve an id-or-path string to AgentFSOptions
     ///
     /// Resolution order (first match wins):
@@ -364,16 +457,43 @@ impl AgentFS {
             OverlayFS::init_schema(&conn, &base_path_str).await?;
         }
 
-        Self::open_with_pool(pool, sync_db).await
+        let custom_storage = options.chunk_size.is_some()
+            || options.dedup
+            || options.compression != Compression::None
+            || options.deferred_reclaim
+            || options.size_classes;
+        let storage = custom_storage.then(|| filesystem::StorageOptions {
+            chunk_size: options
+                .chunk_size
+                .unwrap_or(filesystem::StorageOptions::default().chunk_size),
+            dedup: options.dedup,
+            compression: options.compression,
+            deferred_reclaim: options.deferred_reclaim,
+            size_classes: options.size_classes,
+        });
+        Self::open_with_pool_and_storage(pool, sync_db, storage).await
     }
 
     /// Open an AgentFS instance from a connection pool
     pub async fn open_with_pool(
         pool: connection_pool::ConnectionPool,
         sync_db: Option<turso::sync::Database>,
+    ) -> Result<Self> {
+        Self::open_with_pool_and_storage(pool, sync_db, None).await
+    }
+
+    async fn open_with_pool_and_storage(
+        pool: connection_pool::ConnectionPool,
+        sync_db: Option<turso::sync::Database>,
+        storage: Option<filesystem::StorageOptions>,
     ) -> Result<Self> {
         let kv = KvStore::from_pool(pool.clone()).await?;
-        let fs = filesystem::AgentFS::from_pool(pool.clone()).await?;
+        let fs = match storage {
+            Some(storage) => {
+                filesystem::AgentFS::from_pool_with_storage(pool.clone(), storage).await?
+            }
+            None => filesystem::AgentFS::from_pool(pool.clone()).await?,
+        };
         let tools = ToolCalls::from_pool(pool.clone()).await?;
 
         Ok(Self {
@@ -446,6 +566,14 @@ impl AgentFS {
         Ok(())
     }
 
+    /// Push and checkpoint in the background, as `options` says
+    ///
+    /// Must be called from within a tokio runtime, which runs the task.
+    pub fn auto_sync(&self, options: AutoSyncOptions) -> Result<AutoSync> {
+        let db = self.sync_db.as_ref().ok_or(Error::SyncNotEnabled)?;
+        Ok(AutoSync::spawn(db.clone(), options))
+    }
+
     /// Get sync statistics
     pub async fn sync_stats(&self) -> Result<DatabaseSyncStats> {
         let db = self.sync_db.as_ref().ok_or(Error::SyncNotEnabled)?;
@@ -691,6 +819,39 @@ mod tests {
         assert_eq!(value, None);
     }
 
+    #[tokio::test]
+    async fn test_kv_batch_and_scan() {
+        let agentfs = AgentFS::open(AgentFSOptions::ephemeral()).await.unwrap();
+        let kv = agentfs.kv.clone().with_cache(16);
+
+        let entries: Vec<(String, i64)> = (0..300).map(|i| (format!("mem:{i:03}"), i)).collect();
+        kv.set_many(&entries).await.unwrap();
+        kv.set("other", &-1).await.unwrap();
+
+        let keys = ["mem:007", "missing", "mem:299"];
+        let values: Vec<Option<i64>> = kv.get_many(&keys).await.unwrap();
+        assert_eq!(values, vec![Some(7), None, Some(299)]);
+        let all_keys: Vec<&str> = entries.iter().map(|(k, _)| k.as_str()).collect();
+        let values: Vec<Option<i64>> = kv.get_many(&all_keys).await.unwrap();
+        assert_eq!(values.iter().flatten().count(), 300);
+
+        let page: Vec<(String, i64)> = kv.scan_prefix("mem:", Some(2)).await.unwrap();
+        assert_eq!(
+            page,
+            vec![("mem:000".to_string(), 0), ("mem:001".to_string(), 1)]
+        );
+        let rest: Vec<(String, i64)> = kv.scan_range(Some("mem:298"), None, None).await.unwrap();
+        assert_eq!(rest.len(), 3);
+        assert_eq!(rest[2], ("other".to_string(), -1));
+
+        // Writes through any store keep the cache of its clones current
+        kv.clone().delete("mem:007").await.unwrap();
+        assert_eq!(kv.get::<i64>("mem:007").await.unwrap(), None);
+        kv.set("missing", &1).await.unwrap();
+        assert_eq!(kv.get::<i64>("missing").await.unwrap(), Some(1));
+        assert_eq!(agentfs.kv.get::<i64>("missing").await.unwrap(), Some(1));
+    }
+
     #[tokio::test]
     async fn test_filesystem_operations() {
         let agentfs = AgentFS::open(AgentFSOptions::ephemeral()).await.unwrap();
@@ -756,6 +917,87 @@ mod tests {
         assert_eq!(stats.successful, 1);
     }
 
+    #[tokio::test]
+    async fn test_tool_call_stats_aggregates() {
+        let agentfs = AgentFS::open(AgentFSOptions::ephemeral()).await.unwrap();
+        let call = |started_at: i64, completed_at: i64, error: Option<&str>| CompletedToolCall {
+            name: "search".to_string(),
+            started_at,
+            completed_at,
+            parameters: None,
+            result: None,
+            error: error.map(str::to_string),
+        };
+
+        let ids = agentfs
+            .tools
+            .record_many(&[call(100, 101, None), call(100, 103, Some("timeout"))])
+            .await
+            .unwrap();
+        assert_eq!(ids.len(), 2);
+        assert_eq!(
+            agentfs.tools.get(ids[1]).await.unwrap().unwrap().status,
+            ToolCallStatus::Error
+        );
+        agentfs
+            .tools
+            .record("search", 100, 100, None, None, None)
+            .await
+            .unwrap();
+        let pending = agentfs.tools.start("search", None).await.unwrap();
+
+        let stats = agentfs.tools.stats_for("search").await.unwrap().unwrap();
+        assert_eq!(stats.total_calls, 4);
+        assert_eq!(stats.successful, 2);
+        assert_eq!(stats.failed, 1);
+        assert_eq!(stats.avg_duration_ms, 1000.0);
+        assert_eq!(stats.min_duration_ms, Some(0));
+        assert_eq!(stats.max_duration_ms, Some(3000));
+        assert_eq!(
+            stats.latency_histogram,
+            vec![
+                LatencyBucket {
+                    max_ms: 0,
+                    count: 1
+                },
+                LatencyBucket {
+                    max_ms: 1023,
+                    count: 1
+                },
+                LatencyBucket {
+                    max_ms: 4095,
+                    count: 1
+                },
+            ]
+        );
+
+        // A call completed again is counted once, with its latest outcome
+        agentfs.tools.error(pending, "failed").await.unwrap();
+        agentfs.tools.error(pending, "failed again").await.unwrap();
+        let stats = agentfs.tools.stats_for("search").await.unwrap().unwrap();
+        assert_eq!(
+            (stats.total_calls, stats.successful, stats.failed),
+            (4, 2, 2)
+        );
+        agentfs.tools.success(pending, None).await.unwrap();
+        let stats = agentfs.tools.stats_for("search").await.unwrap().unwrap();
+        assert_eq!(
+            (stats.total_calls, stats.successful, stats.failed),
+            (4, 3, 1)
+        );
+        let counted: i64 = stats.latency_histogram.iter().map(|b| b.count).sum();
+        assert_eq!(counted, 4);
+
+        // Rebuilding from the calls themselves gives the same totals
+        agentfs.tools.rebuild_stats().await.unwrap();
+        let rebuilt = agentfs.tools.stats_for("search").await.unwrap().unwrap();
+        assert_eq!((rebuilt.successful, rebuilt.failed), (3, 1));
+        assert_eq!(rebuilt.min_duration_ms, stats.min_duration_ms);
+        assert_eq!(rebuilt.max_duration_ms, stats.max_duration_ms);
+        assert_eq!(rebuilt.latency_histogram, stats.latency_histogram);
+        assert_eq!(agentfs.tools.stats().await.unwrap().len(), 1);
+    }
+
     #[test]
     fn test_resolve_memory() {
         let opts = AgentFSOptions::resolve(":memory:").unwrap();
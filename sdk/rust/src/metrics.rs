@@ -0,0 +1,311 @@
+//! Always-on operation metrics.
+//!
+//! Instrumented code keeps its metrics in statics: an [`OpMetrics`] per
+//! operation, holding call and error counts, bytes moved and a latency
+//! histogram, or a [`Counter`] for plain events such as cache hits. Recording
+//! is a few relaxed atomic adds, cheap enough to leave on in every mount.
+//!
+//! A metric registers itself the first time it is recorded, and [`snapshot()`]
+//! reads every registered metric of the process.
+
+use serde::{Deserialize, Serialize};
+use std::fmt;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+/// Histogram sub-buckets per power of two, as a power of two. Four
+/// sub-buckets keep percentiles within 25% of the true value.
+const SUB_BITS: u32 = 2;
+const SUB: usize = 1 << SUB_BITS;
+const BUCKETS: usize = 64 * SUB;
+
+/// Metrics that have been recorded at least once.
+static REGISTRY: Mutex<Registry> = Mutex::new(Registry {
+    ops: Vec::new(),
+    counters: Vec::new(),
+});
+
+struct Registry {
+    ops: Vec<&'static OpMetrics>,
+    counters: Vec<&'static Counter>,
+}
+
+/// Define a static [`OpMetrics`] named `$name` and evaluate to a reference
+/// to it.
+#[macro_export]
+macro_rules! op_metrics {
+    ($name:expr) => {{
+        static METRICS: $crate::metrics::OpMetrics = $crate::metrics::OpMetrics::new($name);
+        &METRICS
+    }};
+}
+
+/// Calls, errors, bytes and latency distribution of one operation.
+pub struct OpMetrics {
+    name: &'static str,
+    registered: AtomicBool,
+    calls: AtomicU64,
+    errors: AtomicU64,
+    bytes: AtomicU64,
+    total_ns: AtomicU64,
+    max_ns: AtomicU64,
+    /// Log-linear latency histogram, see `bucket()`
+    buckets: [AtomicU64; BUCKETS],
+}
+
+impl OpMetrics {
+    pub const fn new(name: &'static str) -> Self {
+        Self {
+            name,
+            registered: AtomicBool::new(false),
+            calls: AtomicU64::new(0),
+            errors: AtomicU64::new(0),
+            bytes: AtomicU64::new(0),
+            total_ns: AtomicU64::new(0),
+            max_ns: AtomicU64::new(0),
+            buckets: [const { AtomicU64::new(0) }; BUCKETS],
+        }
+    }
+
+    /// Start timing a call, recorded when the timer is finished.
+    pub fn start(&'static self) -> OpTimer {
+        OpTimer {
+            metrics: self,
+            start: Instant::now(),
+        }
+    }
+
+    /// Record a call that took `elapsed`, failed unless `ok`, and moved
+    /// `bytes` of file data.
+    pub fn record(&'static self, elapsed: Duration, ok: bool, bytes: u64) {
+        if !self.registered.load(Ordering::Relaxed) && !self.registered.swap(true, Ordering::AcqRel)
+        {
+            REGISTRY.lock().unwrap().ops.push(self);
+        }
+        let ns = u64::try_from(elapsed.as_nanos()).unwrap_or(u64::MAX);
+        self.calls.fetch_add(1, Ordering::Relaxed);
+        if !ok {
+            self.errors.fetch_add(1, Ordering::Relaxed);
+        }
+        if bytes > 0 {
+            self.bytes.fetch_add(bytes, Ordering::Relaxed);
+        }
+        self.total_ns.fetch_add(ns, Ordering::Relaxed);
+        self.max_ns.fetch_max(ns, Ordering::Relaxed);
+        self.buckets[bucket(ns)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn snapshot(&self) -> OpSnapshot {
+        let buckets: Vec<u64> = self
+            .buckets
+            .iter()
+            .map(|b| b.load(Ordering::Relaxed))
+            .collect();
+        let max_ns = self.max_ns.load(Ordering::Relaxed);
+        let percentile = |pct: u64| {
+            let count: u64 = buckets.iter().sum();
+            if count == 0 {
+                return 0;
+            }
+            let rank = (count * pct).div_ceil(100).max(1);
+            let mut seen = 0;
+            for (i, n) in buckets.iter().enumerate() {
+                seen += n;
+                if seen >= rank {
+                    return bucket_max(i).min(max_ns);
+                }
+            }
+            max_ns
+        };
+        OpSnapshot {
+            name: self.name.to_string(),
+            calls: self.calls.load(Ordering::Relaxed),
+            errors: self.errors.load(Ordering::Relaxed),
+            bytes: self.bytes.load(Ordering::Relaxed),
+            total_ns: self.total_ns.load(Ordering::Relaxed),
+            p50_ns: percentile(50),
+            p90_ns: percentile(90),
+            p99_ns: percentile(99),
+            max_ns,
+        }
+    }
+}
+
+impl fmt::Debug for OpMetrics {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_tuple("OpMetrics").field(&self.name).finish()
+    }
+}
+
+/// A call being timed by [`OpMetrics::start()`].
+#[derive(Debug)]
+#[must_use = "the call is only recorded by finish()"]
+pub struct OpTimer {
+    metrics: &'static OpMetrics,
+    start: Instant,
+}
+
+impl OpTimer {
+    /// Record the call as completed now.
+    pub fn finish(self, ok: bool, bytes: u64) {
+        self.metrics.record(self.start.elapsed(), ok, bytes);
+    }
+}
+
+/// A count of events.
+pub struct Counter {
+    name: &'static str,
+    registered: AtomicBool,
+    value: AtomicU64,
+}
+
+impl Counter {
+    pub const fn new(name: &'static str) -> Self {
+        Self {
+            name,
+            registered: AtomicBool::new(false),
+            value: AtomicU64::new(0),
+        }
+    }
+
+    pub fn add(&'static self, n: u64) {
+        if !self.registered.load(Ordering::Relaxed) && !self.registered.swap(true, Ordering::AcqRel)
+        {
+            REGISTRY.lock().unwrap().counters.push(self);
+        }
+        self.value.fetch_add(n, Ordering::Relaxed);
+    }
+
+    pub fn increment(&'static self) {
+        self.add(1);
+    }
+}
+
+/// Histogram bucket of a latency: values below `2 * SUB` get a bucket each,
+/// larger ones `SUB` buckets per power of two.
+fn bucket(ns: u64) -> usize {
+    if ns < 2 * SUB as u64 {
+        return ns as usize;
+    }
+    let shift = 63 - ns.leading_zeros() - SUB_BITS;
+    shift as usize * SUB + (ns >> shift) as usize
+}
+
+/// Largest latency that falls into bucket `index`.
+fn bucket_max(index: usize) -> u64 {
+    if index < 2 * SUB {
+        return index as u64;
+    }
+    let shift = index / SUB - 1;
+    let mantissa = (index % SUB + SUB) as u64;
+    ((mantissa + 1) << shift).wrapping_sub(1)
+}
+
+/// Values of all recorded metrics at one point in time.
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+pub struct MetricsSnapshot {
+    /// Operations, sorted by name
+    pub ops: Vec<OpSnapshot>,
+    /// Counters, sorted by name
+    pub counters: Vec<CounterSnapshot>,
+}
+
+impl MetricsSnapshot {
+    /// Value of the counter named `name`, 0 if it was never incremented.
+    pub fn counter(&self, name: &str) -> u64 {
+        self.counters
+            .iter()
+            .find(|c| c.name == name)
+            .map_or(0, |c| c.value)
+    }
+}
+
+/// Values of one [`OpMetrics`].
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct OpSnapshot {
+    pub name: String,
+    pub calls: u64,
+    pub errors: u64,
+    pub bytes: u64,
+    pub total_ns: u64,
+    pub p50_ns: u64,
+    pub p90_ns: u64,
+    pub p99_ns: u64,
+    pub max_ns: u64,
+}
+
+impl OpSnapshot {
+    /// Mean latency of the calls.
+    pub fn avg_ns(&self) -> u64 {
+        self.total_ns.checked_div(self.calls).unwrap_or(0)
+    }
+}
+
+/// Value of one [`Counter`].
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct CounterSnapshot {
+    pub name: String,
+    pub value: u64,
+}
+
+/// Read all metrics recorded so far in this process.
+pub fn snapshot() -> MetricsSnapshot {
+    let registry = REGISTRY.lock().unwrap();
+    let mut ops: Vec<OpSnapshot> = registry.ops.iter().map(|m| m.snapshot()).collect();
+    let mut counters: Vec<CounterSnapshot> = registry
+        .counters
+        .iter()
+        .map(|c| CounterSnapshot {
+            name: c.name.to_string(),
+            value: c.value.load(Ordering::Relaxed),
+        })
+        .collect();
+    ops.sort_by(|a, b| a.name.cmp(&b.name));
+    counters.sort_by(|a, b| a.name.cmp(&b.name));
+    MetricsSnapshot { ops, counters }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_bucket_bounds() {
+        for ns in [0, 1, 7, 8, 9, 1000, 123_456_789, u64::MAX / 2, u64::MAX] {
+            let index = bucket(ns);
+            assert!(index < BUCKETS);
+            assert!(bucket_max(index) >= ns);
+            if index > 0 {
+                assert!(bucket_max(index - 1) < ns);
+            }
+        }
+    }
+
+    #[test]
+    fn test_op_metrics_snapshot() {
+        let metrics = op_metrics!("test.op");
+        for us in 1..=100 {
+            metrics.record(Duration::from_micros(us), us != 100, 10);
+        }
+
+        let snapshot = snapshot();
+        let op = snapshot.ops.iter().find(|o| o.name == "test.op").unwrap();
+        assert_eq!(op.calls, 100);
+        assert_eq!(op.errors, 1);
+        assert_eq!(op.bytes, 1000);
+        assert_eq!(op.max_ns, 100_000);
+        // Percentiles are bucket bounds, within 25% above the exact value
+        assert!((50_000..=62_500).contains(&op.p50_ns));
+        assert!((99_000..=100_000).contains(&op.p99_ns));
+    }
+
+    #[test]
+    fn test_counter_snapshot() {
+        static COUNTER: Counter = Counter::new("test.counter");
+        COUNTER.increment();
+        COUNTER.add(2);
+        assert_eq!(snapshot().counter("test.counter"), 3);
+        assert_eq!(snapshot().counter("test.missing"), 0);
+    }
+}
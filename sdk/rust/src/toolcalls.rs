@@ -1,12 +1,20 @@
-use crate::connection_pool::ConnectionPool;
+use crate::connection_pool::{ConnectionPool, PooledConnection};
 use crate::error::{Error, Result};
 use serde::{Deserialize, Serialize};
 use std::{
+    collections::HashMap,
     fmt,
     time::{SystemTime, UNIX_EPOCH},
 };
+use turso::transaction::{Transaction, TransactionBehavior};
 use turso::{Builder, Value};
 
+/// Number of latency histogram buckets kept per tool.
+///
+/// Bucket 0 counts calls that took 0ms and bucket `b` calls that took from
+/// `2^(b-1)` to `2^b - 1` ms; the last bucket also counts anything longer.
+const LATENCY_BUCKETS: usize = 32;
+
 /// Status of a tool call
 #[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
 #[serde(rename_all = "lowercase")]
@@ -55,14 +63,151 @@ pub struct ToolCall {
     pub duration_ms: Option<i64>,
 }
 
+/// A completed tool call, for [`ToolCalls::record_many()`]
+#[derive(Debug, Clone)]
+pub struct CompletedToolCall {
+    pub name: String,
+    pub started_at: i64,
+    pub completed_at: i64,
+    pub parameters: Option<serde_json::Value>,
+    pub result: Option<serde_json::Value>,
+    /// Error message if the call failed
+    pub error: Option<String>,
+}
+
+/// Number of completed calls of a tool that took at most `max_ms`
+/// milliseconds (and more than the previous bucket's `max_ms`)
+#[derive(Debug, Clone, Serialize, Deserialize, PartialEq)]
+pub struct LatencyBucket {
+    pub max_ms: i64,
+    pub count: i64,
+}
+
 /// Statistics for a specific tool
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct ToolCallStats {
     pub name: String,
+    /// Calls started or recorded, including pending ones
     pub total_calls: i64,
     pub successful: i64,
     pub failed: i64,
+    /// Average duration over all calls (pending ones count as 0ms)
     pub avg_duration_ms: f64,
+    /// Shortest completed call
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub min_duration_ms: Option<i64>,
+    /// Longest completed call
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub max_duration_ms: Option<i64>,
+    /// Latency distribution of completed calls, non-empty buckets only
+    #[serde(default)]
+    pub latency_histogram: Vec<LatencyBucket>,
+}
+
+/// Running totals of the calls of one tool, as kept in `tool_call_stats`.
+///
+/// Also used for changes to them: applying a change with `merge()` adds
+/// up its counts and widens the min/max durations.
+#[derive(Debug, Clone, Default, PartialEq)]
+struct ToolAggregate {
+    total_calls: i64,
+    successful: i64,
+    failed: i64,
+    total_duration_ms: i64,
+    min_duration_ms: Option<i64>,
+    max_duration_ms: Option<i64>,
+    /// Completed calls per latency bucket (empty if none)
+    histogram: Vec<i64>,
+}
+
+impl ToolAggregate {
+    /// Count a call completing after `duration_ms`
+    fn completed(&mut self, success: bool, duration_ms: i64) {
+        if success {
+            self.successful += 1;
+        } else {
+            self.failed += 1;
+        }
+        self.total_duration_ms += duration_ms;
+        self.min_duration_ms = Some(
+            self.min_duration_ms
+                .map_or(duration_ms, |m| m.min(duration_ms)),
+        );
+        self.max_duration_ms = Some(
+            self.max_duration_ms
+                .map_or(duration_ms, |m| m.max(duration_ms)),
+        );
+        self.histogram.resize(LATENCY_BUCKETS, 0);
+        self.histogram[latency_bucket(duration_ms)] += 1;
+    }
+
+    /// Apply the change `other`
+    fn merge(&mut self, other: &ToolAggregate) {
+        self.total_calls += other.total_calls;
+        self.successful += other.successful;
+        self.failed += other.failed;
+        self.total_duration_ms += other.total_duration_ms;
+        self.min_duration_ms = match (self.min_duration_ms, other.min_duration_ms) {
+            (Some(a), Some(b)) => Some(a.min(b)),
+            (a, b) => a.or(b),
+        };
+        self.max_duration_ms = match (self.max_duration_ms, other.max_duration_ms) {
+            (Some(a), Some(b)) => Some(a.max(b)),
+            (a, b) => a.or(b),
+        };
+        if self.histogram.len() < other.histogram.len() {
+            self.histogram.resize(other.histogram.len(), 0);
+        }
+        for (count, more) in self.histogram.iter_mut().zip(&other.histogram) {
+            *count += more;
+        }
+    }
+
+    fn to_stats(&self, name: String) -> ToolCallStats {
+        let avg_duration_ms = if self.total_calls > 0 {
+            self.total_duration_ms as f64 / self.total_calls as f64
+        } else {
+            0.0
+        };
+        let latency_histogram = self
+            .histogram
+            .iter()
+            .enumerate()
+            .filter(|(_, count)| **count > 0)
+            .map(|(bucket, count)| LatencyBucket {
+                max_ms: latency_bucket_max(bucket),
+                count: *count,
+            })
+            .collect();
+        ToolCallStats {
+            name,
+            total_calls: self.total_calls,
+            successful: self.successful,
+            failed: self.failed,
+            avg_duration_ms,
+            min_duration_ms: self.min_duration_ms,
+            max_duration_ms: self.max_duration_ms,
+            latency_histogram,
+        }
+    }
+}
+
+/// Histogram bucket of a call that took `duration_ms`
+fn latency_bucket(duration_ms: i64) -> usize {
+    if duration_ms <= 0 {
+        return 0;
+    }
+    let bucket = 64 - (duration_ms as u64).leading_zeros() as usize;
+    bucket.min(LATENCY_BUCKETS - 1)
+}
+
+/// Longest duration counted in `bucket`
+fn latency_bucket_max(bucket: usize) -> i64 {
+    if bucket + 1 >= LATENCY_BUCKETS {
+        i64::MAX
+    } else {
+        (1i64 << bucket) - 1
+    }
 }
 
 /// Tool calls tracker backed by SQLite
@@ -121,18 +266,174 @@ impl ToolCalls {
         )
         .await?;
 
+        // Per-tool totals, kept up to date with every call instead of
+        // aggregating over all of tool_calls for each stats query
+        conn.execute(
+            "CREATE TABLE IF NOT EXISTS tool_call_stats (
+                name TEXT PRIMARY KEY,
+                total_calls INTEGER NOT NULL DEFAULT 0,
+                successful INTEGER NOT NULL DEFAULT 0,
+                failed INTEGER NOT NULL DEFAULT 0,
+                total_duration_ms INTEGER NOT NULL DEFAULT 0,
+                min_duration_ms INTEGER,
+                max_duration_ms INTEGER,
+                latency_histogram TEXT NOT NULL DEFAULT '[]'
+            )",
+            (),
+        )
+        .await?;
+
+        // Count the calls recorded before the totals existed
+        let has_calls = conn
+            .query("SELECT 1 FROM tool_calls LIMIT 1", ())
+            .await?
+            .next()
+            .await?
+            .is_some();
+        if has_calls {
+            let has_stats = conn
+                .query("SELECT 1 FROM tool_call_stats LIMIT 1", ())
+                .await?
+                .next()
+                .await?
+                .is_some();
+            if !has_stats {
+                Self::rebuild_stats_on(&conn).await?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Recompute `tool_call_stats` from all of `tool_calls`.
+    ///
+    /// Only needed when another writer changed `tool_calls` without keeping
+    /// the totals up to date.
+    pub async fn rebuild_stats(&self) -> Result<()> {
+        let conn = self.pool.get_connection().await?;
+        Self::rebuild_stats_on(&conn).await
+    }
+
+    async fn rebuild_stats_on(conn: &PooledConnection) -> Result<()> {
+        let txn = Transaction::new_unchecked(conn, TransactionBehavior::Immediate).await?;
+        let mut totals: HashMap<String, ToolAggregate> = HashMap::new();
+        let mut rows = conn
+            .query("SELECT name, status, duration_ms FROM tool_calls", ())
+            .await?;
+        while let Some(row) = rows.next().await? {
+            let name = match row.get_value(0)? {
+                Value::Text(s) => s,
+                _ => continue,
+            };
+            let status = match row.get_value(1)? {
+                Value::Text(s) => ToolCallStatus::from(s.as_str()),
+                _ => ToolCallStatus::Pending,
+            };
+            let duration_ms = row.get_value(2)?.as_integer().copied().unwrap_or(0);
+
+            let total = totals.entry(name).or_default();
+            total.total_calls += 1;
+            if status != ToolCallStatus::Pending {
+                total.completed(status == ToolCallStatus::Success, duration_ms);
+            }
+        }
+        drop(rows);
+
+        conn.execute("DELETE FROM tool_call_stats", ()).await?;
+        for (name, total) in &totals {
+            Self::store_totals(conn, name, total).await?;
+        }
+        txn.commit().await?;
         Ok(())
     }
 
+    /// Read the totals of `name`, zero if it has none yet
+    async fn load_totals(conn: &PooledConnection, name: &str) -> Result<ToolAggregate> {
+        let mut stmt = conn
+            .prepare_cached(
+                "SELECT total_calls, successful, failed, total_duration_ms,
+                    min_duration_ms, max_duration_ms, latency_histogram
+                FROM tool_call_stats WHERE name = ?",
+            )
+            .await?;
+        let mut rows = stmt.query((name,)).await?;
+        match rows.next().await? {
+            Some(row) => Self::row_to_totals(&row, 0),
+            None => Ok(ToolAggregate::default()),
+        }
+    }
+
+    async fn store_totals(
+        conn: &PooledConnection,
+        name: &str,
+        totals: &ToolAggregate,
+    ) -> Result<()> {
+        let histogram = serde_json::to_string(&totals.histogram)?;
+        let mut stmt = conn
+            .prepare_cached(
+                "INSERT OR REPLACE INTO tool_call_stats (name, total_calls, successful, failed,
+                    total_duration_ms, min_duration_ms, max_duration_ms, latency_histogram)
+                VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+            )
+            .await?;
+        stmt.execute((
+            name,
+            totals.total_calls,
+            totals.successful,
+            totals.failed,
+            totals.total_duration_ms,
+            totals.min_duration_ms.map_or(Value::Null, Value::Integer),
+            totals.max_duration_ms.map_or(Value::Null, Value::Integer),
+            histogram.as_str(),
+        ))
+        .await?;
+        Ok(())
+    }
+
+    /// Apply `change` to the totals of `name`, in the caller's transaction
+    async fn update_totals(
+        conn: &PooledConnection,
+        name: &str,
+        change: &ToolAggregate,
+    ) -> Result<()> {
+        let mut totals = Self::load_totals(conn, name).await?;
+        totals.merge(change);
+        Self::store_totals(conn, name, &totals).await
+    }
+
+    /// Recount the totals of `name` from its calls, in the caller's transaction
+    async fn recount_totals(conn: &PooledConnection, name: &str) -> Result<()> {
+        let mut totals = ToolAggregate::default();
+        let mut stmt = conn
+            .prepare_cached("SELECT status, duration_ms FROM tool_calls WHERE name = ?")
+            .await?;
+        let mut rows = stmt.query((name,)).await?;
+        while let Some(row) = rows.next().await? {
+            let status = match row.get_value(0)? {
+                Value::Text(s) => ToolCallStatus::from(s.as_str()),
+                _ => ToolCallStatus::Pending,
+            };
+            let duration_ms = row.get_value(1)?.as_integer().copied().unwrap_or(0);
+
+            totals.total_calls += 1;
+            if status != ToolCallStatus::Pending {
+                totals.completed(status == ToolCallStatus::Success, duration_ms);
+            }
+        }
+        drop(rows);
+        Self::store_totals(conn, name, &totals).await
+    }
+
     /// Start a new tool call and mark it as pending
     /// Returns the ID of the created tool call record
     pub async fn start(&self, name: &str, parameters: Option<serde_json::Value>) -> Result<i64> {
-        let conn = self.pool.get_connection().await?;
         let serialized_params = parameters.map(|p| serde_json::to_string(&p)).transpose()?;
         let started_at = SystemTime::now().duration_since(UNIX_EPOCH)?.as_secs() as i64;
 
+        let conn = self.pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
         let mut stmt = conn
-            .prepare(
+            .prepare_cached(
                 "INSERT INTO tool_calls (name, parameters, status, started_at)
                 VALUES (?, ?, 'pending', ?) RETURNING id",
             )
@@ -146,44 +447,85 @@ impl ToolCalls {
             .ok()
             .and_then(|v| v.as_integer().copied())
             .ok_or_else(|| Error::Internal("failed to get tool call ID".to_string()))?;
+
+        let change = ToolAggregate {
+            total_calls: 1,
+            ..Default::default()
+        };
+        Self::update_totals(&conn, name, &change).await?;
+        txn.commit().await?;
         Ok(id)
     }
 
     /// Mark a tool call as successful
     pub async fn success(&self, id: i64, result: Option<serde_json::Value>) -> Result<()> {
-        let conn = self.pool.get_connection().await?;
         let serialized_result = result.map(|r| serde_json::to_string(&r)).transpose()?;
+        self.complete(id, serialized_result.as_deref().unwrap_or(""), None)
+            .await
+    }
+
+    /// Mark a tool call as failed
+    pub async fn error(&self, id: i64, error: &str) -> Result<()> {
+        self.complete(id, "", Some(error)).await
+    }
+
+    /// Complete the call `id` with `result`, or as failed with `error`.
+    ///
+    /// Completing a call a second time replaces its outcome. The totals of
+    /// its tool are then recounted from its calls, as the min/max durations
+    /// the earlier outcome contributed can't be taken back out.
+    async fn complete(&self, id: i64, result: &str, error: Option<&str>) -> Result<()> {
         let completed_at = SystemTime::now().duration_since(UNIX_EPOCH)?.as_secs() as i64;
 
+        let conn = self.pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
+
         // Get the started_at time to calculate duration
-        let mut rows = conn
-            .query("SELECT started_at FROM tool_calls WHERE id = ?", (id,))
+        let mut stmt = conn
+            .prepare_cached("SELECT name, started_at, status FROM tool_calls WHERE id = ?")
             .await?;
-
-        let started_at = if let Some(row) = rows.next().await? {
-            row.get_value(0)
-                .ok()
-                .and_then(|v| v.as_integer().copied())
-                .ok_or_else(|| Error::Internal("invalid started_at value".to_string()))?
-        } else {
+        let mut rows = stmt.query((id,)).await?;
+        let Some(row) = rows.next().await? else {
             return Err(Error::ToolCallNotFound);
         };
+        let name = match row.get_value(0)? {
+            Value::Text(s) => s,
+            _ => return Err(Error::Internal("invalid name value".to_string())),
+        };
+        let started_at = row
+            .get_value(1)
+            .ok()
+            .and_then(|v| v.as_integer().copied())
+            .ok_or_else(|| Error::Internal("invalid started_at value".to_string()))?;
+        let pending = matches!(row.get_value(2)?, Value::Text(s) if s == "pending");
+        drop(rows);
 
         let duration_ms = (completed_at - started_at) * 1000;
-
-        conn.execute(
-            "UPDATE tool_calls
-            SET result = ?, status = 'success', completed_at = ?, duration_ms = ?
-            WHERE id = ?",
-            (
-                serialized_result.as_deref().unwrap_or(""),
-                completed_at,
-                duration_ms,
-                id,
-            ),
-        )
+        let mut stmt = conn
+            .prepare_cached(
+                "UPDATE tool_calls
+                SET result = ?, error = ?, status = ?, completed_at = ?, duration_ms = ?
+                WHERE id = ?",
+            )
+            .await?;
+        stmt.execute((
+            result,
+            error.unwrap_or(""),
+            if error.is_some() { "error" } else { "success" },
+            completed_at,
+            duration_ms,
+            id,
+        ))
         .await?;
 
+        if pending {
+            let mut change = ToolAggregate::default();
+            change.completed(error.is_none(), duration_ms);
+            Self::update_totals(&conn, &name, &change).await?;
+        } else {
+            Self::recount_totals(&conn, &name).await?;
+        }
+        txn.commit().await?;
         Ok(())
     }
 
@@ -199,74 +541,92 @@ impl ToolCalls {
         result: Option<serde_json::Value>,
         error: Option<&str>,
     ) -> Result<i64> {
-        let conn = self.pool.get_connection().await?;
-        let serialized_params = parameters.map(|p| serde_json::to_string(&p)).transpose()?;
-        let serialized_result = result.map(|r| serde_json::to_string(&r)).transpose()?;
-        let duration_ms = (completed_at - started_at) * 1000;
-        let status = if error.is_some() { "error" } else { "success" };
+        let call = CompletedToolCall {
+            name: name.to_string(),
+            started_at,
+            completed_at,
+            parameters,
+            result,
+            error: error.map(str::to_string),
+        };
+        let ids = self.record_many(std::slice::from_ref(&call)).await?;
+        Ok(ids[0])
+    }
+
+    /// Record many completed tool calls in one transaction.
+    ///
+    /// Agents issuing bursts of calls pay for one commit and one update of
+    /// each tool's totals per batch, rather than per call. Returns the IDs of
+    /// the created records, in the order of `calls`.
+    pub async fn record_many(&self, calls: &[CompletedToolCall]) -> Result<Vec<i64>> {
+        // Serialize before taking the writer, to hold it no longer than needed
+        let mut serialized = Vec::with_capacity(calls.len());
+        for call in calls {
+            let params = call
+                .parameters
+                .as_ref()
+                .map(serde_json::to_string)
+                .transpose()?;
+            let result = call
+                .result
+                .as_ref()
+                .map(serde_json::to_string)
+                .transpose()?;
+            serialized.push((params, result));
+        }
 
+        let conn = self.pool.get_connection().await?;
+        let txn = Transaction::new_unchecked(&conn, TransactionBehavior::Immediate).await?;
         let mut stmt = conn
-            .prepare(
+            .prepare_cached(
                 "INSERT INTO tool_calls (name, parameters, result, error, status, started_at, completed_at, duration_ms)
-                VALUES (?, ?, ?, ?, ?, ?, ?, ?) RETURNING id"
+                VALUES (?, ?, ?, ?, ?, ?, ?, ?) RETURNING id",
             )
             .await?;
 
-        let row = stmt
-            .query_row((
-                name,
-                serialized_params.as_deref().unwrap_or(""),
-                serialized_result.as_deref().unwrap_or(""),
-                error.unwrap_or(""),
-                status,
-                started_at,
-                completed_at,
-                duration_ms,
-            ))
-            .await?;
-        let id = row
-            .get_value(0)
-            .ok()
-            .and_then(|v| v.as_integer().copied())
-            .ok_or_else(|| Error::Internal("failed to get tool call ID".to_string()))?;
-        Ok(id)
-    }
-
-    /// Mark a tool call as failed
-    pub async fn error(&self, id: i64, error: &str) -> Result<()> {
-        let conn = self.pool.get_connection().await?;
-        let completed_at = SystemTime::now().duration_since(UNIX_EPOCH)?.as_secs() as i64;
-
-        // Get the started_at time to calculate duration
-        let mut rows = conn
-            .query("SELECT started_at FROM tool_calls WHERE id = ?", (id,))
-            .await?;
-
-        let started_at = if let Some(row) = rows.next().await? {
-            row.get_value(0)
+        let mut ids = Vec::with_capacity(calls.len());
+        let mut changes: HashMap<&str, ToolAggregate> = HashMap::new();
+        for (call, (params, result)) in calls.iter().zip(&serialized) {
+            let duration_ms = (call.completed_at - call.started_at) * 1000;
+            let status = if call.error.is_some() {
+                "error"
+            } else {
+                "success"
+            };
+            let row = stmt
+                .query_row((
+                    call.name.as_str(),
+                    params.as_deref().unwrap_or(""),
+                    result.as_deref().unwrap_or(""),
+                    call.error.as_deref().unwrap_or(""),
+                    status,
+                    call.started_at,
+                    call.completed_at,
+                    duration_ms,
+                ))
+                .await?;
+            let id = row
+                .get_value(0)
                 .ok()
                 .and_then(|v| v.as_integer().copied())
-                .ok_or_else(|| Error::Internal("invalid started_at value".to_string()))?
-        } else {
-            return Err(Error::ToolCallNotFound);
-        };
-
-        let duration_ms = (completed_at - started_at) * 1000;
+                .ok_or_else(|| Error::Internal("failed to get tool call ID".to_string()))?;
+            ids.push(id);
 
-        conn.execute(
-            "UPDATE tool_calls
-            SET error = ?, status = 'error', completed_at = ?, duration_ms = ?
-            WHERE id = ?",
-            (error, completed_at, duration_ms, id),
-        )
-        .await?;
+            let change = changes.entry(call.name.as_str()).or_default();
+            change.total_calls += 1;
+            change.completed(call.error.is_none(), duration_ms);
+        }
 
-        Ok(())
+        for (name, change) in &changes {
+            Self::update_totals(&conn, name, change).await?;
+        }
+        txn.commit().await?;
+        Ok(ids)
     }
 
     /// Get a tool call by ID
     pub async fn get(&self, id: i64) -> Result<Option<ToolCall>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn
             .query(
                 "SELECT id, name, parameters, result, error, status, started_at, completed_at, duration_ms
@@ -284,7 +644,7 @@ impl ToolCalls {
 
     /// Get recent tool calls with optional limit
     pub async fn recent(&self, limit: Option<i64>) -> Result<Vec<ToolCall>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let limit = limit.unwrap_or(100);
         let mut rows = conn
             .query(
@@ -306,18 +666,13 @@ impl ToolCalls {
 
     /// Get statistics for a specific tool
     pub async fn stats_for(&self, name: &str) -> Result<Option<ToolCallStats>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn
             .query(
-                "SELECT
-                    name,
-                    COUNT(*) as total_calls,
-                    SUM(CASE WHEN status = 'success' THEN 1 ELSE 0 END) as successful,
-                    SUM(CASE WHEN status = 'error' THEN 1 ELSE 0 END) as failed,
-                    AVG(CASE WHEN duration_ms IS NOT NULL THEN duration_ms ELSE 0 END) as avg_duration_ms
-                FROM tool_calls
-                WHERE name = ?
-                GROUP BY name",
+                "SELECT name, total_calls, successful, failed, total_duration_ms,
+                    min_duration_ms, max_duration_ms, latency_histogram
+                FROM tool_call_stats
+                WHERE name = ?",
                 (name,),
             )
             .await?;
@@ -331,17 +686,12 @@ impl ToolCalls {
 
     /// Get statistics for all tools
     pub async fn stats(&self) -> Result<Vec<ToolCallStats>> {
-        let conn = self.pool.get_connection().await?;
+        let conn = self.pool.get_read_connection().await?;
         let mut rows = conn
             .query(
-                "SELECT
-                    name,
-                    COUNT(*) as total_calls,
-                    SUM(CASE WHEN status = 'success' THEN 1 ELSE 0 END) as successful,
-                    SUM(CASE WHEN status = 'error' THEN 1 ELSE 0 END) as failed,
-                    AVG(CASE WHEN duration_ms IS NOT NULL THEN duration_ms ELSE 0 END) as avg_duration_ms
-                FROM tool_calls
-                GROUP BY name
+                "SELECT name, total_calls, successful, failed, total_duration_ms,
+                    min_duration_ms, max_duration_ms, latency_histogram
+                FROM tool_call_stats
                 ORDER BY total_calls DESC",
                 (),
             )
@@ -458,40 +808,37 @@ impl ToolCalls {
             })
             .unwrap_or_default();
 
-        let total_calls = row
-            .get_value(1)
-            .ok()
-            .and_then(|v| v.as_integer().copied())
-            .unwrap_or(0);
-
-        let successful = row
-            .get_value(2)
-            .ok()
-            .and_then(|v| v.as_integer().copied())
-            .unwrap_or(0);
+        Ok(Self::row_to_totals(row, 1)?.to_stats(name))
+    }
 
-        let failed = row
-            .get_value(3)
-            .ok()
-            .and_then(|v| v.as_integer().copied())
-            .unwrap_or(0);
+    /// Read the totals in the columns of `row` from `first` on
+    fn row_to_totals(row: &turso::Row, first: usize) -> Result<ToolAggregate> {
+        let integer = |i: usize| {
+            row.get_value(first + i)
+                .ok()
+                .and_then(|v| v.as_integer().copied())
+        };
 
-        let avg_duration_ms = row
-            .get_value(4)
+        let histogram = row
+            .get_value(first + 6)
             .ok()
-            .and_then(|v| match v {
-                Value::Real(f) => Some(f),
-                Value::Integer(i) => Some(i as f64),
-                _ => None,
+            .and_then(|v| {
+                if let Value::Text(s) = v {
+                    serde_json::from_str(s.as_str()).ok()
+                } else {
+                    None
+                }
             })
-            .unwrap_or(0.0);
+            .unwrap_or_default();
 
-        Ok(ToolCallStats {
-            name,
-            total_calls,
-            successful,
-            failed,
-            avg_duration_ms,
+        Ok(ToolAggregate {
+            total_calls: integer(0).unwrap_or(0),
+            successful: integer(1).unwrap_or(0),
+            failed: integer(2).unwrap_or(0),
+            total_duration_ms: integer(3).unwrap_or(0),
+            min_duration_ms: integer(4),
+            max_duration_ms: integer(5),
+            histogram,
         })
     }
 }